@@ -4,12 +4,14 @@
 
 include Config.mk
 
-OBJS		:=	src/config.o \
+OBJS		:=	src/channelmeters.o \
+			src/config.o \
 			src/control/control.o \
 			src/control/mister.o \
 			src/control/rotaryencoder.o \
 			src/control/simplebuttons.o \
 			src/control/simpleencoder.o \
+			src/deferredlog.o \
 			src/kernel.o \
 			src/lcd/drivers/hd44780.o \
 			src/lcd/drivers/hd44780fourbit.o \
@@ -22,15 +24,25 @@ OBJS		:=	src/config.o \
 			src/midiparser.o \
 			src/mt32pi.o \
 			src/net/applemidi.o \
+			src/net/filetransfer.o \
 			src/net/ftpdaemon.o \
 			src/net/ftpworker.o \
+			src/net/rtpmidireceiver.o \
+			src/net/socketmultiplexer.o \
 			src/net/udpmidi.o \
 			src/pisound.o \
 			src/power.o \
+			src/rendermonitor.o \
 			src/rommanager.o \
+			src/sampleconverter.o \
+			src/soundfontindex.o \
 			src/soundfontmanager.o \
+			src/synth/layeredsynth.o \
 			src/synth/mt32synth.o \
+			src/synth/soundfontfile.o \
+			src/synth/soundfontloadtask.o \
 			src/synth/soundfontsynth.o \
+			src/synth/timedmidiqueue.o \
 			src/zoneallocator.o
 
 EXTRACLEAN	+=	src/*.d src/*.o \
@@ -1618,6 +1618,33 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 	return cl + *tbl;	/* Return the cluster number */
 }
 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Count contiguous clusters from the file offset         */
+/*-----------------------------------------------------------------------*/
+
+static DWORD clmt_contig (	/* 0:Error, >=1:Number of clusters left in the fragment */
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t ofs		/* File offset in the first cluster */
+)
+{
+	DWORD cl, ncl, *tbl;
+	FATFS *fs = fp->obj.fs;
+
+
+	tbl = fp->cltbl + 1;	/* Top of CLMT */
+	cl = (DWORD)(ofs / SS(fs) / fs->csize);	/* Cluster order from top of the file */
+	for (;;) {
+		ncl = *tbl++;			/* Number of cluters in the fragment */
+		if (ncl == 0) return 0;	/* End of table? (error) */
+		if (cl < ncl) break;	/* In this fragment? */
+		cl -= ncl; tbl++;		/* Next fragment */
+	}
+	return ncl - cl;	/* Return the clusters left, including this one */
+}
+
 #endif	/* FF_USE_FASTSEEK */
 
 
@@ -3900,7 +3927,17 @@ FRESULT f_read (
 			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
+#if FF_USE_FASTSEEK
+					if (fp->cltbl) {			/* Clip at fragment boundary instead */
+						clst = clmt_contig(fp, fp->fptr);
+						if (clst == 0) ABORT(fs, FR_INT_ERR);
+						if (csect + cc > clst * fs->csize) cc = clst * fs->csize - csect;
+						if (cc > FF_FASTSEEK_MAX_READ) cc = FF_FASTSEEK_MAX_READ;
+					} else
+#endif
+					{
+						cc = fs->csize - csect;
+					}
 				}
 				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -3915,6 +3952,9 @@ FRESULT f_read (
 #endif
 #endif
 				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
+#if FF_USE_FASTSEEK
+				fp->clust += (csect + cc - 1) / fs->csize;	/* Cluster of the last sector read */
+#endif
 				continue;
 			}
 #if !FF_FS_TINY
@@ -34,9 +34,13 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FASTSEEK	0
+#define FF_USE_FASTSEEK	1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
+#define FF_FASTSEEK_MAX_READ	256
+/* Maximum number of sectors read by a single disk_read() when f_read() reads across
+/  contiguous clusters of a file with a cluster link map table. */
+
 
 #define FF_USE_EXPAND	0
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
@@ -25,6 +25,7 @@
 #include <circle/net/ipaddress.h>
 #include <circle/net/icmphandler.h>
 #include <circle/net/checksumcalculator.h>
+#include <circle/sched/synchronizationevent.h>
 #include <circle/types.h>
 
 class CNetConnection
@@ -60,6 +61,10 @@ public:
 
 	virtual boolean IsConnected (void) const = 0;
 	virtual boolean IsTerminated (void) const = 0;
+
+	// pEvent is set (in addition to waking blocked callers) whenever data arrives or the
+	// connection state changes; 0 to detach
+	void SetNotifyEvent (CSynchronizationEvent *pEvent);
 	
 	virtual void Process (void) = 0;
 
@@ -73,6 +78,9 @@ public:
 					  u16 nSendPort, u16 nReceivePort,
 					  int nProtocol) = 0;
 
+protected:
+	void Notify (void);
+
 protected:
 	CNetConfig    *m_pNetConfig;
 	CNetworkLayer *m_pNetworkLayer;
@@ -83,6 +91,8 @@ protected:
 	int m_nProtocol;
 
 	CChecksumCalculator m_Checksum;
+
+	CSynchronizationEvent *m_pNotifyEvent;
 };
 
 #endif
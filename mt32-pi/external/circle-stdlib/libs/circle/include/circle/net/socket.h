@@ -104,6 +104,12 @@ public:
 	/// \return Status (0 success, < 0 on error)
 	int SetOptionBroadcast (boolean bAllowed);
 
+	/// \brief Set an event to be signalled when data arrives or the connection state changes,\n
+	/// so that a task can wait on several sockets at once and poll them with MSG_DONTWAIT
+	/// \param pEvent Event to signal (0 to detach)
+	/// \return Status (0 success, < 0 on error)
+	int SetNotifyEvent (CSynchronizationEvent *pEvent);
+
 	/// \brief Get IP address of connected remote host
 	/// \return Pointer to IP address (four bytes, 0-pointer if not connected)
 	const u8 *GetForeignIP (void) const;
@@ -121,6 +127,8 @@ private:
 
 	unsigned m_nBackLog;
 	int m_hListenConnection[SOCKET_MAX_LISTEN_BACKLOG];
+
+	CSynchronizationEvent *m_pNotifyEvent;
 };
 
 #endif
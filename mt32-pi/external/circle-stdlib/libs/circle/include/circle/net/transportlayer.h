@@ -65,6 +65,8 @@ public:
 
 	int SetOptionBroadcast (boolean bAllowed, int hConnection);
 
+	int SetNotifyEvent (CSynchronizationEvent *pEvent, int hConnection);
+
 	boolean IsConnected (int hConnection) const;
 	const u8 *GetForeignIP (int hConnection) const;		// returns 0 if not connected
 
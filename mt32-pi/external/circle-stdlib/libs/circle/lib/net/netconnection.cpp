@@ -32,7 +32,8 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 	m_nForeignPort (nForeignPort),
 	m_nOwnPort (nOwnPort),
 	m_nProtocol (nProtocol),
-	m_Checksum (*pNetConfig->GetIPAddress (), rForeignIP, nProtocol)
+	m_Checksum (*pNetConfig->GetIPAddress (), rForeignIP, nProtocol),
+	m_pNotifyEvent (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
@@ -46,7 +47,8 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 	m_pNetworkLayer (pNetworkLayer),
 	m_nForeignPort (0),
 	m_nOwnPort (nOwnPort),
-	m_Checksum (*pNetConfig->GetIPAddress (), nProtocol)
+	m_Checksum (*pNetConfig->GetIPAddress (), nProtocol),
+	m_pNotifyEvent (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
@@ -54,6 +56,7 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 
 CNetConnection::~CNetConnection (void)
 {
+	m_pNotifyEvent = 0;
 	m_pNetworkLayer = 0;
 	m_pNetConfig = 0;
 }
@@ -73,3 +76,16 @@ int CNetConnection::GetProtocol (void) const
 {
 	return m_nProtocol;
 }
+
+void CNetConnection::SetNotifyEvent (CSynchronizationEvent *pEvent)
+{
+	m_pNotifyEvent = pEvent;
+}
+
+void CNetConnection::Notify (void)
+{
+	if (m_pNotifyEvent != 0)
+	{
+		m_pNotifyEvent->Set ();
+	}
+}
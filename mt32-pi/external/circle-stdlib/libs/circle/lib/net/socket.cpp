@@ -30,7 +30,8 @@ CSocket::CSocket (CNetSubSystem *pNetSubSystem, int nProtocol)
 	m_nProtocol (nProtocol),
 	m_nOwnPort (0),
 	m_hConnection (-1),
-	m_nBackLog (0)
+	m_nBackLog (0),
+	m_pNotifyEvent (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pTransportLayer != 0);
@@ -43,7 +44,8 @@ CSocket::CSocket (CSocket &rSocket, int hConnection)
 	m_nProtocol (rSocket.m_nProtocol),
 	m_nOwnPort (rSocket.m_nOwnPort),
 	m_hConnection (hConnection),
-	m_nBackLog (0)
+	m_nBackLog (0),
+	m_pNotifyEvent (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pTransportLayer != 0);
@@ -53,6 +55,9 @@ CSocket::~CSocket (void)
 {
 	assert (m_pTransportLayer != 0);
 
+	// the connection may linger after we are gone
+	SetNotifyEvent (0);
+
 	if (m_hConnection >= 0)
 	{
 		assert (m_nBackLog == 0);
@@ -163,6 +168,7 @@ int CSocket::Listen (unsigned nBackLog)
 	{
 		m_hListenConnection[i] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol);
 		assert (m_hListenConnection[i] >= 0);
+		m_pTransportLayer->SetNotifyEvent (m_pNotifyEvent, m_hListenConnection[i]);
 	}
 
 	return 0;
@@ -215,9 +221,13 @@ CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort)
 		assert (pNewSocket != 0);
 	}
 
+	// the accepted connection does not belong to this socket any more
+	m_pTransportLayer->SetNotifyEvent (0, hConnection);
+
 	// replace the returned connection with a new listening one
 	m_hListenConnection[nIndex] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol);
 	assert (m_hListenConnection[nIndex] >= 0);
+	m_pTransportLayer->SetNotifyEvent (m_pNotifyEvent, m_hListenConnection[nIndex]);
 
 	return pNewSocket;
 }
@@ -348,6 +358,25 @@ int CSocket::SetOptionBroadcast (boolean bAllowed)
 	return m_pTransportLayer->SetOptionBroadcast (bAllowed, m_hConnection);
 }
 
+int CSocket::SetNotifyEvent (CSynchronizationEvent *pEvent)
+{
+	assert (m_pTransportLayer != 0);
+
+	m_pNotifyEvent = pEvent;
+
+	if (m_hConnection >= 0)
+	{
+		return m_pTransportLayer->SetNotifyEvent (pEvent, m_hConnection);
+	}
+
+	for (unsigned i = 0; i < m_nBackLog; i++)
+	{
+		m_pTransportLayer->SetNotifyEvent (pEvent, m_hListenConnection[i]);
+	}
+
+	return 0;
+}
+
 const u8 *CSocket::GetForeignIP (void) const
 {
 	if (m_hConnection < 0)
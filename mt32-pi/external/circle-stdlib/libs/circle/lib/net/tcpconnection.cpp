@@ -43,7 +43,7 @@
 #define MSS_S				1480	// maximum segment size to be send to network layer
 
 #define TCP_CONFIG_MSS			(MSS_R - 20)
-#define TCP_CONFIG_WINDOW		(TCP_CONFIG_MSS * 10)
+#define TCP_CONFIG_WINDOW		(TCP_CONFIG_MSS * 44)	// largest multiple that fits without window scaling
 
 #define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x10000	// should be greater than maximum send window size
 
@@ -215,6 +215,7 @@ CTCPConnection::~CTCPConnection (void)
 
 	// ensure no task is waiting any more
 	m_Event.Set ();
+	Notify ();
 	m_TxEvent.Set ();
 
 	assert (s_nConnections > 0);
@@ -510,6 +511,7 @@ void CTCPConnection::Process (void)
 		m_nErrno = -1;
 		NEW_STATE (TCPStateClosed);
 		m_Event.Set ();
+		Notify ();
 		return;
 	}
 
@@ -788,6 +790,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			NEW_STATE (TCPStateSynReceived);
 
 			m_Event.Set ();
+			Notify ();
 		}
 		break;
 
@@ -818,6 +821,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_nErrno = -1;
 
 				m_Event.Set ();
+				Notify ();
 			}
 			
 			break;
@@ -857,6 +861,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_nRetransmissionCount = MAX_RETRANSMISSIONS;
 
 				m_Event.Set ();
+				Notify ();
 
 				// RFC 1122 section 4.2.2.20 (c)
 				m_nSND_WND = nSEG_WND;
@@ -891,6 +896,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 						NEW_STATE (TCPStateClosed);
 						m_nErrno = -1;
 						m_Event.Set ();
+						Notify ();
 					}
 
 					if (nDataLength > 0)
@@ -966,6 +972,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					m_nErrno = -1;
 					NEW_STATE (TCPStateClosed);
 					m_Event.Set ();
+					Notify ();
 					return 1;
 					
 				}
@@ -981,6 +988,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_RxQueue.Flush ();
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
+				Notify ();
 				return 1;
 
 			case TCPStateClosing:
@@ -988,6 +996,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			case TCPStateTimeWait:
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
+				Notify ();
 				return 1;
 
 			default:
@@ -1016,6 +1025,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_RxQueue.Flush ();
 			NEW_STATE (TCPStateClosed);
 			m_Event.Set ();
+			Notify ();
 			return 1;
 		}
 
@@ -1148,6 +1158,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				if (m_RetransmissionQueue.IsEmpty ())
 				{
 					m_Event.Set ();
+					Notify ();
 				}
 				break;
 				
@@ -1175,6 +1186,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_bFINQueued = FALSE;
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
+				Notify ();
 				return 1;
 			}
 			break;
@@ -1223,6 +1235,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					if (nFlags & TCP_FLAG_PUSH)
 					{
 						m_Event.Set ();
+						Notify ();
 					}
 				}
 			}
@@ -1268,6 +1281,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		case TCPStateEstablished:
 			NEW_STATE (TCPStateCloseWait);
 			m_Event.Set ();
+			Notify ();
 			break;
 
 		case TCPStateFinWait1:
@@ -1348,6 +1362,7 @@ int CTCPConnection::NotificationReceived (TICMPNotificationType  Type,
 	StartTimer (TCPTimerTimeWait, HZ_TIMEWAIT);
 
 	m_Event.Set ();
+	Notify ();
 
 	return 1;
 }
@@ -389,6 +389,20 @@ int CTransportLayer::SetOptionBroadcast (boolean bAllowed, int hConnection)
 	return ((CNetConnection *) m_pConnection[hConnection])->SetOptionBroadcast (bAllowed);
 }
 
+int CTransportLayer::SetNotifyEvent (CSynchronizationEvent *pEvent, int hConnection)
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	((CNetConnection *) m_pConnection[hConnection])->SetNotifyEvent (pEvent);
+
+	return 0;
+}
+
 boolean CTransportLayer::IsConnected (int hConnection) const
 {
 	assert (hConnection >= 0);
@@ -399,6 +399,7 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 	m_RxQueue.Enqueue ((u8 *) pPacket + sizeof (TUDPHeader), nLength, pData);
 
 	m_Event.Set ();
+	Notify ();
 
 	return 1;
 }
@@ -442,6 +443,7 @@ int CUDPConnection::NotificationReceived (TICMPNotificationType  Type,
 	m_nErrno = -1;
 
 	m_Event.Set ();
+	Notify ();
 
 	return 1;
 }
@@ -83,7 +83,10 @@ enum
     FLUID_PRESET_UNSELECTED,              /**< Preset unselected notify */
     FLUID_SAMPLE_DONE,                    /**< Sample no longer needed notify */
     FLUID_PRESET_PIN,                     /**< Request to pin preset samples to cache */
-    FLUID_PRESET_UNPIN                    /**< Request to unpin preset samples from cache */
+    FLUID_PRESET_UNPIN,                   /**< Request to unpin preset samples from cache */
+    FLUID_PRESET_HOLD,                    /**< Request to keep preset samples loaded until released (counted) */
+    FLUID_PRESET_RELEASE,                 /**< Request to undo one hold of preset samples */
+    FLUID_PRESET_LOAD_SAMPLES             /**< Request to read the missing samples of a selected preset */
 };
 
 /**
@@ -134,6 +137,34 @@ FLUIDSYNTH_API void delete_fluid_sfloader(fluid_sfloader_t *loader);
 FLUIDSYNTH_API fluid_sfloader_t *new_fluid_defsfloader(fluid_settings_t *settings);
 /** @endlifecycle */
 
+FLUIDSYNTH_API fluid_sfont_t *fluid_sfloader_load_sfont(fluid_sfloader_t *loader, const char *filename);
+
+/**
+ * Callback type used to share SoundFont loading work with an external worker.
+ * @param data User defined data pointer passed to fluid_sfloader_set_load_worker()
+ * @param job Opaque job handle to be passed to fluid_sfloader_load_worker_process()
+ *
+ * The wait callback must not return until the worker has stopped calling
+ * fluid_sfloader_load_worker_process() for the job.
+ */
+typedef void (*fluid_sfloader_worker_func_t)(void *data, void *job);
+
+/**
+ * Callback type used to report how much of a SoundFont's sample data has been loaded.
+ * @param data User defined data pointer passed to fluid_sfloader_set_progress_callback()
+ * @param percent Percentage loaded so far
+ */
+typedef void (*fluid_sfloader_progress_func_t)(void *data, int percent);
+
+FLUIDSYNTH_API void fluid_sfloader_set_load_worker(fluid_sfloader_t *loader,
+        fluid_sfloader_worker_func_t kick,
+        fluid_sfloader_worker_func_t wait,
+        void *data);
+FLUIDSYNTH_API int fluid_sfloader_load_worker_process(void *job);
+FLUIDSYNTH_API void fluid_sfloader_set_progress_callback(fluid_sfloader_t *loader,
+        fluid_sfloader_progress_func_t progress,
+        void *data);
+
 /**
  * Opens the file or memory indicated by \c filename in binary read mode.
  *
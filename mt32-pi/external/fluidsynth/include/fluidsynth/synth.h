@@ -137,8 +137,10 @@ FLUIDSYNTH_API void fluid_synth_get_voicelist(fluid_synth_t *synth,
  */
 FLUIDSYNTH_API
 int fluid_synth_sfload(fluid_synth_t *synth, const char *filename, int reset_presets);
+FLUIDSYNTH_API int fluid_synth_sfload_sfont(fluid_synth_t *synth, fluid_sfont_t *sfont, int reset_presets);
 FLUIDSYNTH_API int fluid_synth_sfreload(fluid_synth_t *synth, int id);
 FLUIDSYNTH_API int fluid_synth_sfunload(fluid_synth_t *synth, int id, int reset_presets);
+FLUIDSYNTH_API int fluid_synth_sfunload_pending(fluid_synth_t *synth);
 FLUIDSYNTH_API int fluid_synth_add_sfont(fluid_synth_t *synth, fluid_sfont_t *sfont);
 FLUIDSYNTH_API int fluid_synth_remove_sfont(fluid_synth_t *synth, fluid_sfont_t *sfont);
 FLUIDSYNTH_API int fluid_synth_sfcount(fluid_synth_t *synth);
@@ -357,6 +359,19 @@ FLUID_DEPRECATED FLUIDSYNTH_API int fluid_synth_nwrite_float(fluid_synth_t *synt
 FLUIDSYNTH_API int fluid_synth_process(fluid_synth_t *synth, int len,
                                        int nfx, float *fx[],
                                        int nout, float *out[]);
+
+/**
+ * Callback type used to hand voice rendering work to an external worker.
+ * @param data User defined data pointer passed to fluid_synth_set_mixer_worker()
+ * @param job Opaque job handle to be passed to fluid_synth_mixer_worker_render()
+ */
+typedef void (*fluid_mixer_worker_func_t)(void *data, void *job);
+
+FLUIDSYNTH_API int fluid_synth_set_mixer_worker(fluid_synth_t *synth,
+        fluid_mixer_worker_func_t kick,
+        fluid_mixer_worker_func_t wait,
+        void *data);
+FLUIDSYNTH_API void fluid_synth_mixer_worker_render(void *job);
 /** @} Audio Rendering */
 
 
@@ -542,6 +557,18 @@ int fluid_synth_pin_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int
 FLUIDSYNTH_API
 int fluid_synth_unpin_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int preset_num);
 
+/** @ingroup soundfonts */
+FLUIDSYNTH_API
+int fluid_synth_hold_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int preset_num);
+
+/** @ingroup soundfonts */
+FLUIDSYNTH_API
+int fluid_synth_release_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int preset_num);
+
+/** @ingroup soundfonts */
+FLUIDSYNTH_API
+int fluid_synth_load_selected_samples(fluid_synth_t *synth);
+
 /** @ingroup ladspa */
 FLUIDSYNTH_API fluid_ladspa_fx_t *fluid_synth_get_ladspa_fx(fluid_synth_t *synth);
 
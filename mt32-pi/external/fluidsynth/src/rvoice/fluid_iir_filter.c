@@ -22,6 +22,58 @@
 #include "fluid_sys.h"
 #include "fluid_conv.h"
 
+/* IIR_NEON filters 4 samples at a time with NEON while the filter coefficients
+   are constant, using the contributions of 4 input samples and of the history
+   to 4 output samples. The result differs from the scalar code only by
+   rounding errors.
+   Defining IIR_NO_NEON selects the scalar code (see mt32-pi's fluidsynthdsptest). */
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(WITH_FLOAT) && !defined(IIR_NO_NEON)
+#define IIR_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef IIR_NEON
+/*
+ * Calculates the contributions of 4 input samples and of the filter history to
+ * the next 4 output samples (y_coeffs) and to the history after them
+ * (hist_coeffs, in the order hist1, hist2).
+ * Index k of both is the contribution of input sample k for k = 0..3, of hist1
+ * for k = 4, and of hist2 for k = 5.
+ */
+static void
+fluid_iir_filter_block_coeffs_neon(fluid_real_t a1, fluid_real_t a2, fluid_real_t b02, fluid_real_t b1,
+                                   float32x4_t y_coeffs[6], float32x2_t hist_coeffs[6])
+{
+    /* centernode[n + 2][k]: contribution of k to the centernode of sample n,
+       centernode[0] and centernode[1] being hist2 and hist1 */
+    fluid_real_t centernode[6][6];
+    fluid_real_t y[6][4], hist[6][2];
+    int n, k;
+
+    FLUID_MEMSET(centernode, 0, sizeof(centernode));
+    centernode[0][5] = 1.0f;
+    centernode[1][4] = 1.0f;
+
+    for(n = 0; n < 4; n++)
+    {
+        for(k = 0; k < 6; k++)
+        {
+            /* The filter is implemented in Direct-II form. */
+            centernode[n + 2][k] = (k == n ? 1.0f : 0.0f) - a1 * centernode[n + 1][k] - a2 * centernode[n][k];
+            y[k][n] = b02 * (centernode[n + 2][k] + centernode[n][k]) + b1 * centernode[n + 1][k];
+        }
+    }
+
+    for(k = 0; k < 6; k++)
+    {
+        hist[k][0] = centernode[5][k];
+        hist[k][1] = centernode[4][k];
+        y_coeffs[k] = vld1q_f32(y[k]);
+        hist_coeffs[k] = vld1_f32(hist[k]);
+    }
+}
+#endif /* IIR_NEON */
+
 /**
  * Applies a low- or high-pass filter with variable cutoff frequency and quality factor
  * for a given biquad transfer function:
@@ -120,7 +172,47 @@ fluid_iir_filter_apply(fluid_iir_filter_t *iir_filter,
         }
         else /* The filter parameters are constant.  This is duplicated to save time. */
         {
-            for(dsp_i = 0; dsp_i < count; dsp_i++)
+#ifdef IIR_NEON
+            float32x4_t y_coeffs[6];
+            float32x2_t hist_coeffs[6];
+            float32x2_t dsp_hist = vset_lane_f32(dsp_hist2, vdup_n_f32(dsp_hist1), 1);
+
+            fluid_iir_filter_block_coeffs_neon(dsp_a1, dsp_a2, dsp_b02, dsp_b1, y_coeffs, hist_coeffs);
+
+            /* filter 4 samples at a time */
+            for(dsp_i = 0; dsp_i + 4 <= count; dsp_i += 4)
+            {
+                float32x4_t in = vld1q_f32(&dsp_buf[dsp_i]);
+                float32x2_t in_low = vget_low_f32(in);
+                float32x2_t in_high = vget_high_f32(in);
+                float32x4_t out;
+                float32x2_t next_hist;
+
+                out = vmulq_lane_f32(y_coeffs[4], dsp_hist, 0);
+                out = vmlaq_lane_f32(out, y_coeffs[5], dsp_hist, 1);
+                out = vmlaq_lane_f32(out, y_coeffs[0], in_low, 0);
+                out = vmlaq_lane_f32(out, y_coeffs[1], in_low, 1);
+                out = vmlaq_lane_f32(out, y_coeffs[2], in_high, 0);
+                out = vmlaq_lane_f32(out, y_coeffs[3], in_high, 1);
+
+                next_hist = vmul_lane_f32(hist_coeffs[4], dsp_hist, 0);
+                next_hist = vmla_lane_f32(next_hist, hist_coeffs[5], dsp_hist, 1);
+                next_hist = vmla_lane_f32(next_hist, hist_coeffs[0], in_low, 0);
+                next_hist = vmla_lane_f32(next_hist, hist_coeffs[1], in_low, 1);
+                next_hist = vmla_lane_f32(next_hist, hist_coeffs[2], in_high, 0);
+                next_hist = vmla_lane_f32(next_hist, hist_coeffs[3], in_high, 1);
+
+                vst1q_f32(&dsp_buf[dsp_i], out);
+                dsp_hist = next_hist;
+            }
+
+            dsp_hist1 = vget_lane_f32(dsp_hist, 0);
+            dsp_hist2 = vget_lane_f32(dsp_hist, 1);
+#else
+            dsp_i = 0;
+#endif
+
+            for(; dsp_i < count; dsp_i++)
             {
                 /* The filter is implemented in Direct-II form. */
                 dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
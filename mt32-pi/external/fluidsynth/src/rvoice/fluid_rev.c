@@ -199,6 +199,16 @@
 /* DENORMALISING enable denormalising handling */
 #define DENORMALISING
 
+/* FDN_NEON processes the delay lines in NEON vector lanes, 4 lines per vector.
+   The result differs from the scalar code only in the order in which the delay
+   line outputs are summed (rounding errors, below -120 dB of the output).
+   Defining FDN_NO_NEON selects the scalar code (see mt32-pi's fluidsynthdsptest). */
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(WITH_FLOAT) && !defined(FDN_NO_NEON) \
+    && (NBR_DELAYS % 4) == 0
+#define FDN_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef DENORMALISING
 #define DC_OFFSET 1e-8f
 #else
@@ -511,15 +521,13 @@ static int get_mod_delay_line_length(mod_delay_line *mdl)
 }
 
 /*-----------------------------------------------------------------------------
- Reads the sample value out of the modulated delay line.
+ Updates the read position of the modulated delay line (every mod_rate samples).
  @param mdl, pointer on modulated delay line.
- @return the sample value.
 -----------------------------------------------------------------------------*/
-static FLUID_INLINE fluid_real_t get_mod_delay(mod_delay_line *mdl)
+static FLUID_INLINE void update_mod_delay_position(mod_delay_line *mdl)
 {
     fluid_real_t out_index;  /* new modulated index position */
     int int_out_index; /* integer part of out_index */
-    fluid_real_t out; /* value to return */
 
     /* Checks if the modulator must be updated (every mod_rate samples). */
     /* Important: center_pos_mod must be used immediately for the
@@ -566,6 +574,18 @@ static FLUID_INLINE fluid_real_t get_mod_delay(mod_delay_line *mdl)
             mdl->center_pos_mod -= mdl->dl.size;
         }
     }
+}
+
+/*-----------------------------------------------------------------------------
+ Reads the sample value out of the modulated delay line.
+ @param mdl, pointer on modulated delay line.
+ @return the sample value.
+-----------------------------------------------------------------------------*/
+static FLUID_INLINE fluid_real_t get_mod_delay(mod_delay_line *mdl)
+{
+    fluid_real_t out; /* value to return */
+
+    update_mod_delay_position(mdl);
 
     /*  First order all-pass interpolation ----------------------------------*/
     /* https://ccrma.stanford.edu/~jos/pasp/First_Order_Allpass_Interpolation.html */
@@ -1280,6 +1300,175 @@ fluid_revmodel_reset(fluid_revmodel_t *rev)
     fluid_revmodel_init(rev);
 }
 
+#ifdef FDN_NEON
+/*-----------------------------------------------------------------------------
+ NEON fdn reverb process, used by fluid_revmodel_processreplace() and
+ fluid_revmodel_processmix().
+ Reading and writing the delay lines remains scalar, but the all-pass
+ interpolation, damping filters, feedback matrix and stereo output gains are
+ computed for 4 delay lines at once. The filter states and coefficients stay
+ in vector registers during the whole block.
+-----------------------------------------------------------------------------*/
+#define NBR_DELAY_VECTORS (NBR_DELAYS / 4)
+
+static FLUID_INLINE float32_t fdn_neon_sum(float32x4_t v)
+{
+#ifdef __aarch64__
+    return vaddvq_f32(v);
+#else
+    float32x2_t sum = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#endif
+}
+
+static FLUID_INLINE void fdn_process_neon(fluid_revmodel_t *rev, const fluid_real_t *in,
+        fluid_real_t *left_out, fluid_real_t *right_out, int mix)
+{
+    fluid_late *late = &rev->late;
+    int i, k, v;
+
+    fluid_real_t xn;                   /* mono input x(n) */
+    fluid_real_t out_tone_filter;      /* tone corrector output */
+    fluid_real_t out_left, out_right;  /* output stereo Left  and Right  */
+    fluid_real_t matrix_factor;        /* partial matrix computation */
+
+    /* per delay line values, to be loaded in vectors */
+    fluid_real_t line_cur[NBR_DELAYS], line_next[NBR_DELAYS], frac_pos[NBR_DELAYS];
+    fluid_real_t delay_in[NBR_DELAYS];
+    fluid_real_t interp_state[NBR_DELAYS], damping_state[NBR_DELAYS];
+    fluid_real_t damping_b0[NBR_DELAYS], damping_a1[NBR_DELAYS];
+
+    float32x4_t interp_buffer[NBR_DELAY_VECTORS], damping_buffer[NBR_DELAY_VECTORS];
+    float32x4_t b0[NBR_DELAY_VECTORS], a1[NBR_DELAY_VECTORS];
+    float32x4_t left_gain[NBR_DELAY_VECTORS], right_gain[NBR_DELAY_VECTORS];
+    float32x4_t delay_out[NBR_DELAY_VECTORS];
+
+    for(i = 0; i < NBR_DELAYS; i++)
+    {
+        mod_delay_line *mdl = &late->mod_delay_lines[i];
+        interp_state[i] = mdl->buffer;
+        damping_state[i] = mdl->dl.damping.buffer;
+        damping_b0[i] = mdl->dl.damping.b0;
+        damping_a1[i] = mdl->dl.damping.a1;
+    }
+
+    for(v = 0; v < NBR_DELAY_VECTORS; v++)
+    {
+        interp_buffer[v] = vld1q_f32(&interp_state[v * 4]);
+        damping_buffer[v] = vld1q_f32(&damping_state[v * 4]);
+        b0[v] = vld1q_f32(&damping_b0[v * 4]);
+        a1[v] = vld1q_f32(&damping_a1[v * 4]);
+        left_gain[v] = vld1q_f32(&late->out_left_gain[v * 4]);
+        right_gain[v] = vld1q_f32(&late->out_right_gain[v * 4]);
+    }
+
+    for(k = 0; k < FLUID_BUFSIZE; k++)
+    {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        float32x4_t left = sum, right = sum;
+
+#ifdef DENORMALISING
+        /* Input is adjusted by DC_OFFSET. */
+        xn = (in[k]) * FIXED_GAIN + DC_OFFSET;
+#else
+        xn = (in[k]) * FIXED_GAIN;
+#endif
+
+        /* tone correction */
+        out_tone_filter = xn * late->b1 - late->b2 * late->tone_buffer;
+        late->tone_buffer = xn;
+        xn = out_tone_filter;
+
+        /* reads the two samples around the modulated output position of each line */
+        for(i = 0; i < NBR_DELAYS; i++)
+        {
+            mod_delay_line *mdl = &late->mod_delay_lines[i];
+
+            update_mod_delay_position(mdl);
+            frac_pos[i] = mdl->frac_pos_mod;
+            line_cur[i] = mdl->dl.line[mdl->dl.line_out];
+
+            if(++mdl->dl.line_out >= mdl->dl.size)
+            {
+                mdl->dl.line_out -= mdl->dl.size;
+            }
+
+            line_next[i] = mdl->dl.line[mdl->dl.line_out];
+        }
+
+        for(v = 0; v < NBR_DELAY_VECTORS; v++)
+        {
+            float32x4_t out;
+
+            /* first order all-pass interpolation: out = cur + frac * (next - buffer) */
+            out = vsubq_f32(vld1q_f32(&line_next[v * 4]), interp_buffer[v]);
+            out = vmlaq_f32(vld1q_f32(&line_cur[v * 4]), vld1q_f32(&frac_pos[v * 4]), out);
+            interp_buffer[v] = out;
+
+            /* low pass damping filter: out = out * b0 - buffer * a1 */
+            out = vmlsq_f32(vmulq_f32(out, b0[v]), damping_buffer[v], a1[v]);
+            damping_buffer[v] = out;
+            delay_out[v] = out;
+
+            sum = vaddq_f32(sum, out);
+            left = vmlaq_f32(left, left_gain[v], out);
+            right = vmlaq_f32(right, right_gain[v], out);
+        }
+
+        /* matrix_factor = output sum * (-2.0)/N + input */
+        matrix_factor = fdn_neon_sum(sum) * FDN_MATRIX_FACTOR + xn;
+        out_left = fdn_neon_sum(left);
+        out_right = fdn_neon_sum(right);
+
+        /* delay_in[i-1] = delay_out[i] + matrix_factor, and
+           delay_in[NB_DELAY-1] = delay_out[0] + matrix_factor:
+           the lanes are rotated by one line across the vectors */
+        for(v = 0; v < NBR_DELAY_VECTORS; v++)
+        {
+            float32x4_t rotated = vextq_f32(delay_out[v], delay_out[(v + 1) % NBR_DELAY_VECTORS], 1);
+            vst1q_f32(&delay_in[v * 4], vaddq_f32(rotated, vdupq_n_f32(matrix_factor)));
+        }
+
+        for(i = 0; i < NBR_DELAYS; i++)
+        {
+            delay_line *dl = &late->mod_delay_lines[i].dl;
+            push_in_delay_line(dl, delay_in[i]);
+        }
+
+#ifdef DENORMALISING
+        /* Removes the DC offset */
+        out_left -= DC_OFFSET;
+        out_right -= DC_OFFSET;
+#endif
+
+        /* wet1 is integrated in out_left and out_right (see processreplace) */
+        if(mix)
+        {
+            left_out[k]  += out_left  + out_right * rev->wet2;
+            right_out[k] += out_right + out_left * rev->wet2;
+        }
+        else
+        {
+            left_out[k]  = out_left  + out_right * rev->wet2;
+            right_out[k] = out_right + out_left * rev->wet2;
+        }
+    }
+
+    for(v = 0; v < NBR_DELAY_VECTORS; v++)
+    {
+        vst1q_f32(&interp_state[v * 4], interp_buffer[v]);
+        vst1q_f32(&damping_state[v * 4], damping_buffer[v]);
+    }
+
+    for(i = 0; i < NBR_DELAYS; i++)
+    {
+        mod_delay_line *mdl = &late->mod_delay_lines[i];
+        mdl->buffer = interp_state[i];
+        mdl->dl.damping.buffer = damping_state[i];
+    }
+}
+#endif /* FDN_NEON */
+
 /*-----------------------------------------------------------------------------
 * fdn reverb process replace.
 * @param rev pointer on reverb.
@@ -1294,6 +1483,9 @@ void
 fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
                               fluid_real_t *left_out, fluid_real_t *right_out)
 {
+#ifdef FDN_NEON
+    fdn_process_neon(rev, in, left_out, right_out, FALSE);
+#else
     int i, k;
 
     fluid_real_t xn;                   /* mono input x(n) */
@@ -1400,6 +1592,7 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
         left_out[k]  = out_left  + out_right * rev->wet2;
         right_out[k] = out_right + out_left * rev->wet2;
     }
+#endif /* FDN_NEON */
 }
 
 
@@ -1416,6 +1609,9 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
 void fluid_revmodel_processmix(fluid_revmodel_t *rev, const fluid_real_t *in,
                                fluid_real_t *left_out, fluid_real_t *right_out)
 {
+#ifdef FDN_NEON
+    fdn_process_neon(rev, in, left_out, right_out, TRUE);
+#else
     int i, k;
 
     fluid_real_t xn;                   /* mono input x(n) */
@@ -1520,4 +1716,5 @@ void fluid_revmodel_processmix(fluid_revmodel_t *rev, const fluid_real_t *in,
         left_out[k]  += out_left  + out_right * rev->wet2;
         right_out[k] += out_right + out_left * rev->wet2;
     }
+#endif /* FDN_NEON */
 }
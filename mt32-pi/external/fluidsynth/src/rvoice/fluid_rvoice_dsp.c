@@ -23,6 +23,16 @@
 #include "fluid_rvoice.h"
 #include "fluid_rvoice_dsp_tables.inc.h"
 
+/* DSP_NEON interpolates 4 output samples at a time with NEON, within the part of
+   the sample or loop that needs no special handling of its start and end points.
+   The result differs from the scalar code only in the order in which the
+   interpolation products are summed (rounding errors).
+   Defining DSP_NO_NEON selects the scalar code (see mt32-pi's fluidsynthdsptest). */
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(WITH_FLOAT) && !defined(DSP_NO_NEON)
+#define DSP_NEON
+#include <arm_neon.h>
+#endif
+
 /* Purpose:
  *
  * Interpolates audio data (obtains values between the samples of the original
@@ -54,6 +64,117 @@ fluid_rvoice_get_float_sample(const short int *dsp_msb, const char *dsp_lsb, uns
     return (fluid_real_t)sample;
 }
 
+#ifdef DSP_NEON
+/* Gets 4 consecutive samples as floats, like fluid_rvoice_get_float_sample() */
+static FLUID_INLINE float32x4_t
+fluid_rvoice_get_float_samples_neon(const short int *dsp_msb, const char *dsp_lsb, unsigned int idx)
+{
+    int32x4_t sample = vshlq_n_s32(vmovl_s16(vld1_s16(&dsp_msb[idx])), 8);
+
+    if(FLUID_UNLIKELY(dsp_lsb != NULL))
+    {
+        uint32_t lsb;
+        uint16x8_t lsb16;
+
+        FLUID_MEMCPY(&lsb, &dsp_lsb[idx], sizeof(lsb));
+        lsb16 = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(lsb)));
+        sample = vorrq_s32(sample, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lsb16))));
+    }
+
+    return vcvtq_f32_s32(sample);
+}
+
+/* Returns the sums of the lanes of p0, p1, p2 and p3, in lanes 0 to 3 */
+static FLUID_INLINE float32x4_t
+fluid_rvoice_sum_lanes_neon(float32x4_t p0, float32x4_t p1, float32x4_t p2, float32x4_t p3)
+{
+#ifdef __aarch64__
+    return vpaddq_f32(vpaddq_f32(p0, p1), vpaddq_f32(p2, p3));
+#else
+    float32x2_t s0 = vpadd_f32(vget_low_f32(p0), vget_high_f32(p0));
+    float32x2_t s1 = vpadd_f32(vget_low_f32(p1), vget_high_f32(p1));
+    float32x2_t s2 = vpadd_f32(vget_low_f32(p2), vget_high_f32(p2));
+    float32x2_t s3 = vpadd_f32(vget_low_f32(p3), vget_high_f32(p3));
+
+    return vcombine_f32(vpadd_f32(s0, s1), vpadd_f32(s2, s3));
+#endif
+}
+
+/* Interpolates 4 output samples with 4th order interpolation. All of the points
+ * used must be within the sample (none of the start or end points).
+ * Advances the phase and returns the amplitude of the next output sample.
+ */
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_interpolate_4th_order_neon(const short int *dsp_data, const char *dsp_data24,
+        fluid_phase_t *dsp_phase, fluid_phase_t dsp_phase_incr,
+        fluid_real_t dsp_amp, fluid_real_t dsp_amp_incr,
+        fluid_real_t *FLUID_RESTRICT dsp_buf)
+{
+    float32x4_t products[4];
+    fluid_real_t amp[4];
+    int i;
+
+    for(i = 0; i < 4; i++)
+    {
+        unsigned int dsp_phase_index = fluid_phase_index(*dsp_phase);
+        const fluid_real_t *coeffs = interp_coeff[fluid_phase_fract_to_tablerow(*dsp_phase)];
+
+        products[i] = vmulq_f32(vld1q_f32(coeffs),
+                                fluid_rvoice_get_float_samples_neon(dsp_data, dsp_data24, dsp_phase_index - 1));
+
+        /* increment phase and amplitude */
+        amp[i] = dsp_amp;
+        fluid_phase_incr(*dsp_phase, dsp_phase_incr);
+        dsp_amp += dsp_amp_incr;
+    }
+
+    vst1q_f32(dsp_buf, vmulq_f32(vld1q_f32(amp),
+                                 fluid_rvoice_sum_lanes_neon(products[0], products[1], products[2], products[3])));
+
+    return dsp_amp;
+}
+
+/* Interpolates 4 output samples with 7th order interpolation. All of the points
+ * used must be within the sample (none of the start or end points).
+ * Advances the phase and returns the amplitude of the next output sample.
+ */
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_interpolate_7th_order_neon(const short int *dsp_data, const char *dsp_data24,
+        fluid_phase_t *dsp_phase, fluid_phase_t dsp_phase_incr,
+        fluid_real_t dsp_amp, fluid_real_t dsp_amp_incr,
+        fluid_real_t *FLUID_RESTRICT dsp_buf)
+{
+    float32x4_t products[4];
+    fluid_real_t amp[4];
+    int i;
+
+    for(i = 0; i < 4; i++)
+    {
+        unsigned int dsp_phase_index = fluid_phase_index(*dsp_phase);
+        const fluid_real_t *coeffs = sinc_table7[fluid_phase_fract_to_tablerow(*dsp_phase)];
+
+        /* points -3 to 0, then points 1 to 3 (coeffs[3] is zeroed to not count point 0
+           twice, and to not read beyond the row or the sample) */
+        float32x4_t low = vmulq_f32(vld1q_f32(coeffs),
+                                    fluid_rvoice_get_float_samples_neon(dsp_data, dsp_data24, dsp_phase_index - 3));
+        float32x4_t high = vmulq_f32(vsetq_lane_f32(0.0f, vld1q_f32(coeffs + 3), 0),
+                                     fluid_rvoice_get_float_samples_neon(dsp_data, dsp_data24, dsp_phase_index));
+
+        products[i] = vaddq_f32(low, high);
+
+        /* increment phase and amplitude */
+        amp[i] = dsp_amp;
+        fluid_phase_incr(*dsp_phase, dsp_phase_incr);
+        dsp_amp += dsp_amp_incr;
+    }
+
+    vst1q_f32(dsp_buf, vmulq_f32(vld1q_f32(amp),
+                                 fluid_rvoice_sum_lanes_neon(products[0], products[1], products[2], products[3])));
+
+    return dsp_amp;
+}
+#endif /* DSP_NEON */
+
 /* No interpolation. Just take the sample, which is closest to
   * the playback pointer.  Questionable quality, but very
   * efficient. */
@@ -284,6 +405,18 @@ fluid_rvoice_dsp_interpolate_4th_order(fluid_rvoice_dsp_t *voice, fluid_real_t *
             dsp_amp += dsp_amp_incr;
         }
 
+#ifdef DSP_NEON
+        /* interpolate the sequence of sample points, 4 at a time while all of them are before end_index */
+        for(; dsp_i + 4 <= FLUID_BUFSIZE
+                && fluid_phase_index(dsp_phase + 3 * dsp_phase_incr) <= end_index; dsp_i += 4)
+        {
+            dsp_amp = fluid_rvoice_dsp_interpolate_4th_order_neon(dsp_data, dsp_data24, &dsp_phase, dsp_phase_incr,
+                      dsp_amp, dsp_amp_incr, &dsp_buf[dsp_i]);
+        }
+
+        dsp_phase_index = fluid_phase_index(dsp_phase);
+#endif
+
         /* interpolate the sequence of sample points */
         for(; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
         {
@@ -504,6 +637,18 @@ fluid_rvoice_dsp_interpolate_7th_order(fluid_rvoice_dsp_t *voice, fluid_real_t *
         start_index -= 2;	/* set back to original start index */
 
 
+#ifdef DSP_NEON
+        /* interpolate the sequence of sample points, 4 at a time while all of them are before end_index */
+        for(; dsp_i + 4 <= FLUID_BUFSIZE
+                && fluid_phase_index(dsp_phase + 3 * dsp_phase_incr) <= end_index; dsp_i += 4)
+        {
+            dsp_amp = fluid_rvoice_dsp_interpolate_7th_order_neon(dsp_data, dsp_data24, &dsp_phase, dsp_phase_incr,
+                      dsp_amp, dsp_amp_incr, &dsp_buf[dsp_i]);
+        }
+
+        dsp_phase_index = fluid_phase_index(dsp_phase);
+#endif
+
         /* interpolate the sequence of sample points */
         for(; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
         {
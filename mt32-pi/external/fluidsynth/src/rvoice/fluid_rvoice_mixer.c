@@ -120,6 +120,13 @@ struct _fluid_rvoice_mixer_t
     int thread_count;            /**< Number of extra mixer threads for multi-core rendering */
     fluid_mixer_buffers_t *threads;    /**< Array of mixer threads (thread_count in length) */
 #endif
+
+    /* External render worker, e.g. a spare CPU core on a bare-metal system without thread support */
+    fluid_mixer_worker_func_t worker_kick; /**< Hands the current block to the worker */
+    fluid_mixer_worker_func_t worker_wait; /**< Blocks until the worker has finished the current block */
+    void *worker_data;                     /**< User data passed to the worker callbacks */
+    fluid_mixer_buffers_t *worker_buffers; /**< Buffers the worker renders its voices into */
+    fluid_atomic_int_t worker_rvoice;      /**< Atomic: next voice to be claimed by either side */
 };
 
 #if ENABLE_MIXER_THREADS
@@ -393,6 +400,12 @@ static FLUID_INLINE void fluid_rvoice_mixer_process_finished_voices(fluid_rvoice
     }
 
 #endif
+
+    if(mixer->worker_buffers)
+    {
+        fluid_mixer_buffer_process_finished_voices(mixer->worker_buffers);
+    }
+
     fluid_mixer_buffer_process_finished_voices(&mixer->buffers);
 }
 
@@ -658,6 +671,12 @@ DECLARE_FLUID_RVOICE_FUNCTION(fluid_rvoice_mixer_set_polyphony)
     }
 #endif
 
+    if(handler->worker_buffers
+            && fluid_mixer_buffers_update_polyphony(handler->worker_buffers, value) == FLUID_FAILED)
+    {
+        return /*FLUID_FAILED*/;
+    }
+
     handler->polyphony = value;
     /*return FLUID_OK*/;
 }
@@ -924,6 +943,12 @@ void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t *mixer)
 #endif
     fluid_mixer_buffers_free(&mixer->buffers);
 
+    if(mixer->worker_buffers)
+    {
+        fluid_mixer_buffers_free(mixer->worker_buffers);
+        FLUID_FREE(mixer->worker_buffers);
+    }
+
 
     for(i = 0; i < mixer->fx_units; i++)
     {
@@ -1310,6 +1335,86 @@ int fluid_rvoice_mixer_get_active_voices(fluid_rvoice_mixer_t *mixer)
 }
 #endif
 
+static void
+fluid_mixer_buffers_mix(fluid_mixer_buffers_t *dst, fluid_mixer_buffers_t *src, int current_blockcount)
+{
+    int i, j;
+    int scount = current_blockcount * FLUID_BUFSIZE;
+    int minbuf;
+    fluid_real_t *FLUID_RESTRICT base_src;
+    fluid_real_t *FLUID_RESTRICT base_dst;
+
+    minbuf = dst->buf_count;
+
+    if(minbuf > src->buf_count)
+    {
+        minbuf = src->buf_count;
+    }
+
+    base_src = fluid_align_ptr(src->left_buf, FLUID_DEFAULT_ALIGNMENT);
+    base_dst = fluid_align_ptr(dst->left_buf, FLUID_DEFAULT_ALIGNMENT);
+
+    for(i = 0; i < minbuf; i++)
+    {
+        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
+
+        for(j = 0; j < scount; j++)
+        {
+            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
+            base_dst[dsp_i] += base_src[dsp_i];
+        }
+    }
+
+    base_src = fluid_align_ptr(src->right_buf, FLUID_DEFAULT_ALIGNMENT);
+    base_dst = fluid_align_ptr(dst->right_buf, FLUID_DEFAULT_ALIGNMENT);
+
+    for(i = 0; i < minbuf; i++)
+    {
+        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
+
+        for(j = 0; j < scount; j++)
+        {
+            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
+            base_dst[dsp_i] += base_src[dsp_i];
+        }
+    }
+
+    minbuf = dst->fx_buf_count;
+
+    if(minbuf > src->fx_buf_count)
+    {
+        minbuf = src->fx_buf_count;
+    }
+
+    base_src = fluid_align_ptr(src->fx_left_buf, FLUID_DEFAULT_ALIGNMENT);
+    base_dst = fluid_align_ptr(dst->fx_left_buf, FLUID_DEFAULT_ALIGNMENT);
+
+    for(i = 0; i < minbuf; i++)
+    {
+        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
+
+        for(j = 0; j < scount; j++)
+        {
+            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
+            base_dst[dsp_i] += base_src[dsp_i];
+        }
+    }
+
+    base_src = fluid_align_ptr(src->fx_right_buf, FLUID_DEFAULT_ALIGNMENT);
+    base_dst = fluid_align_ptr(dst->fx_right_buf, FLUID_DEFAULT_ALIGNMENT);
+
+    for(i = 0; i < minbuf; i++)
+    {
+        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
+
+        for(j = 0; j < scount; j++)
+        {
+            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
+            base_dst[dsp_i] += base_src[dsp_i];
+        }
+    }
+}
+
 #if ENABLE_MIXER_THREADS
 
 static FLUID_INLINE fluid_rvoice_t *
@@ -1392,87 +1497,6 @@ fluid_mixer_thread_func(void *data)
     return FLUID_THREAD_RETURN_VALUE;
 }
 
-static void
-fluid_mixer_buffers_mix(fluid_mixer_buffers_t *dst, fluid_mixer_buffers_t *src, int current_blockcount)
-{
-    int i, j;
-    int scount = current_blockcount * FLUID_BUFSIZE;
-    int minbuf;
-    fluid_real_t *FLUID_RESTRICT base_src;
-    fluid_real_t *FLUID_RESTRICT base_dst;
-
-    minbuf = dst->buf_count;
-
-    if(minbuf > src->buf_count)
-    {
-        minbuf = src->buf_count;
-    }
-
-    base_src = fluid_align_ptr(src->left_buf, FLUID_DEFAULT_ALIGNMENT);
-    base_dst = fluid_align_ptr(dst->left_buf, FLUID_DEFAULT_ALIGNMENT);
-
-    for(i = 0; i < minbuf; i++)
-    {
-        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
-
-        for(j = 0; j < scount; j++)
-        {
-            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
-            base_dst[dsp_i] += base_src[dsp_i];
-        }
-    }
-
-    base_src = fluid_align_ptr(src->right_buf, FLUID_DEFAULT_ALIGNMENT);
-    base_dst = fluid_align_ptr(dst->right_buf, FLUID_DEFAULT_ALIGNMENT);
-
-    for(i = 0; i < minbuf; i++)
-    {
-        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
-
-        for(j = 0; j < scount; j++)
-        {
-            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
-            base_dst[dsp_i] += base_src[dsp_i];
-        }
-    }
-
-    minbuf = dst->fx_buf_count;
-
-    if(minbuf > src->fx_buf_count)
-    {
-        minbuf = src->fx_buf_count;
-    }
-
-    base_src = fluid_align_ptr(src->fx_left_buf, FLUID_DEFAULT_ALIGNMENT);
-    base_dst = fluid_align_ptr(dst->fx_left_buf, FLUID_DEFAULT_ALIGNMENT);
-
-    for(i = 0; i < minbuf; i++)
-    {
-        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
-
-        for(j = 0; j < scount; j++)
-        {
-            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
-            base_dst[dsp_i] += base_src[dsp_i];
-        }
-    }
-
-    base_src = fluid_align_ptr(src->fx_right_buf, FLUID_DEFAULT_ALIGNMENT);
-    base_dst = fluid_align_ptr(dst->fx_right_buf, FLUID_DEFAULT_ALIGNMENT);
-
-    for(i = 0; i < minbuf; i++)
-    {
-        #pragma omp simd aligned(base_dst,base_src:FLUID_DEFAULT_ALIGNMENT)
-
-        for(j = 0; j < scount; j++)
-        {
-            int dsp_i = i * FLUID_MIXER_MAX_BUFFERS_DEFAULT * FLUID_BUFSIZE + j;
-            base_dst[dsp_i] += base_src[dsp_i];
-        }
-    }
-}
-
-
 /**
  * Go through all threads and see if someone is finished for mixing
  */
@@ -1684,6 +1708,124 @@ static int fluid_rvoice_mixer_set_threads(fluid_rvoice_mixer_t *mixer, int threa
 }
 #endif
 
+static FLUID_INLINE fluid_rvoice_t *
+fluid_mixer_get_worker_rvoice(fluid_rvoice_mixer_t *mixer)
+{
+    int i = fluid_atomic_int_exchange_and_add(&mixer->worker_rvoice, 1);
+
+    if(i >= mixer->active_voices)
+    {
+        return NULL;
+    }
+
+    return mixer->rvoices[i];
+}
+
+/**
+ * Render voices on behalf of the mixer from another CPU core.
+ * Voices are claimed one at a time from the same counter the mixer itself uses,
+ * so the work is balanced between both sides regardless of per-voice cost.
+ * @param mixer mixer passed to the worker_kick callback as the job
+ */
+void
+fluid_rvoice_mixer_worker_render(fluid_rvoice_mixer_t *mixer)
+{
+    fluid_mixer_buffers_t *buffers = mixer->worker_buffers;
+    int bufcount, blockcount = mixer->current_blockcount;
+    fluid_real_t *local_buf = fluid_align_ptr(buffers->local_buf, FLUID_DEFAULT_ALIGNMENT);
+    fluid_rvoice_t *rvoice;
+
+    FLUID_DECLARE_VLA(fluid_real_t *, bufs, buffers->buf_count * 2 + buffers->fx_buf_count * 2);
+
+    fluid_mixer_buffers_zero(buffers, blockcount);
+    bufcount = fluid_mixer_buffers_prepare(buffers, bufs);
+
+    while((rvoice = fluid_mixer_get_worker_rvoice(mixer)) != NULL)
+    {
+        fluid_mixer_buffers_render_one(buffers, rvoice, bufs, bufcount, local_buf, blockcount);
+    }
+}
+
+static void
+fluid_render_loop_worker(fluid_rvoice_mixer_t *mixer, int blockcount)
+{
+    fluid_real_t *local_buf = fluid_align_ptr(mixer->buffers.local_buf, FLUID_DEFAULT_ALIGNMENT);
+    fluid_rvoice_t *rvoice;
+    int bufcount;
+
+    FLUID_DECLARE_VLA(fluid_real_t *, bufs,
+                      mixer->buffers.buf_count * 2 + mixer->buffers.fx_buf_count * 2);
+
+    // Not enough voices to outweigh the handoff overhead
+    if(mixer->active_voices < VOICES_PER_THREAD * 2)
+    {
+        fluid_render_loop_singlethread(mixer, blockcount);
+        return;
+    }
+
+    bufcount = fluid_mixer_buffers_prepare(&mixer->buffers, bufs);
+
+    fluid_atomic_int_set(&mixer->worker_rvoice, 0);
+    mixer->worker_kick(mixer->worker_data, mixer);
+
+    while((rvoice = fluid_mixer_get_worker_rvoice(mixer)) != NULL)
+    {
+        fluid_profile_ref_var(prof_ref);
+        fluid_mixer_buffers_render_one(&mixer->buffers, rvoice, bufs, bufcount, local_buf, blockcount);
+        fluid_profile(FLUID_PROF_ONE_BLOCK_VOICE, prof_ref, 1,
+                      blockcount * FLUID_BUFSIZE);
+    }
+
+    mixer->worker_wait(mixer->worker_data, mixer);
+    fluid_mixer_buffers_mix(&mixer->buffers, mixer->worker_buffers, blockcount);
+}
+
+/**
+ * Install (or remove, if kick is NULL) an external render worker.
+ * Note: Not hard real-time capable (calls malloc); must not be called while rendering.
+ * @return FLUID_OK or FLUID_FAILED
+ */
+int
+fluid_rvoice_mixer_set_worker(fluid_rvoice_mixer_t *mixer, fluid_mixer_worker_func_t kick,
+                              fluid_mixer_worker_func_t wait, void *data)
+{
+    if(kick == NULL || wait == NULL)
+    {
+        mixer->worker_kick = NULL;
+        mixer->worker_wait = NULL;
+        mixer->worker_data = NULL;
+        return FLUID_OK;
+    }
+
+    if(mixer->worker_buffers == NULL)
+    {
+        fluid_mixer_buffers_t *buffers = FLUID_NEW(fluid_mixer_buffers_t);
+
+        if(buffers == NULL)
+        {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            return FLUID_FAILED;
+        }
+
+        FLUID_MEMSET(buffers, 0, sizeof(*buffers));
+
+        if(!fluid_mixer_buffers_init(buffers, mixer))
+        {
+            fluid_mixer_buffers_free(buffers);
+            FLUID_FREE(buffers);
+            return FLUID_FAILED;
+        }
+
+        mixer->worker_buffers = buffers;
+    }
+
+    mixer->worker_kick = kick;
+    mixer->worker_wait = wait;
+    mixer->worker_data = data;
+
+    return FLUID_OK;
+}
+
 /**
  * Synthesize audio into buffers
  * @param blockcount number of blocks to render, each having FLUID_BUFSIZE samples
@@ -1709,6 +1851,11 @@ fluid_rvoice_mixer_render(fluid_rvoice_mixer_t *mixer, int blockcount)
     }
     else
 #endif
+    if(mixer->worker_kick != NULL)
+    {
+        fluid_render_loop_worker(mixer, blockcount);
+    }
+    else
     {
         fluid_render_loop_singlethread(mixer, blockcount);
     }
@@ -43,6 +43,10 @@ fluid_rvoice_mixer_t *new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, in
 
 void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t *);
 
+int fluid_rvoice_mixer_set_worker(fluid_rvoice_mixer_t *mixer, fluid_mixer_worker_func_t kick,
+                                  fluid_mixer_worker_func_t wait, void *data);
+void fluid_rvoice_mixer_worker_render(fluid_rvoice_mixer_t *mixer);
+
 void
 fluid_rvoice_mixer_set_reverb_full(const fluid_rvoice_mixer_t *mixer,
                                    int fx_group, int set, const double values[]);
@@ -29,6 +29,10 @@
 #include "fluid_samplecache.h"
 #include "fluid_chan.h"
 
+#if !LIBSNDFILE_SUPPORT
+#include "fluid_vorbis.h"
+#endif
+
 /* EMU8k/10k hardware applies this factor to initial attenuation generator values set at preset and
  * instrument level in a soundfont. We apply this factor when loading the generator values to stay
  * compatible as most existing soundfonts expect exactly this (strange, non-standard) behaviour. */
@@ -38,8 +42,15 @@
 static int pin_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
 static int unpin_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
 static int load_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
+static int select_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
+static int load_missing_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
 static int unload_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
+static int hold_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
+static int release_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset);
 static void unload_sample(fluid_sample_t *sample);
+static void release_sample(fluid_defsfont_t *defsfont, fluid_sample_t *sample);
+static void reclaim_sample(fluid_defsfont_t *defsfont, fluid_sample_t *sample);
+static void evict_idle_samples(fluid_defsfont_t *defsfont, size_t limit);
 static int dynamic_samples_preset_notify(fluid_preset_t *preset, int reason, int chan);
 static int dynamic_samples_sample_notify(fluid_sample_t *sample, int reason);
 static int fluid_preset_zone_create_voice_zones(fluid_preset_zone_t *preset_zone);
@@ -104,6 +115,7 @@ fluid_sfont_t *fluid_defsfloader_load(fluid_sfloader_t *loader, const char *file
     fluid_sfont_set_data(sfont, defsfont);
 
     defsfont->sfont = sfont;
+    defsfont->loader = loader;
 
     if(fluid_defsfont_load(defsfont, &loader->file_callbacks, filename) == FLUID_FAILED)
     {
@@ -111,6 +123,8 @@ fluid_sfont_t *fluid_defsfloader_load(fluid_sfloader_t *loader, const char *file
         return NULL;
     }
 
+    defsfont->loader = NULL;
+
     return sfont;
 }
 
@@ -203,6 +217,7 @@ int fluid_defpreset_preset_noteon(fluid_preset_t *preset, fluid_synth_t *synth,
 fluid_defsfont_t *new_fluid_defsfont(fluid_settings_t *settings)
 {
     fluid_defsfont_t *defsfont;
+    int cache_size = 0;
 
     defsfont = FLUID_NEW(fluid_defsfont_t);
 
@@ -216,6 +231,10 @@ fluid_defsfont_t *new_fluid_defsfont(fluid_settings_t *settings)
 
     fluid_settings_getint(settings, "synth.lock-memory", &defsfont->mlock);
     fluid_settings_getint(settings, "synth.dynamic-sample-loading", &defsfont->dynamic_samples);
+    fluid_settings_getint(settings, "synth.dynamic-sample-deferred", &defsfont->deferred_samples);
+    fluid_settings_getint(settings, "synth.dynamic-sample-cache-size", &cache_size);
+    defsfont->idle_budget = (size_t)cache_size * 1024 * 1024;
+    fluid_mutex_init(defsfont->sample_mutex);
 
     return defsfont;
 }
@@ -227,18 +246,26 @@ int delete_fluid_defsfont(fluid_defsfont_t *defsfont)
 {
     fluid_list_t *list;
     fluid_preset_t *preset;
+    fluid_defpreset_t *defpreset;
     fluid_sample_t *sample;
 
     fluid_return_val_if_fail(defsfont != NULL, FLUID_OK);
 
     /* If we use dynamic sample loading, make sure we unpin any
-     * pinned presets before removing this soundfont */
+     * pinned or held presets before removing this soundfont */
     if(defsfont->dynamic_samples)
     {
         for(list = defsfont->preset; list; list = fluid_list_next(list))
         {
             preset = (fluid_preset_t *)fluid_list_get(list);
             unpin_preset_samples(defsfont, preset);
+
+            defpreset = fluid_preset_get_data(preset);
+
+            while(defpreset->hold_count > 0)
+            {
+                release_preset_samples(defsfont, preset);
+            }
         }
     }
 
@@ -299,6 +326,7 @@ int delete_fluid_defsfont(fluid_defsfont_t *defsfont)
 
     delete_fluid_list(defsfont->inst);
 
+    fluid_mutex_destroy(defsfont->sample_mutex);
     FLUID_FREE(defsfont);
     return FLUID_OK;
 }
@@ -311,12 +339,36 @@ const char *fluid_defsfont_get_name(fluid_defsfont_t *defsfont)
     return defsfont->filename;
 }
 
-/* Load sample data for a single sample from the Soundfont file.
- * Returns FLUID_OK on error, otherwise FLUID_FAILED
+/* Sets the pointers of a sample that has been loaded into its own buffer of num_samples words */
+static void set_individual_sample_range(fluid_sample_t *sample, int num_samples)
+{
+    if(num_samples == 0)
+    {
+        sample->start = sample->end = 0;
+        sample->loopstart = sample->loopend = 0;
+        return;
+    }
+
+    /* Ogg Vorbis samples already have loop pointers relative to the individual decompressed sample,
+     * but SF2 samples are relative to sample chunk start, so they need to be adjusted */
+    if(!(sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS))
+    {
+        sample->loopstart = sample->source_loopstart - sample->source_start;
+        sample->loopend = sample->source_loopend - sample->source_start;
+    }
+
+    /* As we've just loaded an individual sample into it's own buffer, we need to adjust the start
+     * and end pointers */
+    sample->start = 0;
+    sample->end = num_samples - 1;
+}
+
+/* Read the data of a single sample from the Soundfont file into data and data24, leaving the
+ * sample itself untouched. Returns the number of sample words read, or -1 on error.
  */
-int fluid_defsfont_load_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata, fluid_sample_t *sample)
+static int read_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata, fluid_sample_t *sample,
+                           short **data, char **data24)
 {
-    int num_samples;
     unsigned int source_end = sample->source_end;
 
     /* For uncompressed samples we want to include the 46 zero sample word area following each sample
@@ -334,110 +386,557 @@ int fluid_defsfont_load_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata, f
         }
     }
 
-    num_samples = fluid_samplecache_load(
-                      sfdata, sample->source_start, source_end, sample->sampletype,
-                      defsfont->mlock, &sample->data, &sample->data24);
+    return fluid_samplecache_load(sfdata, sample->source_start, source_end, sample->sampletype,
+                                  defsfont->mlock, data, data24);
+}
+
+/* Load sample data for a single sample from the Soundfont file.
+ * Returns FLUID_OK on error, otherwise FLUID_FAILED
+ */
+int fluid_defsfont_load_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata, fluid_sample_t *sample)
+{
+    int num_samples;
+
+    num_samples = read_sampledata(defsfont, sfdata, sample, &sample->data, &sample->data24);
 
     if(num_samples < 0)
     {
         return FLUID_FAILED;
     }
 
-    if(num_samples == 0)
+    set_individual_sample_range(sample, num_samples);
+
+    return FLUID_OK;
+}
+
+/*
+ * Pipelined loading of the SF2 sample data block: the loading thread reads the block in chunks,
+ * while the samples whose data is complete are sanitized and optimized by a worker (and by the
+ * loading thread once the read has finished).
+ *
+ * SF3 files are loaded the same way without libsndfile, except that the block holds the compressed
+ * data, which the worker and the loading thread decode with the built-in Vorbis decoder.
+ */
+typedef struct
+{
+    fluid_sample_t **samples;   /* sorted by the last frame (or compressed byte) they need */
+    int count;
+    int next;                   /* next sample to be claimed (atomic) */
+    int frames;                 /* number of frames (or compressed bytes) whose data is complete,
+                                   or -1 for all (atomic) */
+    int stopped;                /* the worker may no longer claim samples (atomic) */
+    int sanitized;              /* TRUE if any sample loop was sanitized (atomic) */
+
+    short *data;                /* set before frames is raised */
+    char *data24;
+    unsigned int samplesize;
+
+#if !LIBSNDFILE_SUPPORT
+    const unsigned char *compressed;        /* NULL for SF2 files */
+    fluid_vorbis_decoder_t *decoders[2];    /* for the loading thread and the worker */
+    int *sample_counts;                     /* decoded words of each sample, -1 if it failed */
+    int decoded;                            /* compressed bytes decoded so far (atomic) */
+    unsigned int decode_total;
+#endif
+
+    const fluid_sfloader_t *loader;
+    int use_worker;
+    int percent;
+} fluid_defsfont_load_job_t;
+
+static unsigned int sample_last_frame(const fluid_sample_t *sample)
+{
+    return sample->loopend > sample->end ? sample->loopend : sample->end;
+}
+
+static int compare_sample_last_frame(const void *a, const void *b)
+{
+    unsigned int frame_a = sample_last_frame(*(fluid_sample_t *const *)a);
+    unsigned int frame_b = sample_last_frame(*(fluid_sample_t *const *)b);
+
+    return (frame_a > frame_b) - (frame_a < frame_b);
+}
+
+#if !LIBSNDFILE_SUPPORT
+/* End (exclusive) of the compressed data of a sample within the sample data chunk */
+static unsigned int sample_compressed_end(const fluid_sample_t *sample, unsigned int samplesize)
+{
+    return sample->source_end < samplesize ? sample->source_end + 1 : samplesize;
+}
+
+static int compare_sample_compressed_end(const void *a, const void *b)
+{
+    unsigned int end_a = (*(fluid_sample_t *const *)a)->source_end;
+    unsigned int end_b = (*(fluid_sample_t *const *)b)->source_end;
+
+    return (end_a > end_b) - (end_a < end_b);
+}
+
+/* Decodes a compressed sample into a buffer of its own, which is handed over to the sample cache
+ * by the loading thread once all samples are done. Failures are reported from there as well. */
+static void load_job_decode(fluid_defsfont_load_job_t *job, int index, int worker)
+{
+    fluid_sample_t *sample = job->samples[index];
+    unsigned int end = sample_compressed_end(sample, job->samplesize);
+    short *data = NULL;
+    int num_samples = -1;
+
+    if(sample->source_start < end)
     {
-        sample->start = sample->end = 0;
-        sample->loopstart = sample->loopend = 0;
-        return FLUID_OK;
+        num_samples = fluid_vorbis_decoder_decode(job->decoders[worker], job->compressed + sample->source_start,
+                      end - sample->source_start, &data);
     }
 
-    /* Ogg Vorbis samples already have loop pointers relative to the individual decompressed sample,
-     * but SF2 samples are relative to sample chunk start, so they need to be adjusted */
-    if(!(sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS))
+    job->sample_counts[index] = num_samples;
+
+    if(num_samples >= 0)
     {
-        sample->loopstart = sample->source_loopstart - sample->source_start;
-        sample->loopend = sample->source_loopend - sample->source_start;
+        sample->data = data;
+        sample->data24 = NULL;
+        set_individual_sample_range(sample, num_samples);
+
+        if(fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short)))
+        {
+            fluid_atomic_int_set(&job->sanitized, TRUE);
+        }
+
+        fluid_voice_optimize_sample(sample);
     }
 
-    /* As we've just loaded an individual sample into it's own buffer, we need to adjust the start
-     * and end pointers */
-    sample->start = 0;
-    sample->end = num_samples - 1;
+    if(sample->source_start < end)
+    {
+        fluid_atomic_int_add(&job->decoded, end - sample->source_start);
+    }
+}
+#endif
 
-    return FLUID_OK;
+/* Returns the last frame (or compressed byte) that must be complete before a sample can be processed */
+static unsigned int load_job_last_needed(const fluid_defsfont_load_job_t *job, const fluid_sample_t *sample)
+{
+#if !LIBSNDFILE_SUPPORT
+    if(job->compressed != NULL)
+    {
+        return sample_compressed_end(sample, job->samplesize) - 1;
+    }
+#endif
+
+    return sample_last_frame(sample);
 }
 
-/* Loads the sample data for all samples from the Soundfont file. For SF2 files, it loads the data in
- * one large block. For SF3 files, each compressed sample gets loaded individually.
- * Returns FLUID_OK on success, otherwise FLUID_FAILED
+/* Processes the next sample if its data is complete. Returns FALSE once every sample has been claimed. */
+static int load_job_process(fluid_defsfont_load_job_t *job, int worker)
+{
+    fluid_sample_t *sample;
+    int index, frames;
+
+    if(worker && fluid_atomic_int_get(&job->stopped))
+    {
+        return FALSE;
+    }
+
+    index = fluid_atomic_int_get(&job->next);
+
+    if(index >= job->count)
+    {
+        return FALSE;
+    }
+
+    sample = job->samples[index];
+    frames = fluid_atomic_int_get(&job->frames);
+
+    /* Loop points beyond the data are only sanitized once all of it is available */
+    if(frames >= 0 && load_job_last_needed(job, sample) >= (unsigned int)frames)
+    {
+        return TRUE;
+    }
+
+    if(!fluid_atomic_int_compare_and_exchange(&job->next, index, index + 1))
+    {
+        return TRUE;
+    }
+
+#if !LIBSNDFILE_SUPPORT
+    if(job->compressed != NULL)
+    {
+        load_job_decode(job, index, worker);
+        return TRUE;
+    }
+#endif
+
+    /* The final data pointers are assigned again once loading has finished */
+    sample->data = job->data;
+    sample->data24 = job->data24;
+
+    if(fluid_sample_sanitize_loop(sample, job->samplesize))
+    {
+        fluid_atomic_int_set(&job->sanitized, TRUE);
+    }
+
+    fluid_voice_optimize_sample(sample);
+
+    return TRUE;
+}
+
+static void load_job_stop_worker(fluid_defsfont_load_job_t *job)
+{
+    if(fluid_atomic_int_get(&job->stopped))
+    {
+        return;
+    }
+
+    fluid_atomic_int_set(&job->stopped, TRUE);
+
+    if(job->use_worker)
+    {
+        job->loader->worker_wait(job->loader->worker_data, job);
+    }
+}
+
+static void load_job_report(fluid_defsfont_load_job_t *job, int percent)
+{
+    if(percent != job->percent && job->loader != NULL && job->loader->progress != NULL)
+    {
+        job->percent = percent;
+        job->loader->progress(job->loader->progress_data, percent);
+    }
+}
+
+#if !LIBSNDFILE_SUPPORT
+/* Decoding takes much longer than reading the compressed data, so progress follows the decoding */
+static void load_job_report_decoded(fluid_defsfont_load_job_t *job)
+{
+    int decoded = fluid_atomic_int_get(&job->decoded);
+
+    if(job->decode_total == 0)
+    {
+        return;
+    }
+
+    load_job_report(job, (int)((fluid_long_long_t)decoded * 100 / job->decode_total));
+}
+#endif
+
+static void load_job_progress(void *data, short *data16, char *data24,
+                              unsigned int frames, unsigned int bytes_read, unsigned int bytes_total)
+{
+    fluid_defsfont_load_job_t *job = data;
+
+    /* The buffers are about to be freed; make sure the worker is done with them */
+    if(bytes_total == 0)
+    {
+        load_job_stop_worker(job);
+        return;
+    }
+
+    job->data = data16;
+    job->data24 = data24;
+    fluid_atomic_int_set(&job->frames, (int)frames);
+
+#if !LIBSNDFILE_SUPPORT
+    if(job->compressed != NULL)
+    {
+        load_job_report_decoded(job);
+        return;
+    }
+#endif
+
+    load_job_report(job, (int)((fluid_long_long_t)bytes_read * 100 / bytes_total));
+}
+
+/**
+ * Handle a job passed to the worker kick callback set with fluid_sfloader_set_load_worker().
+ *
+ * @param job The job handle passed to the kick callback.
+ * @return TRUE if the worker should call this function again, FALSE once there is nothing left to do.
  */
-int fluid_defsfont_load_all_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata)
+int fluid_sfloader_load_worker_process(void *job)
+{
+    return load_job_process(job, TRUE);
+}
+
+static int load_sample_block(fluid_defsfont_t *defsfont, SFData *sfdata)
+{
+    fluid_defsfont_load_job_t job;
+    fluid_list_t *list;
+    int read_samples;
+    int num_samples = sfdata->samplesize / sizeof(short);
+    int i;
+
+    FLUID_MEMSET(&job, 0, sizeof(job));
+    job.count = fluid_list_size(defsfont->sample);
+    job.samplesize = defsfont->samplesize;
+    job.loader = defsfont->loader;
+    job.use_worker = job.loader != NULL && job.loader->worker_kick != NULL && job.loader->worker_wait != NULL;
+    job.percent = -1;
+
+    if(job.count > 0)
+    {
+        job.samples = FLUID_ARRAY(fluid_sample_t *, job.count);
+
+        if(job.samples == NULL)
+        {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            return FLUID_FAILED;
+        }
+
+        for(list = defsfont->sample, i = 0; list; list = fluid_list_next(list), i++)
+        {
+            job.samples[i] = fluid_list_get(list);
+        }
+
+        /* Samples become ready in the order of their last frame */
+        qsort(job.samples, job.count, sizeof(*job.samples), compare_sample_last_frame);
+    }
+
+    load_job_report(&job, 0);
+
+    sfdata->sample_progress = load_job_progress;
+    sfdata->sample_progress_data = &job;
+
+    if(job.use_worker)
+    {
+        job.loader->worker_kick(job.loader->worker_data, &job);
+    }
+
+    read_samples = fluid_samplecache_load(sfdata, 0, num_samples - 1, 0, defsfont->mlock,
+                                          &defsfont->sampledata, &defsfont->sample24data);
+
+    sfdata->sample_progress = NULL;
+    sfdata->sample_progress_data = NULL;
+
+    if(read_samples != num_samples)
+    {
+        load_job_stop_worker(&job);
+        FLUID_FREE(job.samples);
+
+        FLUID_LOG(FLUID_ERR, "Attempted to read %d words of sample data, but got %d instead",
+                  num_samples, read_samples);
+        return FLUID_FAILED;
+    }
+
+    /* All of the data is available now (it may also have come from the sample cache without a read) */
+    job.data = defsfont->sampledata;
+    job.data24 = defsfont->sample24data;
+    fluid_atomic_int_set(&job.frames, -1);
+
+    /* Help the worker with whatever is left, then wait for its last sample */
+    while(load_job_process(&job, FALSE))
+    {
+    }
+
+    load_job_stop_worker(&job);
+
+    /* Data pointers of SF2 samples point to large sample data block loaded above */
+    for(i = 0; i < job.count; i++)
+    {
+        job.samples[i]->data = defsfont->sampledata;
+        job.samples[i]->data24 = defsfont->sample24data;
+    }
+
+    FLUID_FREE(job.samples);
+
+    load_job_report(&job, 100);
+
+    if(job.sanitized)
+    {
+        FLUID_LOG(FLUID_WARN,
+                  "Some invalid sample loops were sanitized! If you experience audible glitches, "
+                  "start fluidsynth in verbose mode for detailed information.");
+    }
+
+    return FLUID_OK;
+}
+
+#if !LIBSNDFILE_SUPPORT
+static int load_compressed_samples(fluid_defsfont_t *defsfont, SFData *sfdata)
 {
+    fluid_defsfont_load_job_t job;
     fluid_list_t *list;
     fluid_sample_t *sample;
-    int sf3_file = (sfdata->version.major == 3);
-    int sample_parsing_result = FLUID_OK;
-    int invalid_loops_were_sanitized = FALSE;
+    unsigned char *compressed = NULL;
+    int num_samples, read_result = FLUID_FAILED;
+    int result = FLUID_OK;
+    int i;
 
-    /* For SF2 files, we load the sample data in one large block */
-    if(!sf3_file)
+    FLUID_MEMSET(&job, 0, sizeof(job));
+    num_samples = fluid_list_size(defsfont->sample);
+    job.samplesize = sfdata->samplesize;
+    job.loader = defsfont->loader;
+    job.use_worker = job.loader != NULL && job.loader->worker_kick != NULL && job.loader->worker_wait != NULL;
+    job.percent = -1;
+
+    job.samples = FLUID_ARRAY(fluid_sample_t *, num_samples + 1);
+    job.sample_counts = FLUID_ARRAY(int, num_samples + 1);
+    job.decoders[0] = new_fluid_vorbis_decoder();
+    job.decoders[1] = new_fluid_vorbis_decoder();
+
+    if(job.samples == NULL || job.sample_counts == NULL || job.decoders[0] == NULL || job.decoders[1] == NULL)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        result = FLUID_FAILED;
+        goto exit;
+    }
+
+    load_job_report(&job, 0);
+
+    /* Samples that are cached already or not compressed are loaded right away, the rest is decoded below */
+    for(list = defsfont->sample; list; list = fluid_list_next(list))
     {
-        int read_samples;
-        int num_samples = sfdata->samplesize / sizeof(short);
+        sample = fluid_list_get(list);
+
+        if(sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+        {
+            num_samples = fluid_samplecache_find(sfdata, sample->source_start, sample->source_end,
+                                                 sample->sampletype, defsfont->mlock, &sample->data, &sample->data24);
+
+            if(num_samples < 0)
+            {
+                job.sample_counts[job.count] = -1;
+                job.samples[job.count++] = sample;
+                continue;
+            }
 
-        read_samples = fluid_samplecache_load(sfdata, 0, num_samples - 1, 0, defsfont->mlock,
-                                              &defsfont->sampledata, &defsfont->sample24data);
+            set_individual_sample_range(sample, num_samples);
+        }
+        else if(fluid_defsfont_load_sampledata(defsfont, sfdata, sample) == FLUID_FAILED)
+        {
+            FLUID_LOG(FLUID_ERR, "Failed to load sample '%s'", sample->name);
+            result = FLUID_FAILED;
+            continue;
+        }
 
-        if(read_samples != num_samples)
+        if(fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short)))
         {
-            FLUID_LOG(FLUID_ERR, "Attempted to read %d words of sample data, but got %d instead",
-                      num_samples, read_samples);
-            return FLUID_FAILED;
+            job.sanitized = TRUE;
+        }
+
+        fluid_voice_optimize_sample(sample);
+    }
+
+    if(job.count > 0)
+    {
+        /* Samples become ready in the order of the end of their compressed data */
+        qsort(job.samples, job.count, sizeof(*job.samples), compare_sample_compressed_end);
+
+        for(i = 0; i < job.count; i++)
+        {
+            unsigned int end = sample_compressed_end(job.samples[i], job.samplesize);
+
+            if(job.samples[i]->source_start < end)
+            {
+                job.decode_total += end - job.samples[i]->source_start;
+            }
+        }
+
+        /* Only read as far as the last sample that needs decoding */
+        num_samples = sample_compressed_end(job.samples[job.count - 1], job.samplesize);
+        compressed = FLUID_ARRAY(unsigned char, num_samples);
+
+        if(compressed == NULL)
+        {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            result = FLUID_FAILED;
+            goto exit;
+        }
+
+        job.compressed = compressed;
+        sfdata->sample_progress = load_job_progress;
+        sfdata->sample_progress_data = &job;
+
+        if(job.use_worker)
+        {
+            job.loader->worker_kick(job.loader->worker_data, &job);
+        }
+
+        read_result = fluid_sffile_read_compressed_data(sfdata, compressed, num_samples);
+
+        sfdata->sample_progress = NULL;
+        sfdata->sample_progress_data = NULL;
+
+        if(read_result == FLUID_OK)
+        {
+            /* Help the worker with whatever is left, then wait for its last sample */
+            fluid_atomic_int_set(&job.frames, -1);
+
+            while(load_job_process(&job, FALSE))
+            {
+                load_job_report_decoded(&job);
+            }
+        }
+
+        load_job_stop_worker(&job);
+
+        /* The cache takes over the decoded data, which makes it available to other synths as well */
+        for(i = 0; i < job.count; i++)
+        {
+            sample = job.samples[i];
+
+            if(job.sample_counts[i] < 0)
+            {
+                /* A failed read has been reported already, and leaves the remaining samples unclaimed */
+                if(read_result == FLUID_OK)
+                {
+                    FLUID_LOG(FLUID_ERR, "Failed to load sample '%s'", sample->name);
+                }
+
+                result = FLUID_FAILED;
+            }
+            else if(sample->data != NULL
+                    && fluid_samplecache_add(sfdata, sample->source_start, sample->source_end, sample->sampletype,
+                                             defsfont->mlock, sample->data, job.sample_counts[i],
+                                             &sample->data, &sample->data24) < 0)
+            {
+                sample->data = NULL;
+                result = FLUID_FAILED;
+            }
         }
     }
 
+    load_job_report(&job, 100);
+
+    if(job.sanitized)
+    {
+        FLUID_LOG(FLUID_WARN,
+                  "Some invalid sample loops were sanitized! If you experience audible glitches, "
+                  "start fluidsynth in verbose mode for detailed information.");
+    }
+
+exit:
+    delete_fluid_vorbis_decoder(job.decoders[0]);
+    delete_fluid_vorbis_decoder(job.decoders[1]);
+    FLUID_FREE(job.sample_counts);
+    FLUID_FREE(job.samples);
+    FLUID_FREE(compressed);
+    return result;
+}
+#else
+/* Loads SF3 samples individually, as most (or all) of them are in Ogg Vorbis format anyway */
+static int load_individual_samples(fluid_defsfont_t *defsfont, SFData *sfdata)
+{
+    fluid_list_t *list;
+    fluid_sample_t *sample;
+    int sample_parsing_result = FLUID_OK;
+    int invalid_loops_were_sanitized = FALSE;
+
     #pragma omp parallel
     #pragma omp single
     for(list = defsfont->sample; list; list = fluid_list_next(list))
     {
         sample = fluid_list_get(list);
 
-        if(sf3_file)
+        #pragma omp task firstprivate(sample,sfdata,defsfont) shared(sample_parsing_result, invalid_loops_were_sanitized) default(none)
         {
-            /* SF3 samples get loaded individually, as most (or all) of them are in Ogg Vorbis format
-             * anyway */
-            #pragma omp task firstprivate(sample,sfdata,defsfont) shared(sample_parsing_result, invalid_loops_were_sanitized) default(none)
+            if(fluid_defsfont_load_sampledata(defsfont, sfdata, sample) == FLUID_FAILED)
             {
-                if(fluid_defsfont_load_sampledata(defsfont, sfdata, sample) == FLUID_FAILED)
-                {
-                    #pragma omp critical
-                    {
-                        FLUID_LOG(FLUID_ERR, "Failed to load sample '%s'", sample->name);
-                        sample_parsing_result = FLUID_FAILED;
-                    }
-                }
-                else
+                #pragma omp critical
                 {
-                    int modified = fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
-                    if(modified)
-                    {
-                        #pragma omp critical
-                        {
-                            invalid_loops_were_sanitized = TRUE;
-                        }
-                    }
-                    fluid_voice_optimize_sample(sample);
+                    FLUID_LOG(FLUID_ERR, "Failed to load sample '%s'", sample->name);
+                    sample_parsing_result = FLUID_FAILED;
                 }
             }
-        }
-        else
-        {
-            #pragma omp task firstprivate(sample, defsfont) shared(invalid_loops_were_sanitized) default(none)
+            else
             {
-                int modified;
-                /* Data pointers of SF2 samples point to large sample data block loaded above */
-                sample->data = defsfont->sampledata;
-                sample->data24 = defsfont->sample24data;
-                modified = fluid_sample_sanitize_loop(sample, defsfont->samplesize);
+                int modified = fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
                 if(modified)
                 {
                     #pragma omp critical
@@ -459,6 +958,27 @@ int fluid_defsfont_load_all_sampledata(fluid_defsfont_t *defsfont, SFData *sfdat
 
     return sample_parsing_result;
 }
+#endif
+
+/* Loads the sample data for all samples from the Soundfont file. For SF2 files, it loads the data in
+ * one large block. For SF3 files, each compressed sample gets loaded individually (or decoded from
+ * one large block of compressed data by the built-in decoder).
+ * Returns FLUID_OK on success, otherwise FLUID_FAILED
+ */
+int fluid_defsfont_load_all_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata)
+{
+    /* For SF2 files, we load the sample data in one large block */
+    if(sfdata->version.major != 3)
+    {
+        return load_sample_block(defsfont, sfdata);
+    }
+
+#if LIBSNDFILE_SUPPORT
+    return load_individual_samples(defsfont, sfdata);
+#else
+    return load_compressed_samples(defsfont, sfdata);
+#endif
+}
 
 /*
  * fluid_defsfont_load
@@ -689,6 +1209,7 @@ new_fluid_defpreset(void)
     defpreset->global_zone = NULL;
     defpreset->zone = NULL;
     defpreset->pinned = FALSE;
+    defpreset->hold_count = 0;
     return defpreset;
 }
 
@@ -879,6 +1400,13 @@ fluid_defpreset_noteon_add_mod_to_voice(fluid_voice_t *voice,
     }
 }
 
+/* Whether a voice may use the data of a sample; with dynamic sample loading, it may be read by
+ * another thread while this one plays, see load_missing_samples() */
+static int sample_is_loaded(fluid_sample_t *sample)
+{
+    return fluid_atomic_pointer_get(&sample->data) != NULL && !fluid_atomic_int_get(&sample->loading);
+}
+
 /*
  * fluid_defpreset_noteon
  */
@@ -941,6 +1469,12 @@ fluid_defpreset_noteon(fluid_defpreset_t *defpreset, fluid_synth_t *synth, int c
 
                     inst_zone = voice_zone->inst_zone;
 
+                    /* with dynamic sample loading, the sample data may not have been read yet */
+                    if(!sample_is_loaded(inst_zone->sample))
+                    {
+                        continue;
+                    }
+
                     /* this is a good zone. allocate a new synthesis process and initialize it */
                     voice = fluid_synth_alloc_voice_LOCAL(synth, inst_zone->sample, chan, key, vel, &voice_zone->range);
 
@@ -2090,6 +2624,7 @@ fluid_sample_import_sfont(fluid_sample_t *sample, SFSample *sfsample, fluid_defs
     if(defsfont->dynamic_samples)
     {
         sample->notify = dynamic_samples_sample_notify;
+        sample->owner = defsfont;
     }
 
     if(fluid_sample_validate(sample, defsfont->samplesize) == FLUID_FAILED)
@@ -2105,9 +2640,20 @@ fluid_sample_import_sfont(fluid_sample_t *sample, SFSample *sfsample, fluid_defs
  * be unloaded straight away because it was still in use by a voice. */
 static int dynamic_samples_sample_notify(fluid_sample_t *sample, int reason)
 {
-    if(reason == FLUID_SAMPLE_DONE && sample->preset_count == 0)
+    fluid_defsfont_t *defsfont;
+
+    if(reason == FLUID_SAMPLE_DONE)
     {
-        unload_sample(sample);
+        defsfont = sample->owner;
+
+        fluid_mutex_lock(defsfont->sample_mutex);
+
+        if(sample->preset_count == 0)
+        {
+            release_sample(defsfont, sample);
+        }
+
+        fluid_mutex_unlock(defsfont->sample_mutex);
     }
 
     return FLUID_OK;
@@ -2123,6 +2669,14 @@ static int dynamic_samples_preset_notify(fluid_preset_t *preset, int reason, int
     {
         FLUID_LOG(FLUID_DBG, "Selected preset '%s' on channel %d", fluid_preset_get_name(preset), chan);
         defsfont = fluid_sfont_get_data(preset->sfont);
+
+        /* Leave reading the samples to fluid_synth_load_selected_samples() */
+        if(defsfont->deferred_samples)
+        {
+            select_preset_samples(defsfont, preset);
+            return FLUID_OK;
+        }
+
         return load_preset_samples(defsfont, preset);
     }
 
@@ -2145,10 +2699,27 @@ static int dynamic_samples_preset_notify(fluid_preset_t *preset, int reason, int
         return unpin_preset_samples(defsfont, preset);
     }
 
+    if(reason == FLUID_PRESET_HOLD)
+    {
+        defsfont = fluid_sfont_get_data(preset->sfont);
+        return hold_preset_samples(defsfont, preset);
+    }
+
+    if(reason == FLUID_PRESET_RELEASE)
+    {
+        defsfont = fluid_sfont_get_data(preset->sfont);
+        return release_preset_samples(defsfont, preset);
+    }
+
+    if(reason == FLUID_PRESET_LOAD_SAMPLES)
+    {
+        defsfont = fluid_sfont_get_data(preset->sfont);
+        return load_missing_samples(defsfont, preset);
+    }
+
     return FLUID_OK;
 }
 
-
 static int pin_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
 {
     fluid_defpreset_t *defpreset;
@@ -2195,20 +2766,70 @@ static int unpin_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *pres
 }
 
 
+/* Unlike pinning, holds are counted, so that a preset can be held for each of several
+ * pending selections. */
+static int hold_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
+{
+    fluid_defpreset_t *defpreset;
+
+    if(load_preset_samples(defsfont, preset) == FLUID_FAILED)
+    {
+        unload_preset_samples(defsfont, preset);
+        return FLUID_FAILED;
+    }
+
+    defpreset = fluid_preset_get_data(preset);
+    defpreset->hold_count++;
+
+    return FLUID_OK;
+}
+
+
+static int release_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
+{
+    fluid_defpreset_t *defpreset;
+
+    defpreset = fluid_preset_get_data(preset);
+    if (defpreset->hold_count == 0)
+    {
+        return FLUID_FAILED;
+    }
+
+    defpreset->hold_count--;
+
+    return unload_preset_samples(defsfont, preset);
+}
+
+
 /* Walk through all samples used by the passed in preset and make sure that the
  * sample data is loaded for each sample. Used by dynamic sample loading. */
 static int load_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
+{
+    if(select_preset_samples(defsfont, preset))
+    {
+        return load_missing_samples(defsfont, preset);
+    }
+
+    return FLUID_OK;
+}
+
+/* Count the passed in preset as a user of each of its samples, taking those still
+ * loaded back from the idle samples. Returns TRUE if any of the samples still needs
+ * its data read. Used by dynamic sample loading. */
+static int select_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
 {
     fluid_defpreset_t *defpreset;
     fluid_preset_zone_t *preset_zone;
     fluid_inst_t *inst;
     fluid_inst_zone_t *inst_zone;
     fluid_sample_t *sample;
-    SFData *sffile = NULL;
+    int missing = FALSE;
 
     defpreset = fluid_preset_get_data(preset);
     preset_zone = fluid_defpreset_get_zone(defpreset);
 
+    fluid_mutex_lock(defsfont->sample_mutex);
+
     while(preset_zone != NULL)
     {
         inst = fluid_preset_zone_get_inst(preset_zone);
@@ -2222,35 +2843,152 @@ static int load_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *prese
             {
                 sample->preset_count++;
 
-                /* If this is the first time this sample has been selected,
-                 * load the sampledata */
+                /* Still loaded from an earlier selection; take it back from the idle samples */
                 if(sample->preset_count == 1)
                 {
-                    /* Make sure we have an open Soundfont file. Do this here
-                     * to avoid having to open the file if no loading is necessary
-                     * for a preset */
-                    if(sffile == NULL)
-                    {
-                        sffile = fluid_sffile_open(defsfont->filename, defsfont->fcbs);
+                    reclaim_sample(defsfont, sample);
+                }
 
-                        if(sffile == NULL)
-                        {
-                            FLUID_LOG(FLUID_ERR, "Unable to open Soundfont file");
-                            return FLUID_FAILED;
-                        }
-                    }
+                if(sample->data == NULL)
+                {
+                    missing = TRUE;
+                }
+            }
+
+            inst_zone = fluid_inst_zone_next(inst_zone);
+        }
+
+        preset_zone = fluid_preset_zone_next(preset_zone);
+    }
+
+    fluid_mutex_unlock(defsfont->sample_mutex);
+
+    return missing;
+}
+
+/* Mark a sample as being read by the calling thread if a selected preset needs its data
+ * and no other thread is reading it already */
+static int claim_sample(fluid_defsfont_t *defsfont, fluid_sample_t *sample)
+{
+    int claimed;
+
+    fluid_mutex_lock(defsfont->sample_mutex);
+
+    claimed = sample->preset_count > 0 && sample->data == NULL && !sample->loading
+              && sample->start != sample->end;
+
+    if(claimed)
+    {
+        fluid_atomic_int_set(&sample->loading, TRUE);
+    }
+
+    fluid_mutex_unlock(defsfont->sample_mutex);
+
+    return claimed;
+}
+
+/* Hand the data read for a claimed sample over to the voices, or disable the sample if
+ * num_samples is negative because reading it failed */
+static void publish_sample(fluid_defsfont_t *defsfont, fluid_sample_t *sample,
+                           short *data, char *data24, int num_samples)
+{
+    fluid_mutex_lock(defsfont->sample_mutex);
+
+    if(num_samples < 0)
+    {
+        sample->start = sample->end = 0;
+    }
+    else
+    {
+        /* Still skipped by new voices until loading is cleared below */
+        fluid_atomic_pointer_set(&sample->data, data);
+        sample->data24 = data24;
+        set_individual_sample_range(sample, num_samples);
+        fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
+        fluid_voice_optimize_sample(sample);
+    }
+
+    fluid_atomic_int_set(&sample->loading, FALSE);
+
+    /* Unselected again while it was being read */
+    if(sample->preset_count == 0 && sample->refcount == 0)
+    {
+        release_sample(defsfont, sample);
+    }
+
+    fluid_mutex_unlock(defsfont->sample_mutex);
+}
+
+/* Read the data of each sample of the passed in preset that a selected preset needs but
+ * that isn't loaded yet. The file is read without holding the sample lock, so that the
+ * synthesis thread can carry on selecting presets and starting voices meanwhile; voices
+ * skip samples that are still being read. Used by dynamic sample loading. */
+static int load_missing_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
+{
+    fluid_defpreset_t *defpreset;
+    fluid_preset_zone_t *preset_zone;
+    fluid_inst_t *inst;
+    fluid_inst_zone_t *inst_zone;
+    fluid_sample_t *sample;
+    SFData *sffile = NULL;
+    short *data;
+    char *data24;
+    int num_samples;
+    int evicted;
+
+    defpreset = fluid_preset_get_data(preset);
+    preset_zone = fluid_defpreset_get_zone(defpreset);
+
+    while(preset_zone != NULL)
+    {
+        inst = fluid_preset_zone_get_inst(preset_zone);
+        inst_zone = fluid_inst_get_zone(inst);
+
+        while(inst_zone != NULL)
+        {
+            sample = fluid_inst_zone_get_sample(inst_zone);
+
+            if((sample != NULL) && claim_sample(defsfont, sample))
+            {
+                /* Make sure we have an open Soundfont file. Do this here
+                 * to avoid having to open the file if no loading is necessary
+                 * for a preset */
+                if(sffile == NULL)
+                {
+                    sffile = fluid_sffile_open(defsfont->filename, defsfont->fcbs);
 
-                    if(fluid_defsfont_load_sampledata(defsfont, sffile, sample) == FLUID_OK)
+                    if(sffile == NULL)
                     {
-                        fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
-                        fluid_voice_optimize_sample(sample);
+                        FLUID_LOG(FLUID_ERR, "Unable to open Soundfont file");
+                        fluid_atomic_int_set(&sample->loading, FALSE);
+                        return FLUID_FAILED;
                     }
-                    else
+                }
+
+                data = NULL;
+                data24 = NULL;
+                num_samples = read_sampledata(defsfont, sffile, sample, &data, &data24);
+
+                /* Probably out of memory; make room by dropping all idle samples and try again */
+                if(num_samples < 0)
+                {
+                    fluid_mutex_lock(defsfont->sample_mutex);
+                    evicted = defsfont->idle_head != NULL;
+                    evict_idle_samples(defsfont, 0);
+                    fluid_mutex_unlock(defsfont->sample_mutex);
+
+                    if(evicted)
                     {
-                        FLUID_LOG(FLUID_ERR, "Unable to load sample '%s', disabling", sample->name);
-                        sample->start = sample->end = 0;
+                        num_samples = read_sampledata(defsfont, sffile, sample, &data, &data24);
                     }
                 }
+
+                publish_sample(defsfont, sample, data, data24, num_samples);
+
+                if(num_samples < 0)
+                {
+                    FLUID_LOG(FLUID_ERR, "Unable to load sample '%s', disabling", sample->name);
+                }
             }
 
             inst_zone = fluid_inst_zone_next(inst_zone);
@@ -2281,6 +3019,8 @@ static int unload_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *pre
     defpreset = fluid_preset_get_data(preset);
     preset_zone = fluid_defpreset_get_zone(defpreset);
 
+    fluid_mutex_lock(defsfont->sample_mutex);
+
     while(preset_zone != NULL)
     {
         inst = fluid_preset_zone_get_inst(preset_zone);
@@ -2295,13 +3035,13 @@ static int unload_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *pre
                 sample->preset_count--;
 
                 /* If the sample is not used by any preset or used by a
-                 * sounding voice, unload it from the sample cache. If it's
+                 * sounding voice, release it to the idle samples. If it's
                  * still in use by a voice, dynamic_samples_sample_notify will
-                 * take care of unloading the sample as soon as the voice is
+                 * take care of releasing the sample as soon as the voice is
                  * finished with it (but only on the next API call). */
                 if(sample->preset_count == 0 && sample->refcount == 0)
                 {
-                    unload_sample(sample);
+                    release_sample(defsfont, sample);
                 }
             }
 
@@ -2311,6 +3051,8 @@ static int unload_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *pre
         preset_zone = fluid_preset_zone_next(preset_zone);
     }
 
+    fluid_mutex_unlock(defsfont->sample_mutex);
+
     return FLUID_OK;
 }
 
@@ -2335,6 +3077,96 @@ static void unload_sample(fluid_sample_t *sample)
     }
 }
 
+/* Size of the sample data held by a loaded sample */
+static size_t sample_data_size(fluid_sample_t *sample)
+{
+    size_t count = (size_t)sample->end + 1;
+
+    return count * sizeof(short) + (sample->data24 != NULL ? count : 0);
+}
+
+/* Keep the data of a sample no longer used by any preset or voice loaded, so that
+ * selecting the preset again doesn't have to read it from disk. The least recently
+ * released samples are unloaded once the idle samples exceed the cache budget. */
+static void release_sample(fluid_defsfont_t *defsfont, fluid_sample_t *sample)
+{
+    fluid_return_if_fail(defsfont != NULL);
+    fluid_return_if_fail(sample != NULL);
+
+    if(sample->data == NULL || sample->idle)
+    {
+        return;
+    }
+
+    if(defsfont->idle_budget == 0)
+    {
+        unload_sample(sample);
+        return;
+    }
+
+    sample->idle = TRUE;
+    sample->idle_prev = NULL;
+    sample->idle_next = defsfont->idle_head;
+
+    if(defsfont->idle_head != NULL)
+    {
+        defsfont->idle_head->idle_prev = sample;
+    }
+    else
+    {
+        defsfont->idle_tail = sample;
+    }
+
+    defsfont->idle_head = sample;
+    defsfont->idle_size += sample_data_size(sample);
+
+    evict_idle_samples(defsfont, defsfont->idle_budget);
+}
+
+/* Remove a sample from the idle samples because a selected preset uses it again */
+static void reclaim_sample(fluid_defsfont_t *defsfont, fluid_sample_t *sample)
+{
+    if(!sample->idle)
+    {
+        return;
+    }
+
+    if(sample->idle_prev != NULL)
+    {
+        sample->idle_prev->idle_next = sample->idle_next;
+    }
+    else
+    {
+        defsfont->idle_head = sample->idle_next;
+    }
+
+    if(sample->idle_next != NULL)
+    {
+        sample->idle_next->idle_prev = sample->idle_prev;
+    }
+    else
+    {
+        defsfont->idle_tail = sample->idle_prev;
+    }
+
+    sample->idle = FALSE;
+    sample->idle_prev = sample->idle_next = NULL;
+    defsfont->idle_size -= sample_data_size(sample);
+}
+
+/* Unload the least recently released idle samples until their data fits within limit bytes */
+static void evict_idle_samples(fluid_defsfont_t *defsfont, size_t limit)
+{
+    fluid_sample_t *sample;
+
+    while(defsfont->idle_size > limit && defsfont->idle_tail != NULL)
+    {
+        sample = defsfont->idle_tail;
+        reclaim_sample(defsfont, sample);
+        unload_sample(sample);
+    }
+}
+
 static fluid_inst_t *find_inst_by_idx(fluid_defsfont_t *defsfont, int idx)
 {
     fluid_list_t *list;
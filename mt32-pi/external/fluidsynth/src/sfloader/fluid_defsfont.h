@@ -103,6 +103,7 @@ int fluid_zone_inside_range(fluid_zone_range_t *zone_range, int key, int vel);
 struct _fluid_defsfont_t
 {
     const fluid_file_callbacks_t *fcbs; /* the file callbacks used to load this Soundfont */
+    const fluid_sfloader_t *loader; /* the loader, for its worker and progress callbacks; only valid while loading */
     char *filename;           /* the filename of this soundfont */
     unsigned int samplepos;   /* the position in the file at which the sample data starts */
     unsigned int samplesize;  /* the size of the sample data in bytes */
@@ -118,6 +119,13 @@ struct _fluid_defsfont_t
     fluid_list_t *inst;        /* the instruments of this soundfont */
     int mlock;                 /* Should we try memlock (avoid swapping)? */
     int dynamic_samples;       /* Enables dynamic sample loading if set */
+    int deferred_samples;      /* Selecting a preset doesn't read its sample data if set */
+    fluid_mutex_t sample_mutex; /* guards the sample counts and idle samples when using dynamic sample loading */
+
+    size_t idle_budget;        /* bytes of unused sample data to keep loaded when using dynamic sample loading */
+    size_t idle_size;          /* bytes of sample data held by the idle samples */
+    fluid_sample_t *idle_head; /* most recently released idle sample */
+    fluid_sample_t *idle_tail; /* least recently released idle sample; evicted first */
 
     fluid_list_t *preset_iter_cur;       /* the current preset in the iteration */
 };
@@ -149,6 +157,7 @@ struct _fluid_defpreset_t
     fluid_preset_zone_t *global_zone;        /* the global zone of the preset */
     fluid_preset_zone_t *zone;               /* the chained list of preset zones */
     int pinned;                           /* preset samples pinned to sample cache? */
+    int hold_count;                       /* number of holds on the preset samples */
 };
 
 fluid_defpreset_t *new_fluid_defpreset(void);
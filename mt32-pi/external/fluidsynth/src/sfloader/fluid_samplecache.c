@@ -60,10 +60,12 @@ static fluid_list_t *samplecache_list = NULL;
 static fluid_mutex_t samplecache_mutex = FLUID_MUTEX_INIT;
 
 static fluid_samplecache_entry_t *new_samplecache_entry(SFData *sf, unsigned int sample_start,
-        unsigned int sample_end, int sample_type, time_t mtime);
+        unsigned int sample_end, int sample_type, time_t mtime, short *sample_data, int sample_count);
 static fluid_samplecache_entry_t *get_samplecache_entry(SFData *sf, unsigned int sample_start,
         unsigned int sample_end, int sample_type, time_t mtime);
 static void delete_samplecache_entry(fluid_samplecache_entry_t *entry);
+static int reference_samplecache_entry(fluid_samplecache_entry_t *entry, int try_mlock,
+                                       short **sample_data, char **sample_data24);
 
 static int fluid_get_file_modification_time(char *filename, time_t *modification_time);
 
@@ -78,19 +80,20 @@ int fluid_samplecache_load(SFData *sf,
     int ret;
     time_t mtime;
 
-    fluid_mutex_lock(samplecache_mutex);
-
+    /* Outside the lock, as reading the file system may block */
     if(fluid_get_file_modification_time(sf->fname, &mtime) == FLUID_FAILED)
     {
         mtime = 0;
     }
 
+    fluid_mutex_lock(samplecache_mutex);
+
     entry = get_samplecache_entry(sf, sample_start, sample_end, sample_type, mtime);
 
     if(entry == NULL)
     {
         fluid_mutex_unlock(samplecache_mutex);
-        entry = new_samplecache_entry(sf, sample_start, sample_end, sample_type, mtime);
+        entry = new_samplecache_entry(sf, sample_start, sample_end, sample_type, mtime, NULL, 0);
 
         if(entry == NULL)
         {
@@ -103,36 +106,76 @@ int fluid_samplecache_load(SFData *sf,
     }
         fluid_mutex_unlock(samplecache_mutex);
 
-    if(try_mlock && !entry->mlocked)
+    ret = reference_samplecache_entry(entry, try_mlock, sample_data, sample_data24);
+
+unlock_exit:
+    return ret;
+}
+
+int fluid_samplecache_find(SFData *sf,
+                           unsigned int sample_start, unsigned int sample_end, int sample_type,
+                           int try_mlock, short **sample_data, char **sample_data24)
+{
+    fluid_samplecache_entry_t *entry;
+    time_t mtime;
+
+    /* Outside the lock, as reading the file system may block */
+    if(fluid_get_file_modification_time(sf->fname, &mtime) == FLUID_FAILED)
     {
-        /* Lock the memory to disable paging. It's okay if this fails. It
-         * probably means that the user doesn't have the required permission. */
-        if(fluid_mlock(entry->sample_data, entry->sample_count * sizeof(short)) == 0)
-        {
-            if(entry->sample_data24 != NULL)
-            {
-                entry->mlocked = (fluid_mlock(entry->sample_data24, entry->sample_count) == 0);
-            }
-            else
-            {
-                entry->mlocked = TRUE;
-            }
+        mtime = 0;
+    }
 
-            if(!entry->mlocked)
-            {
-                fluid_munlock(entry->sample_data, entry->sample_count * sizeof(short));
-                FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
-            }
-        }
+    fluid_mutex_lock(samplecache_mutex);
+
+    entry = get_samplecache_entry(sf, sample_start, sample_end, sample_type, mtime);
+    fluid_mutex_unlock(samplecache_mutex);
+
+    if(entry == NULL)
+    {
+        return -1;
     }
 
-    entry->num_references++;
-    *sample_data = entry->sample_data;
-    *sample_data24 = entry->sample_data24;
-    ret = entry->sample_count;
+    return reference_samplecache_entry(entry, try_mlock, sample_data, sample_data24);
+}
 
-unlock_exit:
-    return ret;
+int fluid_samplecache_add(SFData *sf,
+                          unsigned int sample_start, unsigned int sample_end, int sample_type,
+                          int try_mlock, short *data, int count, short **sample_data, char **sample_data24)
+{
+    fluid_samplecache_entry_t *entry;
+    time_t mtime;
+
+    /* Outside the lock, as reading the file system may block */
+    if(fluid_get_file_modification_time(sf->fname, &mtime) == FLUID_FAILED)
+    {
+        mtime = 0;
+    }
+
+    fluid_mutex_lock(samplecache_mutex);
+
+    entry = get_samplecache_entry(sf, sample_start, sample_end, sample_type, mtime);
+
+    if(entry != NULL)
+    {
+        /* Someone else has loaded the same sample in the meantime */
+        fluid_mutex_unlock(samplecache_mutex);
+        FLUID_FREE(data);
+        return reference_samplecache_entry(entry, try_mlock, sample_data, sample_data24);
+    }
+
+    fluid_mutex_unlock(samplecache_mutex);
+    entry = new_samplecache_entry(sf, sample_start, sample_end, sample_type, mtime, data, count);
+
+    if(entry == NULL)
+    {
+        return -1;
+    }
+
+    fluid_mutex_lock(samplecache_mutex);
+    samplecache_list = fluid_list_prepend(samplecache_list, entry);
+    fluid_mutex_unlock(samplecache_mutex);
+
+    return reference_samplecache_entry(entry, try_mlock, sample_data, sample_data24);
 }
 
 int fluid_samplecache_unload(const short *sample_data)
@@ -186,11 +229,46 @@ unlock_exit:
 
 
 /* Private functions */
+static int reference_samplecache_entry(fluid_samplecache_entry_t *entry, int try_mlock,
+                                       short **sample_data, char **sample_data24)
+{
+    if(try_mlock && !entry->mlocked)
+    {
+        /* Lock the memory to disable paging. It's okay if this fails. It
+         * probably means that the user doesn't have the required permission. */
+        if(fluid_mlock(entry->sample_data, entry->sample_count * sizeof(short)) == 0)
+        {
+            if(entry->sample_data24 != NULL)
+            {
+                entry->mlocked = (fluid_mlock(entry->sample_data24, entry->sample_count) == 0);
+            }
+            else
+            {
+                entry->mlocked = TRUE;
+            }
+
+            if(!entry->mlocked)
+            {
+                fluid_munlock(entry->sample_data, entry->sample_count * sizeof(short));
+                FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
+            }
+        }
+    }
+
+    entry->num_references++;
+    *sample_data = entry->sample_data;
+    *sample_data24 = entry->sample_data24;
+    return entry->sample_count;
+}
+
+/* Reads the sample from the file, unless its data is passed in (and then owned by the entry) */
 static fluid_samplecache_entry_t *new_samplecache_entry(SFData *sf,
         unsigned int sample_start,
         unsigned int sample_end,
         int sample_type,
-        time_t mtime)
+        time_t mtime,
+        short *sample_data,
+        int sample_count)
 {
     fluid_samplecache_entry_t *entry;
 
@@ -199,10 +277,12 @@ static fluid_samplecache_entry_t *new_samplecache_entry(SFData *sf,
     if(entry == NULL)
     {
         FLUID_LOG(FLUID_ERR, "Out of memory");
+        FLUID_FREE(sample_data);
         return NULL;
     }
 
     FLUID_MEMSET(entry, 0, sizeof(*entry));
+    entry->sample_data = sample_data;
 
     entry->filename = FLUID_STRDUP(sf->fname);
 
@@ -221,6 +301,12 @@ static fluid_samplecache_entry_t *new_samplecache_entry(SFData *sf,
     entry->sample_type = sample_type;
     entry->modification_time = mtime;
 
+    if(sample_data != NULL)
+    {
+        entry->sample_count = sample_count;
+        return entry;
+    }
+
     entry->sample_count = fluid_sffile_read_sample_data(sf, sample_start, sample_end, sample_type,
                           &entry->sample_data, &entry->sample_data24);
 
@@ -29,6 +29,15 @@ int fluid_samplecache_load(SFData *sf,
                            unsigned int sample_start, unsigned int sample_end, int sample_type,
                            int try_mlock, short **data, char **data24);
 
+/* For callers that decode samples themselves: find returns -1 if the sample isn't cached, in which
+ * case the decoded data can be handed over to the cache (which takes ownership of it) with add */
+int fluid_samplecache_find(SFData *sf,
+                           unsigned int sample_start, unsigned int sample_end, int sample_type,
+                           int try_mlock, short **data, char **data24);
+int fluid_samplecache_add(SFData *sf,
+                          unsigned int sample_start, unsigned int sample_end, int sample_type,
+                          int try_mlock, short *sample_data, int sample_count, short **data, char **data24);
+
 int fluid_samplecache_unload(const short *sample_data);
 
 /* Only used for tests */
@@ -28,6 +28,8 @@
 
 #if LIBSNDFILE_SUPPORT
 #include <sndfile.h>
+#else
+#include "fluid_vorbis.h"
 #endif
 
 #if LIBINSTPATCH_SUPPORT
@@ -151,6 +153,9 @@ static const unsigned short invalid_preset_gen[] =
 #define SF_IHDR_SIZE (22)
 #define SF_SHDR_SIZE (46)
 
+/* sample data is read in pieces of this size when progress is being reported */
+#define SAMPLE_READ_CHUNK_SIZE (256 * 1024)
+
 
 #define READCHUNK(sf, var)                                                  \
     do                                                                      \
@@ -678,21 +683,13 @@ static int process_info(SFData *sf, int size)
                 return FALSE;
             }
 
-            if(sf->version.major == 3)
-            {
-#if !LIBSNDFILE_SUPPORT
-                FLUID_LOG(FLUID_WARN,
-                          "Sound font version is %d.%d but fluidsynth was compiled without"
-                          " support for (v3.x)",
-                          sf->version.major, sf->version.minor);
-                return FALSE;
-#endif
-            }
-            else if(sf->version.major > 2)
+            /* Version 3 (Ogg Vorbis compressed samples) is decoded by libsndfile if available, or
+             * by the built-in decoder otherwise */
+            if(sf->version.major > 3)
             {
                 FLUID_LOG(FLUID_WARN,
                           "Sound font version is %d.%d which is newer than"
-                          " what this version of fluidsynth was designed for (v2.0x)",
+                          " what this version of fluidsynth was designed for (v2.0x and v3.0x)",
                           sf->version.major, sf->version.minor);
                 return FALSE;
             }
@@ -2203,15 +2200,64 @@ static int valid_preset_genid(unsigned short genid)
 }
 
 
+/* Reads sample data in chunks when a progress callback is set, so that the samples which are complete
+ * can be processed while the rest is still being read. frame_bytes is the number of bytes read per
+ * complete frame, or 0 if no frames are complete until a later read. */
+static int fluid_sffile_read_sample_chunks(SFData *sf, void *buf, unsigned int size,
+        short *data16, char *data24, unsigned int frame_bytes,
+        unsigned int bytes_before, unsigned int bytes_total)
+{
+    char *pos = buf;
+    unsigned int done = 0;
+
+    if(sf->sample_progress == NULL)
+    {
+        return sf->fcbs->fread(buf, size, sf->sffd);
+    }
+
+    while(done < size)
+    {
+        unsigned int count = size - done;
+
+        if(count > SAMPLE_READ_CHUNK_SIZE)
+        {
+            count = SAMPLE_READ_CHUNK_SIZE;
+        }
+
+        if(sf->fcbs->fread(pos + done, count, sf->sffd) == FLUID_FAILED)
+        {
+            return FLUID_FAILED;
+        }
+
+        done += count;
+        sf->sample_progress(sf->sample_progress_data, data16, data24,
+                            frame_bytes ? done / frame_bytes : 0,
+                            bytes_before + done, bytes_total);
+    }
+
+    return FLUID_OK;
+}
+
+/* Tells the progress callback that the buffers it has seen are about to be freed */
+static void fluid_sffile_abort_sample_progress(SFData *sf)
+{
+    if(sf->sample_progress != NULL)
+    {
+        sf->sample_progress(sf->sample_progress_data, NULL, NULL, 0, 0, 0);
+    }
+}
+
 static int fluid_sffile_read_wav(SFData *sf, unsigned int start, unsigned int end, short **data, char **data24)
 {
     short *loaded_data = NULL;
     char *loaded_data24 = NULL;
     unsigned int num_samples;
+    unsigned int bytes_total;
 
     fluid_return_val_if_fail((end + 1) > start , -1);
 
     num_samples = (end + 1) - start;
+    bytes_total = num_samples * sizeof(short) + (sf->sample24pos ? num_samples : 0);
 
     if((start * sizeof(short) > sf->samplesize) || (end * sizeof(short) > sf->samplesize))
     {
@@ -2234,7 +2280,10 @@ static int fluid_sffile_read_wav(SFData *sf, unsigned int start, unsigned int en
         goto error_exit;
     }
 
-    if(sf->fcbs->fread(loaded_data, num_samples * sizeof(short), sf->sffd) == FLUID_FAILED)
+    /* Frames aren't complete until their 24-bit part (or the byte swap below) is done */
+    if(fluid_sffile_read_sample_chunks(sf, loaded_data, num_samples * sizeof(short), loaded_data, NULL,
+                                       (sf->sample24pos || FLUID_IS_BIG_ENDIAN) ? 0 : sizeof(short),
+                                       0, bytes_total) == FLUID_FAILED)
     {
 #if FLUID_VERSION_CHECK(FLUIDSYNTH_VERSION_MAJOR, FLUIDSYNTH_VERSION_MINOR, FLUIDSYNTH_VERSION_MICRO) < FLUID_VERSION_CHECK(2,2,0)
         if((int)(num_samples * sizeof(short)) < 0)
@@ -2286,7 +2335,8 @@ static int fluid_sffile_read_wav(SFData *sf, unsigned int start, unsigned int en
             goto error24_exit;
         }
 
-        if(sf->fcbs->fread(loaded_data24, num_samples, sf->sffd) == FLUID_FAILED)
+        if(fluid_sffile_read_sample_chunks(sf, loaded_data24, num_samples, loaded_data, loaded_data24, 1,
+                                           num_samples * sizeof(short), bytes_total) == FLUID_FAILED)
         {
             FLUID_LOG(FLUID_ERR, "Failed to read 24-bit sample data");
             goto error24_exit;
@@ -2299,16 +2349,46 @@ static int fluid_sffile_read_wav(SFData *sf, unsigned int start, unsigned int en
 
 error24_exit:
     FLUID_LOG(FLUID_WARN, "Ignoring 24-bit sample data, sound quality might suffer");
+    fluid_sffile_abort_sample_progress(sf);
     FLUID_FREE(loaded_data24);
     *data24 = NULL;
     return num_samples;
 
 error_exit:
+    fluid_sffile_abort_sample_progress(sf);
     FLUID_FREE(loaded_data);
     FLUID_FREE(loaded_data24);
     return -1;
 }
 
+/* Reads the first size bytes of the sample data chunk of an SF3 file as they are, for decompressing
+ * the samples from memory. Progress is reported with frames counting bytes.
+ *
+ * @return FLUID_OK on success, otherwise FLUID_FAILED
+ */
+int fluid_sffile_read_compressed_data(SFData *sf, unsigned char *buf, unsigned int size)
+{
+    if(size > sf->samplesize)
+    {
+        FLUID_LOG(FLUID_ERR, "Compressed data size exceeds sample data chunk");
+        return FLUID_FAILED;
+    }
+
+    if(sf->fcbs->fseek(sf->sffd, sf->samplepos, SEEK_SET) == FLUID_FAILED)
+    {
+        FLUID_LOG(FLUID_ERR, "Failed to seek to sample position");
+        return FLUID_FAILED;
+    }
+
+    if(fluid_sffile_read_sample_chunks(sf, buf, size, NULL, NULL, 1, 0, size) == FLUID_FAILED)
+    {
+        FLUID_LOG(FLUID_ERR, "Failed to read compressed sample data");
+        return FLUID_FAILED;
+    }
+
+    return FLUID_OK;
+}
+
 
 /* Ogg Vorbis loading and decompression */
 #if LIBSNDFILE_SUPPORT
@@ -2520,8 +2600,63 @@ error_exit:
     return -1;
 }
 #else
+/*
+ * Read Ogg Vorbis compressed data from the Soundfont and decompress it with the built-in decoder.
+ *
+ * Like the libsndfile variant, this function takes byte indices for start and end source data.
+ */
 static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigned int end_byte, short **data)
 {
-    return -1;
+    fluid_vorbis_decoder_t *decoder = NULL;
+    unsigned char *stream = NULL;
+    unsigned int size;
+    int frames = -1;
+
+    if((start_byte > sf->samplesize) || (end_byte > sf->samplesize) || (end_byte < start_byte))
+    {
+        FLUID_LOG(FLUID_ERR, "Ogg Vorbis data offsets exceed sample data chunk");
+        return -1;
+    }
+
+    /* end_byte is inclusive, but may point just past the end of the chunk */
+    size = end_byte - start_byte + 1;
+
+    if(start_byte + size > sf->samplesize)
+    {
+        size = sf->samplesize - start_byte;
+    }
+
+    stream = FLUID_ARRAY(unsigned char, size);
+    decoder = new_fluid_vorbis_decoder();
+
+    if(stream == NULL || decoder == NULL)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        goto exit;
+    }
+
+    fluid_rec_mutex_lock(sf->mtx);
+
+    if(sf->fcbs->fseek(sf->sffd, sf->samplepos + start_byte, SEEK_SET) == FLUID_FAILED
+            || sf->fcbs->fread(stream, size, sf->sffd) == FLUID_FAILED)
+    {
+        fluid_rec_mutex_unlock(sf->mtx);
+        FLUID_LOG(FLUID_ERR, "Failed to read compressed sample data");
+        goto exit;
+    }
+
+    fluid_rec_mutex_unlock(sf->mtx);
+
+    frames = fluid_vorbis_decoder_decode(decoder, stream, size, data);
+
+    if(frames < 0)
+    {
+        FLUID_LOG(FLUID_ERR, "Failed to decode Ogg Vorbis sample");
+    }
+
+exit:
+    delete_fluid_vorbis_decoder(decoder);
+    FLUID_FREE(stream);
+    return frames;
 }
 #endif
@@ -46,6 +46,12 @@ typedef struct _SFPreset SFPreset;
 typedef struct _SFData SFData;
 typedef struct _SFChunk SFChunk;
 
+/* Called while sample data is read in chunks. frames is the number of frames from the start of
+ * the read whose data is complete (or bytes, for compressed data, where data16 and data24 are NULL).
+ * bytes_total is 0 if the read failed and the buffers are about to be freed. */
+typedef void (*fluid_sffile_progress_t)(void *data, short *data16, char *data24,
+                                        unsigned int frames, unsigned int bytes_read, unsigned int bytes_total);
+
 
 struct _SFVersion
 {
@@ -158,6 +164,9 @@ struct _SFData
     fluid_list_t *preset; /* linked list of preset info */
     fluid_list_t *inst; /* linked list of instrument info */
     fluid_list_t *sample; /* linked list of sample info */
+
+    fluid_sffile_progress_t sample_progress; /* optional progress callback for sample data reads */
+    void *sample_progress_data;
 };
 
 /* functions */
@@ -182,6 +191,7 @@ void fluid_sffile_close(SFData *sf);
 int fluid_sffile_parse_presets(SFData *sf);
 int fluid_sffile_read_sample_data(SFData *sf, unsigned int sample_start, unsigned int sample_end,
                                   int sample_type, short **data, char **data24);
+int fluid_sffile_read_compressed_data(SFData *sf, unsigned char *buf, unsigned int size);
 
 
 /* extern only for unit test purposes */
@@ -141,6 +141,66 @@ void delete_fluid_sfloader(fluid_sfloader_t *loader)
     FLUID_FREE(loader);
 }
 
+/**
+ * Load a SoundFont without adding it to a synth.
+ *
+ * @param loader The SoundFont loader instance.
+ * @param filename File name of the SoundFont to load.
+ * @return The SoundFont instance on success, NULL otherwise.
+ *
+ * The SoundFont can be handed to a synth later with fluid_synth_sfload_sfont(), which
+ * takes ownership of it. The loader must outlive the SoundFont.
+ */
+fluid_sfont_t *fluid_sfloader_load_sfont(fluid_sfloader_t *loader, const char *filename)
+{
+    fluid_return_val_if_fail(loader != NULL, NULL);
+    fluid_return_val_if_fail(filename != NULL, NULL);
+
+    return fluid_sfloader_load(loader, filename);
+}
+
+/**
+ * Share the processing of sample data with an external worker while loading.
+ *
+ * @param loader The SoundFont loader instance.
+ * @param kick Called when a job is available; the worker should call
+ *   fluid_sfloader_load_worker_process() with it until that returns FALSE.
+ * @param wait Called once the loader no longer needs the worker for the job.
+ * @param data User defined data pointer passed to the callbacks.
+ *
+ * Samples are processed by the worker as soon as their data has been read, so that
+ * reading the file and processing the samples overlap. Passing NULL callbacks disables
+ * the worker.
+ */
+void fluid_sfloader_set_load_worker(fluid_sfloader_t *loader,
+                                    fluid_sfloader_worker_func_t kick,
+                                    fluid_sfloader_worker_func_t wait,
+                                    void *data)
+{
+    fluid_return_if_fail(loader != NULL);
+
+    loader->worker_kick = kick;
+    loader->worker_wait = wait;
+    loader->worker_data = data;
+}
+
+/**
+ * Report the progress of sample data loading.
+ *
+ * @param loader The SoundFont loader instance.
+ * @param progress Called from the loading thread whenever the percentage changes.
+ * @param data User defined data pointer passed to the callback.
+ */
+void fluid_sfloader_set_progress_callback(fluid_sfloader_t *loader,
+        fluid_sfloader_progress_func_t progress,
+        void *data)
+{
+    fluid_return_if_fail(loader != NULL);
+
+    loader->progress = progress;
+    loader->progress_data = data;
+}
+
 /**
  * Specify private data to be used by #fluid_sfloader_load_t.
  *
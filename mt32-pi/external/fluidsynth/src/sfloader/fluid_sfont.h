@@ -82,6 +82,14 @@ struct _fluid_sfloader_t
     fluid_sfloader_free_t free;
 
     fluid_sfloader_load_t load;
+
+    /* Optional worker that processes sample data while the rest is still being read */
+    fluid_sfloader_worker_func_t worker_kick;
+    fluid_sfloader_worker_func_t worker_wait;
+    void *worker_data;
+
+    fluid_sfloader_progress_func_t progress;
+    void *progress_data;
 };
 
 /**
@@ -176,6 +184,13 @@ struct _fluid_sample_t
     unsigned int refcount;        /**< Count of voices using this sample */
     int preset_count;             /**< Count of selected presets using this sample (used for dynamic sample loading) */
 
+    /* Used by dynamic sample loading to keep the data of unused samples loaded until the cache budget is exceeded */
+    void *owner;                  /**< SoundFont that loaded this sample */
+    int idle;                     /**< TRUE if this sample is in its owner's list of idle samples */
+    fluid_sample_t *idle_prev;    /**< More recently released idle sample */
+    fluid_sample_t *idle_next;    /**< Less recently released idle sample */
+    int loading;                  /**< TRUE while the sample data is being read; voices must not use it yet (atomic) */
+
     /**
      * Implement this function to receive notification when sample is no longer used.
      * @param sample Virtual SoundFont sample
@@ -0,0 +1,2014 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Ogg Vorbis decoder, written from the Vorbis I specification
+ * (https://xiph.org/vorbis/doc/Vorbis_I_spec.html); section numbers below refer to it.
+ */
+
+#include "fluid_vorbis.h"
+#include "fluid_sys.h"
+
+#define VORBIS_MIN_BLOCKSIZE_LOG2   6
+#define VORBIS_MAX_BLOCKSIZE_LOG2   13
+#define VORBIS_FAST_BITS            10
+#define VORBIS_FLOOR1_MAX_VALUES    65
+#define VORBIS_MAX_CLASSIFICATIONS  64
+
+typedef struct
+{
+    int dimensions;
+    int entries;
+    unsigned char *lengths;     /* codeword length of each entry, 0 if unused */
+    int *fast;                  /* entry for each VORBIS_FAST_BITS bit pattern, or -1 */
+    uint32_t *long_codes;       /* longer codewords, first bit in bit 31, sorted */
+    int *long_entries;
+    int long_count;
+    int single_entry;           /* the only used entry, or -1 */
+    float *values;              /* vector of each entry, if the codebook has a lookup table */
+} vorbis_codebook_t;
+
+typedef struct
+{
+    int partitions;
+    unsigned char partition_class[31];
+    unsigned char class_dimensions[16];
+    unsigned char class_subclasses[16];
+    unsigned char class_masterbook[16];
+    short subclass_books[16][8];
+    int multiplier;
+    int values;
+    int x[VORBIS_FLOOR1_MAX_VALUES];
+    unsigned char sorted[VORBIS_FLOOR1_MAX_VALUES];
+    unsigned char low_neighbor[VORBIS_FLOOR1_MAX_VALUES];
+    unsigned char high_neighbor[VORBIS_FLOOR1_MAX_VALUES];
+} vorbis_floor_t;
+
+typedef struct
+{
+    int type;
+    unsigned int begin;
+    unsigned int end;
+    unsigned int partition_size;
+    int classifications;
+    int classbook;
+    short books[VORBIS_MAX_CLASSIFICATIONS][8];
+} vorbis_residue_t;
+
+typedef struct
+{
+    int submap;                 /* submap of our only channel */
+    unsigned char submap_floor[16];
+    unsigned char submap_residue[16];
+} vorbis_mapping_t;
+
+typedef struct
+{
+    int blockflag;
+    int mapping;
+} vorbis_mode_t;
+
+/* Tables for an inverse MDCT of n points, computed with an FFT of n/4 points */
+typedef struct
+{
+    int n;
+    float *twiddle;             /* exp(-i*pi*(k + 1/8) / (n/2)) for k < n/4 */
+    float *fft_twiddle;         /* exp(-2*i*pi*k / (n/4)) for k < n/8 */
+    unsigned short *bit_reverse;
+    float *window;              /* rising half of the window, n/2 points */
+} vorbis_mdct_t;
+
+typedef struct
+{
+    /* Setup header and parameters from the identification header; a stream with the same ones
+     * can reuse the setup */
+    unsigned char *packet;
+    unsigned int packet_size;
+    int blocksize[2];
+
+    int codebook_count;
+    vorbis_codebook_t *codebooks;
+    int floor_count;
+    vorbis_floor_t *floors;
+    int residue_count;
+    vorbis_residue_t *residues;
+    int mapping_count;
+    vorbis_mapping_t *mappings;
+    int mode_count;
+    vorbis_mode_t modes[64];
+
+    vorbis_mdct_t mdct[2];
+} vorbis_setup_t;
+
+struct _fluid_vorbis_decoder_t
+{
+    vorbis_setup_t *setup;
+
+    unsigned char *packet;
+    unsigned int packet_capacity;
+
+    /* Work buffers, sized for the long blocks of the current setup */
+    float *residue;
+    float *block;
+    float *fft;
+    float *previous;
+    int *classifications;
+    int buffer_blocksize;
+};
+
+/* Reads a packet LSB first (section 2) */
+typedef struct
+{
+    const unsigned char *data;
+    const unsigned char *end;
+    uint64_t acc;
+    int valid;
+    int eop;
+} vorbis_bits_t;
+
+typedef struct
+{
+    const unsigned char *data;
+    const unsigned char *end;
+    unsigned int segment;
+    unsigned int segments;
+    const unsigned char *lacing;
+    const unsigned char *payload;
+} vorbis_ogg_t;
+
+static float floor1_inverse_db[256];
+static int floor1_inverse_db_ready = FALSE;
+
+static void delete_vorbis_setup(vorbis_setup_t *setup);
+
+
+/* Bit reading */
+
+static void bits_init(vorbis_bits_t *bits, const unsigned char *data, unsigned int size)
+{
+    bits->data = data;
+    bits->end = data + size;
+    bits->acc = 0;
+    bits->valid = 0;
+    bits->eop = FALSE;
+}
+
+static void bits_fill(vorbis_bits_t *bits)
+{
+    while(bits->valid <= 56 && bits->data < bits->end)
+    {
+        bits->acc |= (uint64_t)*bits->data++ << bits->valid;
+        bits->valid += 8;
+    }
+}
+
+/* Reads up to 32 bits; reading past the end of the packet returns 0 and sets eop */
+static uint32_t bits_read(vorbis_bits_t *bits, int count)
+{
+    uint32_t value;
+
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    if(bits->valid < count)
+    {
+        bits_fill(bits);
+
+        if(bits->valid < count)
+        {
+            bits->eop = TRUE;
+            bits->acc = 0;
+            bits->valid = 0;
+            return 0;
+        }
+    }
+
+    value = (uint32_t)(bits->acc & ((((uint64_t)1) << count) - 1));
+    bits->acc >>= count;
+    bits->valid -= count;
+
+    return value;
+}
+
+static int ilog(uint32_t value)
+{
+    int bits = 0;
+
+    while(value)
+    {
+        bits++;
+        value >>= 1;
+    }
+
+    return bits;
+}
+
+static uint32_t bit_reverse(uint32_t n)
+{
+    n = ((n & 0xAAAAAAAA) >> 1) | ((n & 0x55555555) << 1);
+    n = ((n & 0xCCCCCCCC) >> 2) | ((n & 0x33333333) << 2);
+    n = ((n & 0xF0F0F0F0) >> 4) | ((n & 0x0F0F0F0F) << 4);
+    n = ((n & 0xFF00FF00) >> 8) | ((n & 0x00FF00FF) << 8);
+    return (n >> 16) | (n << 16);
+}
+
+/* Section 9.2.2 */
+static float float32_unpack(uint32_t x)
+{
+    float mantissa = (float)(x & 0x1FFFFF);
+    int exponent = (int)((x & 0x7FE00000) >> 21);
+
+    if(x & 0x80000000)
+    {
+        mantissa = -mantissa;
+    }
+
+    return (float)ldexp(mantissa, exponent - 788);
+}
+
+/* Section 9.2.3: the largest r such that r^dimensions <= entries */
+static int lookup1_values(int entries, int dimensions)
+{
+    int r = (int)floor(exp(log((double)entries) / dimensions));
+    int i;
+    double power;
+
+    /* Correct rounding errors in either direction */
+    for(;;)
+    {
+        for(power = 1, i = 0; i < dimensions; i++)
+        {
+            power *= r + 1;
+        }
+
+        if(power > entries)
+        {
+            break;
+        }
+
+        r++;
+    }
+
+    for(;;)
+    {
+        for(power = 1, i = 0; i < dimensions; i++)
+        {
+            power *= r;
+        }
+
+        if(power <= entries || r == 0)
+        {
+            break;
+        }
+
+        r--;
+    }
+
+    return r;
+}
+
+
+/* Codebooks (section 3) */
+
+/* Sorts codeword/entry pairs by codeword */
+static int compare_long_codes(const void *a, const void *b)
+{
+    uint64_t code_a = *(const uint64_t *)a;
+    uint64_t code_b = *(const uint64_t *)b;
+
+    return (code_a > code_b) - (code_a < code_b);
+}
+
+/* Assigns codewords in entry order, each the lowest one that is still available (section 3.2.1) */
+static int codebook_build(vorbis_codebook_t *book)
+{
+    uint32_t available[33];
+    uint32_t code;
+    uint64_t *pairs = NULL;
+    int used = 0, i, j, length, z;
+
+    FLUID_MEMSET(available, 0, sizeof(available));
+
+    book->fast = FLUID_ARRAY(int, 1 << VORBIS_FAST_BITS);
+
+    if(book->fast == NULL)
+    {
+        return FALSE;
+    }
+
+    for(i = 0; i < (1 << VORBIS_FAST_BITS); i++)
+    {
+        book->fast[i] = -1;
+    }
+
+    book->single_entry = -1;
+
+    for(i = 0; i < book->entries; i++)
+    {
+        if(book->lengths[i])
+        {
+            used++;
+            book->single_entry = i;
+        }
+    }
+
+    /* A single entry decodes without looking at its bits, like libvorbis does */
+    if(used <= 1)
+    {
+        return TRUE;
+    }
+
+    book->single_entry = -1;
+    pairs = FLUID_ARRAY(uint64_t, used);
+
+    if(pairs == NULL)
+    {
+        return FALSE;
+    }
+
+    for(i = 0, used = 0; i < book->entries; i++)
+    {
+        length = book->lengths[i];
+
+        if(!length)
+        {
+            continue;
+        }
+
+        if(used == 0)
+        {
+            code = 0;
+
+            for(j = 1; j <= length; j++)
+            {
+                available[j] = 1U << (32 - j);
+            }
+        }
+        else
+        {
+            for(z = length; z > 0 && !available[z]; z--)
+            {
+            }
+
+            /* Overspecified tree */
+            if(z == 0)
+            {
+                FLUID_FREE(pairs);
+                return FALSE;
+            }
+
+            code = available[z];
+            available[z] = 0;
+
+            for(j = length; j > z; j--)
+            {
+                available[j] = code + (1U << (32 - j));
+            }
+        }
+
+        used++;
+
+        if(length <= VORBIS_FAST_BITS)
+        {
+            /* The packet is read LSB first, so the table is indexed by the reversed codeword */
+            uint32_t reversed = bit_reverse(code);
+
+            for(j = reversed; j < (1 << VORBIS_FAST_BITS); j += 1 << length)
+            {
+                book->fast[j] = i;
+            }
+        }
+        else
+        {
+            pairs[book->long_count++] = ((uint64_t)code << 32) | (uint32_t)i;
+        }
+    }
+
+    if(book->long_count)
+    {
+        book->long_codes = FLUID_ARRAY(uint32_t, book->long_count);
+        book->long_entries = FLUID_ARRAY(int, book->long_count);
+
+        if(book->long_codes == NULL || book->long_entries == NULL)
+        {
+            FLUID_FREE(pairs);
+            return FALSE;
+        }
+
+        qsort(pairs, book->long_count, sizeof(*pairs), compare_long_codes);
+
+        for(i = 0; i < book->long_count; i++)
+        {
+            book->long_codes[i] = (uint32_t)(pairs[i] >> 32);
+            book->long_entries[i] = (int)(uint32_t)pairs[i];
+        }
+    }
+
+    FLUID_FREE(pairs);
+    return TRUE;
+}
+
+static int codebook_decode(const vorbis_codebook_t *book, vorbis_bits_t *bits)
+{
+    int entry, length, low, high, middle;
+    uint32_t key, code;
+
+    if(bits->valid < 32)
+    {
+        bits_fill(bits);
+    }
+
+    if(book->single_entry >= 0)
+    {
+        bits_read(bits, book->lengths[book->single_entry]);
+        return bits->eop ? -1 : book->single_entry;
+    }
+
+    entry = book->fast[bits->acc & ((1 << VORBIS_FAST_BITS) - 1)];
+
+    if(entry < 0)
+    {
+        /* Find the last long codeword that is <= the next 32 bits, then check its prefix */
+        if(book->long_count == 0)
+        {
+            bits->eop = TRUE;
+            return -1;
+        }
+
+        key = bit_reverse((uint32_t)bits->acc);
+        low = 0;
+        high = book->long_count;
+
+        while(high - low > 1)
+        {
+            middle = (low + high) / 2;
+
+            if(book->long_codes[middle] <= key)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        code = book->long_codes[low];
+        entry = book->long_entries[low];
+        length = book->lengths[entry];
+
+        if(((key ^ code) >> (32 - length)) != 0)
+        {
+            bits->eop = TRUE;
+            return -1;
+        }
+    }
+
+    length = book->lengths[entry];
+
+    if(length > bits->valid)
+    {
+        bits->eop = TRUE;
+        bits->acc = 0;
+        bits->valid = 0;
+        return -1;
+    }
+
+    bits->acc >>= length;
+    bits->valid -= length;
+
+    return entry;
+}
+
+static int codebook_parse(vorbis_codebook_t *book, vorbis_bits_t *bits)
+{
+    int ordered, sparse, lookup_type, value_bits, sequence_p, lookup_values;
+    int i, j, current_length, number;
+    uint32_t *multiplicands = NULL;
+    float minimum, delta, last;
+
+    if(bits_read(bits, 24) != 0x564342)
+    {
+        return FALSE;
+    }
+
+    book->dimensions = bits_read(bits, 16);
+    book->entries = bits_read(bits, 24);
+    ordered = bits_read(bits, 1);
+
+    if(bits->eop || book->dimensions == 0 || book->entries == 0)
+    {
+        return FALSE;
+    }
+
+    book->lengths = FLUID_ARRAY(unsigned char, book->entries);
+
+    if(book->lengths == NULL)
+    {
+        return FALSE;
+    }
+
+    if(!ordered)
+    {
+        sparse = bits_read(bits, 1);
+
+        for(i = 0; i < book->entries; i++)
+        {
+            if(sparse && !bits_read(bits, 1))
+            {
+                book->lengths[i] = 0;
+            }
+            else
+            {
+                book->lengths[i] = bits_read(bits, 5) + 1;
+            }
+        }
+    }
+    else
+    {
+        current_length = bits_read(bits, 5) + 1;
+
+        for(i = 0; i < book->entries; current_length++)
+        {
+            number = bits_read(bits, ilog(book->entries - i));
+
+            if(current_length > 32 || number > book->entries - i)
+            {
+                return FALSE;
+            }
+
+            for(j = 0; j < number; j++)
+            {
+                book->lengths[i++] = current_length;
+            }
+
+            if(bits->eop)
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    if(bits->eop || !codebook_build(book))
+    {
+        return FALSE;
+    }
+
+    lookup_type = bits_read(bits, 4);
+
+    if(lookup_type == 0)
+    {
+        return !bits->eop;
+    }
+
+    if(lookup_type > 2)
+    {
+        return FALSE;
+    }
+
+    minimum = float32_unpack(bits_read(bits, 32));
+    delta = float32_unpack(bits_read(bits, 32));
+    value_bits = bits_read(bits, 4) + 1;
+    sequence_p = bits_read(bits, 1);
+
+    if(lookup_type == 1)
+    {
+        lookup_values = lookup1_values(book->entries, book->dimensions);
+    }
+    else
+    {
+        lookup_values = book->entries * book->dimensions;
+    }
+
+    multiplicands = FLUID_ARRAY(uint32_t, lookup_values);
+    book->values = FLUID_ARRAY(float, book->entries * book->dimensions);
+
+    if(multiplicands == NULL || book->values == NULL || lookup_values <= 0)
+    {
+        FLUID_FREE(multiplicands);
+        return FALSE;
+    }
+
+    for(i = 0; i < lookup_values; i++)
+    {
+        multiplicands[i] = bits_read(bits, value_bits);
+    }
+
+    /* Unpack the vector of every entry up front (section 3.2.1, VQ lookup table vector representation) */
+    for(i = 0; i < book->entries; i++)
+    {
+        int index_divisor = 1;
+        float *vector = book->values + i * book->dimensions;
+
+        last = 0;
+
+        for(j = 0; j < book->dimensions; j++)
+        {
+            int offset;
+
+            if(lookup_type == 1)
+            {
+                offset = (i / index_divisor) % lookup_values;
+                index_divisor *= lookup_values;
+            }
+            else
+            {
+                offset = i * book->dimensions + j;
+            }
+
+            vector[j] = multiplicands[offset] * delta + minimum + last;
+
+            if(sequence_p)
+            {
+                last = vector[j];
+            }
+        }
+    }
+
+    FLUID_FREE(multiplicands);
+    return !bits->eop;
+}
+
+
+/* Floors (section 7) */
+
+static int floor_parse(vorbis_floor_t *floor, vorbis_bits_t *bits, int codebook_count)
+{
+    int max_class = -1, rangebits, i, j, k, cls;
+
+    /* Floor type 0 is not produced by any encoder in use */
+    if(bits_read(bits, 16) != 1)
+    {
+        return FALSE;
+    }
+
+    floor->partitions = bits_read(bits, 5);
+
+    for(i = 0; i < floor->partitions; i++)
+    {
+        floor->partition_class[i] = bits_read(bits, 4);
+
+        if(floor->partition_class[i] > max_class)
+        {
+            max_class = floor->partition_class[i];
+        }
+    }
+
+    for(i = 0; i <= max_class; i++)
+    {
+        floor->class_dimensions[i] = bits_read(bits, 3) + 1;
+        floor->class_subclasses[i] = bits_read(bits, 2);
+
+        if(floor->class_subclasses[i])
+        {
+            floor->class_masterbook[i] = bits_read(bits, 8);
+
+            if(floor->class_masterbook[i] >= codebook_count)
+            {
+                return FALSE;
+            }
+        }
+
+        for(j = 0; j < (1 << floor->class_subclasses[i]); j++)
+        {
+            floor->subclass_books[i][j] = (short)bits_read(bits, 8) - 1;
+
+            if(floor->subclass_books[i][j] >= codebook_count)
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    floor->multiplier = bits_read(bits, 2) + 1;
+    rangebits = bits_read(bits, 4);
+    floor->x[0] = 0;
+    floor->x[1] = 1 << rangebits;
+    floor->values = 2;
+
+    for(i = 0; i < floor->partitions; i++)
+    {
+        cls = floor->partition_class[i];
+
+        for(j = 0; j < floor->class_dimensions[cls]; j++)
+        {
+            if(floor->values == VORBIS_FLOOR1_MAX_VALUES)
+            {
+                return FALSE;
+            }
+
+            floor->x[floor->values++] = bits_read(bits, rangebits);
+        }
+    }
+
+    /* Rendering order and neighbours for curve synthesis (section 7.2.4) */
+    for(i = 0; i < floor->values; i++)
+    {
+        floor->sorted[i] = i;
+    }
+
+    for(i = 1; i < floor->values; i++)
+    {
+        for(j = i; j > 0 && floor->x[floor->sorted[j - 1]] > floor->x[floor->sorted[j]]; j--)
+        {
+            unsigned char swap = floor->sorted[j];
+            floor->sorted[j] = floor->sorted[j - 1];
+            floor->sorted[j - 1] = swap;
+        }
+    }
+
+    /* X values must be unique; curve synthesis divides by the distance between neighbours */
+    for(i = 1; i < floor->values; i++)
+    {
+        if(floor->x[floor->sorted[i - 1]] == floor->x[floor->sorted[i]])
+        {
+            return FALSE;
+        }
+    }
+
+    for(i = 2; i < floor->values; i++)
+    {
+        int low = 0, high = 1;
+
+        for(k = 0; k < i; k++)
+        {
+            if(floor->x[k] < floor->x[i] && floor->x[k] > floor->x[low])
+            {
+                low = k;
+            }
+
+            if(floor->x[k] > floor->x[i] && floor->x[k] < floor->x[high])
+            {
+                high = k;
+            }
+        }
+
+        floor->low_neighbor[i] = low;
+        floor->high_neighbor[i] = high;
+    }
+
+    return !bits->eop;
+}
+
+static int render_point(int x0, int y0, int x1, int y1, int x)
+{
+    int dy = y1 - y0;
+    int adx = x1 - x0;
+    int offset = (dy < 0 ? -dy : dy) * (x - x0) / adx;
+
+    return dy < 0 ? y0 - offset : y0 + offset;
+}
+
+/* Multiplies the residue by the floor curve along a line, from x0 up to (not including) x1 */
+static void render_line(float *residue, int n, int x0, int y0, int x1, int y1)
+{
+    int dy = y1 - y0;
+    int adx = x1 - x0;
+    int ady = dy < 0 ? -dy : dy;
+    int base = dy / adx;
+    int sy = dy < 0 ? base - 1 : base + 1;
+    int x = x0, y = y0, err = 0;
+
+    ady -= (base < 0 ? -base : base) * adx;
+
+    if(x1 > n)
+    {
+        x1 = n;
+    }
+
+    if(x < x1)
+    {
+        residue[x] *= floor1_inverse_db[y & 255];
+    }
+
+    for(x++; x < x1; x++)
+    {
+        err += ady;
+
+        if(err >= adx)
+        {
+            err -= adx;
+            y += sy;
+        }
+        else
+        {
+            y += base;
+        }
+
+        residue[x] *= floor1_inverse_db[y & 255];
+    }
+}
+
+/* Reads the floor of a packet (section 7.2.3). Returns FALSE if the channel is unused. */
+static int floor_decode(const vorbis_setup_t *setup, const vorbis_floor_t *floor, vorbis_bits_t *bits, int *y)
+{
+    static const int ranges[4] = { 256, 128, 86, 64 };
+    int range_bits = ilog(ranges[floor->multiplier - 1] - 1);
+    int offset = 2, i, j, cls, cdim, cbits, csub, cval, book;
+
+    if(!bits_read(bits, 1))
+    {
+        return FALSE;
+    }
+
+    y[0] = bits_read(bits, range_bits);
+    y[1] = bits_read(bits, range_bits);
+
+    for(i = 0; i < floor->partitions; i++)
+    {
+        cls = floor->partition_class[i];
+        cdim = floor->class_dimensions[cls];
+        cbits = floor->class_subclasses[cls];
+        csub = (1 << cbits) - 1;
+        cval = 0;
+
+        if(cbits)
+        {
+            cval = codebook_decode(&setup->codebooks[floor->class_masterbook[cls]], bits);
+        }
+
+        for(j = 0; j < cdim; j++)
+        {
+            book = floor->subclass_books[cls][cval & csub];
+            cval >>= cbits;
+
+            if(book >= 0)
+            {
+                y[offset + j] = codebook_decode(&setup->codebooks[book], bits);
+            }
+            else
+            {
+                y[offset + j] = 0;
+            }
+        }
+
+        offset += cdim;
+    }
+
+    /* Running out of packet here means the channel is unused */
+    return !bits->eop;
+}
+
+/* Computes the floor curve and applies it to the residue (sections 7.2.4 and 8.2) */
+static void floor_apply(const vorbis_floor_t *floor, const int *y, float *residue, int n)
+{
+    static const int ranges[4] = { 256, 128, 86, 64 };
+    int range = ranges[floor->multiplier - 1];
+    int final_y[VORBIS_FLOOR1_MAX_VALUES];
+    unsigned char step2[VORBIS_FLOOR1_MAX_VALUES];
+    int i, low, high, predicted, value, highroom, lowroom, room;
+    int lx, ly, hx, hy;
+
+    final_y[0] = y[0];
+    final_y[1] = y[1];
+    step2[0] = step2[1] = TRUE;
+
+    for(i = 2; i < floor->values; i++)
+    {
+        low = floor->low_neighbor[i];
+        high = floor->high_neighbor[i];
+        predicted = render_point(floor->x[low], final_y[low], floor->x[high], final_y[high], floor->x[i]);
+        value = y[i];
+        highroom = range - predicted;
+        lowroom = predicted;
+        room = (highroom < lowroom ? highroom : lowroom) * 2;
+
+        if(value)
+        {
+            step2[low] = step2[high] = step2[i] = TRUE;
+
+            if(value >= room)
+            {
+                final_y[i] = highroom > lowroom ? value - lowroom + predicted : predicted - value + highroom - 1;
+            }
+            else
+            {
+                final_y[i] = (value & 1) ? predicted - (value + 1) / 2 : predicted + value / 2;
+            }
+        }
+        else
+        {
+            step2[i] = FALSE;
+            final_y[i] = predicted;
+        }
+    }
+
+    lx = 0;
+    ly = final_y[floor->sorted[0]] * floor->multiplier;
+    hx = 0;
+    hy = ly;
+
+    for(i = 1; i < floor->values; i++)
+    {
+        int index = floor->sorted[i];
+
+        if(step2[index])
+        {
+            hy = final_y[index] * floor->multiplier;
+            hx = floor->x[index];
+            render_line(residue, n, lx, ly, hx, hy);
+            lx = hx;
+            ly = hy;
+        }
+    }
+
+    if(hx < n)
+    {
+        render_line(residue, n, hx, hy, n, hy);
+    }
+}
+
+
+/* Residues (section 8) */
+
+static int residue_parse(vorbis_residue_t *residue, vorbis_bits_t *bits, int codebook_count)
+{
+    int cascade[VORBIS_MAX_CLASSIFICATIONS];
+    int i, j;
+
+    residue->type = bits_read(bits, 16);
+    residue->begin = bits_read(bits, 24);
+    residue->end = bits_read(bits, 24);
+    residue->partition_size = bits_read(bits, 24) + 1;
+    residue->classifications = bits_read(bits, 6) + 1;
+    residue->classbook = bits_read(bits, 8);
+
+    if(residue->type > 2 || residue->classbook >= codebook_count)
+    {
+        return FALSE;
+    }
+
+    for(i = 0; i < residue->classifications; i++)
+    {
+        int high_bits = 0;
+        int low_bits = bits_read(bits, 3);
+
+        if(bits_read(bits, 1))
+        {
+            high_bits = bits_read(bits, 5);
+        }
+
+        cascade[i] = high_bits * 8 + low_bits;
+    }
+
+    for(i = 0; i < residue->classifications; i++)
+    {
+        for(j = 0; j < 8; j++)
+        {
+            residue->books[i][j] = -1;
+
+            if(cascade[i] & (1 << j))
+            {
+                residue->books[i][j] = bits_read(bits, 8);
+
+                if(residue->books[i][j] >= codebook_count)
+                {
+                    return FALSE;
+                }
+            }
+        }
+    }
+
+    return !bits->eop;
+}
+
+/* Decodes the residue of our single channel; for one channel, formats 1 and 2 are the same (section 8.6) */
+static void residue_decode(fluid_vorbis_decoder_t *decoder, const vorbis_residue_t *residue,
+                           vorbis_bits_t *bits, float *vector, int n)
+{
+    const vorbis_setup_t *setup = decoder->setup;
+    const vorbis_codebook_t *classbook = &setup->codebooks[residue->classbook];
+    unsigned int begin = residue->begin < (unsigned int)n ? residue->begin : (unsigned int)n;
+    unsigned int end = residue->end < (unsigned int)n ? residue->end : (unsigned int)n;
+    unsigned int size = residue->partition_size;
+    int classwords = classbook->dimensions;
+    int partitions, pass, count, i, j, k, temp, entry;
+
+    if(end <= begin)
+    {
+        return;
+    }
+
+    partitions = (end - begin) / size;
+
+    for(pass = 0; pass < 8; pass++)
+    {
+        count = 0;
+
+        while(count < partitions)
+        {
+            if(pass == 0)
+            {
+                temp = codebook_decode(classbook, bits);
+
+                if(temp < 0)
+                {
+                    return;
+                }
+
+                for(i = classwords - 1; i >= 0; i--)
+                {
+                    decoder->classifications[count + i] = temp % residue->classifications;
+                    temp /= residue->classifications;
+                }
+            }
+
+            for(i = 0; i < classwords && count < partitions; i++, count++)
+            {
+                int book_index = residue->books[decoder->classifications[count]][pass];
+                const vorbis_codebook_t *book;
+                float *v;
+                int dim;
+
+                if(book_index < 0)
+                {
+                    continue;
+                }
+
+                book = &setup->codebooks[book_index];
+                dim = book->dimensions;
+                v = vector + begin + count * size;
+
+                if(book->values == NULL)
+                {
+                    return;
+                }
+
+                if(residue->type == 0)
+                {
+                    /* Interleaved by step (section 8.6.3) */
+                    int step = size / dim;
+
+                    for(j = 0; j < step; j++)
+                    {
+                        const float *values;
+
+                        entry = codebook_decode(book, bits);
+
+                        if(entry < 0)
+                        {
+                            return;
+                        }
+
+                        values = book->values + entry * dim;
+
+                        for(k = 0; k < dim; k++)
+                        {
+                            v[j + k * step] += values[k];
+                        }
+                    }
+                }
+                else
+                {
+                    for(j = 0; j < (int)size;)
+                    {
+                        const float *values;
+
+                        entry = codebook_decode(book, bits);
+
+                        if(entry < 0)
+                        {
+                            return;
+                        }
+
+                        values = book->values + entry * dim;
+
+                        for(k = 0; k < dim && j < (int)size; k++, j++)
+                        {
+                            v[j] += values[k];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/* Inverse MDCT (section 1.3.2) */
+
+static int mdct_init(vorbis_mdct_t *mdct, int n)
+{
+    int quarter = n / 4;
+    int half = n / 2;
+    int bits = ilog(quarter) - 1;
+    int i, j;
+
+    mdct->n = n;
+    mdct->twiddle = FLUID_ARRAY(float, quarter * 2);
+    mdct->fft_twiddle = FLUID_ARRAY(float, quarter);
+    mdct->bit_reverse = FLUID_ARRAY(unsigned short, quarter);
+    mdct->window = FLUID_ARRAY(float, half);
+
+    if(mdct->twiddle == NULL || mdct->fft_twiddle == NULL || mdct->bit_reverse == NULL || mdct->window == NULL)
+    {
+        return FALSE;
+    }
+
+    for(i = 0; i < quarter; i++)
+    {
+        double angle = -M_PI * (i + 0.125) / half;
+        mdct->twiddle[i * 2] = (float)cos(angle);
+        mdct->twiddle[i * 2 + 1] = (float)sin(angle);
+    }
+
+    for(i = 0; i < quarter / 2; i++)
+    {
+        double angle = -2 * M_PI * i / quarter;
+        mdct->fft_twiddle[i * 2] = (float)cos(angle);
+        mdct->fft_twiddle[i * 2 + 1] = (float)sin(angle);
+    }
+
+    for(i = 0; i < quarter; i++)
+    {
+        mdct->bit_reverse[i] = (unsigned short)(bit_reverse(i) >> (32 - bits));
+    }
+
+    /* Vorbis window (section 4.3.1) */
+    for(j = 0; j < half; j++)
+    {
+        double s = sin((j + 0.5) / half * M_PI / 2);
+        mdct->window[j] = (float)sin(M_PI / 2 * s * s);
+    }
+
+    return TRUE;
+}
+
+static void mdct_free(vorbis_mdct_t *mdct)
+{
+    FLUID_FREE(mdct->twiddle);
+    FLUID_FREE(mdct->fft_twiddle);
+    FLUID_FREE(mdct->bit_reverse);
+    FLUID_FREE(mdct->window);
+}
+
+/* In-place radix-2 FFT of interleaved complex values, after bit reversal */
+static void fft(const vorbis_mdct_t *mdct, float *z, int size)
+{
+    int length, i, j, stride;
+
+    for(length = 2, stride = size / 2; length <= size; length *= 2, stride /= 2)
+    {
+        int half = length / 2;
+
+        for(i = 0; i < size; i += length)
+        {
+            for(j = 0; j < half; j++)
+            {
+                float wr = mdct->fft_twiddle[j * stride * 2];
+                float wi = mdct->fft_twiddle[j * stride * 2 + 1];
+                float *a = z + (i + j) * 2;
+                float *b = z + (i + j + half) * 2;
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+/* y[i] = sum(x[k] * cos(2 * pi / n * (i + 1/2 + n/4) * (k + 1/2))) for i < n, k < n/2; computed as a
+ * DCT-IV of n/2 points with an FFT of n/4 points, then unfolded */
+static void imdct(const vorbis_mdct_t *mdct, const float *x, float *y, float *z)
+{
+    int n = mdct->n;
+    int half = n / 2;
+    int quarter = n / 4;
+    int i;
+
+    for(i = 0; i < quarter; i++)
+    {
+        float re = x[2 * i];
+        float im = x[half - 1 - 2 * i];
+        float wr = mdct->twiddle[i * 2];
+        float wi = mdct->twiddle[i * 2 + 1];
+        float *out = z + mdct->bit_reverse[i] * 2;
+
+        out[0] = re * wr - im * wi;
+        out[1] = re * wi + im * wr;
+    }
+
+    fft(mdct, z, quarter);
+
+    /* Post-twiddle gives the DCT-IV c[2i] and c[half - 1 - 2i], which then unfolds with
+     * y[i] = c[i + n/4], y[i] = -c[3n/4 - 1 - i] and y[i] = -c[i - 3n/4] in the three ranges */
+    for(i = 0; i < quarter; i++)
+    {
+        float wr = mdct->twiddle[i * 2];
+        float wi = mdct->twiddle[i * 2 + 1];
+        float even = z[i * 2] * wr - z[i * 2 + 1] * wi;
+        float odd = -(z[i * 2] * wi + z[i * 2 + 1] * wr);
+        int m;
+
+        /* c[m] for m = 2i, then for m = half - 1 - 2i */
+        m = 2 * i;
+
+        if(m >= quarter)
+        {
+            y[m - quarter] = even;
+        }
+        else
+        {
+            y[3 * quarter + m] = -even;
+        }
+
+        y[3 * quarter - 1 - m] = -even;
+
+        m = half - 1 - 2 * i;
+
+        if(m >= quarter)
+        {
+            y[m - quarter] = odd;
+        }
+        else
+        {
+            y[3 * quarter + m] = -odd;
+        }
+
+        y[3 * quarter - 1 - m] = -odd;
+    }
+}
+
+
+/* Headers (section 4.2) */
+
+static int check_header(vorbis_bits_t *bits, int type)
+{
+    static const char signature[6] = { 'v', 'o', 'r', 'b', 'i', 's' };
+    int i;
+
+    if(bits_read(bits, 8) != (uint32_t)type)
+    {
+        return FALSE;
+    }
+
+    for(i = 0; i < 6; i++)
+    {
+        if(bits_read(bits, 8) != (uint32_t)signature[i])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static vorbis_setup_t *parse_setup(const unsigned char *packet, unsigned int size, const int *blocksize)
+{
+    vorbis_setup_t *setup;
+    vorbis_bits_t bits;
+    int i, j, count;
+
+    setup = FLUID_NEW(vorbis_setup_t);
+
+    if(setup == NULL)
+    {
+        return NULL;
+    }
+
+    FLUID_MEMSET(setup, 0, sizeof(*setup));
+    setup->blocksize[0] = blocksize[0];
+    setup->blocksize[1] = blocksize[1];
+    setup->packet = FLUID_ARRAY(unsigned char, size);
+
+    if(setup->packet == NULL)
+    {
+        goto error_exit;
+    }
+
+    FLUID_MEMCPY(setup->packet, packet, size);
+    setup->packet_size = size;
+
+    bits_init(&bits, packet, size);
+
+    if(!check_header(&bits, 5))
+    {
+        goto error_exit;
+    }
+
+    /* Codebooks */
+    setup->codebook_count = bits_read(&bits, 8) + 1;
+    setup->codebooks = FLUID_ARRAY(vorbis_codebook_t, setup->codebook_count);
+
+    if(setup->codebooks == NULL)
+    {
+        goto error_exit;
+    }
+
+    FLUID_MEMSET(setup->codebooks, 0, setup->codebook_count * sizeof(vorbis_codebook_t));
+
+    for(i = 0; i < setup->codebook_count; i++)
+    {
+        if(!codebook_parse(&setup->codebooks[i], &bits))
+        {
+            goto error_exit;
+        }
+    }
+
+    /* Time domain transforms; placeholders */
+    count = bits_read(&bits, 6) + 1;
+
+    for(i = 0; i < count; i++)
+    {
+        if(bits_read(&bits, 16) != 0)
+        {
+            goto error_exit;
+        }
+    }
+
+    /* Floors */
+    setup->floor_count = bits_read(&bits, 6) + 1;
+    setup->floors = FLUID_ARRAY(vorbis_floor_t, setup->floor_count);
+
+    if(setup->floors == NULL)
+    {
+        goto error_exit;
+    }
+
+    for(i = 0; i < setup->floor_count; i++)
+    {
+        if(!floor_parse(&setup->floors[i], &bits, setup->codebook_count))
+        {
+            goto error_exit;
+        }
+    }
+
+    /* Residues */
+    setup->residue_count = bits_read(&bits, 6) + 1;
+    setup->residues = FLUID_ARRAY(vorbis_residue_t, setup->residue_count);
+
+    if(setup->residues == NULL)
+    {
+        goto error_exit;
+    }
+
+    for(i = 0; i < setup->residue_count; i++)
+    {
+        if(!residue_parse(&setup->residues[i], &bits, setup->codebook_count))
+        {
+            goto error_exit;
+        }
+    }
+
+    /* Mappings; with only one channel there can be no coupling steps */
+    setup->mapping_count = bits_read(&bits, 6) + 1;
+    setup->mappings = FLUID_ARRAY(vorbis_mapping_t, setup->mapping_count);
+
+    if(setup->mappings == NULL)
+    {
+        goto error_exit;
+    }
+
+    for(i = 0; i < setup->mapping_count; i++)
+    {
+        vorbis_mapping_t *mapping = &setup->mappings[i];
+        int submaps = 1;
+
+        if(bits_read(&bits, 16) != 0)
+        {
+            goto error_exit;
+        }
+
+        if(bits_read(&bits, 1))
+        {
+            submaps = bits_read(&bits, 4) + 1;
+        }
+
+        if(bits_read(&bits, 1) || bits_read(&bits, 2) != 0)
+        {
+            goto error_exit;
+        }
+
+        mapping->submap = 0;
+
+        if(submaps > 1)
+        {
+            mapping->submap = bits_read(&bits, 4);
+
+            if(mapping->submap >= submaps)
+            {
+                goto error_exit;
+            }
+        }
+
+        for(j = 0; j < submaps; j++)
+        {
+            bits_read(&bits, 8);
+            mapping->submap_floor[j] = bits_read(&bits, 8);
+            mapping->submap_residue[j] = bits_read(&bits, 8);
+
+            if(mapping->submap_floor[j] >= setup->floor_count || mapping->submap_residue[j] >= setup->residue_count)
+            {
+                goto error_exit;
+            }
+        }
+    }
+
+    /* Modes */
+    setup->mode_count = bits_read(&bits, 6) + 1;
+
+    for(i = 0; i < setup->mode_count; i++)
+    {
+        setup->modes[i].blockflag = bits_read(&bits, 1);
+
+        if(bits_read(&bits, 16) != 0 || bits_read(&bits, 16) != 0)
+        {
+            goto error_exit;
+        }
+
+        setup->modes[i].mapping = bits_read(&bits, 8);
+
+        if(setup->modes[i].mapping >= setup->mapping_count)
+        {
+            goto error_exit;
+        }
+    }
+
+    if(!bits_read(&bits, 1) || bits.eop)
+    {
+        goto error_exit;
+    }
+
+    for(i = 0; i < 2; i++)
+    {
+        if(!mdct_init(&setup->mdct[i], blocksize[i]))
+        {
+            goto error_exit;
+        }
+    }
+
+    return setup;
+
+error_exit:
+    delete_vorbis_setup(setup);
+    return NULL;
+}
+
+static void delete_vorbis_setup(vorbis_setup_t *setup)
+{
+    int i;
+
+    fluid_return_if_fail(setup != NULL);
+
+    if(setup->codebooks != NULL)
+    {
+        for(i = 0; i < setup->codebook_count; i++)
+        {
+            FLUID_FREE(setup->codebooks[i].lengths);
+            FLUID_FREE(setup->codebooks[i].fast);
+            FLUID_FREE(setup->codebooks[i].long_codes);
+            FLUID_FREE(setup->codebooks[i].long_entries);
+            FLUID_FREE(setup->codebooks[i].values);
+        }
+    }
+
+    mdct_free(&setup->mdct[0]);
+    mdct_free(&setup->mdct[1]);
+
+    FLUID_FREE(setup->codebooks);
+    FLUID_FREE(setup->floors);
+    FLUID_FREE(setup->residues);
+    FLUID_FREE(setup->mappings);
+    FLUID_FREE(setup->packet);
+    FLUID_FREE(setup);
+}
+
+/* Makes sure the work buffers fit the current setup */
+static int decoder_prepare(fluid_vorbis_decoder_t *decoder)
+{
+    const vorbis_setup_t *setup = decoder->setup;
+    int n = setup->blocksize[1];
+    int partitions = 0, i;
+
+    for(i = 0; i < setup->residue_count; i++)
+    {
+        int count = (int)(n / 2 / setup->residues[i].partition_size) + setup->codebooks[setup->residues[i].classbook].dimensions;
+
+        if(count > partitions)
+        {
+            partitions = count;
+        }
+    }
+
+    if(decoder->buffer_blocksize < n)
+    {
+        FLUID_FREE(decoder->residue);
+        FLUID_FREE(decoder->block);
+        FLUID_FREE(decoder->fft);
+        FLUID_FREE(decoder->previous);
+        decoder->residue = FLUID_ARRAY(float, n / 2);
+        decoder->block = FLUID_ARRAY(float, n);
+        decoder->fft = FLUID_ARRAY(float, n / 2);
+        decoder->previous = FLUID_ARRAY(float, n / 2);
+        decoder->buffer_blocksize = n;
+
+        if(decoder->residue == NULL || decoder->block == NULL || decoder->fft == NULL || decoder->previous == NULL)
+        {
+            decoder->buffer_blocksize = 0;
+            return FALSE;
+        }
+    }
+
+    FLUID_FREE(decoder->classifications);
+    decoder->classifications = FLUID_ARRAY(int, partitions);
+
+    return decoder->classifications != NULL;
+}
+
+
+/* Ogg pages (RFC 3533) */
+
+static void ogg_init(vorbis_ogg_t *ogg, const unsigned char *stream, unsigned int size)
+{
+    FLUID_MEMSET(ogg, 0, sizeof(*ogg));
+    ogg->data = stream;
+    ogg->end = stream + size;
+}
+
+static int ogg_next_page(vorbis_ogg_t *ogg, int64_t *granule)
+{
+    const unsigned char *page = ogg->data;
+    unsigned int i, payload_size = 0;
+
+    if(ogg->end - page < 27 || memcmp(page, "OggS", 4) != 0 || page[4] != 0)
+    {
+        return FALSE;
+    }
+
+    ogg->segments = page[26];
+
+    if((unsigned int)(ogg->end - page) < 27 + ogg->segments)
+    {
+        return FALSE;
+    }
+
+    ogg->lacing = page + 27;
+
+    for(i = 0; i < ogg->segments; i++)
+    {
+        payload_size += ogg->lacing[i];
+    }
+
+    ogg->payload = ogg->lacing + ogg->segments;
+
+    if((unsigned int)(ogg->end - ogg->payload) < payload_size)
+    {
+        return FALSE;
+    }
+
+    if(granule != NULL)
+    {
+        *granule = 0;
+
+        for(i = 0; i < 8; i++)
+        {
+            *granule |= (int64_t)page[6 + i] << (i * 8);
+        }
+    }
+
+    ogg->segment = 0;
+    ogg->data = ogg->payload + payload_size;
+    return TRUE;
+}
+
+/* Assembles the next packet into the decoder's packet buffer */
+static int ogg_next_packet(fluid_vorbis_decoder_t *decoder, vorbis_ogg_t *ogg, unsigned int *size)
+{
+    *size = 0;
+
+    for(;;)
+    {
+        while(ogg->segment < ogg->segments)
+        {
+            unsigned int length = ogg->lacing[ogg->segment++];
+
+            if(*size + length > decoder->packet_capacity)
+            {
+                unsigned int capacity = (*size + length) * 2;
+                unsigned char *packet = FLUID_REALLOC(decoder->packet, capacity);
+
+                if(packet == NULL)
+                {
+                    return FALSE;
+                }
+
+                decoder->packet = packet;
+                decoder->packet_capacity = capacity;
+            }
+
+            FLUID_MEMCPY(decoder->packet + *size, ogg->payload, length);
+            ogg->payload += length;
+            *size += length;
+
+            if(length < 255)
+            {
+                return TRUE;
+            }
+        }
+
+        if(!ogg_next_page(ogg, NULL))
+        {
+            /* End of the stream; a packet cut off here is incomplete */
+            return FALSE;
+        }
+    }
+}
+
+/* The number of samples in the stream is the granule position of its last page */
+static int64_t ogg_last_granule(const unsigned char *stream, unsigned int size)
+{
+    vorbis_ogg_t ogg;
+    int64_t granule, last = -1;
+
+    ogg_init(&ogg, stream, size);
+
+    while(ogg_next_page(&ogg, &granule))
+    {
+        if(granule != -1)
+        {
+            last = granule;
+        }
+    }
+
+    return last;
+}
+
+
+/* Audio packets (section 4.3) */
+
+/* Decodes an audio packet into the windowed block; returns the blocksize, 0 to skip the packet, or -1 */
+static int decode_audio_packet(fluid_vorbis_decoder_t *decoder, const unsigned char *packet, unsigned int size,
+                               int *left_start, int *left_size, int *right_start, int *right_size)
+{
+    const vorbis_setup_t *setup = decoder->setup;
+    const vorbis_mode_t *mode;
+    const vorbis_mapping_t *mapping;
+    vorbis_bits_t bits;
+    int y[VORBIS_FLOOR1_MAX_VALUES];
+    int n, half, previous_flag = 0, next_flag = 0, used, i;
+    int short_size = setup->blocksize[0];
+
+    bits_init(&bits, packet, size);
+
+    /* Not an audio packet */
+    if(bits_read(&bits, 1) != 0)
+    {
+        return bits.eop ? 0 : -1;
+    }
+
+    i = bits_read(&bits, ilog(setup->mode_count - 1));
+
+    if(i >= setup->mode_count)
+    {
+        return -1;
+    }
+
+    mode = &setup->modes[i];
+    mapping = &setup->mappings[mode->mapping];
+    n = setup->blocksize[mode->blockflag];
+    half = n / 2;
+
+    if(mode->blockflag)
+    {
+        previous_flag = bits_read(&bits, 1);
+        next_flag = bits_read(&bits, 1);
+    }
+
+    if(bits.eop)
+    {
+        return 0;
+    }
+
+    /* Window shape (section 4.3.1) */
+    if(mode->blockflag && !previous_flag)
+    {
+        *left_start = n / 4 - short_size / 4;
+        *left_size = short_size / 2;
+    }
+    else
+    {
+        *left_start = 0;
+        *left_size = half;
+    }
+
+    if(mode->blockflag && !next_flag)
+    {
+        *right_start = n * 3 / 4 - short_size / 4;
+        *right_size = short_size / 2;
+    }
+    else
+    {
+        *right_start = half;
+        *right_size = half;
+    }
+
+    /* Floor, residue and their product form the spectrum */
+    FLUID_MEMSET(decoder->residue, 0, half * sizeof(float));
+    used = floor_decode(setup, &setup->floors[mapping->submap_floor[mapping->submap]], &bits, y);
+
+    if(used)
+    {
+        residue_decode(decoder, &setup->residues[mapping->submap_residue[mapping->submap]], &bits, decoder->residue, half);
+        floor_apply(&setup->floors[mapping->submap_floor[mapping->submap]], y, decoder->residue, half);
+        imdct(&setup->mdct[mode->blockflag], decoder->residue, decoder->block, decoder->fft);
+    }
+    else
+    {
+        FLUID_MEMSET(decoder->block, 0, n * sizeof(float));
+    }
+
+    /* Apply the window */
+    for(i = 0; i < *left_start; i++)
+    {
+        decoder->block[i] = 0;
+    }
+
+    for(i = 0; i < *left_size; i++)
+    {
+        decoder->block[*left_start + i] *= setup->mdct[*left_size == half ? mode->blockflag : 0].window[i];
+    }
+
+    for(i = 0; i < *right_size; i++)
+    {
+        decoder->block[*right_start + i] *= setup->mdct[*right_size == half ? mode->blockflag : 0].window[*right_size - 1 - i];
+    }
+
+    for(i = *right_start + *right_size; i < n; i++)
+    {
+        decoder->block[i] = 0;
+    }
+
+    return n;
+}
+
+static short float_to_short(float value)
+{
+    value *= 32768.0f;
+    value += value < 0 ? -0.5f : 0.5f;
+
+    if(value >= 32767.0f)
+    {
+        return 32767;
+    }
+
+    if(value <= -32768.0f)
+    {
+        return -32768;
+    }
+
+    return (short)value;
+}
+
+
+/* Public interface */
+
+fluid_vorbis_decoder_t *new_fluid_vorbis_decoder(void)
+{
+    fluid_vorbis_decoder_t *decoder;
+    int i;
+
+    if(!floor1_inverse_db_ready)
+    {
+        /* The table in section 10.1 is a geometric series from 1.0649863e-07 up to 1.0 */
+        for(i = 0; i < 256; i++)
+        {
+            floor1_inverse_db[i] = (float)exp((255 - i) * log(1.0649863e-07) / 255.0);
+        }
+
+        floor1_inverse_db_ready = TRUE;
+    }
+
+    decoder = FLUID_NEW(fluid_vorbis_decoder_t);
+
+    if(decoder == NULL)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        return NULL;
+    }
+
+    FLUID_MEMSET(decoder, 0, sizeof(*decoder));
+    return decoder;
+}
+
+void delete_fluid_vorbis_decoder(fluid_vorbis_decoder_t *decoder)
+{
+    fluid_return_if_fail(decoder != NULL);
+
+    delete_vorbis_setup(decoder->setup);
+    FLUID_FREE(decoder->packet);
+    FLUID_FREE(decoder->residue);
+    FLUID_FREE(decoder->block);
+    FLUID_FREE(decoder->fft);
+    FLUID_FREE(decoder->previous);
+    FLUID_FREE(decoder->classifications);
+    FLUID_FREE(decoder);
+}
+
+int fluid_vorbis_decoder_decode(fluid_vorbis_decoder_t *decoder, const unsigned char *stream,
+                                unsigned int size, short **data)
+{
+    vorbis_ogg_t ogg;
+    vorbis_bits_t bits;
+    unsigned int packet_size;
+    int blocksize[2], previous_size = 0, have_previous = FALSE;
+    int64_t total;
+    int frames = 0, capacity, i, n;
+    short *output = NULL;
+
+    *data = NULL;
+
+    /* Identification header (section 4.2.2) */
+    ogg_init(&ogg, stream, size);
+
+    if(!ogg_next_page(&ogg, NULL) || !ogg_next_packet(decoder, &ogg, &packet_size))
+    {
+        FLUID_LOG(FLUID_ERR, "Vorbis: not an Ogg stream");
+        return -1;
+    }
+
+    bits_init(&bits, decoder->packet, packet_size);
+
+    if(!check_header(&bits, 1) || bits_read(&bits, 32) != 0)
+    {
+        FLUID_LOG(FLUID_ERR, "Vorbis: not a Vorbis I stream");
+        return -1;
+    }
+
+    if(bits_read(&bits, 8) != 1)
+    {
+        FLUID_LOG(FLUID_ERR, "Vorbis: only mono streams are supported");
+        return -1;
+    }
+
+    bits_read(&bits, 32);
+    bits_read(&bits, 32);
+    bits_read(&bits, 32);
+    bits_read(&bits, 32);
+    blocksize[0] = 1 << bits_read(&bits, 4);
+    blocksize[1] = 1 << bits_read(&bits, 4);
+
+    if(blocksize[0] < (1 << VORBIS_MIN_BLOCKSIZE_LOG2) || blocksize[1] > (1 << VORBIS_MAX_BLOCKSIZE_LOG2)
+            || blocksize[0] > blocksize[1] || !bits_read(&bits, 1))
+    {
+        FLUID_LOG(FLUID_ERR, "Vorbis: invalid identification header");
+        return -1;
+    }
+
+    /* Comment header */
+    if(!ogg_next_packet(decoder, &ogg, &packet_size))
+    {
+        FLUID_LOG(FLUID_ERR, "Vorbis: missing comment header");
+        return -1;
+    }
+
+    /* Setup header; reuse the last one if it's the same */
+    if(!ogg_next_packet(decoder, &ogg, &packet_size))
+    {
+        FLUID_LOG(FLUID_ERR, "Vorbis: missing setup header");
+        return -1;
+    }
+
+    if(decoder->setup == NULL
+            || decoder->setup->packet_size != packet_size
+            || decoder->setup->blocksize[0] != blocksize[0]
+            || decoder->setup->blocksize[1] != blocksize[1]
+            || memcmp(decoder->setup->packet, decoder->packet, packet_size) != 0)
+    {
+        delete_vorbis_setup(decoder->setup);
+        decoder->setup = parse_setup(decoder->packet, packet_size, blocksize);
+
+        if(decoder->setup == NULL)
+        {
+            FLUID_LOG(FLUID_ERR, "Vorbis: invalid setup header");
+            return -1;
+        }
+
+        if(!decoder_prepare(decoder))
+        {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            delete_vorbis_setup(decoder->setup);
+            decoder->setup = NULL;
+            return -1;
+        }
+    }
+
+    total = ogg_last_granule(stream, size);
+    capacity = total > 0 ? (int)total : blocksize[1];
+    output = FLUID_ARRAY(short, capacity);
+
+    if(output == NULL)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        return -1;
+    }
+
+    /* Audio packets; each one completes the samples from the centre of the previous window
+     * to the centre of its own (section 4.3.8) */
+    while(ogg_next_packet(decoder, &ogg, &packet_size))
+    {
+        int left_start, left_size, right_start, right_size, count;
+
+        n = decode_audio_packet(decoder, decoder->packet, packet_size, &left_start, &left_size, &right_start, &right_size);
+
+        if(n < 0)
+        {
+            FLUID_LOG(FLUID_ERR, "Vorbis: invalid audio packet");
+            goto error_exit;
+        }
+
+        if(n == 0)
+        {
+            continue;
+        }
+
+        if(have_previous)
+        {
+            count = previous_size / 4 + n / 4;
+
+            if(frames + count > capacity)
+            {
+                short *grown;
+
+                capacity = (frames + count) * 2;
+                grown = FLUID_REALLOC(output, capacity * sizeof(short));
+
+                if(grown == NULL)
+                {
+                    FLUID_LOG(FLUID_ERR, "Out of memory");
+                    goto error_exit;
+                }
+
+                output = grown;
+            }
+
+            /* previous holds the second half of the last block; its 3/4 point lines up with our 1/4 point */
+            for(i = 0; i < count; i++)
+            {
+                int p = i;
+                int c = i - previous_size / 4 + n / 4;
+                float value = 0;
+
+                if(p < previous_size / 2)
+                {
+                    value += decoder->previous[p];
+                }
+
+                if(c >= 0)
+                {
+                    value += decoder->block[c];
+                }
+
+                output[frames + i] = float_to_short(value);
+            }
+
+            frames += count;
+        }
+
+        /* Keep the second half for the next packet */
+        FLUID_MEMCPY(decoder->previous, decoder->block + n / 2, n / 2 * sizeof(float));
+        previous_size = n;
+        have_previous = TRUE;
+    }
+
+    /* The last page's granule position trims the padding of the last block */
+    if(total >= 0 && frames > total)
+    {
+        frames = (int)total;
+    }
+
+    if(frames == 0)
+    {
+        FLUID_FREE(output);
+        return 0;
+    }
+
+    *data = output;
+    return frames;
+
+error_exit:
+    FLUID_FREE(output);
+    return -1;
+}
@@ -0,0 +1,45 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_VORBIS_H
+#define _FLUID_VORBIS_H
+
+/*
+ * Built-in Ogg Vorbis decoder for SF3 samples, for builds without libsndfile.
+ *
+ * Only what SF3 needs is supported: single, complete, mono streams held in memory, using floor
+ * type 1 (which is all that libvorbis has produced since its 1.0 release).
+ *
+ * A decoder keeps the setup of the last stream it has decoded, as the samples of a SoundFont
+ * are usually all encoded with the same settings. A decoder must only be used by one thread at
+ * a time; use one decoder per thread to decode in parallel.
+ */
+typedef struct _fluid_vorbis_decoder_t fluid_vorbis_decoder_t;
+
+fluid_vorbis_decoder_t *new_fluid_vorbis_decoder(void);
+void delete_fluid_vorbis_decoder(fluid_vorbis_decoder_t *decoder);
+
+/* Decodes an Ogg Vorbis stream to 16-bit PCM. Returns the number of frames, with *data allocated
+ * using FLUID_MALLOC (or NULL if there are none), or -1 if the stream could not be decoded. */
+int fluid_vorbis_decoder_decode(fluid_vorbis_decoder_t *decoder, const unsigned char *stream,
+                                unsigned int size, short **data);
+
+#endif /* _FLUID_VORBIS_H */
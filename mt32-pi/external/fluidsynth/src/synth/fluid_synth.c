@@ -257,6 +257,8 @@ void fluid_synth_settings(fluid_settings_t *settings)
     fluid_settings_add_option(settings, "synth.midi-bank-select", "mma");
 
     fluid_settings_register_int(settings, "synth.dynamic-sample-loading", 0, 0, 1, FLUID_HINT_TOGGLED);
+    fluid_settings_register_int(settings, "synth.dynamic-sample-deferred", 0, 0, 1, FLUID_HINT_TOGGLED);
+    fluid_settings_register_int(settings, "synth.dynamic-sample-cache-size", 0, 0, 2048, 0);
 }
 
 /**
@@ -1133,6 +1135,15 @@ delete_fluid_synth(fluid_synth_t *synth)
 
     delete_fluid_list(synth->sfont);
 
+    /* delete all the SoundFonts awaiting a lazy unload; no voices reference their samples any more */
+    for(list = synth->fonts_to_be_unloaded; list; list = fluid_list_next(list))
+    {
+        sfont = fluid_list_get(list);
+        fluid_sfont_delete_internal(sfont);
+    }
+
+    delete_fluid_list(synth->fonts_to_be_unloaded);
+
     /* delete all the SoundFont loaders */
 
     for(list = synth->loaders; list; list = fluid_list_next(list))
@@ -1143,21 +1154,6 @@ delete_fluid_synth(fluid_synth_t *synth)
 
     delete_fluid_list(synth->loaders);
 
-    /* wait for and delete all the lazy sfont unloading timers */
-
-#if 0
-    for(list = synth->fonts_to_be_unloaded; list; list = fluid_list_next(list))
-    {
-        fluid_timer_t* timer = fluid_list_get(list);
-        // explicitly join to wait for the unload really to happen
-        fluid_timer_join(timer);
-        // delete_fluid_timer alone would stop the timer, even if it had not unloaded the soundfont yet
-        delete_fluid_timer(timer);
-    }
-
-    delete_fluid_list(synth->fonts_to_be_unloaded);
-#endif
-
     if(synth->channel != NULL)
     {
         for(i = 0; i < synth->midi_channels; i++)
@@ -3390,6 +3386,115 @@ fluid_synth_unpin_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int p
     FLUID_API_RETURN(ret);
 }
 
+/* Sends a hold or release request to the given preset */
+static int
+fluid_synth_notify_held_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int preset_num, int reason)
+{
+    int ret;
+    fluid_preset_t *preset;
+
+    fluid_return_val_if_fail(synth != NULL, FLUID_FAILED);
+    fluid_return_val_if_fail(bank_num >= 0, FLUID_FAILED);
+    fluid_return_val_if_fail(preset_num >= 0, FLUID_FAILED);
+
+    fluid_synth_api_enter(synth);
+
+    preset = fluid_synth_get_preset(synth, sfont_id, bank_num, preset_num);
+
+    if(preset == NULL)
+    {
+        FLUID_LOG(FLUID_ERR,
+                  "There is no preset with bank number %d and preset number %d in SoundFont %d",
+                  bank_num, preset_num, sfont_id);
+        FLUID_API_RETURN(FLUID_FAILED);
+    }
+
+    ret = fluid_preset_notify(preset, reason, -1); // channel unused for holding messages
+
+    FLUID_API_RETURN(ret);
+}
+
+/**
+ * Holds all samples of the given preset.
+ *
+ * @param synth FluidSynth instance
+ * @param sfont_id ID of a loaded SoundFont
+ * @param bank_num MIDI bank number
+ * @param preset_num MIDI program number
+ * @return #FLUID_OK if the preset was found, held and loaded
+ * into memory successfully. #FLUID_FAILED otherwise.
+ *
+ * Like fluid_synth_pin_preset(), this loads the samples of the preset and keeps
+ * them loaded, but holds are counted: the samples stay loaded until each hold
+ * has been undone by fluid_synth_release_preset(). Holding the preset that a
+ * pending program change will select lets the samples be read before the
+ * program change reaches the synthesis thread.
+ *
+ * Holding and releasing presets, and loading selected samples, may be done from
+ * another thread than the synthesis thread, but not concurrently with each other
+ * or with loading and unloading SoundFonts.
+ *
+ * @note Only useful for presets loaded with the default soundfont loader and
+ * only if \ref settings_synth_dynamic-sample-loading is enabled.
+ */
+int
+fluid_synth_hold_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int preset_num)
+{
+    return fluid_synth_notify_held_preset(synth, sfont_id, bank_num, preset_num, FLUID_PRESET_HOLD);
+}
+
+/**
+ * Undoes one hold of the samples of the given preset.
+ *
+ * @param synth FluidSynth instance
+ * @param sfont_id ID of a loaded SoundFont
+ * @param bank_num MIDI bank number
+ * @param preset_num MIDI program number
+ * @return #FLUID_OK if the preset was found and held, #FLUID_FAILED otherwise
+ *
+ * Once the preset is neither held, pinned nor used, its samples will be unloaded.
+ */
+int
+fluid_synth_release_preset(fluid_synth_t *synth, int sfont_id, int bank_num, int preset_num)
+{
+    return fluid_synth_notify_held_preset(synth, sfont_id, bank_num, preset_num, FLUID_PRESET_RELEASE);
+}
+
+/**
+ * Reads the samples of the presets selected on all MIDI channels that are not loaded yet.
+ *
+ * @param synth FluidSynth instance
+ * @return #FLUID_OK on success, #FLUID_FAILED if any samples failed to load
+ *
+ * With <code>synth.dynamic-sample-deferred</code> enabled, selecting a preset
+ * doesn't read its samples, so that program changes never block the synthesis
+ * thread on file access. Instead, call this from another thread after program
+ * changes, to read the samples that were not held in advance; notes played
+ * until then skip them.
+ */
+int
+fluid_synth_load_selected_samples(fluid_synth_t *synth)
+{
+    fluid_preset_t *preset;
+    int ret = FLUID_OK;
+    int i;
+
+    fluid_return_val_if_fail(synth != NULL, FLUID_FAILED);
+    fluid_synth_api_enter(synth);
+
+    for(i = 0; i < synth->midi_channels; i++)
+    {
+        preset = fluid_channel_get_preset(synth->channel[i]);
+
+        if(preset != NULL && fluid_preset_notify(preset, FLUID_PRESET_LOAD_SAMPLES, i) == FLUID_FAILED)
+        {
+            ret = FLUID_FAILED;
+        }
+    }
+
+    FLUID_API_RETURN(ret);
+}
+
 /**
  * Select an instrument on a MIDI channel by SoundFont name, bank and program numbers.
  * @param synth FluidSynth instance
@@ -3724,6 +3829,48 @@ fluid_synth_get_active_voice_count(fluid_synth_t *synth)
     FLUID_API_RETURN(result);
 }
 
+/**
+ * Install an external worker that renders part of the active voices in parallel.
+ *
+ * Intended for systems without thread support (i.e. \setting{synth_cpu-cores} is unavailable)
+ * which still have a spare CPU core. When enough voices are active, @p kick is called from
+ * within the rendering function with an opaque job handle. The worker must then call
+ * fluid_synth_mixer_worker_render() with that handle. After the rendering thread has finished
+ * its own share of voices it calls @p wait, which must block until the worker has returned.
+ *
+ * @param synth FluidSynth instance
+ * @param kick Function that hands a job to the worker, or NULL to remove the worker
+ * @param wait Function that blocks until the job handed over by @p kick has completed
+ * @param data User defined data pointer passed to @p kick and @p wait
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ *
+ * @note Must not be called concurrently with any of the fluid_synth_write_*() functions.
+ */
+int
+fluid_synth_set_mixer_worker(fluid_synth_t *synth, fluid_mixer_worker_func_t kick,
+                             fluid_mixer_worker_func_t wait, void *data)
+{
+    int result;
+    fluid_return_val_if_fail(synth != NULL, FLUID_FAILED);
+    fluid_synth_api_enter(synth);
+
+    result = fluid_rvoice_mixer_set_worker(synth->eventhandler->mixer, kick, wait, data);
+    FLUID_API_RETURN(result);
+}
+
+/**
+ * Render the voices claimed by an external worker.
+ * @param job Job handle passed to the worker's kick function
+ *
+ * @note Must only be called between the kick and wait callbacks of the corresponding job.
+ */
+void
+fluid_synth_mixer_worker_render(void *job)
+{
+    fluid_return_if_fail(job != NULL);
+    fluid_rvoice_mixer_worker_render((fluid_rvoice_mixer_t *) job);
+}
+
 /**
  * Get the internal synthesis buffer size value.
  * @param synth FluidSynth instance
@@ -5381,6 +5528,45 @@ fluid_synth_sfload(fluid_synth_t *synth, const char *filename, int reset_presets
     FLUID_API_RETURN(FLUID_FAILED);
 }
 
+/**
+ * Add a SoundFont loaded with fluid_sfloader_load_sfont() to the SoundFont stack.
+ * @param synth FluidSynth instance
+ * @param sfont SoundFont to add
+ * @param reset_presets TRUE to re-assign presets for all MIDI channels (equivalent to calling fluid_synth_program_reset())
+ * @return SoundFont ID on success, #FLUID_FAILED on error
+ *
+ * Unlike fluid_synth_add_sfont(), the synth takes ownership of the SoundFont just as if it
+ * had been loaded with fluid_synth_sfload(), so it must be removed with fluid_synth_sfunload().
+ * This allows the slow part of loading to be done without holding up the synth.
+ */
+int
+fluid_synth_sfload_sfont(fluid_synth_t *synth, fluid_sfont_t *sfont, int reset_presets)
+{
+    int sfont_id;
+
+    fluid_return_val_if_fail(synth != NULL, FLUID_FAILED);
+    fluid_return_val_if_fail(sfont != NULL, FLUID_FAILED);
+    fluid_synth_api_enter(synth);
+
+    sfont_id = synth->sfont_id;
+
+    if(++sfont_id != FLUID_FAILED)
+    {
+        sfont->refcount++;
+        synth->sfont_id = sfont->id = sfont_id;
+
+        synth->sfont = fluid_list_prepend(synth->sfont, sfont);   /* prepend to list */
+
+        /* reset the presets for all channels if requested */
+        if(reset_presets)
+        {
+            fluid_synth_program_reset(synth);
+        }
+    }
+
+    FLUID_API_RETURN(sfont_id);
+}
+
 /**
  * Schedule a SoundFont for unloading.
  *
@@ -5458,17 +5644,53 @@ fluid_synth_sfont_unref(fluid_synth_t *synth, fluid_sfont_t *sfont)
         if(fluid_sfont_delete_internal(sfont) == 0)      /* SoundFont loader can block SoundFont unload */
         {
             FLUID_LOG(FLUID_DBG, "Unloaded SoundFont");
-        } /* spin off a timer thread to unload the sfont later (SoundFont loader blocked unload) */
-#if 0
+        } /* queue the sfont to be unloaded later by fluid_synth_sfunload_pending() (SoundFont loader blocked unload) */
         else
         {
-            fluid_timer_t* timer = new_fluid_timer(100, fluid_synth_sfunload_callback, sfont, TRUE, FALSE, FALSE);
-            synth->fonts_to_be_unloaded = fluid_list_prepend(synth->fonts_to_be_unloaded, timer);
+            synth->fonts_to_be_unloaded = fluid_list_prepend(synth->fonts_to_be_unloaded, sfont);
         }
-#endif
     }
 }
 
+/**
+ * Retry unloading SoundFonts whose unload was blocked by their SoundFont loader.
+ * @param synth FluidSynth instance
+ * @return Number of SoundFonts still waiting to be unloaded, #FLUID_FAILED on error
+ *
+ * A SoundFont removed with fluid_synth_sfunload() can only be freed once no voice
+ * references its samples any more. Without timer support, the application must call
+ * this function periodically until it returns 0.
+ */
+int
+fluid_synth_sfunload_pending(fluid_synth_t *synth)
+{
+    fluid_sfont_t *sfont;
+    fluid_list_t *list, *next;
+    int count = 0;
+
+    fluid_return_val_if_fail(synth != NULL, FLUID_FAILED);
+    fluid_synth_api_enter(synth);
+
+    for(list = synth->fonts_to_be_unloaded; list; list = next)
+    {
+        next = fluid_list_next(list);
+        sfont = fluid_list_get(list);
+
+        if(fluid_sfont_delete_internal(sfont) == 0)
+        {
+            FLUID_LOG(FLUID_DBG, "Unloaded SoundFont");
+            synth->fonts_to_be_unloaded = fluid_list_remove_link(synth->fonts_to_be_unloaded, list);
+            delete1_fluid_list(list);
+        }
+        else
+        {
+            count++;
+        }
+    }
+
+    FLUID_API_RETURN(count);
+}
+
 #if 0
 /* Callback to continually attempt to unload a SoundFont,
  * only if a SoundFont loader blocked the unload operation */
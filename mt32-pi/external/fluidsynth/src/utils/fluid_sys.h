@@ -485,12 +485,16 @@ fluid_atomic_float_get(fluid_atomic_float_t *fptr)
 #define fluid_atomic_float_get(atomic) (*atomic)
 #define fluid_atomic_float_set(atomic, newval) (*atomic = newval)
 
-typedef char fluid_mutex_t;
+#define fluid_atomic_pointer_get(atomic) __atomic_load_n((atomic), __ATOMIC_ACQUIRE)
+#define fluid_atomic_pointer_set(atomic, newval) __atomic_store_n((atomic), (newval), __ATOMIC_RELEASE)
+
+/* Spinlock; the sample cache is shared between CPU cores */
+typedef int fluid_mutex_t;
 #define FLUID_MUTEX_INIT { 0 }
-#define fluid_mutex_init(mutex) (void)mutex
+#define fluid_mutex_init(mutex) __atomic_store_n(&(mutex), 0, __ATOMIC_RELEASE)
 #define fluid_mutex_destroy(mutex) (void)mutex
-#define fluid_mutex_lock(mutex) (void)mutex
-#define fluid_mutex_unlock(mutex) (void)mutex
+#define fluid_mutex_lock(mutex) do { while(__atomic_exchange_n(&(mutex), 1, __ATOMIC_ACQUIRE)) {} } while(0)
+#define fluid_mutex_unlock(mutex) __atomic_store_n(&(mutex), 0, __ATOMIC_RELEASE)
 
 typedef char fluid_rec_mutex_t;
 #define fluid_rec_mutex_init(mutex) (void)mutex
@@ -0,0 +1,151 @@
+#include "test.h"
+#include "fluidsynth.h"
+#include "sfloader/fluid_sfont.h"
+#include "sfloader/fluid_defsfont.h"
+#include "sfloader/fluid_samplecache.h"
+#include "utils/fluid_sys.h"
+#include "utils/fluid_list.h"
+
+#define FRAMES 64
+
+static int count_loaded_samples(fluid_synth_t *synth, int sfont_id);
+
+
+/* Test deferred dynamic sample loading, and holding and releasing presets */
+int main(void)
+{
+    int id;
+    fluid_synth_t *synth;
+    fluid_sfont_t *sfont;
+    fluid_defsfont_t *defsfont;
+    float buffer[FRAMES * 2];
+
+    /* Setup */
+    fluid_settings_t *settings = new_fluid_settings();
+
+    fluid_settings_setint(settings, "synth.dynamic-sample-loading", 1);
+    fluid_settings_setint(settings, "synth.dynamic-sample-deferred", 1);
+    synth = new_fluid_synth(settings);
+    id = fluid_synth_sfload(synth, TEST_SOUNDFONT, 0);
+
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 0);
+
+
+    /* For the following tests, preset 42 (Lead Synth 2) consists of 4 samples,
+     * preset 40 (Aluminum Plate) consists of 1 sample */
+
+    /* Selecting a preset doesn't read its samples until asked to */
+    TEST_ASSERT(fluid_synth_program_select(synth, 0, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 0);
+
+    TEST_ASSERT(fluid_synth_load_selected_samples(synth) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 4);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 4);
+
+    TEST_ASSERT(fluid_synth_unset_program(synth, 0) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 0);
+
+
+    /* Notes skip samples that haven't been read yet */
+    TEST_ASSERT(fluid_synth_program_select(synth, 0, id, 0, 40) == FLUID_OK);
+    fluid_synth_noteon(synth, 0, 60, 100);
+    TEST_ASSERT(fluid_synth_get_active_voice_count(synth) == 0);
+
+    TEST_ASSERT(fluid_synth_load_selected_samples(synth) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 1);
+    TEST_ASSERT(fluid_synth_noteon(synth, 0, 60, 100) == FLUID_OK);
+    TEST_ASSERT(fluid_synth_get_active_voice_count(synth) > 0);
+
+    /* Let the voice finish, so that the sample can be unloaded */
+    TEST_ASSERT(fluid_synth_all_sounds_off(synth, -1) == FLUID_OK);
+    TEST_ASSERT(fluid_synth_write_float(synth, FRAMES, buffer, 0, 2, buffer, 1, 2) == FLUID_OK);
+    TEST_ASSERT(fluid_synth_get_active_voice_count(synth) == 0);
+
+    TEST_ASSERT(fluid_synth_unset_program(synth, 0) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+
+
+    /* Holds are counted, and keep the samples of a selected preset loaded once unselected */
+    TEST_ASSERT(fluid_synth_hold_preset(synth, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 4);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 4);
+
+    TEST_ASSERT(fluid_synth_hold_preset(synth, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 4);
+
+    TEST_ASSERT(fluid_synth_program_select(synth, 0, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(fluid_synth_release_preset(synth, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 4);
+
+    TEST_ASSERT(fluid_synth_unset_program(synth, 0) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 4);
+
+    TEST_ASSERT(fluid_synth_release_preset(synth, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 0);
+
+    /* Releasing a preset that isn't held fails */
+    TEST_ASSERT(fluid_synth_release_preset(synth, id, 0, 42) == FLUID_FAILED);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+
+
+    /* Holding and releasing a non-existent preset should fail */
+    TEST_ASSERT(fluid_synth_hold_preset(synth, id, 42, 42) == FLUID_FAILED);
+    TEST_ASSERT(fluid_synth_release_preset(synth, id, 42, 42) == FLUID_FAILED);
+
+
+    /* A hold that fails to load the samples isn't counted */
+    sfont = fluid_synth_get_sfont_by_id(synth, id);
+    defsfont = fluid_sfont_get_data(sfont);
+    defsfont->filename[0]++;
+
+    TEST_ASSERT(fluid_synth_hold_preset(synth, id, 0, 42) == FLUID_FAILED);
+
+    defsfont->filename[0]--;
+    TEST_ASSERT(fluid_synth_release_preset(synth, id, 0, 42) == FLUID_FAILED);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 0);
+
+
+    /* Test that deleting the synth with a held preset also leaves no
+     * samples in cache */
+    TEST_ASSERT(fluid_synth_hold_preset(synth, id, 0, 42) == FLUID_OK);
+    TEST_ASSERT(fluid_synth_hold_preset(synth, id, 0, 40) == FLUID_OK);
+    TEST_ASSERT(count_loaded_samples(synth, id) == 5);
+    TEST_ASSERT(fluid_samplecache_count_entries() == 5);
+
+    delete_fluid_synth(synth);
+
+    TEST_ASSERT(fluid_samplecache_count_entries() == 0);
+
+
+    /* Tear down */
+    delete_fluid_settings(settings);
+
+    return EXIT_SUCCESS;
+}
+
+
+static int count_loaded_samples(fluid_synth_t *synth, int sfont_id)
+{
+    fluid_list_t *list;
+    int count = 0;
+
+    fluid_sfont_t *sfont = fluid_synth_get_sfont_by_id(synth, sfont_id);
+    fluid_defsfont_t *defsfont = fluid_sfont_get_data(sfont);
+
+    for(list = defsfont->sample; list; list = fluid_list_next(list))
+    {
+        fluid_sample_t *sample = fluid_list_get(list);
+
+        if(sample->data != NULL)
+        {
+            count++;
+        }
+    }
+
+    FLUID_LOG(FLUID_INFO, "Loaded samples on sfont %d: %d\n", sfont_id, count);
+    return count;
+}
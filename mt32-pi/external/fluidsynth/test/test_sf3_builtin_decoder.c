@@ -0,0 +1,67 @@
+#include "test.h"
+#include "fluidsynth.h"
+#include "sfloader/fluid_sfont.h"
+#include "sfloader/fluid_defsfont.h"
+#include "utils/fluid_sys.h"
+
+#include <math.h>
+
+// this test makes sure that the built-in Ogg Vorbis decoder decodes the samples of the SF3 test
+// soundfont to the same lengths as the samples of the SF2 it has been made from, and close enough
+// to their waveforms (the compression is lossy, and noisy samples may come out quite different).
+// mt32-pi's host tests additionally compare every sample with libvorbis's output.
+int main(void)
+{
+    int id_sf2, id_sf3;
+    fluid_defsfont_t *defsfont_sf2, *defsfont_sf3;
+    fluid_list_t *list_sf2, *list_sf3;
+    double dot = 0, energy_sf2 = 0, energy_sf3 = 0;
+
+    fluid_settings_t *settings = new_fluid_settings();
+    fluid_synth_t *synth = new_fluid_synth(settings);
+
+    TEST_ASSERT(settings != NULL);
+    TEST_ASSERT(synth != NULL);
+
+    TEST_SUCCESS(id_sf2 = fluid_synth_sfload(synth, TEST_SOUNDFONT, 0));
+    TEST_SUCCESS(id_sf3 = fluid_synth_sfload(synth, TEST_SOUNDFONT_SF3, 0));
+
+    defsfont_sf2 = fluid_sfont_get_data(fluid_synth_get_sfont_by_id(synth, id_sf2));
+    defsfont_sf3 = fluid_sfont_get_data(fluid_synth_get_sfont_by_id(synth, id_sf3));
+
+    list_sf2 = defsfont_sf2->sample;
+    list_sf3 = defsfont_sf3->sample;
+
+    TEST_ASSERT(fluid_list_size(list_sf2) == fluid_list_size(list_sf3));
+
+    for(; list_sf2 && list_sf3; list_sf2 = fluid_list_next(list_sf2), list_sf3 = fluid_list_next(list_sf3))
+    {
+        fluid_sample_t *sample_sf2 = fluid_list_get(list_sf2);
+        fluid_sample_t *sample_sf3 = fluid_list_get(list_sf3);
+        unsigned int i;
+
+        TEST_ASSERT(FLUID_STRCMP(sample_sf2->name, sample_sf3->name) == 0);
+
+        TEST_ASSERT(sample_sf3->data != NULL);
+        TEST_ASSERT(sample_sf3->start == 0);
+        TEST_ASSERT(sample_sf3->end - sample_sf3->start == sample_sf2->end - sample_sf2->start);
+
+        for(i = 0; i <= sample_sf2->end - sample_sf2->start; i++)
+        {
+            double value_sf2 = sample_sf2->data[sample_sf2->start + i];
+            double value_sf3 = sample_sf3->data[sample_sf3->start + i];
+
+            dot += value_sf2 * value_sf3;
+            energy_sf2 += value_sf2 * value_sf2;
+            energy_sf3 += value_sf3 * value_sf3;
+        }
+    }
+
+    // correlation of all samples together
+    TEST_ASSERT(dot / sqrt(energy_sf2 * energy_sf3) > 0.9);
+
+    delete_fluid_synth(synth);
+    delete_fluid_settings(settings);
+
+    return EXIT_SUCCESS;
+}
@@ -332,7 +332,7 @@ bool Partial::generateNextSample(LA32PairImpl *la32PairImpl) {
 	return true;
 }
 
-void Partial::produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA32IntPartialPair *la32IntPair) {
+float Partial::produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA32IntPartialPair *la32IntPair) {
 	IntSampleEx sample = la32IntPair->nextOutSample();
 
 	// FIXME: LA32 may produce distorted sound in case if the absolute value of maximal amplitude of the input exceeds 8191
@@ -346,14 +346,16 @@ void Partial::produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA3
 	IntSampleEx rightOut = ((sample * rightPanValue) >> 13) + IntSampleEx(*rightBuf);
 	*(leftBuf++) = Synth::clipSampleEx(leftOut);
 	*(rightBuf++) = Synth::clipSampleEx(rightOut);
+	return (sample < 0 ? -sample : sample) * (1.0f / 32768.0f);
 }
 
-void Partial::produceAndMixSample(FloatSample *&leftBuf, FloatSample *&rightBuf, LA32FloatPartialPair *la32FloatPair) {
+float Partial::produceAndMixSample(FloatSample *&leftBuf, FloatSample *&rightBuf, LA32FloatPartialPair *la32FloatPair) {
 	FloatSample sample = la32FloatPair->nextOutSample();
 	FloatSample leftOut = (sample * leftPanValue) / 14.0f;
 	FloatSample rightOut = (sample * rightPanValue) / 14.0f;
 	*(leftBuf++) += leftOut;
 	*(rightBuf++) += rightOut;
+	return sample < 0.0f ? -sample : sample;
 }
 
 template <class Sample, class LA32PairImpl>
@@ -361,11 +363,17 @@ bool Partial::doProduceOutput(Sample *leftBuf, Sample *rightBuf, Bit32u length,
 	if (!canProduceOutput()) return false;
 	alreadyOutputed = true;
 
+	// The partial may get deactivated (and lose its owner part) while producing output
+	const int outputPart = ownerPart;
+	float outputLevel = 0.0f;
+
 	for (sampleNum = 0; sampleNum < length; sampleNum++) {
 		if (!generateNextSample(la32PairImpl)) break;
-		produceAndMixSample(leftBuf, rightBuf, la32PairImpl);
+		float sampleLevel = produceAndMixSample(leftBuf, rightBuf, la32PairImpl);
+		if (sampleLevel > outputLevel) outputLevel = sampleLevel;
 	}
 	sampleNum = 0;
+	synth->updatePartOutputLevel(outputPart, outputLevel);
 	return true;
 }
 
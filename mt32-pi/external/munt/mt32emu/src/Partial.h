@@ -88,8 +88,9 @@ private:
 	bool canProduceOutput();
 	template <class LA32PairImpl>
 	bool generateNextSample(LA32PairImpl *la32PairImpl);
-	void produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA32IntPartialPair *la32IntPair);
-	void produceAndMixSample(FloatSample *&leftBuf, FloatSample *&rightBuf, LA32FloatPartialPair *la32FloatPair);
+	// Return the absolute value of the mixed sample, scaled to full scale 1.0
+	float produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA32IntPartialPair *la32IntPair);
+	float produceAndMixSample(FloatSample *&leftBuf, FloatSample *&rightBuf, LA32FloatPartialPair *la32FloatPair);
 
 public:
 	bool alreadyOutputed;
@@ -255,6 +255,9 @@ public:
 
 	ReportHandler2 defaultReportHandler;
 	ReportHandler2 *reportHandler2;
+
+	// Peak output levels of the parts since the last call to getPartOutputLevels()
+	float partOutputLevels[9];
 };
 
 Bit32u Synth::getLibraryVersionInt() {
@@ -332,6 +335,7 @@ Synth::Synth(ReportHandler *useReportHandler) :
 	renderedSampleCount = 0;
 	extensions.display = NULL;
 	extensions.oldMT32DisplayFeatures = false;
+	memset(extensions.partOutputLevels, 0, sizeof(extensions.partOutputLevels));
 }
 
 Synth::~Synth() {
@@ -368,6 +372,11 @@ void Synth::voicePartStateChanged(Bit8u partNum, bool partActivated) const {
 	extensions.display->voicePartStateChanged(partNum, partActivated);
 }
 
+void Synth::updatePartOutputLevel(int partNum, float level) {
+	if (partNum < 0 || partNum > 8) return;
+	if (level > extensions.partOutputLevels[partNum]) extensions.partOutputLevels[partNum] = level;
+}
+
 void Synth::newTimbreSet(Bit8u partNum) const {
 	const Part *part = getPart(partNum);
 	reportHandler->onProgramChanged(partNum, getSoundGroupName(part), part->getCurrentInstr());
@@ -2581,6 +2590,11 @@ Bit32u Synth::getPartStates() const {
 	return bitSet;
 }
 
+void Synth::getPartOutputLevels(float *partOutputLevels) {
+	memcpy(partOutputLevels, extensions.partOutputLevels, sizeof(extensions.partOutputLevels));
+	memset(extensions.partOutputLevels, 0, sizeof(extensions.partOutputLevels));
+}
+
 void Synth::getPartialStates(PartialState *partialStates) const {
 	if (!opened) {
 		memset(partialStates, 0, partialCount * sizeof(PartialState));
@@ -246,6 +246,7 @@ private:
 	void rhythmNotePlayed() const;
 	void voicePartStateChanged(Bit8u partNum, bool activated) const;
 	void newTimbreSet(Bit8u partNum) const;
+	void updatePartOutputLevel(int partNum, float level);
 	const char *getSoundGroupName(const Part *part) const;
 	const char *getSoundGroupName(Bit8u timbreGroup, Bit8u timbreNumber) const;
 	void printDebug(const char *fmt, ...);
@@ -567,6 +568,12 @@ public:
 	// Returns the number of currently playing notes on the specified part.
 	MT32EMU_EXPORT Bit32u getPlayingNotes(Bit8u partNumber, Bit8u *keys, Bit8u *velocities) const;
 
+	// Fills in the peak output levels of all the parts into the array provided, and starts measuring them anew.
+	// The array must have at least 9 entries to fit values for all the parts. Each value is the highest absolute
+	// sample value (before panning, reverb and output gain) produced by the partials of the part since the previous call,
+	// relative to the full scale of the output. This info is useful for displaying real level meters per part.
+	MT32EMU_EXPORT void getPartOutputLevels(float *partOutputLevels);
+
 	// Returns name of the patch set on the specified part.
 	// Argument partNumber should be 0..7 for Part 1..8, or 8 for Rhythm.
 	// The returned value is a null-terminated string which is guaranteed to remain valid until the next call to one of render methods.
@@ -0,0 +1,75 @@
+//
+// channelmeters.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _channelmeters_h
+#define _channelmeters_h
+
+#include <circle/types.h>
+
+#include "seqlock.h"
+
+// Level meters measured from rendered audio. The rendering core measures each channel (or part) as it
+// renders a block and applies the meter ballistics; other cores read the results without locking.
+class CChannelMeters
+{
+public:
+	static constexpr size_t MaxChannels = 16;
+
+	CChannelMeters();
+
+	// Rendering core; accumulate until the next Publish()
+	void Measure(size_t nChannel, const float* pLeft, const float* pRight, size_t nFrames);
+	void MeasurePeak(size_t nChannel, float nPeak, size_t nFrames);
+	void Publish(size_t nFrames, unsigned int nSampleRate);
+
+	// Any core; levels and peak hold levels in the range 0-1, for display
+	void GetLevels(float* pOutLevels, float* pOutPeaks, size_t nChannels) const;
+
+private:
+	// Bottom of the meter scale
+	static constexpr float RangeDecibels = 48.0f;
+
+	// Time taken to fall over the whole meter scale
+	static constexpr float LevelFalloffTimeMillis = 600.0f;
+	static constexpr float PeakHoldTimeMillis = 2000.0f;
+	static constexpr float PeakFalloffTimeMillis = 1000.0f;
+
+	struct TLevels
+	{
+		float Levels[MaxChannels];
+		float Peaks[MaxChannels];
+	};
+
+	static float ToMeterScale(float nLevel);
+
+	// Measurements of the block being rendered
+	float m_BlockPeaks[MaxChannels];
+	float m_BlockSumSquares[MaxChannels];
+
+	// Meter ballistics, in meter scale
+	TLevels m_Levels;
+	float m_PeakHoldMillis[MaxChannels];
+
+	CSeqLock<TLevels> m_PublishedLevels;
+};
+
+#endif
@@ -37,7 +37,8 @@ class CConfig
 public:
 	#define ENUM_SYSTEMDEFAULTSYNTH(ENUM) \
 		ENUM(MT32, mt32)                  \
-		ENUM(SoundFont, soundfont)
+		ENUM(SoundFont, soundfont)        \
+		ENUM(Layered, layered)
 
 	#define ENUM_AUDIOOUTPUTDEVICE(ENUM) \
 		ENUM(PWM, pwm)                   \
@@ -65,15 +66,26 @@ public:
 		ENUM(SH1106I2C, sh1106_i2c)        \
 		ENUM(SSD1306I2C, ssd1306_i2c)
 
+	#define ENUM_LCDMETERS(ENUM) \
+		ENUM(Audio, audio)         \
+		ENUM(MIDI, midi)
+
 	#define ENUM_NETWORKMODE(ENUM) \
 		ENUM(Off, off)             \
 		ENUM(Ethernet, ethernet)   \
 		ENUM(WiFi, wifi)
 
+	// Set of MIDI channels; written as a comma-separated list of channels or ranges, e.g. "2-10, 16"
+	struct TMIDIChannelMask
+	{
+		u16 nMask;
+	};
+
 	CONFIG_ENUM(TSystemDefaultSynth, ENUM_SYSTEMDEFAULTSYNTH);
 	CONFIG_ENUM(TAudioOutputDevice, ENUM_AUDIOOUTPUTDEVICE);
 	CONFIG_ENUM(TControlScheme, ENUM_CONTROLSCHEME);
 	CONFIG_ENUM(TLCDType, ENUM_LCDTYPE);
+	CONFIG_ENUM(TLCDMeters, ENUM_LCDMETERS);
 	CONFIG_ENUM(TNetworkMode, ENUM_NETWORKMODE);
 
 	CConfig();
@@ -91,6 +103,7 @@ public:
 	static bool ParseOption(const char* pString, float* pOutFloat);
 	static bool ParseOption(const char *pString, CString* pOut);
 	static bool ParseOption(const char *pString, CIPAddress* pOut);
+	static bool ParseOption(const char* pString, TMIDIChannelMask* pOut);
 	static bool ParseOption(const char* pString, TSystemDefaultSynth* pOut);
 	static bool ParseOption(const char* pString, TAudioOutputDevice* pOut);
 	static bool ParseOption(const char* pString, TMT32EmuResamplerQuality* pOut);
@@ -101,6 +114,7 @@ public:
 	static bool ParseOption(const char* pString, TEncoderType* pOut);
 	static bool ParseOption(const char* pString, TLCDRotation* pOut);
 	static bool ParseOption(const char* pString, TLCDMirror* pOut);
+	static bool ParseOption(const char* pString, TLCDMeters* pOut);
 	static bool ParseOption(const char* pString, TNetworkMode* pOut);
 
 private:
@@ -0,0 +1,107 @@
+//
+// deferredlog.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _deferredlog_h
+#define _deferredlog_h
+
+#include <circle/logger.h>
+#include <circle/stdarg.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#include "spscringbuffer.h"
+
+// Queues log messages in constant time, to be written to the log device (and the LCD) later by an
+// idle core, so that logging never blocks a real-time path. Each core and execution level (task,
+// IRQ, FIQ) has its own ring buffer, so that each ring has exactly one producer.
+class CDeferredLog
+{
+public:
+	// Called by the draining core for messages that should be shown on the LCD
+	using TLCDHandler = void (*)(void* pParam, int nLCDType, const char* pMessage);
+
+	CDeferredLog(unsigned int nLogLevel);
+	~CDeferredLog();
+
+	// Messages are written straight through to CLogger before Start() and after Stop()
+	void Start(TLCDHandler pLCDHandler, void* pLCDParam);
+	void Stop();
+
+	// Producer side; safe to call from any core and from interrupt context
+	void Write(const char* pSource, TLogSeverity Severity, const char* pFormat, ...);
+	void WriteV(const char* pSource, TLogSeverity Severity, const char* pFormat, va_list Args);
+	bool WriteLCD(int nLCDType, const char* pMessage);
+
+	// Consumer side; writes out up to nMaxMessages pending messages in the order they were queued
+	size_t Drain(size_t nMaxMessages);
+
+	static CDeferredLog* Get() { return s_pThis; }
+
+private:
+	static constexpr size_t MessageSize = 112;
+	static constexpr size_t RingSize = 16;
+	static constexpr size_t ExecutionLevels = 3;
+	static constexpr int NoLCD = -1;
+
+	struct TRecord
+	{
+		u32 nSequence;
+		TLogSeverity Severity;
+		const char* pSource;
+		int nLCDType;
+		char Message[MessageSize];
+	};
+
+	using TRing = CSPSCRingBuffer<TRecord, RingSize>;
+
+	void Enqueue(TRecord& Record);
+	void Output(const TRecord& Record);
+
+	unsigned int m_nLogLevel;
+	volatile bool m_bStarted;
+	TLCDHandler m_pLCDHandler;
+	void* m_pLCDParam;
+
+	u32 m_nSequence;
+
+	// Messages lost to full rings, per ring (written by its producer only)
+	u32 m_nDropped[CORES][ExecutionLevels];
+	u32 m_nDroppedReported[CORES][ExecutionLevels];
+
+	TRing m_Rings[CORES][ExecutionLevels];
+
+	static CDeferredLog* s_pThis;
+};
+
+// Replace Circle's logging macros, so that logging from the including file is deferred; panics
+// are still written immediately, as the system halts afterwards
+#undef LOGERR
+#undef LOGWARN
+#undef LOGNOTE
+#undef LOGDBG
+
+#define LOGERR(...)		CDeferredLog::Get()->Write(From, LogError, __VA_ARGS__)
+#define LOGWARN(...)		CDeferredLog::Get()->Write(From, LogWarning, __VA_ARGS__)
+#define LOGNOTE(...)		CDeferredLog::Get()->Write(From, LogNotice, __VA_ARGS__)
+#define LOGDBG(...)		CDeferredLog::Get()->Write(From, LogDebug, __VA_ARGS__)
+
+#endif
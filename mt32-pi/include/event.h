@@ -93,6 +93,7 @@ struct TEvent
 	};
 };
 
+// Events are produced from several cores (controls on core 0, MiSTer on core 1), so this queue must lock
 constexpr size_t EventQueueSize = 32;
 using TEventQueue               = CRingBuffer<TEvent, EventQueueSize>;
 
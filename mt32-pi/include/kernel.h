@@ -33,6 +33,7 @@
 #include <circle/timer.h>
 
 #include "config.h"
+#include "deferredlog.h"
 #include "mt32pi.h"
 #include "zoneallocator.h"
 
@@ -52,6 +53,7 @@ protected:
 #endif
 	CTimer m_Timer;
 	CLogger m_Logger;
+	CDeferredLog m_DeferredLog;
 	CScheduler m_Scheduler;
 	CUSBHCIDevice m_USBHCI;
 	CEMMCDevice m_EMMC;
@@ -65,6 +65,13 @@ public:
 	virtual void SetBacklightState(bool bEnabled) override;
 
 protected:
+	static constexpr u8 MaxWidth = 132;
+
+	// I2C control bytes
+	static constexpr u8 ControlByteCommand = 0x80;
+	static constexpr u8 ControlByteCommandStream = 0x00;
+	static constexpr u8 ControlByteDataStream = 0x40;
+
 	struct TFrameBufferUpdatePacket
 	{
 		u8 DataControlByte;
@@ -72,8 +79,10 @@ protected:
 	}
 	PACKED;
 
+	void WriteI2C(const void* pBuffer, size_t nSize) const;
 	void WriteCommand(u8 nCommand) const;
-	virtual void WriteFrameBuffer(bool bForceFullUpdate = false) const;
+	void WriteFrameBuffer(bool bForceFullUpdate = false);
+	virtual void WriteWindow(u8 nPage, u8 nStartColumn, u8 nEndColumn) const;
 	void SwapFrameBuffers();
 
 	CI2CMaster* m_pI2CMaster;
@@ -84,6 +93,9 @@ protected:
 	// Double framebuffers
 	TFrameBufferUpdatePacket m_FrameBuffers[2];
 	u8 m_nCurrentFrameBuffer;
+
+	// Set when the display's contents don't match the previous framebuffer (e.g. after an immediate update)
+	bool m_bFullUpdatePending;
 };
 
 class CSH1106 : public CSSD1306
@@ -92,8 +104,7 @@ public:
 	CSH1106(CI2CMaster* pI2CMaster, u8 nAddress = 0x3C, u8 nWidth = 128, u8 nHeight = 32, TLCDRotation Rotation = TLCDRotation::Normal);
 
 private:
-	void WriteData(const u8* pData, size_t nSize) const;
-	virtual void WriteFrameBuffer(bool bForceFullUpdate = false) const override;
+	virtual void WriteWindow(u8 nPage, u8 nStartColumn, u8 nEndColumn) const override;
 };
 
 #endif
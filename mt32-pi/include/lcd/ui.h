@@ -45,6 +45,9 @@ public:
 
 	void ShowSystemMessage(const char* pMessage, bool bSpinner = false);
 	void ClearSpinnerMessage();
+
+	// Replaces the spinner with a percentage; may be called from another core
+	void SetSpinnerProgress(int nPercent) { m_nSpinnerProgress = nPercent; }
 	void DisplayImage(TImage Image);
 	void ShowSysExText(TSysExDisplayMessage Type, const u8* pMessage, size_t nSize, u8 nOffset);
 	void ShowSysExBitmap(TSysExDisplayMessage Type, const u8* pData, size_t nSize);
@@ -92,6 +95,7 @@ private:
 	bool m_bIsScrolling;
 	size_t m_nCurrentScrollOffset;
 	size_t m_nCurrentSpinnerChar;
+	volatile int m_nSpinnerProgress;
 	TImage m_CurrentImage;
 	char m_SystemMessageTextBuffer[SystemMessageTextBufferSize];
 	TSysExDisplayMessage m_SysExDisplayMessageType;
@@ -39,15 +39,8 @@ public:
 
 private:
 	static constexpr u8 ChannelCount = 16;
-	static constexpr u8 NoteCount = 127;
-
-	static constexpr float AttackTimeMillis = 20.0f;
-	static constexpr float DecayTimeMillis = 100.0f;
-	static constexpr float SustainLevel = 0.8f;
-	static constexpr float ReleaseTimeMillis = 150.0f;
-
-	static constexpr float PeakHoldTimeMillis = 2000.0f;
-	static constexpr float PeakFalloffTimeMillis = 1000.0f;
+	static constexpr u8 NoteCount = 128;
+	static constexpr u8 NoteWordCount = NoteCount / 32;
 
 	enum class TEnvelopePhase
 	{
@@ -61,8 +54,7 @@ private:
 		TEnvelopePhase EnvelopePhase;
 		unsigned int nNoteOnTime;
 		unsigned int nNoteOffTime;
-		u8 nVelocity;
-		bool bDamperFlag;
+		float nVelocityLevel;
 	};
 
 	struct TChannelState
@@ -71,12 +63,23 @@ private:
 		u8 nExpression;
 		u8 nPan;
 		u8 nDamper;
+
+		// Notes whose envelopes haven't finished; only these are visited when computing levels
+		u32 ActiveNotes[NoteWordCount];
+
+		// Notes released while the damper pedal was held
+		u32 DamperNotes[NoteWordCount];
+
 		TNoteState Notes[NoteCount];
 	};
 
+	void NoteOn(TChannelState& ChannelState, u8 nNote, u8 nVelocity, unsigned int nTicks);
+	void NoteOff(TChannelState& ChannelState, u8 nNote, unsigned int nTicks);
 	void ProcessCC(u8 nChannel, u8 nCC, u8 nValue, unsigned int nTicks);
-	inline float ComputeEnvelope(TNoteState& NoteState) const;
-	inline float ComputePercussionEnvelope(TNoteState& NoteState) const;
+	static inline float ComputeGateEnvelope(unsigned int nGateTicks);
+	static inline bool ComputeEnvelope(const TNoteState& NoteState, unsigned int nTicks, float& nOutLevel);
+	static inline bool ComputePercussionEnvelope(const TNoteState& NoteState, unsigned int nTicks, float& nOutLevel);
+	void RetireNote(TChannelState& ChannelState, u8 nNote, unsigned int nNoteOnTime);
 
 	TChannelState m_State[ChannelCount];
 	float m_PeakLevels[ChannelCount];
@@ -32,6 +32,9 @@ public:
 
 	void ParseMIDIBytes(const u8* pData, size_t nSize, bool bIgnoreNoteOns = false);
 
+	// Matches mt32emu's SysEx buffer size; longer messages are dropped with OnSysExOverflow()
+	static constexpr size_t SysExBufferSize = 1000;
+
 protected:
 	virtual void OnShortMessage(u32 nMessage) = 0;
 	virtual void OnSysExMessage(const u8* pData, size_t nSize) = 0;
@@ -47,9 +50,6 @@ private:
 		SysExByte
 	};
 
-	// Matches mt32emu's SysEx buffer size
-	static constexpr size_t SysExBufferSize = 1000;
-
 	void ParseStatusByte(u8 nByte);
 	bool CheckCompleteShortMessage(bool bIgnoreNoteOns = false);
 	u32 PrepareShortMessage() const;
@@ -58,7 +58,8 @@
 #include "net/udpmidi.h"
 #include "pisound.h"
 #include "power.h"
-#include "ringbuffer.h"
+#include "spscringbuffer.h"
+#include "synth/layeredsynth.h"
 #include "synth/mt32romset.h"
 #include "synth/mt32synth.h"
 #include "synth/soundfontsynth.h"
@@ -112,11 +113,13 @@ private:
 	bool InitNetwork();
 	bool InitMT32Synth();
 	bool InitSoundFontSynth();
+	bool InitLayeredSynth();
 
 	// Tasks for specific CPU cores
 	void MainTask();
 	void UITask();
 	void AudioTask();
+	void RenderTask();
 
 	void UpdateUSB(bool bStartup = false);
 	void UpdateNetwork();
@@ -133,6 +136,7 @@ private:
 	void SwitchMT32ROMSet(TMT32ROMSet ROMSet);
 	void NextMT32ROMSet();
 	void SwitchSoundFont(size_t nIndex);
+	void UpdateSoundFontSwitch();
 	void DeferSwitchSoundFont(size_t nIndex);
 	void SetMasterVolume(s32 nVolume);
 
@@ -200,6 +204,7 @@ private:
 
 	volatile bool m_bRunning;
 	volatile bool m_bUITaskDone;
+	volatile bool m_bStatisticsRequested;
 	bool m_bLEDOn;
 	unsigned m_nLEDOnTime;
 
@@ -214,9 +219,10 @@ private:
 	CSynthBase* m_pCurrentSynth;
 	CMT32Synth* m_pMT32Synth;
 	CSoundFontSynth* m_pSoundFontSynth;
+	CLayeredSynth* volatile m_pLayeredSynth;
 
 	// MIDI receive buffer
-	CRingBuffer<u8, MIDIRxBufferSize> m_MIDIRxBuffer;
+	CSPSCRingBuffer<u8, MIDIRxBufferSize> m_MIDIRxBuffer;
 
 	// Event handling
 	TEventQueue m_EventQueue;
@@ -228,6 +234,7 @@ private:
 	static void IRQMIDIReceiveHandler(const u8* pData, size_t nSize);
 
 	static void PanicHandler();
+	static void LCDLogHandler(void* pParam, int nLCDType, const char* pMessage);
 
 	static CMT32Pi* s_pThis;
 };
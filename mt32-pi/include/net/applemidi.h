@@ -28,6 +28,9 @@
 #include <circle/net/socket.h>
 #include <circle/sched/task.h>
 
+#include "net/rtpmidireceiver.h"
+#include "net/socketmultiplexer.h"
+
 class CAppleMIDIHandler
 {
 public:
@@ -39,7 +42,8 @@ public:
 class CAppleMIDIParticipant : protected CTask
 {
 public:
-	CAppleMIDIParticipant(CBcmRandomNumberGenerator* pRandom, CAppleMIDIHandler* pHandler);
+	// Playout latency is in milliseconds; 0 disables the playout buffer
+	CAppleMIDIParticipant(CBcmRandomNumberGenerator* pRandom, CAppleMIDIHandler* pHandler, unsigned int nPlayoutLatency);
 	virtual ~CAppleMIDIParticipant() override;
 
 	bool Initialize();
@@ -51,6 +55,7 @@ private:
 	void MIDIInvitationState();
 	void ConnectedState();
 	void Reset();
+	unsigned int GetWaitTimeout() const;
 
 	bool SendPacket(CSocket* pSocket, CIPAddress* pIPAddress, u16 nPort, const void* pData, size_t nSize);
 	bool SendAcceptInvitationPacket(CSocket* pSocket, CIPAddress* pIPAddress, u16 nPort);
@@ -63,6 +68,7 @@ private:
 	// UDP sockets
 	CSocket* m_pControlSocket;
 	CSocket* m_pMIDISocket;
+	CSocketMultiplexer m_Multiplexer;
 
 	// Foreign peers
 	CIPAddress m_ForeignControlIPAddress;
@@ -85,6 +91,9 @@ private:
 	// Callback handler
 	CAppleMIDIHandler* m_pHandler;
 
+	// RTP-MIDI payload decoding, loss recovery and playout
+	CRTPMIDIReceiver m_Receiver;
+
 	// Participant state machine
 	enum class TState
 	{
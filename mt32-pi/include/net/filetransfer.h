@@ -0,0 +1,104 @@
+//
+// filetransfer.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _filetransfer_h
+#define _filetransfer_h
+
+#include <circle/sched/synchronizationevent.h>
+#include <circle/sched/task.h>
+#include <circle/types.h>
+#include <fatfs/ff.h>
+
+// Moves file data between a network task and any FatFs volume (SD:, USB:) through a ring of large blocks.
+//
+// A dedicated task performs the FatFs I/O one whole block at a time (so that full blocks go to the card as
+// aligned multi-sector transfers), while the network task fills or drains the other blocks. The storage
+// drivers yield while waiting for the hardware, so the card and the network make progress concurrently.
+//
+// The object owns a task; it is deleted by the scheduler after Release(), and must not be used afterwards.
+class CFileTransfer : protected CTask
+{
+public:
+	static constexpr size_t BlockSize = 64 * 1024;
+	static constexpr size_t BlockCount = 3;
+
+	CFileTransfer(const char* pLogName);
+	virtual ~CFileTransfer() override;
+
+	// Network to file; Write() blocks while every block is waiting to be written
+	void BeginWrite(FIL* pFile);
+	bool Write(const void* pData, size_t nSize);
+
+	// File to network; a null return means the end of the file (or a read error)
+	void BeginRead(FIL* pFile);
+	const u8* GetReadBuffer(size_t& nAvailable);
+	void CommitRead(size_t nSize);
+
+	// Flushes (or abandons) the transfer and waits for the disk task; returns false on a disk error
+	bool Finish(bool bAbort = false);
+
+	void Release();
+
+	virtual void Run() override;
+
+private:
+	enum class TMode
+	{
+		Idle,
+		Write,
+		Read,
+	};
+
+	void WriteBlocks();
+	void ReadBlocks();
+
+	u8* GetBlock(size_t nIndex) const { return m_pBuffer + (nIndex % BlockCount) * BlockSize; }
+	void WaitForDisk();
+
+	const char* m_pLogName;
+	u8* m_pBuffer;
+
+	TMode m_Mode;
+	bool m_bQuit;
+	bool m_bEndOfStream;
+	FIL* m_pFile;
+	FRESULT m_Result;
+
+	// Free-running block counts; blocks [m_nTail, m_nHead) are full
+	size_t m_nHead;
+	size_t m_nTail;
+	size_t m_BlockSizes[BlockCount];
+
+	// Fill/drain position within the network task's current block
+	size_t m_nOffset;
+
+	CSynchronizationEvent m_DiskEvent;
+	CSynchronizationEvent m_WorkerEvent;
+
+	// Statistics for the current transfer
+	u64 m_nBytes;
+	unsigned int m_nStartTicks;
+	unsigned int m_nDiskTicks;
+	unsigned int m_nStallTicks;
+};
+
+#endif
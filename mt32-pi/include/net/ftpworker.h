@@ -28,6 +28,9 @@
 #include <circle/sched/task.h>
 #include <circle/string.h>
 
+#include "net/filetransfer.h"
+#include "net/socketmultiplexer.h"
+
 // TODO: These may be incomplete/inaccurate
 enum TFTPStatus
 {
@@ -88,6 +91,8 @@ public:
 
 private:
 	CSocket* OpenDataConnection();
+	bool WaitForData(unsigned int nStartTicks);
+	CFileTransfer* GetFileTransfer();
 
 	bool SendStatus(TFTPStatus StatusCode, const char* pMessage);
 
@@ -129,6 +134,10 @@ private:
 	CSocket* m_pDataSocket;
 	u16 m_nDataSocketPort;
 	CIPAddress m_DataSocketIPAddress;
+	CSocketMultiplexer m_Multiplexer;
+
+	// Pipelined file I/O for RETR/STOR
+	CFileTransfer* m_pFileTransfer;
 
 	// Command/data buffers
 	char m_CommandBuffer[FRAME_BUFFER_SIZE];
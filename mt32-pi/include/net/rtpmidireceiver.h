@@ -0,0 +1,126 @@
+//
+// rtpmidireceiver.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _rtpmidireceiver_h
+#define _rtpmidireceiver_h
+
+#include <circle/types.h>
+
+#include "spscringbuffer.h"
+
+class CAppleMIDIHandler;
+
+// Receives the MIDI commands decoded from an RTP-MIDI stream (RFC 6295).
+//
+// Tracks enough channel state (sounding notes, controllers, programs and pitch wheels) to repair it from
+// the recovery journal when packets are lost, and optionally delays each command by a fixed latency from its
+// RTP timestamp so that bursty delivery (e.g. over Wi-Fi) doesn't clump the timing.
+class CRTPMIDIReceiver
+{
+public:
+	enum class TPacketStatus
+	{
+		InOrder,
+		Lost,
+		Stale,
+	};
+
+	// Latency is in RTP timestamp units (100 microseconds); 0 delivers commands as soon as they arrive
+	CRTPMIDIReceiver(CAppleMIDIHandler* pHandler, unsigned int nPlayoutLatency);
+
+	// Highest sequence number received so far, for receiver feedback
+	u16 GetLastSequence() const { return m_nLastSequence; }
+
+	TPacketStatus BeginPacket(u16 nSequence, u64 nNow);
+	void OnCommand(const u8* pData, size_t nSize, u32 nTimestamp);
+	void ApplyJournal(const u8* pJournal, size_t nSize, u32 nTimestamp);
+
+	// Offset of the sender's clock from ours, as estimated by the sync (CK) exchange
+	void SetClockOffset(u64 nOffset);
+
+	// Delivers commands whose playout time has been reached
+	void Update(u64 nNow);
+
+	// Time until the next buffered command is due, in RTP timestamp units; false if nothing is buffered
+	bool GetPlayoutDelay(unsigned int& nDelay) const;
+	void Reset();
+
+private:
+	struct TChannelState
+	{
+		u32 ActiveNotes[4];
+		u8 Controllers[128];
+		u8 nProgram;
+		u16 nPitchWheel;
+	};
+
+	struct TEntry
+	{
+		u32 nPlayoutTime;
+		size_t nSize;
+	};
+
+	// Sequence numbers this far behind the last one are taken as a sender restart rather than reordering
+	static constexpr s16 MaxReorder = 64;
+
+	// Unknown controller/program values; never equal to a 7-bit value from the journal
+	static constexpr u8 UnknownValue = 0xFF;
+	static constexpr u16 UnknownPitchWheel = 0xFFFF;
+
+	static constexpr size_t EntryQueueSize = 512;
+	static constexpr size_t DataQueueSize = 8192;
+
+	void UpdateChannelState(const u8* pData, size_t nSize);
+	void ResetChannelState();
+
+	void ApplyChannelJournal(u8 nChannel, u8 nChapters, const u8* pChapters, size_t nSize, u32 nTimestamp);
+	size_t ApplyProgramChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp);
+	size_t ApplyControllerChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp);
+	size_t ApplyPitchWheelChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp);
+	size_t ApplyNoteChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp);
+
+	void SendCommand(u8 nStatus, u8 nData1, u8 nData2, u32 nTimestamp);
+	void Deliver(const u8* pData, size_t nSize, u32 nTimestamp);
+	bool PlayNext();
+	void Flush();
+
+	bool IsNoteActive(u8 nChannel, u8 nNote) const { return m_ChannelState[nChannel].ActiveNotes[nNote >> 5] & (1u << (nNote & 31)); }
+
+	CAppleMIDIHandler* m_pHandler;
+	unsigned int m_nPlayoutLatency;
+
+	bool m_bHaveSequence;
+	u16 m_nLastSequence;
+
+	bool m_bHaveClockOffset;
+	u32 m_nClockOffset;
+	u32 m_nNow;
+
+	TChannelState m_ChannelState[16];
+
+	// Playout buffer; only touched by the AppleMIDI task
+	CSPSCRingBuffer<TEntry, EntryQueueSize> m_Entries;
+	CSPSCRingBuffer<u8, DataQueueSize> m_Data;
+	u8 m_CommandBuffer[DataQueueSize];
+};
+
+#endif
@@ -0,0 +1,54 @@
+//
+// socketmultiplexer.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _socketmultiplexer_h
+#define _socketmultiplexer_h
+
+#include <circle/net/socket.h>
+#include <circle/sched/synchronizationevent.h>
+#include <circle/types.h>
+
+// Lets a network task sleep until any of several sockets has something to receive (or a timeout elapses),
+// instead of spinning on non-blocking receive calls and taking time away from the other tasks on core 0.
+//
+// After Wait() returns, sockets should be drained with MSG_DONTWAIT; a wakeup doesn't guarantee data.
+class CSocketMultiplexer
+{
+public:
+	static constexpr size_t MaxSockets = 4;
+
+	CSocketMultiplexer();
+	~CSocketMultiplexer();
+
+	// Sockets must be removed before they are deleted, as the destructor detaches any that remain
+	bool Add(CSocket* pSocket);
+	void Remove(CSocket* pSocket);
+
+	// A timeout of 0 waits indefinitely; returns false if the timeout elapsed without any socket activity
+	bool Wait(unsigned int nTimeoutMicros);
+
+private:
+	CSynchronizationEvent m_Event;
+	CSocket* m_Sockets[MaxSockets];
+};
+
+#endif
@@ -37,20 +37,22 @@ public:
 	}
 
 	TOptional(const TOptional<T>& Other)
+		: m_bSet(false)
 	{
 		operator=(Other);
 	}
 
 	explicit TOptional(T&& Value)
+		: m_bSet(true)
 	{
-		m_bSet = true;
 		new(reinterpret_cast<T*>(m_Value)) T(static_cast<T&&>(Value));
 	}
 
 	explicit TOptional(TOptional<T>&& Other)
+		: m_bSet(Other.m_bSet)
 	{
-		m_bSet = Other.m_bSet;
-		new(reinterpret_cast<T*>(m_Value)) T(*reinterpret_cast<const T*>(Other.m_Value));
+		if (m_bSet)
+			new(reinterpret_cast<T*>(m_Value)) T(*reinterpret_cast<const T*>(Other.m_Value));
 	}
 
 	~TOptional() { Reset(); }
@@ -82,15 +84,21 @@ public:
 
 	TOptional<T>& operator =(const TOptional<T>& Other)
 	{
-		m_bSet = Other.m_bSet;
-		*reinterpret_cast<T*>(m_Value) = *reinterpret_cast<const T*>(Other.m_Value);
+		// Not &Other, which is overloaded to return the value's address
+		if (+m_Value != +Other.m_Value)
+		{
+			Reset();
+			if (Other.m_bSet)
+				operator=(*reinterpret_cast<const T*>(Other.m_Value));
+		}
 		return *this;
 	}
 
 	TOptional<T>& operator =(const T& Value)
 	{
+		Reset();
+		new(reinterpret_cast<T*>(m_Value)) T(Value);
 		m_bSet = true;
-		*reinterpret_cast<T*>(m_Value) = Value;
 		return *this;
 	}
 
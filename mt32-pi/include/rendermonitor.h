@@ -0,0 +1,79 @@
+//
+// rendermonitor.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _rendermonitor_h
+#define _rendermonitor_h
+
+#include <circle/types.h>
+
+// Measures render time against the real-time deadline of each block, counts underruns, and (optionally)
+// adapts how many frames the audio task keeps queued so that latency stays as low as the load allows
+class CRenderMonitor
+{
+public:
+	static constexpr size_t HeadroomBuckets = 11;
+
+	CRenderMonitor(unsigned int nSampleRate, size_t nMinQueuedFrames, size_t nMaxQueuedFrames, bool bAdaptive);
+
+	size_t GetTargetQueuedFrames() const { return m_nTargetQueuedFrames; }
+
+	void OnBlockStart(size_t nQueuedFrames);
+	void OnBlockEnd(size_t nFrames, unsigned int nRenderTicks, size_t nActiveVoices);
+	void OnDataDropped() { ++m_nDropped; }
+
+	void ReportStatus() const;
+	void ResetStatistics();
+
+private:
+	// Adaptation happens once per window of roughly one second of audio
+	static constexpr unsigned int CalmWindowsBeforeShrink = 10;
+	static constexpr float GrowLoadThreshold = 0.9f;
+	static constexpr float ShrinkLoadThreshold = 0.5f;
+	static constexpr size_t StepFrames = 64;
+
+	void EndWindow();
+
+	unsigned int m_nSampleRate;
+	size_t m_nMinQueuedFrames;
+	size_t m_nMaxQueuedFrames;
+	size_t m_nTargetQueuedFrames;
+	bool m_bAdaptive;
+	bool m_bStarted;
+
+	unsigned int m_nUnderruns;
+	unsigned int m_nDropped;
+
+	// Bucket 0 counts blocks that overran their deadline; bucket N counts blocks with (N-1)*10% to N*10% headroom
+	unsigned int m_HeadroomHistogram[HeadroomBuckets];
+
+	// Throughput since the statistics were last reset
+	u64 m_nTotalFrames;
+	u64 m_nTotalRenderTicks;
+	size_t m_nPeakActiveVoices;
+
+	size_t m_nWindowFrames;
+	unsigned int m_nWindowUnderruns;
+	float m_nWindowPeakLoad;
+	unsigned int m_nCalmWindows;
+};
+
+#endif
@@ -0,0 +1,55 @@
+//
+// sampleconverter.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _sampleconverter_h
+#define _sampleconverter_h
+
+#include <circle/types.h>
+
+// Converts interleaved stereo float samples to the formats expected by Circle's sound devices,
+// clamping to full scale and optionally swapping channels and applying TPDF dither in the same pass
+class CSampleConverter
+{
+public:
+	// Packed 24-bit output may be written up to this many bytes past the end of the converted data
+	static constexpr size_t PackedOutputSlack = 4;
+
+	CSampleConverter(bool bReversedStereo, bool bDither);
+
+	// Signed 24-bit in a 32-bit container (I2S)
+	void ConvertS24_32(s32* pOutBuffer, const float* pInBuffer, size_t nFrames);
+
+	// Packed signed 24-bit (PWM, HDMI)
+	void ConvertS24(u8* pOutBuffer, const float* pInBuffer, size_t nFrames);
+
+private:
+	inline s32 ConvertSample(float nSample);
+	inline float NextDitherValue();
+
+	bool m_bReversedStereo;
+	bool m_bDither;
+
+	// Linear congruential generator state; one per vector lane
+	u32 m_DitherState[4];
+};
+
+#endif
@@ -0,0 +1,84 @@
+//
+// seqlock.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _seqlock_h
+#define _seqlock_h
+
+#include <circle/types.h>
+#include <circle/util.h>
+
+#include <type_traits>
+
+// Publishes a value from one writer to any number of readers without locking (a sequence lock).
+// The writer never waits; readers retry if they raced with a write, so the value should be small.
+// Writes must not overlap, e.g. only ever write from one core, or while holding a lock.
+template <class T>
+class CSeqLock
+{
+public:
+	CSeqLock()
+		: m_nSequence(0),
+		  m_Value{}
+	{
+	}
+
+	void Write(const T& Value)
+	{
+		const u32 nSequence = __atomic_load_n(&m_nSequence, __ATOMIC_RELAXED);
+
+		// An odd sequence number marks a write in progress; it must be visible before any of the data is
+		__atomic_store_n(&m_nSequence, nSequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		memcpy(&m_Value, &Value, sizeof(T));
+
+		__atomic_store_n(&m_nSequence, nSequence + 2, __ATOMIC_RELEASE);
+	}
+
+	void Read(T& OutValue) const
+	{
+		u32 nBefore, nAfter;
+
+		do
+		{
+			nBefore = __atomic_load_n(&m_nSequence, __ATOMIC_ACQUIRE);
+			memcpy(&OutValue, &m_Value, sizeof(T));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			nAfter = __atomic_load_n(&m_nSequence, __ATOMIC_RELAXED);
+		} while ((nBefore & 1) || nBefore != nAfter);
+	}
+
+	T Read() const
+	{
+		T Value;
+		Read(Value);
+		return Value;
+	}
+
+private:
+	static_assert(std::is_trivially_copyable<T>::value, "Sequence lock values must be trivially copyable");
+
+	u32 m_nSequence;
+	T m_Value;
+};
+
+#endif
@@ -0,0 +1,102 @@
+//
+// soundfontindex.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _soundfontindex_h
+#define _soundfontindex_h
+
+#include <circle/types.h>
+#include <fatfs/ff.h>
+
+#include "synth/fxprofile.h"
+
+// Persists the results of a SoundFont directory scan so that files which haven't changed since the
+// last scan (same size and modification time) don't need to be opened and parsed again
+class CSoundFontIndex
+{
+public:
+	static constexpr size_t MaxNameLength = 256;
+
+	struct TFileKey
+	{
+		u32 nSize;
+		u16 nDate;
+		u16 nTime;
+
+		bool operator==(const TFileKey& Other) const { return nSize == Other.nSize && nDate == Other.nDate && nTime == Other.nTime; }
+		bool operator!=(const TFileKey& Other) const { return !(*this == Other); }
+	};
+
+	struct TEntry
+	{
+		TFileKey FileKey;
+		bool bSoundFont;
+
+		// Only meaningful if bSoundFont is set
+		char Name[MaxNameLength];
+		u32 nSampleDataSize;
+		u16 nPresetCount;
+
+		// FX profile key is zero if the SoundFont has no FX profile
+		TFileKey FXProfileKey;
+		TFXProfile FXProfile;
+	};
+
+	CSoundFontIndex();
+	~CSoundFontIndex();
+
+	// Reads the index stored in a SoundFont directory; any previously loaded entries are discarded
+	bool Load(const char* pDirectoryPath);
+
+	// Writes the entries added since Load() back to the directory if they differ from what was loaded
+	bool Save(const char* pDirectoryPath);
+
+	// Looks up a file in the loaded index; fails if it's missing or its size/modification time have changed
+	bool Find(const char* pFileName, const TFileKey& FileKey, TEntry& Entry);
+
+	// Records a file for the next Save(); call for every file found during a scan, including unchanged ones
+	void Add(const char* pFileName, const TEntry& Entry);
+
+	static TFileKey GetFileKey(const FILINFO& FileInfo) { return TFileKey{static_cast<u32>(FileInfo.fsize), FileInfo.fdate, FileInfo.ftime}; }
+	static bool IsIndexFile(const char* pFileName);
+
+private:
+	static constexpr size_t MaxIndexSize = 1024 * 1024;
+	static constexpr size_t InitialCapacity = 16 * 1024;
+
+	void Reset();
+	static bool Decode(const u8* pRecord, TEntry& Entry);
+	void Append(const u8* pData, size_t nSize);
+
+	// Loaded index
+	u8* m_pLoadedData;
+	size_t m_nLoadedSize;
+	size_t m_nLoadedEntries;
+	size_t m_nSearchOffset;
+
+	// Index being built for the next save
+	u8* m_pData;
+	size_t m_nSize;
+	size_t m_nCapacity;
+	size_t m_nEntries;
+};
+
+#endif
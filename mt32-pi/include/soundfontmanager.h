@@ -25,6 +25,7 @@
 
 #include <circle/string.h>
 
+#include "soundfontindex.h"
 #include "synth/fxprofile.h"
 
 class CSoundFontManager
@@ -37,7 +38,9 @@ public:
 	size_t GetSoundFontCount() const { return m_nSoundFonts; }
 	const char* GetSoundFontPath(size_t nIndex) const;
 	const char* GetSoundFontName(size_t nIndex) const;
-	TFXProfile GetSoundFontFXProfile(size_t nIndex) const;
+	TFXProfile GetSoundFontFXProfile(size_t nIndex);
+	size_t GetSoundFontSampleDataSize(size_t nIndex) const;
+	size_t GetSoundFontPresetCount(size_t nIndex) const;
 	const char* GetFirstValidSoundFontPath() const;
 
 	static constexpr size_t MaxSoundFonts = 512;
@@ -47,11 +50,17 @@ private:
 	{
 		CString Name;
 		CString Path;
+		u32 nSampleDataSize;
+		u16 nPresetCount;
+		CSoundFontIndex::TFileKey FXProfileKey;
+		TFXProfile FXProfile;
 	};
 
-	static constexpr size_t MaxSoundFontNameLength = 256;
+	void ScanDirectory(const char* pDirectoryPath, size_t& nParsed);
+	void AddSoundFont(const char* pFullPath, const char* pFileName, const CSoundFontIndex::TEntry& IndexEntry);
 
-	void CheckSoundFont(const char* pFullPath, const char* pFileName);
+	static bool ParseSoundFont(const char* pFullPath, CSoundFontIndex::TEntry& IndexEntry);
+	static bool UpdateFXProfile(const char* pSoundFontPath, CSoundFontIndex::TFileKey& FXProfileKey, TFXProfile& FXProfile);
 
 	size_t m_nSoundFonts;
 	TSoundFontListEntry m_SoundFontList[MaxSoundFonts];
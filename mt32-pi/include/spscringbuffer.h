@@ -0,0 +1,126 @@
+//
+// spscringbuffer.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _spscringbuffer_h
+#define _spscringbuffer_h
+
+#include <circle/synchronize.h>
+#include <circle/types.h>
+#include <circle/util.h>
+
+#include <type_traits>
+
+#include "utility.h"
+
+// Wait-free ring buffer for exactly one producer and one consumer (e.g. an IRQ handler and a task).
+// Use CRingBuffer instead when there are several producers or consumers.
+template <class T, size_t N>
+class CSPSCRingBuffer
+{
+public:
+	CSPSCRingBuffer()
+		: m_nHead(0),
+		  m_nTail(0),
+		  m_Data{}
+	{
+	}
+
+	// Producer side
+	size_t GetFreeSpace() const
+	{
+		return N - (__atomic_load_n(&m_nHead, __ATOMIC_RELAXED) - __atomic_load_n(&m_nTail, __ATOMIC_ACQUIRE));
+	}
+
+	bool Enqueue(const T& Item)
+	{
+		return Enqueue(&Item, 1) == 1;
+	}
+
+	size_t Enqueue(const T* pItems, size_t nCount)
+	{
+		const size_t nHead = __atomic_load_n(&m_nHead, __ATOMIC_RELAXED);
+		const size_t nTail = __atomic_load_n(&m_nTail, __ATOMIC_ACQUIRE);
+
+		nCount = Utility::Min(nCount, N - (nHead - nTail));
+		if (!nCount)
+			return 0;
+
+		// Copy up to the end of the buffer, then wrap around
+		const size_t nOffset = nHead & BufferMask;
+		const size_t nFirst = Utility::Min(nCount, N - nOffset);
+		memcpy(m_Data + nOffset, pItems, nFirst * sizeof(T));
+		memcpy(m_Data, pItems + nFirst, (nCount - nFirst) * sizeof(T));
+
+		__atomic_store_n(&m_nHead, nHead + nCount, __ATOMIC_RELEASE);
+		return nCount;
+	}
+
+	// Consumer side
+	bool Peek(T& OutItem) const
+	{
+		const size_t nTail = __atomic_load_n(&m_nTail, __ATOMIC_RELAXED);
+		const size_t nHead = __atomic_load_n(&m_nHead, __ATOMIC_ACQUIRE);
+
+		if (nHead == nTail)
+			return false;
+
+		OutItem = m_Data[nTail & BufferMask];
+		return true;
+	}
+
+	bool Dequeue(T& OutItem)
+	{
+		return Dequeue(&OutItem, 1) == 1;
+	}
+
+	size_t Dequeue(T* pOutBuffer, size_t nMaxCount)
+	{
+		const size_t nTail = __atomic_load_n(&m_nTail, __ATOMIC_RELAXED);
+		const size_t nHead = __atomic_load_n(&m_nHead, __ATOMIC_ACQUIRE);
+
+		const size_t nCount = Utility::Min(nMaxCount, nHead - nTail);
+		if (!nCount)
+			return 0;
+
+		const size_t nOffset = nTail & BufferMask;
+		const size_t nFirst = Utility::Min(nCount, N - nOffset);
+		memcpy(pOutBuffer, m_Data + nOffset, nFirst * sizeof(T));
+		memcpy(pOutBuffer + nFirst, m_Data, (nCount - nFirst) * sizeof(T));
+
+		__atomic_store_n(&m_nTail, nTail + nCount, __ATOMIC_RELEASE);
+		return nCount;
+	}
+
+private:
+	static_assert(Utility::IsPowerOfTwo(N), "Ring buffer size must be a power of 2");
+	static_assert(std::is_trivially_copyable<T>::value, "Ring buffer items must be trivially copyable");
+
+	static constexpr size_t BufferMask = N - 1;
+
+	// Free-running indices (masked on access); kept on separate cache lines so that
+	// the producer and consumer don't contend for the same line
+	size_t m_nHead CACHE_ALIGN;
+	size_t m_nTail CACHE_ALIGN;
+	T m_Data[N] CACHE_ALIGN;
+};
+
+#endif
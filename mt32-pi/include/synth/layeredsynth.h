@@ -0,0 +1,82 @@
+//
+// layeredsynth.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _layeredsynth_h
+#define _layeredsynth_h
+
+#include <circle/types.h>
+
+#include "synth/mt32synth.h"
+#include "synth/soundfontsynth.h"
+#include "synth/synthbase.h"
+
+// Plays mt32emu and FluidSynth at the same time, routing MIDI channel messages to each engine by channel mask.
+// The MT-32 is rendered on a worker core while FluidSynth renders on the audio core, and the outputs are summed.
+class CLayeredSynth : public CSynthBase
+{
+public:
+	CLayeredSynth(CMT32Synth& MT32Synth, CSoundFontSynth& SoundFontSynth, size_t nMaxFrames);
+	virtual ~CLayeredSynth() override;
+
+	// CSynthBase
+	virtual bool Initialize() override;
+	virtual void HandleMIDIShortMessage(u32 nMessage) override;
+	virtual void HandleMIDISysExMessage(const u8* pData, size_t nSize) override;
+	virtual void AllSoundOff() override;
+	virtual void SetMasterVolume(u8 nVolume) override;
+	virtual size_t Render(s16* pOutBuffer, size_t nFrames) override;
+	virtual size_t Render(float* pOutBuffer, size_t nFrames) override;
+	virtual void ReportStatus() const override;
+	virtual void UpdateLCD(CLCD& LCD, unsigned int nTicks) override;
+
+	void SetChannelMasks(u16 nMT32ChannelMask, u16 nSoundFontChannelMask);
+	void SetGains(float nMT32Gain, float nSoundFontGain);
+
+	// Renders the MT-32 on behalf of Render() and serves FluidSynth's mixer worker; to be polled from a spare CPU core
+	void RunWorker();
+
+private:
+	static constexpr u8 PercussionChannel = 9;
+
+	void StartWorker(size_t nFrames, bool bFloat);
+	void WaitForWorker();
+	template <class T> size_t RenderLayered(T* pOutBuffer, T* pMT32Buffer, size_t nFrames, bool bFloat);
+
+	CMT32Synth& m_MT32Synth;
+	CSoundFontSynth& m_SoundFontSynth;
+
+	u16 m_nMT32ChannelMask;
+	u16 m_nSoundFontChannelMask;
+	float m_nMT32Gain;
+	float m_nSoundFontGain;
+
+	// MT-32 output, written by the worker core
+	size_t m_nMaxFrames;
+	float* m_pMT32Buffer;
+	s16* m_pMT32IntBuffer;
+
+	// MT-32 render job handed from the audio core to the worker core; frame count is zero when idle
+	volatile size_t m_nWorkerFrames;
+	bool m_bWorkerFloat;
+};
+
+#endif
@@ -28,6 +28,7 @@
 #include <mt32emu/mt32emu.h>
 
 #include "rommanager.h"
+#include "seqlock.h"
 #include "synth/mt32romset.h"
 #include "synth/synthbase.h"
 #include "utility.h"
@@ -56,7 +57,6 @@ public:
 	virtual bool Initialize() override;
 	virtual void HandleMIDIShortMessage(u32 nMessage) override;
 	virtual void HandleMIDISysExMessage(const u8* pData, size_t nSize) override;
-	virtual bool IsActive() override { return m_pSynth->isActive(); }
 	virtual void AllSoundOff() override;
 	virtual void SetMasterVolume(u8 nVolume) override;
 	virtual size_t Render(s16* pBuffer, size_t nFrames) override;
@@ -74,13 +74,44 @@ public:
 
 	u8 GetMasterVolume() const;
 
+	// Part output levels mapped onto the MIDI channels they're assigned to, for display
+	void GetChannelOutputLevels(float ChannelLevels[16], float ChannelPeaks[16]) const;
+
 private:
 	static constexpr size_t MT32ChannelCount = 9;
+	static constexpr size_t MaxPartials = 256;
+	static constexpr size_t ROMSetCount = 3;
 
 	// N characters plus null terminator
 	static constexpr size_t LCDTextBufferSize = 20 + 1;
 
+	// Emulated hardware state, published by the rendering core alongside CSynthBase::TState
+	struct TMT32State
+	{
+		u8 MIDIChannelPartMap[MT32ChannelCount];
+		u8 nMasterVolume;
+		char DisplayText[LCDTextBufferSize];
+	};
+
+	// An opened mt32emu instance and the ROMs it was opened with
+	struct TInstance
+	{
+		MT32Emu::Synth* pSynth;
+		MT32Emu::SampleRateConverter* pSampleRateConverter;
+		const MT32Emu::ROMImage* pControlROMImage;
+		const MT32Emu::ROMImage* pPCMROMImage;
+	};
+
+	bool OpenInstance(TInstance& Instance);
+	static void CloseInstance(TInstance& Instance);
+	void ResetStandbyInstance(TInstance& Instance);
+	bool SwitchToStandbyInstance(TMT32ROMSet ROMSet);
+	void FinishCrossfade();
+	template <class T> void RenderCrossfade(T* pOutBuffer, size_t nFrames);
+
 	void GetPartLevels(unsigned int nTicks, float PartLevels[9], float PartPeaks[9]);
+	void PlayQueuedMIDIMessages(size_t nFrames);
+	template <class T> void PublishSynthState(const T* pOutBuffer, size_t nFrames);
 
 	// MT32Emu::ReportHandler
 	virtual bool onMIDIQueueOverflow() override;
@@ -104,8 +135,19 @@ private:
 	const MT32Emu::ROMImage* m_pControlROMImage;
 	const MT32Emu::ROMImage* m_pPCMROMImage;
 
+	// Instances kept open for instant ROM set switching, indexed by ROM set
+	bool m_bROMSetStandby;
+	TInstance m_StandbyInstances[ROMSetCount];
+
+	// Previous instance, faded out by the rendering core after a switch
+	TInstance m_FadeOutInstance;
+	TMT32ROMSet m_FadeOutROMSet;
+	size_t m_nCrossfadeFrames;
+	size_t m_nCrossfadeFramesRemaining;
+
 	// LCD state
-	char m_LCDTextBuffer[LCDTextBufferSize];
+	CSeqLock<TMT32State> m_MT32State;
+	volatile bool m_bNarrowDisplayText;
 };
 
 #endif
@@ -0,0 +1,69 @@
+//
+// soundfontfile.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _soundfontfile_h
+#define _soundfontfile_h
+
+#include <circle/types.h>
+#include <fatfs/ff.h>
+
+// Read-only SoundFont file access for FluidSynth's file callbacks.
+//
+// A cluster link map table is built when the file is opened, so that seeks don't have to follow the FAT
+// chain and large reads can span contiguous clusters as a single multi-block transfer. Small reads (the
+// hydra, chunk headers) are served from a sector-aligned read-ahead buffer.
+class CSoundFontFile
+{
+public:
+	CSoundFontFile();
+	~CSoundFontFile();
+
+	bool Open(const char* pPath);
+	bool Close();
+
+	// Fails unless exactly nSize bytes could be read
+	bool Read(void* pBuffer, size_t nSize);
+	bool Seek(u64 nOffset);
+	u64 Tell() const { return m_nPosition; }
+	u64 GetSize() const { return f_size(&m_File); }
+
+private:
+	static constexpr size_t SectorSize = 512;
+	static constexpr size_t ReadAheadSize = 32 * 1024;
+	static constexpr size_t InitialLinkMapSize = 64;
+
+	bool CreateLinkMap();
+	bool FillReadAhead();
+
+	FIL m_File;
+	bool m_bOpen;
+	DWORD* m_pLinkMap;
+
+	u64 m_nPosition;
+
+	// File offset and length of the data in the read-ahead buffer
+	u8* m_pReadAhead;
+	u64 m_nReadAheadOffset;
+	size_t m_nReadAheadLength;
+};
+
+#endif
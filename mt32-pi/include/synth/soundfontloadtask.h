@@ -0,0 +1,59 @@
+//
+// soundfontloadtask.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _soundfontloadtask_h
+#define _soundfontloadtask_h
+
+#include <circle/sched/task.h>
+
+class CSoundFontSynth;
+
+// Reads SoundFont data on the main core, where FatFs (and the scheduler that it relies on for locking and waiting)
+// may be used: either the SoundFont for a background switch, or the samples of presets selected by queued MIDI
+// messages. The reads yield in between, so the other tasks keep running meanwhile.
+//
+// The scheduler deletes the object once the job has completed.
+class CSoundFontLoadTask : protected CTask
+{
+public:
+	enum class TJob
+	{
+		LoadSoundFont,
+		ReadSamples,
+	};
+
+	CSoundFontLoadTask(CSoundFontSynth* pSynth, TJob Job);
+
+	virtual void Run() override;
+
+	// Whether the caller runs in a load task, and so may yield to the other tasks
+	static bool IsCurrentTask();
+
+private:
+	// FluidSynth's loaders were written for thread stacks rather than small task stacks
+	static constexpr unsigned int StackSize = 64 * 1024;
+
+	CSoundFontSynth* m_pSynth;
+	TJob m_Job;
+};
+
+#endif
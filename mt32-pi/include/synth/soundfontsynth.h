@@ -23,6 +23,7 @@
 #ifndef _soundfontsynth_h
 #define _soundfontsynth_h
 
+#include <circle/string.h>
 #include <circle/types.h>
 
 #include <fluidsynth.h>
@@ -34,6 +35,14 @@
 class CSoundFontSynth : public CSynthBase
 {
 public:
+	enum class TSoundFontSwitchResult
+	{
+		None,
+		Switched,
+		Reloaded,
+		Failed,
+	};
+
 	CSoundFontSynth(unsigned nSampleRate);
 	virtual ~CSoundFontSynth() override;
 
@@ -41,7 +50,6 @@ public:
 	virtual bool Initialize() override;
 	virtual void HandleMIDIShortMessage(u32 nMessage) override;
 	virtual void HandleMIDISysExMessage(const u8* pData, size_t nSize) override;
-	virtual bool IsActive() override;
 	virtual void AllSoundOff() override;
 	virtual void SetMasterVolume(u8 nVolume) override;
 	virtual size_t Render(s16* pOutBuffer, size_t nFrames) override;
@@ -49,12 +57,69 @@ public:
 	virtual void ReportStatus() const override;
 	virtual void UpdateLCD(CLCD& LCD, unsigned int nTicks) override;
 
+	// Starts loading a SoundFont in a task on the main core; the current one keeps playing until the switch completes
 	bool SwitchSoundFont(size_t nIndex);
+	// Swaps in a loaded SoundFont and frees replaced ones once their voices have finished; to be polled from the main core
+	TSoundFontSwitchResult UpdateSoundFontSwitch();
+	// Has samples read for instruments selected by played messages, and drops holds on those no longer pending; to be polled from the main core
+	void UpdateDynamicSamples();
 	size_t GetSoundFontIndex() const { return m_nCurrentSoundFontIndex; }
 	CSoundFontManager& GetSoundFontManager() { return m_SoundFontManager; }
 
+	// Renders a share of the active voices on behalf of Render(), and otherwise helps process sample data
+	// while a SoundFont is loading; to be polled from a spare CPU core
+	void RunMixerWorker();
+
 private:
+	friend class CSoundFontLoadTask;
+
+	enum class TSwitchState
+	{
+		Idle,
+		LoadRequested,
+		Loaded,
+		LoadFailed,
+	};
+
+	static constexpr unsigned int UnloadPollPeriodMillis = 100;
+
+	// Presets whose samples are kept loaded until the queued messages that select them have been played.
+	// Holds are queued by the MIDI handler, and their samples read by a load task.
+	static constexpr size_t MaxPresetHolds = 32;
+	static constexpr size_t MIDIChannelCount = 16;
+	static constexpr int DrumBank = 128;
+
+	struct TPresetHold
+	{
+		int nSoundFontID;
+		int nBank;
+		int nProgram;
+		u32 nSequence;
+		bool bHeld;
+	};
+
+	// Per-channel rendering for the level meters: a dry output per MIDI channel, plus reverb and chorus
+	static constexpr size_t MeteredChannelCount = 16;
+	static constexpr size_t DryBufferCount = MeteredChannelCount * 2;
+	static constexpr size_t FXBufferCount = 2 * 2;
+
+	void LoadPendingSoundFont();
+	void ReadPendingSamples();
+	void StartSampleTask();
+	void WaitForSampleTask();
 	bool Reinitialize(const char* pSoundFontPath, const TFXProfile* pFXProfile);
+	void ApplyFXProfile(const TFXProfile* pFXProfile);
+	TSoundFontSwitchResult SwapSoundFont();
+	TSoundFontSwitchResult ReloadSoundFont();
+	template <class T> size_t RenderQueued(T* pOutBuffer, size_t nFrames);
+	template <class T> void RenderFrames(T* pOutBuffer, size_t nFrames);
+	void PlayMIDIShortMessage(u32 nMessage);
+	void PlayMIDISysExMessage(const u8* pData, size_t nSize);
+	void PrepareMIDIShortMessage(u32 nMessage);
+	void HoldPreset(bool bDrums, u8 nBank, u8 nProgram);
+	void HoldResetPresets();
+	void ReleasePresetHolds(bool bAll);
+	void LoadSelectedSamples();
 	void ResetMIDIMonitor();
 #ifndef NDEBUG
 	void DumpFXSettings() const;
@@ -65,6 +130,8 @@ private:
 
 	fluid_settings_t* m_pSettings;
 	fluid_synth_t* m_pSynth;
+	fluid_sfloader_t* m_pSoundFontLoader;
+	int m_nSoundFontID;
 
 	u8 m_nVolume;
 	float m_nInitialGain;
@@ -72,9 +139,57 @@ private:
 	u16 m_nPercussionMask;
 	size_t m_nCurrentSoundFontIndex;
 
+	// Planar buffers for per-channel rendering; null when not metering
+	float* m_pChannelBuffers;
+	float* m_DryBuffers[DryBufferCount];
+	float* m_FXBuffers[FXBufferCount];
+
 	CSoundFontManager m_SoundFontManager;
 
+	// Background SoundFont switch; ownership of the fields below passes to the load task while a load is requested
+	volatile TSwitchState m_SwitchState;
+	size_t m_nSwitchSoundFontIndex;
+	CString m_SwitchSoundFontPath;
+	TFXProfile m_SwitchFXProfile;
+	fluid_sfont_t* m_pSwitchSoundFont;
+
+	// A further switch requested while one was in progress
+	bool m_bSwitchQueued;
+	size_t m_nQueuedSoundFontIndex;
+
+	// Replaced SoundFonts still referenced by playing voices
+	bool m_bUnloadPending;
+	unsigned int m_nUnloadPollTime;
+
+	// Dynamic sample loading; samples are read on the main core ahead of the queued messages that need them
+	bool m_bDynamicSamples;
+	u8 m_BankSelect[MIDIChannelCount];
+	u32 m_nQueuedMessages;
+	volatile u32 m_nPlayedMessages;
+	u32 m_nSelectionSequence;
+	u32 m_nLoadedSequence;
+	TPresetHold m_PresetHolds[MaxPresetHolds];
+	size_t m_nPresetHoldHead;
+	size_t m_nPresetHoldRead;
+	size_t m_nPresetHoldTail;
+	bool m_bSelectedSamplesPending;
+	bool m_bSampleTaskRunning;
+
+	// Job handed from the audio core to the mixer worker core; null when idle
+	void* volatile m_pMixerJob;
+
+	// Sample processing job handed from the loading core to the worker core; null when idle
+	void* volatile m_pLoadJob;
+	volatile bool m_bLoadWorkerBusy;
+
+	void RunLoadWorker();
+
 	static void FluidSynthLogCallback(int nLevel, const char* pMessage, void* pUser);
+	static void MixerWorkerKick(void* pUser, void* pJob);
+	static void MixerWorkerWait(void* pUser, void* pJob);
+	static void LoadWorkerKick(void* pUser, void* pJob);
+	static void LoadWorkerWait(void* pUser, void* pJob);
+	static void LoadProgressCallback(void* pUser, int nPercent);
 };
 
 #endif
@@ -26,17 +26,30 @@
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
+#include "channelmeters.h"
 #include "lcd/lcd.h"
 #include "lcd/ui.h"
 #include "midimonitor.h"
+#include "seqlock.h"
+#include "synth/timedmidiqueue.h"
+#include "utility.h"
 
 class CSynthBase
 {
 public:
+	// Published by the rendering core after each block, so that other cores never need to take m_Lock
+	struct TState
+	{
+		bool bActive;
+		size_t nActiveVoices;
+		float PeakLevels[2];
+	};
+
 	CSynthBase(unsigned int nSampleRate)
 		: m_Lock(TASK_LEVEL),
 		  m_nSampleRate(nSampleRate),
-		  m_pUI(nullptr)
+		  m_pUI(nullptr),
+		  m_bChannelMeters(false)
 	{
 	}
 
@@ -45,7 +58,9 @@ public:
 	virtual bool Initialize() = 0;
 	virtual void HandleMIDIShortMessage(u32 nMessage) { m_MIDIMonitor.OnShortMessage(nMessage); };
 	virtual void HandleMIDISysExMessage(const u8* pData, size_t nSize) = 0;
-	virtual bool IsActive() = 0;
+	bool IsActive() const { return m_State.Read().bActive; }
+	size_t GetActiveVoiceCount() const { return m_State.Read().nActiveVoices; }
+	TState GetState() const { return m_State.Read(); }
 	virtual void AllSoundOff() { m_MIDIMonitor.AllNotesOff(); };
 	virtual void SetMasterVolume(u8 nVolume) = 0;
 	virtual size_t Render(s16* pOutBuffer, size_t nFrames) = 0;
@@ -54,10 +69,53 @@ public:
 	virtual void UpdateLCD(CLCD& LCD, unsigned int nTicks) = 0;
 	void SetUserInterface(CUserInterface* pUI) { m_pUI = pUI; }
 
+	template <class T>
+	void PublishState(const T* pBuffer, size_t nFrames, bool bActive, size_t nActiveVoices)
+	{
+		TState State;
+		State.bActive = bActive;
+		State.nActiveVoices = nActiveVoices;
+		GetPeakLevels(pBuffer, nFrames, State.PeakLevels);
+		m_State.Write(State);
+	}
+
 	CSpinLock m_Lock;
 	unsigned int m_nSampleRate;
 	CMIDIMonitor m_MIDIMonitor;
+	CTimedMIDIQueue m_MIDIQueue;
 	CUserInterface* m_pUI;
+	CSeqLock<TState> m_State;
+
+	// Output level meters, used instead of the MIDI monitor's estimates when enabled
+	CChannelMeters m_ChannelMeters;
+	bool m_bChannelMeters;
+
+private:
+	static void GetPeakLevels(const float* pBuffer, size_t nFrames, float PeakLevels[2])
+	{
+		float nPeakL = 0.0f, nPeakR = 0.0f;
+		for (size_t i = 0; i < nFrames; ++i)
+		{
+			nPeakL = Utility::Max(nPeakL, Utility::Abs(pBuffer[i * 2]));
+			nPeakR = Utility::Max(nPeakR, Utility::Abs(pBuffer[i * 2 + 1]));
+		}
+
+		PeakLevels[0] = nPeakL;
+		PeakLevels[1] = nPeakR;
+	}
+
+	static void GetPeakLevels(const s16* pBuffer, size_t nFrames, float PeakLevels[2])
+	{
+		int nPeakL = 0, nPeakR = 0;
+		for (size_t i = 0; i < nFrames; ++i)
+		{
+			nPeakL = Utility::Max(nPeakL, Utility::Abs(static_cast<int>(pBuffer[i * 2])));
+			nPeakR = Utility::Max(nPeakR, Utility::Abs(static_cast<int>(pBuffer[i * 2 + 1])));
+		}
+
+		PeakLevels[0] = nPeakL / 32768.0f;
+		PeakLevels[1] = nPeakR / 32768.0f;
+	}
 };
 
 #endif
@@ -0,0 +1,90 @@
+//
+// timedmidiqueue.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _timedmidiqueue_h
+#define _timedmidiqueue_h
+
+#include <circle/types.h>
+
+#include "midiparser.h"
+#include "spscringbuffer.h"
+
+// Carries timestamped MIDI messages from the MIDI core to the audio core, so that each message can be
+// played back at the sample offset corresponding to its arrival time rather than at the next block boundary.
+//
+// The wall-clock period between the starts of two consecutive blocks is mapped onto the frames of the
+// later block, which trades one block of constant latency for the removal of block-sized timing jitter.
+class CTimedMIDIQueue
+{
+public:
+	// The largest message the MIDI parser delivers
+	static constexpr size_t MaxSysExSize = CMIDIParser::SysExBufferSize;
+
+	struct TMessage
+	{
+		size_t nOffset;
+		u32 nShortMessage;
+		const u8* pSysExData;
+		size_t nSysExSize;
+	};
+
+	CTimedMIDIQueue();
+
+	// Producer side (MIDI core); returns false when the queue is full
+	bool EnqueueShortMessage(u32 nMessage);
+	bool EnqueueSysExMessage(const u8* pData, size_t nSize);
+
+	// Consumer side (audio core); calls must be serialised, e.g. by the synth lock
+	void BeginBlock(size_t nFrames);
+	bool Dequeue(TMessage& Message);
+	void Flush();
+
+	// Dequeues regardless of arrival time, at offset 0; lets the MIDI core play the queued messages itself
+	// (under the synth lock) before one that doesn't fit
+	bool DequeueImmediate(TMessage& Message);
+
+private:
+	struct TEntry
+	{
+		unsigned int nTicks;
+		u32 nShortMessage;
+		size_t nSysExSize;
+	};
+
+	static constexpr size_t EntryQueueSize = 1024;
+	static constexpr size_t SysExQueueSize = 8192;
+
+	static_assert(SysExQueueSize >= MaxSysExSize, "SysEx queue must hold the largest message from the MIDI parser");
+
+	void PopEntry(const TEntry& Entry, TMessage& Message);
+
+	CSPSCRingBuffer<TEntry, EntryQueueSize> m_Entries;
+	CSPSCRingBuffer<u8, SysExQueueSize> m_SysExData;
+
+	unsigned int m_nBlockStartTicks;
+	unsigned int m_nBlockEndTicks;
+	size_t m_nBlockFrames;
+
+	u8 m_SysExBuffer[MaxSysExSize];
+};
+
+#endif
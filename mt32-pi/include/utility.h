@@ -61,6 +61,13 @@ namespace Utility
 		return nLHS > nRHS ? nLHS : nRHS;
 	}
 
+	// Templated function for taking the absolute value
+	template <class T>
+	constexpr T Abs(const T& nValue)
+	{
+		return nValue < 0 ? -nValue : nValue;
+	}
+
 	// Function for performing a linear interpolation of a value
 	constexpr float Lerp(float nValue, float nMinA, float nMaxA, float nMinB, float nMaxB)
 	{
@@ -132,14 +139,14 @@ namespace Utility
 		}
 	}
 
-	// Swaps two objects in-place
+	// Swaps two objects in-place, bitwise so that any memory they own (e.g. a CString's buffer) isn't copied
 	template<class T>
 	inline void Swap(T& ObjectA, T& ObjectB)
 	{
 		u8 Buffer[sizeof(T)];
-		memcpy(Buffer, &ObjectA, sizeof(T));
-		memcpy(&ObjectA, &ObjectB, sizeof(T));
-		memcpy(&ObjectB, Buffer, sizeof(T));
+		memcpy(Buffer, static_cast<void*>(&ObjectA), sizeof(T));
+		memcpy(static_cast<void*>(&ObjectA), static_cast<void*>(&ObjectB), sizeof(T));
+		memcpy(static_cast<void*>(&ObjectB), Buffer, sizeof(T));
 	}
 
 	namespace
@@ -23,6 +23,7 @@
 #ifndef _zoneallocator_h
 #define _zoneallocator_h
 
+#include <circle/spinlock.h>
 #include <circle/types.h>
 
 // Block allocation tags
@@ -33,13 +34,25 @@ enum TZoneTag : u32
 	FluidSynth
 };
 
+// Two-level segregated fit allocator (after TLSF): free blocks are binned by size class so that
+// allocation and free are O(1) regardless of how fragmented the heap becomes
 class CZoneAllocator
 {
 public:
+	struct TStats
+	{
+		size_t nUsedBlocks;
+		size_t nUsedBytes;
+		size_t nFreeBlocks;
+		size_t nFreeBytes;
+		size_t nLargestFreeBlock;
+		size_t nCorruptBlocks;
+	};
+
 	CZoneAllocator();
 	~CZoneAllocator();
 
-	// Allocator interface
+	// Allocator interface; safe to call from any core
 	bool Initialize();
 	void* Alloc(size_t nSize, TZoneTag Tag);
 	void* Realloc(void* pPtr, size_t nSize, TZoneTag Tag);
@@ -48,40 +61,76 @@ public:
 
 	void FreeTag(u32 nTag);
 	void Clear();
+	// Walks the whole block list, so best kept off the audio path
+	void GetStats(TStats& Stats) const;
 	void Dump() const;
 
+	// Walks the block list and the free lists and checks that they agree; logs the first problem found
+	bool CheckHeap() const;
+
 	static CZoneAllocator* Get() { return s_pThis; }
 
 private:
 	// Memory block header/linked list
 	struct TBlock
 	{
-		size_t nSize;      // 32bit: 4  bytes  |  64bit: 8  bytes
-		TBlock* pNext;     //        8  bytes  |         16 bytes
-		TBlock* pPrevious; //        12 bytes  |         24 bytes
-		TZoneTag Tag;      //        16 bytes  |         28 bytes
-		u32 nMagic;        //        20 bytes  |         32 bytes
+		size_t nSize;           // 32bit: 4  bytes  |  64bit: 8  bytes
+		TBlock* pNext;          //        8  bytes  |         16 bytes
+		TBlock* pPrevious;      //        12 bytes  |         24 bytes
+		TZoneTag Tag;           //        16 bytes  |         28 bytes
+		u32 nMagic;             //        20 bytes  |         32 bytes
+		TBlock* pNextFree;      //        24 bytes  |         40 bytes
+		TBlock* pPreviousFree;  //        28 bytes  |         48 bytes
 #if AARCH == 32
-		u8 Padding[12]; //        32 bytes  |
+		u8 Padding[4];          //        32 bytes  |
 #endif
 	};
 
 	// Constants
-	static constexpr u32 BlockMagic         = 0xDA1EDEAD;
-	static constexpr size_t MinFragmentSize = 16;
+	static constexpr u32 BlockMagic      = 0xDA1EDEAD;
+	static constexpr size_t AlignLog2    = 4;
+	static constexpr size_t MinBlockSize = (sizeof(TBlock) + sizeof(BlockMagic) + 0xF) & ~0xF;
+
+	// Size classes: blocks smaller than SmallBlockSize are binned linearly in first level 0, larger
+	// blocks by power of two (first level) subdivided into SecondLevelCount linear steps
+	static constexpr size_t SecondLevelLog2  = 3;
+	static constexpr size_t SecondLevelCount = 1 << SecondLevelLog2;
+	static constexpr size_t FirstLevelShift  = SecondLevelLog2 + AlignLog2;
+	static constexpr size_t SmallBlockSize   = 1 << FirstLevelShift;
+	static constexpr size_t FirstLevelCount  = sizeof(size_t) * 8 - FirstLevelShift + 1;
 
 	inline u32& GetEndMagic(TBlock* pBlock) const
 	{
 		return *reinterpret_cast<u32*>(reinterpret_cast<u8*>(pBlock) + pBlock->nSize - sizeof(BlockMagic));
 	}
 
+	void GatherStats(TStats& Stats) const;
+	void* AllocBlock(size_t nSize, TZoneTag Tag);
+	void* ReallocBlock(void* pPtr, size_t nSize, TZoneTag Tag);
+	void FreeBlock(void* pPtr);
+
+	static void GetSizeClass(size_t nSize, size_t& nFirstLevel, size_t& nSecondLevel);
+	TBlock* FindFreeBlock(size_t nSize);
+	void InsertFreeBlock(TBlock* pBlock);
+	void RemoveFreeBlock(TBlock* pBlock);
+	TBlock* SplitBlock(TBlock* pBlock, size_t nSize);
+	void MergeWithNext(TBlock* pBlock);
+	static void InitBlock(TBlock* pBlock, size_t nSize, TBlock* pNext, TBlock* pPrevious);
+
 	void* m_pHeap;
 	size_t m_nHeapSize;
 	TBlock m_MainBlock;
-	TBlock* m_pCurrentBlock;
+
+	// Free lists and bitmaps of which ones are non-empty
+	u64 m_nFirstLevelBitmap;
+	u32 m_SecondLevelBitmaps[FirstLevelCount];
+	TBlock* m_FreeLists[FirstLevelCount][SecondLevelCount];
 
 	size_t m_nAllocCount;
 
+	// Held while walking or modifying the block list
+	mutable CSpinLock m_Lock;
+
 	static CZoneAllocator* s_pThis;
 };
 
@@ -0,0 +1,145 @@
+//
+// channelmeters.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/util.h>
+
+#include <cmath>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CHANNEL_METERS_NEON
+#include <arm_neon.h>
+#endif
+
+#include "channelmeters.h"
+#include "utility.h"
+
+CChannelMeters::CChannelMeters()
+	: m_BlockPeaks{0.0f},
+	  m_BlockSumSquares{0.0f},
+	  m_Levels{},
+	  m_PeakHoldMillis{0.0f}
+{
+}
+
+void CChannelMeters::Measure(size_t nChannel, const float* pLeft, const float* pRight, size_t nFrames)
+{
+	float nPeak = 0.0f;
+	float nSumSquares = 0.0f;
+	size_t i = 0;
+
+#ifdef CHANNEL_METERS_NEON
+	float32x4_t Peak = vdupq_n_f32(0.0f);
+	float32x4_t SumSquares = vdupq_n_f32(0.0f);
+
+	for (; i + 4 <= nFrames; i += 4)
+	{
+		const float32x4_t Left = vld1q_f32(pLeft + i);
+		const float32x4_t Right = vld1q_f32(pRight + i);
+
+		Peak = vmaxq_f32(Peak, vmaxq_f32(vabsq_f32(Left), vabsq_f32(Right)));
+		SumSquares = vmlaq_f32(SumSquares, Left, Left);
+		SumSquares = vmlaq_f32(SumSquares, Right, Right);
+	}
+
+#ifdef __aarch64__
+	nPeak = vmaxvq_f32(Peak);
+	nSumSquares = vaddvq_f32(SumSquares);
+#else
+	float32x2_t Peak2 = vpmax_f32(vget_low_f32(Peak), vget_high_f32(Peak));
+	float32x2_t SumSquares2 = vpadd_f32(vget_low_f32(SumSquares), vget_high_f32(SumSquares));
+	nPeak = vget_lane_f32(vpmax_f32(Peak2, Peak2), 0);
+	nSumSquares = vget_lane_f32(vpadd_f32(SumSquares2, SumSquares2), 0);
+#endif
+#endif
+
+	for (; i < nFrames; ++i)
+	{
+		nPeak = Utility::Max(nPeak, Utility::Max(Utility::Abs(pLeft[i]), Utility::Abs(pRight[i])));
+		nSumSquares += pLeft[i] * pLeft[i] + pRight[i] * pRight[i];
+	}
+
+	m_BlockPeaks[nChannel] = Utility::Max(m_BlockPeaks[nChannel], nPeak);
+	m_BlockSumSquares[nChannel] += nSumSquares;
+}
+
+void CChannelMeters::MeasurePeak(size_t nChannel, float nPeak, size_t nFrames)
+{
+	// Treated like a sine wave of this peak level in both channels
+	m_BlockPeaks[nChannel] = Utility::Max(m_BlockPeaks[nChannel], nPeak);
+	m_BlockSumSquares[nChannel] += nPeak * nPeak * nFrames;
+}
+
+void CChannelMeters::Publish(size_t nFrames, unsigned int nSampleRate)
+{
+	if (!nFrames)
+		return;
+
+	const float nBlockMillis = nFrames * 1000.0f / nSampleRate;
+	const float nLevelFall = nBlockMillis / LevelFalloffTimeMillis;
+	const float nPeakFall = nBlockMillis / PeakFalloffTimeMillis;
+
+	for (size_t nChannel = 0; nChannel < MaxChannels; ++nChannel)
+	{
+		// RMS level of both channels, relative to that of a full scale sine wave
+		const float nBlockLevel = ToMeterScale(sqrtf(m_BlockSumSquares[nChannel] / nFrames));
+		const float nBlockPeak = ToMeterScale(m_BlockPeaks[nChannel]);
+
+		float& nLevel = m_Levels.Levels[nChannel];
+		nLevel = Utility::Max(nBlockLevel, nLevel - nLevelFall);
+		nLevel = Utility::Max(nLevel, 0.0f);
+
+		float& nPeakLevel = m_Levels.Peaks[nChannel];
+		if (nBlockPeak >= nPeakLevel)
+		{
+			nPeakLevel = nBlockPeak;
+			m_PeakHoldMillis[nChannel] = 0.0f;
+		}
+		else if ((m_PeakHoldMillis[nChannel] += nBlockMillis) >= PeakHoldTimeMillis)
+			nPeakLevel = Utility::Max(nPeakLevel - nPeakFall, 0.0f);
+
+		m_BlockPeaks[nChannel] = 0.0f;
+		m_BlockSumSquares[nChannel] = 0.0f;
+	}
+
+	m_PublishedLevels.Write(m_Levels);
+}
+
+void CChannelMeters::GetLevels(float* pOutLevels, float* pOutPeaks, size_t nChannels) const
+{
+	TLevels Levels;
+	m_PublishedLevels.Read(Levels);
+
+	if (nChannels > MaxChannels)
+		nChannels = MaxChannels;
+
+	memcpy(pOutLevels, Levels.Levels, nChannels * sizeof(float));
+	memcpy(pOutPeaks, Levels.Peaks, nChannels * sizeof(float));
+}
+
+float CChannelMeters::ToMeterScale(float nLevel)
+{
+	if (nLevel <= 0.0f)
+		return 0.0f;
+
+	// Decibels relative to full scale, mapped onto the meter range
+	return Utility::Clamp(1.0f + 20.0f * log10f(nLevel) / RangeDecibels, 0.0f, 1.0f);
+}
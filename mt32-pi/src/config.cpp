@@ -67,6 +67,7 @@ CONFIG_ENUM_STRINGS(TControlScheme, ENUM_CONTROLSCHEME);
 CONFIG_ENUM_STRINGS(TEncoderType, ENUM_ENCODERTYPE);
 CONFIG_ENUM_STRINGS(TLCDRotation, ENUM_LCDROTATION);
 CONFIG_ENUM_STRINGS(TLCDMirror, ENUM_LCDMIRROR);
+CONFIG_ENUM_STRINGS(TLCDMeters, ENUM_LCDMETERS);
 CONFIG_ENUM_STRINGS(TNetworkMode, ENUM_NETWORKMODE);
 
 CConfig* CConfig::s_pThis = nullptr;
@@ -96,7 +97,7 @@ bool CConfig::Initialize(const char* pPath)
 
 	if (f_read(&File, Buffer, nSize, &nRead) != FR_OK)
 	{
-		LOGERR("Error reading config file", pPath);
+		LOGERR("Error reading '%s'", pPath);
 		f_close(&File);
 		return false;
 	}
@@ -184,7 +185,8 @@ bool CConfig::ParseOption(const char* pString, CIPAddress* pOut)
 	char Buffer[16];
 	u8 IPAddress[4];
 
-	strncpy(Buffer, pString, sizeof(Buffer));
+	strncpy(Buffer, pString, sizeof(Buffer) - 1);
+	Buffer[sizeof(Buffer) - 1] = '\0';
 	char* pToken = strtok(Buffer, ".");
 
 	for (uint8_t i = 0; i < 4; ++i)
@@ -200,6 +202,46 @@ bool CConfig::ParseOption(const char* pString, CIPAddress* pOut)
 	return true;
 }
 
+bool CConfig::ParseOption(const char* pString, TMIDIChannelMask* pOut)
+{
+	u16 nMask = 0;
+	const char* pToken = pString;
+
+	while (*pToken)
+	{
+		char* pEnd;
+		const long nFirst = strtol(pToken, &pEnd, 10);
+		long nLast = nFirst;
+
+		if (pEnd == pToken)
+			return false;
+
+		// Range of channels
+		if (*pEnd == '-')
+		{
+			pToken = pEnd + 1;
+			nLast = strtol(pToken, &pEnd, 10);
+			if (pEnd == pToken)
+				return false;
+		}
+
+		if (nFirst < 1 || nLast > 16 || nFirst > nLast)
+			return false;
+
+		for (long nChannel = nFirst; nChannel <= nLast; ++nChannel)
+			nMask |= 1 << (nChannel - 1);
+
+		// Skip separators
+		while (*pEnd == ',' || *pEnd == ' ' || *pEnd == '\t')
+			++pEnd;
+
+		pToken = pEnd;
+	}
+
+	pOut->nMask = nMask;
+	return true;
+}
+
 // Define template function wrappers for parsing enums
 CONFIG_ENUM_PARSER(TSystemDefaultSynth);
 CONFIG_ENUM_PARSER(TAudioOutputDevice);
@@ -211,4 +253,5 @@ CONFIG_ENUM_PARSER(TControlScheme);
 CONFIG_ENUM_PARSER(TEncoderType);
 CONFIG_ENUM_PARSER(TLCDRotation);
 CONFIG_ENUM_PARSER(TLCDMirror);
+CONFIG_ENUM_PARSER(TLCDMeters);
 CONFIG_ENUM_PARSER(TNetworkMode);
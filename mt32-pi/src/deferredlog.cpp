@@ -0,0 +1,188 @@
+//
+// deferredlog.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "deferredlog.h"
+
+LOGMODULE("deferredlog");
+
+CDeferredLog* CDeferredLog::s_pThis = nullptr;
+
+CDeferredLog::CDeferredLog(unsigned int nLogLevel)
+	: m_nLogLevel(nLogLevel),
+	  m_bStarted(false),
+	  m_pLCDHandler(nullptr),
+	  m_pLCDParam(nullptr),
+	  m_nSequence(0),
+	  m_nDropped{},
+	  m_nDroppedReported{}
+{
+	s_pThis = this;
+}
+
+CDeferredLog::~CDeferredLog()
+{
+	s_pThis = nullptr;
+}
+
+void CDeferredLog::Start(TLCDHandler pLCDHandler, void* pLCDParam)
+{
+	m_pLCDHandler = pLCDHandler;
+	m_pLCDParam = pLCDParam;
+
+	__atomic_store_n(&m_bStarted, true, __ATOMIC_RELEASE);
+}
+
+void CDeferredLog::Stop()
+{
+	__atomic_store_n(&m_bStarted, false, __ATOMIC_RELEASE);
+
+	// Flush everything that was queued before we stopped
+	while (Drain(RingSize))
+		;
+}
+
+void CDeferredLog::Write(const char* pSource, TLogSeverity Severity, const char* pFormat, ...)
+{
+	va_list Args;
+	va_start(Args, pFormat);
+	WriteV(pSource, Severity, pFormat, Args);
+	va_end(Args);
+}
+
+void CDeferredLog::WriteV(const char* pSource, TLogSeverity Severity, const char* pFormat, va_list Args)
+{
+	if (static_cast<unsigned int>(Severity) > m_nLogLevel)
+		return;
+
+	if (!__atomic_load_n(&m_bStarted, __ATOMIC_ACQUIRE))
+	{
+		CLogger::Get()->WriteV(pSource, Severity, pFormat, Args);
+		return;
+	}
+
+	TRecord Record;
+	Record.Severity = Severity;
+	Record.pSource = pSource;
+	Record.nLCDType = NoLCD;
+	vsnprintf(Record.Message, sizeof(Record.Message), pFormat, Args);
+
+	Enqueue(Record);
+}
+
+bool CDeferredLog::WriteLCD(int nLCDType, const char* pMessage)
+{
+	// Not started; caller should update the LCD itself
+	if (!__atomic_load_n(&m_bStarted, __ATOMIC_ACQUIRE))
+		return false;
+
+	TRecord Record;
+	Record.Severity = LogNotice;
+	Record.pSource = nullptr;
+	Record.nLCDType = nLCDType;
+	strncpy(Record.Message, pMessage, sizeof(Record.Message) - 1);
+	Record.Message[sizeof(Record.Message) - 1] = '\0';
+
+	Enqueue(Record);
+	return true;
+}
+
+size_t CDeferredLog::Drain(size_t nMaxMessages)
+{
+	size_t nMessages = 0;
+
+	while (nMessages < nMaxMessages)
+	{
+		// Pick the oldest message across all rings
+		TRing* pOldestRing = nullptr;
+		TRecord Record, OldestRecord;
+
+		for (size_t nCore = 0; nCore < CORES; ++nCore)
+		{
+			for (size_t nLevel = 0; nLevel < ExecutionLevels; ++nLevel)
+			{
+				TRing& Ring = m_Rings[nCore][nLevel];
+				if (!Ring.Peek(Record))
+					continue;
+
+				if (!pOldestRing || static_cast<s32>(Record.nSequence - OldestRecord.nSequence) < 0)
+				{
+					pOldestRing = &Ring;
+					OldestRecord = Record;
+				}
+			}
+		}
+
+		if (!pOldestRing)
+			break;
+
+		pOldestRing->Dequeue(Record);
+		Output(OldestRecord);
+		++nMessages;
+	}
+
+	// Report any messages that were lost because their ring was full
+	for (size_t nCore = 0; nCore < CORES; ++nCore)
+	{
+		for (size_t nLevel = 0; nLevel < ExecutionLevels; ++nLevel)
+		{
+			const u32 nDropped = __atomic_load_n(&m_nDropped[nCore][nLevel], __ATOMIC_RELAXED);
+			if (nDropped != m_nDroppedReported[nCore][nLevel])
+			{
+				CLogger::Get()->Write(From, LogWarning, "%u log messages from core %u dropped", nDropped - m_nDroppedReported[nCore][nLevel], static_cast<unsigned int>(nCore));
+				m_nDroppedReported[nCore][nLevel] = nDropped;
+			}
+		}
+	}
+
+	return nMessages;
+}
+
+void CDeferredLog::Enqueue(TRecord& Record)
+{
+	// Each core and execution level has its own ring; an interrupt can't preempt a producer at its own level
+	static_assert(FIQ_LEVEL < ExecutionLevels, "Not enough rings for all execution levels");
+	const unsigned int nCore = CMultiCoreSupport::ThisCore();
+	const unsigned int nLevel = CurrentExecutionLevel();
+
+	Record.nSequence = __atomic_fetch_add(&m_nSequence, 1, __ATOMIC_RELAXED);
+
+	if (!m_Rings[nCore][nLevel].Enqueue(Record))
+		__atomic_store_n(&m_nDropped[nCore][nLevel], m_nDropped[nCore][nLevel] + 1, __ATOMIC_RELAXED);
+}
+
+void CDeferredLog::Output(const TRecord& Record)
+{
+	if (Record.nLCDType != NoLCD)
+	{
+		if (m_pLCDHandler)
+			m_pLCDHandler(m_pLCDParam, Record.nLCDType, Record.Message);
+		return;
+	}
+
+	CLogger::Get()->Write(Record.pSource, Record.Severity, "%s", Record.Message);
+}
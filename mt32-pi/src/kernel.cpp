@@ -37,6 +37,7 @@ CKernel::CKernel(void)
 
 	  m_Timer(&mInterrupt),
 	  m_Logger(mOptions.GetLogLevel(), &m_Timer),
+	  m_DeferredLog(mOptions.GetLogLevel()),
 	  m_USBHCI(&mInterrupt, &m_Timer, true),
 	  m_EMMC(&mInterrupt, &m_Timer, &mActLED),
 	  m_SDFileSystem{},
@@ -35,34 +35,27 @@ CSH1106::CSH1106(CI2CMaster *pI2CMaster, u8 nAddress, u8 nWidth, u8 nHeight, TLC
 {
 }
 
-void CSH1106::WriteFrameBuffer(bool bForceFullUpdate) const
+void CSH1106::WriteWindow(u8 nPage, u8 nStartColumn, u8 nEndColumn) const
 {
-	// Reset start line
-	WriteCommand(SetStartLine | 0x00);
+	// SH1106 displays have a 132x64 pixel memory, but most modules have a visible width of 128 centred on this buffer
+	const u8 nColumnAddress = nStartColumn + 2;
 
-	const size_t nPages = m_nHeight / 8;
-	constexpr size_t nPageSize = 128;
-
-	// Copy framebuffer one page at a time
-	for (u8 nPage = 0; nPage < nPages; ++nPage)
+	// SH1106 only supports page addressing, so a window is addressed by its start column
+	const u8 Commands[] =
 	{
-		const size_t nOffset = nPage * nPageSize;
-		const bool bNeedsUpdate = bForceFullUpdate || memcmp(&m_FrameBuffers[0].FrameBuffer[nOffset], &m_FrameBuffers[1].FrameBuffer[nOffset], nPageSize) != 0;
-
-		if (bNeedsUpdate)
-		{
-			WriteCommand(SetPageAddress | nPage);
-
-			// SH1106 displays have a 132x64 pixel memory, but most modules have a visible width of 128 centred on this buffer
-			WriteCommand(SetColumnAddressLow | 0x02);
-			WriteCommand(SetColumnAddressHigh | 0x00);
+		ControlByteCommandStream,
+		SetStartLine | 0x00,						// Reset start line
+		static_cast<u8>(SetPageAddress | nPage),
+		static_cast<u8>(SetColumnAddressLow | (nColumnAddress & 0x0F)),
+		static_cast<u8>(SetColumnAddressHigh | (nColumnAddress >> 4)),
+	};
 
-			// Prefix this page's pixel data with a data control byte
-			u8 Buffer[nPageSize + 1] = { 0x40 };
-			memcpy(Buffer + 1, &m_FrameBuffers[m_nCurrentFrameBuffer].FrameBuffer[nOffset], nPageSize);
+	WriteI2C(Commands, sizeof(Commands));
 
-			m_pI2CMaster->Write(m_nAddress, Buffer, sizeof(Buffer));
+	// Prefix the window's pixel data with a data control byte
+	const size_t nColumns = nEndColumn - nStartColumn + 1;
+	u8 Buffer[1 + MaxWidth] = { ControlByteDataStream };
+	memcpy(Buffer + 1, &m_FrameBuffers[m_nCurrentFrameBuffer].FrameBuffer[nPage * m_nWidth + nStartColumn], nColumns);
 
-		}
-	}
+	WriteI2C(Buffer, nColumns + 1);
 }
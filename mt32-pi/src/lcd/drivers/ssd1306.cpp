@@ -149,6 +149,9 @@ constexpr auto MisterLogo = CSSD1306Image<128, 32>(MisterLogo128x32);
 // Drawing constants
 constexpr u8 BarSpacing = 2;
 
+// Unchanged columns between two changed regions of a page that are cheaper to resend than to start a new window for
+constexpr u8 MaxWindowGap = 8;
+
 CSSD1306::CSSD1306(CI2CMaster* pI2CMaster, u8 nAddress, u8 nWidth, u8 nHeight, TLCDRotation Rotation, TLCDMirror Mirror)
 	: CLCD(nWidth, nHeight),
 	  m_pI2CMaster(pI2CMaster),
@@ -156,8 +159,9 @@ CSSD1306::CSSD1306(CI2CMaster* pI2CMaster, u8 nAddress, u8 nWidth, u8 nHeight, T
 	  m_Rotation(Rotation),
 	  m_Mirror(Mirror),
 
-	  m_FrameBuffers{{0x40, {0}}, {0x40, {0}}},
-	  m_nCurrentFrameBuffer(0)
+	  m_FrameBuffers{{ControlByteDataStream, {0}}, {ControlByteDataStream, {0}}},
+	  m_nCurrentFrameBuffer(0),
+	  m_bFullUpdatePending(true)
 {
 }
 
@@ -214,24 +218,83 @@ bool CSSD1306::Initialize()
 	return true;
 }
 
+void CSSD1306::WriteI2C(const void* pBuffer, size_t nSize) const
+{
+	m_pI2CMaster->Write(m_nAddress, pBuffer, nSize);
+}
+
 void CSSD1306::WriteCommand(u8 nCommand) const
 {
-	const u8 Buffer[] = { 0x80, nCommand };
-	m_pI2CMaster->Write(m_nAddress, Buffer, sizeof(Buffer));
+	const u8 Buffer[] = { ControlByteCommand, nCommand };
+	WriteI2C(Buffer, sizeof(Buffer));
+}
+
+void CSSD1306::WriteFrameBuffer(bool bForceFullUpdate)
+{
+	const bool bFullUpdate = bForceFullUpdate || m_bFullUpdatePending;
+
+	// An immediate update leaves the display showing the current framebuffer, so the next flip can't diff against the other one
+	m_bFullUpdatePending = bForceFullUpdate;
+
+	const u8* pNewFrameBuffer = m_FrameBuffers[m_nCurrentFrameBuffer].FrameBuffer;
+	const u8* pOldFrameBuffer = m_FrameBuffers[(m_nCurrentFrameBuffer + 1) % 2].FrameBuffer;
+	const u8 nPages = m_nHeight / 8;
+
+	for (u8 nPage = 0; nPage < nPages; ++nPage)
+	{
+		const size_t nOffset = nPage * m_nWidth;
+
+		if (bFullUpdate)
+		{
+			WriteWindow(nPage, 0, m_nWidth - 1);
+			continue;
+		}
+
+		if (memcmp(pNewFrameBuffer + nOffset, pOldFrameBuffer + nOffset, m_nWidth) == 0)
+			continue;
+
+		// Send each changed run of columns, merging runs separated by small gaps
+		int nStartColumn = -1;
+		int nEndColumn = -1;
+
+		for (int nColumn = 0; nColumn < m_nWidth; ++nColumn)
+		{
+			if (pNewFrameBuffer[nOffset + nColumn] == pOldFrameBuffer[nOffset + nColumn])
+				continue;
+
+			if (nStartColumn < 0)
+				nStartColumn = nColumn;
+			else if (nColumn - nEndColumn > MaxWindowGap)
+			{
+				WriteWindow(nPage, nStartColumn, nEndColumn);
+				nStartColumn = nColumn;
+			}
+
+			nEndColumn = nColumn;
+		}
+
+		WriteWindow(nPage, nStartColumn, nEndColumn);
+	}
 }
 
-void CSSD1306::WriteFrameBuffer(bool bForceFullUpdate) const
+void CSSD1306::WriteWindow(u8 nPage, u8 nStartColumn, u8 nEndColumn) const
 {
-	// Reset start line
-	WriteCommand(SetStartLine | 0x00);
+	const u8 Commands[] =
+	{
+		ControlByteCommandStream,
+		SetStartLine | 0x00,						// Reset start line
+		SetColumnAddress,	nStartColumn,	nEndColumn,
+		SetPageAddress,		nPage,		nPage,
+	};
+
+	WriteI2C(Commands, sizeof(Commands));
 
-	// Compare two framebuffers
-	const size_t nFrameBufferSize = m_nWidth * m_nHeight / 8;
-	const bool bNeedsUpdate = bForceFullUpdate || memcmp(m_FrameBuffers[0].FrameBuffer, m_FrameBuffers[1].FrameBuffer, nFrameBufferSize) != 0;
+	// Prefix the window's pixel data with a data control byte
+	const size_t nColumns = nEndColumn - nStartColumn + 1;
+	u8 Buffer[1 + MaxWidth] = { ControlByteDataStream };
+	memcpy(Buffer + 1, &m_FrameBuffers[m_nCurrentFrameBuffer].FrameBuffer[nPage * m_nWidth + nStartColumn], nColumns);
 
-	// Copy entire framebuffer
-	if (bNeedsUpdate)
-		m_pI2CMaster->Write(m_nAddress, &m_FrameBuffers[m_nCurrentFrameBuffer], sizeof(TFrameBufferUpdatePacket::DataControlByte) + nFrameBufferSize);
+	WriteI2C(Buffer, nColumns + 1);
 }
 
 void CSSD1306::SwapFrameBuffers()
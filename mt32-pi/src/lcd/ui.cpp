@@ -40,6 +40,7 @@ CUserInterface::CUserInterface()
 	  m_bIsScrolling(false),
 	  m_nCurrentScrollOffset(0),
 	  m_nCurrentSpinnerChar(0),
+	  m_nSpinnerProgress(-1),
 	  m_CurrentImage(TImage::None),
 	  m_SystemMessageTextBuffer{'\0'},
 	  m_SysExDisplayMessageType(TSysExDisplayMessage::Roland),
@@ -98,8 +99,19 @@ void CUserInterface::Update(CLCD& LCD, CSynthBase& Synth, unsigned int nTicks)
 		// TODO: API for getting width in pixels/characters for a string
 		const size_t nCharWidth = LCD.GetType() == CLCD::TType::Graphical ? 20 : LCD.Width();
 
-		m_nCurrentSpinnerChar = (m_nCurrentSpinnerChar + 1) % sizeof(SpinnerChars);
-		m_SystemMessageTextBuffer[nCharWidth - 2] = SpinnerChars[m_nCurrentSpinnerChar];
+		const int nProgress = m_nSpinnerProgress;
+		if (nProgress >= 0)
+		{
+			// Percentage takes the place of the spinner
+			char ProgressText[5];
+			snprintf(ProgressText, sizeof(ProgressText), "%3d%%", Utility::Min(nProgress, 100));
+			memcpy(m_SystemMessageTextBuffer + nCharWidth - 5, ProgressText, 4);
+		}
+		else
+		{
+			m_nCurrentSpinnerChar = (m_nCurrentSpinnerChar + 1) % sizeof(SpinnerChars);
+			m_SystemMessageTextBuffer[nCharWidth - 2] = SpinnerChars[m_nCurrentSpinnerChar];
+		}
 		m_nStateTime = nTicks;
 	}
 
@@ -111,7 +123,7 @@ void CUserInterface::Update(CLCD& LCD, CSynthBase& Synth, unsigned int nTicks)
 	}
 
 	// SC-55 text timeout
-	else if ((m_State == TState::DisplayingSysExText && !m_bIsScrolling || m_State == TState::DisplayingSysExBitmap) && nDeltaTicks >= Utility::MillisToTicks(SC55DisplayTimeMillis))
+	else if (((m_State == TState::DisplayingSysExText && !m_bIsScrolling) || m_State == TState::DisplayingSysExBitmap) && nDeltaTicks >= Utility::MillisToTicks(SC55DisplayTimeMillis))
 	{
 		m_State = TState::None;
 		m_nStateTime = nTicks;
@@ -152,6 +164,7 @@ void CUserInterface::ShowSystemMessage(const char* pMessage, bool bSpinner)
 		snprintf(m_SystemMessageTextBuffer, sizeof(m_SystemMessageTextBuffer), "%-*.*s %c", nMaxMessageLen, nMaxMessageLen, pMessage, SpinnerChars[0]);
 		m_State = TState::DisplayingSpinnerMessage;
 		m_nCurrentSpinnerChar = 0;
+		m_nSpinnerProgress = -1;
 	}
 	else
 	{
@@ -167,6 +180,7 @@ void CUserInterface::ClearSpinnerMessage()
 {
 	m_State = TState::None;
 	m_nCurrentSpinnerChar = 0;
+	m_nSpinnerProgress = -1;
 }
 
 void CUserInterface::DisplayImage(TImage Image)
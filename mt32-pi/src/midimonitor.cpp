@@ -24,19 +24,48 @@
 
 #include "midimonitor.h"
 
+namespace
+{
+	constexpr unsigned int AttackTimeMillis = 20;
+	constexpr unsigned int DecayTimeMillis = 100;
+	constexpr float SustainLevel = 0.8f;
+	constexpr unsigned int ReleaseTimeMillis = 150;
+
+	constexpr unsigned int PeakHoldTimeMillis = 2000;
+	constexpr unsigned int PeakFalloffTimeMillis = 1000;
+
+	// Envelope times and rates pre-scaled to clock ticks, so that no divisions are needed per note
+	constexpr unsigned int AttackTicks = Utility::MillisToTicks(AttackTimeMillis);
+	constexpr unsigned int DecayTicks = Utility::MillisToTicks(DecayTimeMillis);
+	constexpr unsigned int ReleaseTicks = Utility::MillisToTicks(ReleaseTimeMillis);
+	constexpr unsigned int PeakHoldTicks = Utility::MillisToTicks(PeakHoldTimeMillis);
+
+	constexpr float AttackRate = 1.0f / AttackTicks;
+	constexpr float DecayRate = (1.0f - SustainLevel) / DecayTicks;
+	constexpr float ReleaseRate = 1.0f / ReleaseTicks;
+	constexpr float PeakFalloffRate = 1.0f / Utility::MillisToTicks(PeakFalloffTimeMillis);
+	constexpr float VelocityScale = 1.0f / 127.0f;
+	constexpr float ChannelGainScale = 1.0f / (127.0f * 127.0f);
+}
+
 CMIDIMonitor::CMIDIMonitor()
 	: m_PeakLevels{0.0f},
 	  m_PeakTimes{0}
 {
 	for (auto& Channel : m_State)
 	{
+		for (size_t i = 0; i < NoteWordCount; ++i)
+		{
+			Channel.ActiveNotes[i] = 0;
+			Channel.DamperNotes[i] = 0;
+		}
+
 		for (auto& Note : Channel.Notes)
 		{
 			Note.EnvelopePhase = TEnvelopePhase::Idle;
 			Note.nNoteOnTime = 0;
 			Note.nNoteOffTime = 0;
-			Note.nVelocity = 0;
-			Note.bDamperFlag = false;
+			Note.nVelocityLevel = 0.0f;
 		}
 	}
 
@@ -47,39 +76,25 @@ void CMIDIMonitor::OnShortMessage(u32 nMessage)
 {
 	const u8 nStatus  = nMessage & 0xF0;
 	const u8 nChannel = nMessage & 0x0F;
-	const u8 nData1   = (nMessage >> 8) & 0xFF;
-	const u8 nData2   = (nMessage >> 16) & 0xFF;
+	const u8 nData1   = (nMessage >> 8) & 0x7F;
+	const u8 nData2   = (nMessage >> 16) & 0x7F;
 
 	TChannelState& ChannelState = m_State[nChannel];
-	TNoteState& NoteState = ChannelState.Notes[nData1];
 	const unsigned int nTicks = CTimer::GetClockTicks();
 
 	switch (nStatus)
 	{
 		// Note off
 		case 0x80:
-			if (!NoteState.bDamperFlag)
-			{
-				NoteState.EnvelopePhase = TEnvelopePhase::NoteOff;
-				NoteState.nNoteOffTime = nTicks;
-			}
-
+			NoteOff(ChannelState, nData1, nTicks);
 			break;
 
 		// Note on
 		case 0x90:
 			if (nData2)
-			{
-				NoteState.EnvelopePhase = TEnvelopePhase::NoteOn;
-				NoteState.nNoteOnTime = nTicks;
-				NoteState.nVelocity = nData2;
-				NoteState.bDamperFlag = ChannelState.nDamper;
-			}
-			else if (!NoteState.bDamperFlag)
-			{
-				NoteState.EnvelopePhase = TEnvelopePhase::NoteOff;
-				NoteState.nNoteOffTime = nTicks;
-			}
+				NoteOn(ChannelState, nData1, nData2, nTicks);
+			else
+				NoteOff(ChannelState, nData1, nTicks);
 			break;
 
 		// Control change
@@ -101,26 +116,44 @@ void CMIDIMonitor::GetChannelLevels(unsigned int nTicks, float* pOutLevels, floa
 {
 	for (size_t nChannel = 0; nChannel < ChannelCount; ++nChannel)
 	{
+		TChannelState& ChannelState = m_State[nChannel];
 		const bool bIsPercussionChannel = nPercussionBitMask & (1 << nChannel);
 		float nChannelVolume = 0.0f;
 
-		for (size_t nNote = 0; nNote < NoteCount; ++nNote)
+		// Visit only the notes whose envelopes are still running
+		for (size_t nWord = 0; nWord < NoteWordCount; ++nWord)
 		{
-			TNoteState& NoteState = m_State[nChannel].Notes[nNote];
-			const float nEnvelope = bIsPercussionChannel ? ComputePercussionEnvelope(NoteState) : ComputeEnvelope(NoteState);
-			const float nNoteVolume = nEnvelope * (NoteState.nVelocity / 127.0f) * (m_State[nChannel].nVolume / 127.0f) * (m_State[nChannel].nExpression / 127.0f);
-			nChannelVolume = Utility::Max(nChannelVolume, nNoteVolume);
+			u32 nActiveNotes = __atomic_load_n(&ChannelState.ActiveNotes[nWord], __ATOMIC_ACQUIRE);
+
+			while (nActiveNotes)
+			{
+				const u8 nNote = nWord * 32 + __builtin_ctz(nActiveNotes);
+				nActiveNotes &= nActiveNotes - 1;
+
+				const TNoteState& NoteState = ChannelState.Notes[nNote];
+				const unsigned int nNoteOnTime = NoteState.nNoteOnTime;
+				float nEnvelope;
+
+				const bool bSounding = bIsPercussionChannel ? ComputePercussionEnvelope(NoteState, nTicks, nEnvelope) : ComputeEnvelope(NoteState, nTicks, nEnvelope);
+				if (!bSounding)
+				{
+					RetireNote(ChannelState, nNote, nNoteOnTime);
+					continue;
+				}
+
+				nChannelVolume = Utility::Max(nChannelVolume, nEnvelope * NoteState.nVelocityLevel);
+			}
 		}
 
+		nChannelVolume *= ChannelState.nVolume * ChannelState.nExpression * ChannelGainScale;
 		nChannelVolume = Utility::Clamp(nChannelVolume, 0.0f, 1.0f);
 
 		float nPeakLevel = m_PeakLevels[nChannel];
-		const float nPeakUpdatedMillis = Utility::TicksToMillis(nTicks - m_PeakTimes[nChannel]);
+		const unsigned int nPeakUpdatedTicks = nTicks - m_PeakTimes[nChannel];
 
-		if (nPeakUpdatedMillis >= PeakHoldTimeMillis)
+		if (nPeakUpdatedTicks >= PeakHoldTicks)
 		{
-			const float nPeakFallMillis = Utility::Max(nPeakUpdatedMillis - PeakHoldTimeMillis, 0.0f);
-			nPeakLevel -= nPeakFallMillis / PeakFalloffTimeMillis;
+			nPeakLevel -= (nPeakUpdatedTicks - PeakHoldTicks) * PeakFalloffRate;
 			nPeakLevel = Utility::Clamp(nPeakLevel, 0.0f, 1.0f);
 		}
 
@@ -142,15 +175,23 @@ void CMIDIMonitor::AllNotesOff()
 
 	for (auto& Channel : m_State)
 	{
-		for (auto& Note : Channel.Notes)
+		for (size_t nWord = 0; nWord < NoteWordCount; ++nWord)
 		{
-			if (Note.EnvelopePhase == TEnvelopePhase::NoteOn)
+			u32 nActiveNotes = __atomic_load_n(&Channel.ActiveNotes[nWord], __ATOMIC_ACQUIRE);
+
+			while (nActiveNotes)
 			{
-				Note.EnvelopePhase = TEnvelopePhase::NoteOff;
-				Note.nNoteOffTime = nTicks;
+				TNoteState& Note = Channel.Notes[nWord * 32 + __builtin_ctz(nActiveNotes)];
+				nActiveNotes &= nActiveNotes - 1;
+
+				if (Note.EnvelopePhase == TEnvelopePhase::NoteOn)
+				{
+					Note.nNoteOffTime = nTicks;
+					__atomic_store_n(&Note.EnvelopePhase, TEnvelopePhase::NoteOff, __ATOMIC_RELEASE);
+				}
 			}
 
-			Note.bDamperFlag = false;
+			Channel.DamperNotes[nWord] = 0;
 		}
 	}
 }
@@ -172,6 +213,51 @@ void CMIDIMonitor::ResetControllers(bool bIsResetAllControllers)
 	}
 }
 
+void CMIDIMonitor::NoteOn(TChannelState& ChannelState, u8 nNote, u8 nVelocity, unsigned int nTicks)
+{
+	TNoteState& NoteState = ChannelState.Notes[nNote];
+	const u32 nBit = 1 << (nNote % 32);
+
+	NoteState.nNoteOnTime = nTicks;
+	NoteState.nVelocityLevel = nVelocity * VelocityScale;
+	__atomic_store_n(&NoteState.EnvelopePhase, TEnvelopePhase::NoteOn, __ATOMIC_RELAXED);
+
+	// Publish the note state before making it visible to GetChannelLevels()
+	ChannelState.DamperNotes[nNote / 32] &= ~nBit;
+	__atomic_fetch_or(&ChannelState.ActiveNotes[nNote / 32], nBit, __ATOMIC_RELEASE);
+}
+
+void CMIDIMonitor::NoteOff(TChannelState& ChannelState, u8 nNote, unsigned int nTicks)
+{
+	TNoteState& NoteState = ChannelState.Notes[nNote];
+	const u32 nBit = 1 << (nNote % 32);
+
+	if (NoteState.EnvelopePhase != TEnvelopePhase::NoteOn)
+		return;
+
+	// Held by the damper pedal; released when the pedal is
+	if (ChannelState.nDamper)
+	{
+		ChannelState.DamperNotes[nNote / 32] |= nBit;
+		return;
+	}
+
+	NoteState.nNoteOffTime = nTicks;
+	__atomic_store_n(&NoteState.EnvelopePhase, TEnvelopePhase::NoteOff, __ATOMIC_RELEASE);
+}
+
+void CMIDIMonitor::RetireNote(TChannelState& ChannelState, u8 nNote, unsigned int nNoteOnTime)
+{
+	const u32 nBit = 1 << (nNote % 32);
+	u32& nActiveNotes = ChannelState.ActiveNotes[nNote / 32];
+
+	__atomic_fetch_and(&nActiveNotes, ~nBit, __ATOMIC_ACQ_REL);
+
+	// The note may have been retriggered by the MIDI core while its envelope was being computed
+	if (__atomic_load_n(&ChannelState.Notes[nNote].nNoteOnTime, __ATOMIC_ACQUIRE) != nNoteOnTime)
+		__atomic_fetch_or(&nActiveNotes, nBit, __ATOMIC_RELEASE);
+}
+
 void CMIDIMonitor::ProcessCC(u8 nChannel, u8 nCC, u8 nValue, unsigned int nTicks)
 {
 	TChannelState& ChannelState = m_State[nChannel];
@@ -197,16 +283,18 @@ void CMIDIMonitor::ProcessCC(u8 nChannel, u8 nCC, u8 nValue, unsigned int nTicks
 		case 0x40:
 			ChannelState.nDamper = nValue;
 
-			// Damper released; trigger note-off for flagged notes
+			// Damper released; trigger note-off for notes it was holding
 			if (!nValue)
 			{
-				for (auto& Note : ChannelState.Notes)
+				for (size_t nWord = 0; nWord < NoteWordCount; ++nWord)
 				{
-					if (Note.bDamperFlag)
+					u32 nDamperNotes = ChannelState.DamperNotes[nWord];
+					ChannelState.DamperNotes[nWord] = 0;
+
+					while (nDamperNotes)
 					{
-						Note.EnvelopePhase = TEnvelopePhase::NoteOff;
-						Note.nNoteOffTime = nTicks;
-						Note.bDamperFlag = false;
+						NoteOff(ChannelState, nWord * 32 + __builtin_ctz(nDamperNotes), nTicks);
+						nDamperNotes &= nDamperNotes - 1;
 					}
 				}
 			}
@@ -233,83 +321,57 @@ void CMIDIMonitor::ProcessCC(u8 nChannel, u8 nCC, u8 nValue, unsigned int nTicks
 	}
 }
 
-float CMIDIMonitor::ComputeEnvelope(TNoteState& NoteState) const
+float CMIDIMonitor::ComputeGateEnvelope(unsigned int nGateTicks)
 {
-	switch (NoteState.EnvelopePhase)
-	{
-		// Note is on
-		case TEnvelopePhase::NoteOn:
-		{
-			const unsigned int nTicks = CTimer::GetClockTicks();
-			const float nNoteOnDurationMillis = Utility::TicksToMillis(nTicks - NoteState.nNoteOnTime);
+	// Attack phase
+	if (nGateTicks < AttackTicks)
+		return nGateTicks * AttackRate;
 
-			// Attack phase
-			if (nNoteOnDurationMillis < AttackTimeMillis)
-				return nNoteOnDurationMillis / AttackTimeMillis;
+	// Decay phase
+	if (nGateTicks < AttackTicks + DecayTicks)
+		return 1.0f - (nGateTicks - AttackTicks) * DecayRate;
 
-			// Decay phase
-			else if (nNoteOnDurationMillis < AttackTimeMillis + DecayTimeMillis)
-			{
-				const float nDecayDurationMillis = nNoteOnDurationMillis - AttackTimeMillis;
-				return 1.0f - (nDecayDurationMillis / DecayTimeMillis) * (1.0f - SustainLevel);
-			}
+	// Sustain phase
+	return SustainLevel;
+}
 
-			// Sustain phase
-			return SustainLevel;
-		}
+bool CMIDIMonitor::ComputeEnvelope(const TNoteState& NoteState, unsigned int nTicks, float& nOutLevel)
+{
+	switch (__atomic_load_n(&NoteState.EnvelopePhase, __ATOMIC_ACQUIRE))
+	{
+		// Note is on
+		case TEnvelopePhase::NoteOn:
+			nOutLevel = ComputeGateEnvelope(nTicks - NoteState.nNoteOnTime);
+			return true;
 
 		// Note has been released
 		case TEnvelopePhase::NoteOff:
 		{
-			const float nGateDurationMillis = Utility::TicksToMillis(NoteState.nNoteOffTime - NoteState.nNoteOnTime);
-			float nVolume;
-
-			// Note off during attack phase
-			if (nGateDurationMillis < AttackTimeMillis)
-				nVolume = nGateDurationMillis / AttackTimeMillis;
-
-			// Note off during decay phase
-			else if (nGateDurationMillis < AttackTimeMillis + DecayTimeMillis)
-				nVolume = 1.0f - ((nGateDurationMillis - AttackTimeMillis) / DecayTimeMillis) * (1.0f - SustainLevel);
-
-			// Note off during sustain phase
-			else
-				nVolume = SustainLevel;
-
-			const unsigned int nTicks = CTimer::GetClockTicks();
-			const float nNoteOffDurationMillis = Utility::TicksToMillis(nTicks - NoteState.nNoteOffTime);
+			const unsigned int nNoteOffTicks = nTicks - NoteState.nNoteOffTime;
 
 			// Envelope is complete
-			if (nNoteOffDurationMillis > ReleaseTimeMillis)
-			{
-				NoteState.EnvelopePhase = TEnvelopePhase::Idle;
-				return 0.0f;
-			}
+			if (nNoteOffTicks > ReleaseTicks)
+				return false;
 
-			return nVolume - nNoteOffDurationMillis / ReleaseTimeMillis;
+			nOutLevel = ComputeGateEnvelope(NoteState.nNoteOffTime - NoteState.nNoteOnTime) - nNoteOffTicks * ReleaseRate;
+			return true;
 		}
 
 		// Envelope has finished
 		default:
-			return 0.0f;
+			return false;
 	}
 }
 
-float CMIDIMonitor::ComputePercussionEnvelope(TNoteState& NoteState) const
+bool CMIDIMonitor::ComputePercussionEnvelope(const TNoteState& NoteState, unsigned int nTicks, float& nOutLevel)
 {
-	if (NoteState.EnvelopePhase == TEnvelopePhase::Idle)
-		return 0.0f;
-
-	const unsigned int nTicks = CTimer::GetClockTicks();
-	const float nNoteOnDurationMillis = Utility::TicksToMillis(nTicks - NoteState.nNoteOnTime);
+	const unsigned int nNoteOnTicks = nTicks - NoteState.nNoteOnTime;
 
 	// Envelope is complete
-	if (nNoteOnDurationMillis > ReleaseTimeMillis)
-	{
-		NoteState.EnvelopePhase = TEnvelopePhase::Idle;
-		return 0.0f;
-	}
+	if (nNoteOnTicks > ReleaseTicks)
+		return false;
 
 	// No decay/sustain for percussion
-	return 1.0f - nNoteOnDurationMillis / ReleaseTimeMillis;
+	nOutLevel = 1.0f - nNoteOnTicks * ReleaseRate;
+	return true;
 }
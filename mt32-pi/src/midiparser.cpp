@@ -22,6 +22,7 @@
 
 #include <circle/logger.h>
 
+#include "deferredlog.h"
 #include "midiparser.h"
 
 LOGMODULE("midiparser");
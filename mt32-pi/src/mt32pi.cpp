@@ -28,10 +28,14 @@
 
 #include <cstdarg>
 
+#include "deferredlog.h"
 #include "lcd/drivers/hd44780.h"
 #include "lcd/drivers/ssd1306.h"
 #include "lcd/ui.h"
 #include "mt32pi.h"
+#include "rendermonitor.h"
+#include "sampleconverter.h"
+#include "zoneallocator.h"
 
 #define MT32_PI_NAME "mt32-pi"
 LOGMODULE(MT32_PI_NAME);
@@ -46,7 +50,15 @@ constexpr u32 MisterUpdatePeriodMillis             = 50;
 constexpr u32 LEDTimeoutMillis                     = 50;
 constexpr u32 ActiveSenseTimeoutMillis             = 330;
 
-constexpr float Sample24BitMax = (1 << 24 - 1) - 1;
+// Log messages written out by the UI task per loop iteration, so that the LCD keeps updating
+constexpr size_t LogDrainBatchSize                 = 8;
+
+// Upper bound for the adaptive audio queue; AudioTask keeps its conversion buffers on the stack
+constexpr int MinAudioQueueSize                    = 32;
+constexpr int MaxAudioQueueSize                    = 1024;
+
+// Upper bound for the RTP-MIDI playout buffer latency
+constexpr int MaxRTPMIDILatencyMillis              = 100;
 
 enum class TCustomSysExCommand : u8
 {
@@ -55,6 +67,7 @@ enum class TCustomSysExCommand : u8
 	SwitchSoundFont       = 0x02,
 	SwitchSynth           = 0x03,
 	SetMT32ReversedStereo = 0x04,
+	ReportStatistics      = 0x05,
 };
 
 CMT32Pi* CMT32Pi::s_pThis = nullptr;
@@ -112,6 +125,7 @@ CMT32Pi::CMT32Pi(CI2CMaster* pI2CMaster, CSPIMaster* pSPIMaster, CInterruptSyste
 
 	  m_bRunning(true),
 	  m_bUITaskDone(false),
+	  m_bStatisticsRequested(false),
 	  m_bLEDOn(false),
 	  m_nLEDOnTime(0),
 
@@ -121,7 +135,8 @@ CMT32Pi::CMT32Pi(CI2CMaster* pI2CMaster, CSPIMaster* pSPIMaster, CInterruptSyste
 	  m_nMasterVolume(100),
 	  m_pCurrentSynth(nullptr),
 	  m_pMT32Synth(nullptr),
-	  m_pSoundFontSynth(nullptr)
+	  m_pSoundFontSynth(nullptr),
+	  m_pLayeredSynth(nullptr)
 {
 	s_pThis = this;
 }
@@ -254,6 +269,10 @@ bool CMT32Pi::Initialize(bool bSerialMIDIAvailable)
 		}
 	}
 
+	// Leave room for the adaptive queue to grow into
+	if (m_pConfig->AudioAdaptiveQueue)
+		nQueueSize = Utility::Max(nQueueSize, static_cast<unsigned int>(Utility::Clamp(m_pConfig->AudioMaxQueueSize, MinAudioQueueSize, MaxAudioQueueSize)));
+
 	m_pSound->SetWriteFormat(Format);
 	if (!m_pSound->AllocateQueueFrames(nQueueSize))
 		LOGPANIC("Failed to allocate sound queue");
@@ -271,17 +290,21 @@ bool CMT32Pi::Initialize(bool bSerialMIDIAvailable)
 		m_pControl = nullptr;
 	}
 
-	//LCDLog(TLCDLogType::Startup, "Init mt32emu");
-	//InitMT32Synth();
+	LCDLog(TLCDLogType::Startup, "Init mt32emu");
+	InitMT32Synth();
 
 	LCDLog(TLCDLogType::Startup, "Init FluidSynth");
 	InitSoundFontSynth();
 
+	InitLayeredSynth();
+
 	// Set initial synthesizer
 	if (m_pConfig->SystemDefaultSynth == CConfig::TSystemDefaultSynth::MT32)
 		m_pCurrentSynth = m_pMT32Synth;
 	else if (m_pConfig->SystemDefaultSynth == CConfig::TSystemDefaultSynth::SoundFont)
 		m_pCurrentSynth = m_pSoundFontSynth;
+	else if (m_pConfig->SystemDefaultSynth == CConfig::TSystemDefaultSynth::Layered)
+		m_pCurrentSynth = m_pLayeredSynth;
 
 	if (!m_pCurrentSynth)
 	{
@@ -412,6 +435,34 @@ bool CMT32Pi::InitSoundFontSynth()
 	return true;
 }
 
+bool CMT32Pi::InitLayeredSynth()
+{
+	assert(m_pLayeredSynth == nullptr);
+
+	// Needs both engines
+	if (!(m_pMT32Synth && m_pSoundFontSynth))
+		return false;
+
+	CLayeredSynth* const pLayeredSynth = new CLayeredSynth(*m_pMT32Synth, *m_pSoundFontSynth, m_pSound->GetQueueSizeFrames());
+	pLayeredSynth->SetChannelMasks(m_pConfig->LayeredMT32Channels.nMask, m_pConfig->LayeredSoundFontChannels.nMask);
+	pLayeredSynth->SetGains(m_pConfig->LayeredMT32Gain, m_pConfig->LayeredSoundFontGain);
+
+	if (!pLayeredSynth->Initialize())
+	{
+		LOGWARN("Layered synth init failed");
+		delete pLayeredSynth;
+		return false;
+	}
+
+	pLayeredSynth->SetUserInterface(&m_UserInterface);
+
+	// Publish only once fully initialized; the render task polls for it
+	DataMemBarrier();
+	m_pLayeredSynth = pLayeredSynth;
+
+	return true;
+}
+
 void CMT32Pi::MainTask()
 {
 	CScheduler* const pScheduler = CScheduler::Get();
@@ -484,6 +535,14 @@ void CMT32Pi::MainTask()
 			}
 		}
 
+		// Complete SoundFont switches loaded in the background
+		if (m_pSoundFontSynth)
+			UpdateSoundFontSwitch();
+
+		// Read samples for instruments selected by MIDI messages
+		if (m_pSoundFontSynth)
+			m_pSoundFontSynth->UpdateDynamicSamples();
+
 		// Check for USB PnP events
 		UpdateUSB();
 
@@ -506,12 +565,9 @@ void CMT32Pi::UITask()
 
 	const bool bMisterEnabled = m_pConfig->ControlMister;
 
-	// Nothing for this core to do; bail out
-	if (!(m_pLCD || bMisterEnabled))
-	{
-		m_bUITaskDone = true;
-		return;
-	}
+	// From now on, this core writes out log messages on behalf of the others
+	CDeferredLog* const pDeferredLog = CDeferredLog::Get();
+	pDeferredLog->Start(LCDLogHandler, this);
 
 	// Display current MT-32 ROM version/SoundFont
 	m_pCurrentSynth->ReportStatus();
@@ -520,6 +576,9 @@ void CMT32Pi::UITask()
 	{
 		const unsigned int nTicks = CTimer::GetClockTicks();
 
+		// Write out queued log messages (and LCD messages, before updating the LCD)
+		pDeferredLog->Drain(LogDrainBatchSize);
+
 		// Update LCD
 		if (m_pLCD && (nTicks - m_nLCDUpdateTime) >= Utility::MillisToTicks(LCDUpdatePeriodMillis))
 		{
@@ -548,6 +607,9 @@ void CMT32Pi::UITask()
 		}
 	}
 
+	// Flush log messages and go back to logging directly
+	pDeferredLog->Stop();
+
 	// Clear screen
 	if (m_pLCD)
 		m_pLCD->Clear();
@@ -563,47 +625,84 @@ void CMT32Pi::AudioTask()
 
 	// Circle's "fast path" for I2S 24-bit really expects 32-bit samples
 	const bool bI2S = m_pConfig->AudioOutputDevice == CConfig::TAudioOutputDevice::I2S;
-	const bool bReversedStereo = m_pConfig->AudioReversedStereo;
 	const u8 nBytesPerSample = bI2S ? sizeof(s32) : (sizeof(s8) * 3);
 	const u8 nBytesPerFrame = 2 * nBytesPerSample;
 
 	const size_t nQueueSizeFrames = m_pSound->GetQueueSizeFrames();
 
-	// Extra byte so that we can write to the 24-bit buffer with overlapping 32-bit writes (efficiency)
+	// Extra bytes so that we can write to the 24-bit buffer with overlapping writes (efficiency)
+	const size_t nIntBufferSize = nQueueSizeFrames * nBytesPerFrame + CSampleConverter::PackedOutputSlack;
 	float FloatBuffer[nQueueSizeFrames * nChannels];
-	s8 IntBuffer[nQueueSizeFrames * nBytesPerFrame + bI2S ? 0 : 1];
+	u32 IntBuffer[(nIntBufferSize + sizeof(u32) - 1) / sizeof(u32)];
+
+	CSampleConverter SampleConverter(m_pConfig->AudioReversedStereo, m_pConfig->AudioDither);
+
+	// When adaptive, start from the configured chunk size and let the monitor grow the queue within the allocation
+	const size_t nMinQueuedFrames = m_pConfig->AudioAdaptiveQueue ? Utility::Min(static_cast<size_t>(m_pConfig->AudioChunkSize), nQueueSizeFrames) : nQueueSizeFrames;
+	CRenderMonitor RenderMonitor(m_pConfig->AudioSampleRate, nMinQueuedFrames, nQueueSizeFrames, m_pConfig->AudioAdaptiveQueue);
 
 	while (m_bRunning)
 	{
-		const size_t nFrames = nQueueSizeFrames - m_pSound->GetQueueFramesAvail();
+		// Statistics cover everything played since the last request
+		if (m_bStatisticsRequested)
+		{
+			RenderMonitor.ReportStatus();
+			RenderMonitor.ResetStatistics();
+			m_bStatisticsRequested = false;
+		}
+
+		const size_t nQueuedFrames = m_pSound->GetQueueFramesAvail();
+		const size_t nTargetFrames = RenderMonitor.GetTargetQueuedFrames();
+		if (nQueuedFrames >= nTargetFrames)
+		{
+			// Sleep until at least one frame has played rather than polling; the queue is guarded by a spinlock
+			// that the DMA completion interrupt on core 0 also takes
+			CTimer::SimpleusDelay((nQueuedFrames - nTargetFrames + 1) * 1000000 / m_pConfig->AudioSampleRate + 1);
+			continue;
+		}
+
+		const size_t nFrames = nTargetFrames - nQueuedFrames;
 		const size_t nWriteBytes = nFrames * nBytesPerFrame;
 
+		RenderMonitor.OnBlockStart(nQueuedFrames);
+
+		const unsigned int nRenderStart = CTimer::GetClockTicks();
 		m_pCurrentSynth->Render(FloatBuffer, nFrames);
+		RenderMonitor.OnBlockEnd(nFrames, CTimer::GetClockTicks() - nRenderStart, m_pCurrentSynth->GetActiveVoiceCount());
 
-		if (bReversedStereo)
-		{
-			// Convert to signed 24-bit integers with channel swap
-			for (size_t i = 0; i < nFrames * nChannels; i += nChannels)
-			{
-				s32* const pLeftSample = reinterpret_cast<s32*>(IntBuffer + i * nBytesPerSample);
-				s32* const pRightSample = reinterpret_cast<s32*>(IntBuffer + (i + 1) * nBytesPerSample);
-				*pLeftSample = FloatBuffer[i + 1] * Sample24BitMax;
-				*pRightSample = FloatBuffer[i] * Sample24BitMax;
-			}
-		}
+		// Convert to signed 24-bit integers
+		if (bI2S)
+			SampleConverter.ConvertS24_32(reinterpret_cast<s32*>(IntBuffer), FloatBuffer, nFrames);
 		else
-		{
-			// Convert to signed 24-bit integers
-			for (size_t i = 0; i < nFrames * nChannels; ++i)
-			{
-				s32* const pSample = reinterpret_cast<s32*>(IntBuffer + i * nBytesPerSample);
-				*pSample = FloatBuffer[i] * Sample24BitMax;
-			}
-		}
+			SampleConverter.ConvertS24(reinterpret_cast<u8*>(IntBuffer), FloatBuffer, nFrames);
 
 		const int nResult = m_pSound->Write(IntBuffer, nWriteBytes);
 		if (nResult != static_cast<int>(nWriteBytes))
+		{
 			LOGERR("Sound data dropped");
+			RenderMonitor.OnDataDropped();
+		}
+	}
+
+	RenderMonitor.ReportStatus();
+}
+
+void CMT32Pi::RenderTask()
+{
+	LOGNOTE("Render task on Core 3 starting up");
+
+	// Synths may be created later on (e.g. when a USB disk is attached), so keep checking for work
+	while (m_bRunning)
+	{
+		if (m_pLayeredSynth)
+			m_pLayeredSynth->RunWorker();
+		else if (m_pSoundFontSynth)
+			m_pSoundFontSynth->RunMixerWorker();
+		else
+		{
+			WaitForEvent();
+			DataMemBarrier();
+		}
 	}
 }
 
@@ -621,6 +720,9 @@ void CMT32Pi::Run(unsigned nCore)
 		case 2:
 			return AudioTask();
 
+		case 3:
+			return RenderTask();
+
 		default:
 			break;
 	}
@@ -732,6 +834,16 @@ bool CMT32Pi::ParseCustomSysEx(const u8* pData, size_t nSize)
 		return true;
 	}
 
+	// Report and reset performance statistics (F0 7D 05 F7)
+	if (nSize == 4 && Command == TCustomSysExCommand::ReportStatistics)
+	{
+		// Render statistics are reported by the audio task
+		m_bStatisticsRequested = true;
+		if (CZoneAllocator* const pAllocator = CZoneAllocator::Get())
+			pAllocator->Dump();
+		return true;
+	}
+
 	if (nSize != 5)
 		return false;
 
@@ -795,14 +907,14 @@ void CMT32Pi::UpdateUSB(bool bStartup)
 				LCDLog(TLCDLogType::Spinner, "MT-32 ROM rescan");
 				if (m_pMT32Synth)
 					m_pMT32Synth->GetROMManager().ScanROMs();
-				else
-					InitMT32Synth();
+				else if (InitMT32Synth())
+					InitLayeredSynth();
 
 				LCDLog(TLCDLogType::Spinner, "SoundFont rescan");
 				if (m_pSoundFontSynth)
 					m_pSoundFontSynth->GetSoundFontManager().ScanSoundFonts();
-				else
-					InitSoundFontSynth();
+				else if (InitSoundFontSynth())
+					InitLayeredSynth();
 
 				if (m_pSoundFontSynth)
 					LCDLog(TLCDLogType::Notice, "%d SoundFonts avail", m_pSoundFontSynth->GetSoundFontManager().GetSoundFontCount());
@@ -873,7 +985,8 @@ void CMT32Pi::UpdateNetwork()
 
 		if (m_pConfig->NetworkRTPMIDI && !m_pAppleMIDIParticipant)
 		{
-			m_pAppleMIDIParticipant = new CAppleMIDIParticipant(&m_Random, this);
+			const unsigned int nLatency = Utility::Clamp(m_pConfig->NetworkRTPMIDILatency, 0, MaxRTPMIDILatencyMillis);
+			m_pAppleMIDIParticipant = new CAppleMIDIParticipant(&m_Random, this, nLatency);
 			if (!m_pAppleMIDIParticipant->Initialize())
 			{
 				LOGERR("Failed to init AppleMIDI receiver");
@@ -1048,10 +1161,15 @@ void CMT32Pi::ProcessEventQueue()
 				break;
 
 			case TEventType::AllSoundOff:
-				if (m_pMT32Synth)
-					m_pMT32Synth->AllSoundOff();
-				if (m_pSoundFontSynth)
-					m_pSoundFontSynth->AllSoundOff();
+				if (m_pLayeredSynth)
+					m_pLayeredSynth->AllSoundOff();
+				else
+				{
+					if (m_pMT32Synth)
+						m_pMT32Synth->AllSoundOff();
+					if (m_pSoundFontSynth)
+						m_pSoundFontSynth->AllSoundOff();
+				}
 				break;
 
 			case TEventType::DisplayImage:
@@ -1078,9 +1196,11 @@ void CMT32Pi::ProcessButtonEvent(const TButtonEvent& Event)
 
 	if (Event.Button == TButton::Button2 && !Event.bRepeat)
 	{
-		// Swap synths
+		// Cycle through synths
 		if (m_pCurrentSynth == m_pMT32Synth)
 			SwitchSynth(TSynth::SoundFont);
+		else if (m_pCurrentSynth == m_pSoundFontSynth && m_pLayeredSynth)
+			SwitchSynth(TSynth::Layered);
 		else
 			SwitchSynth(TSynth::MT32);
 	}
@@ -1132,6 +1252,8 @@ void CMT32Pi::SwitchSynth(TSynth NewSynth)
 		pNewSynth = m_pMT32Synth;
 	else if (NewSynth == TSynth::SoundFont)
 		pNewSynth = m_pSoundFontSynth;
+	else if (NewSynth == TSynth::Layered)
+		pNewSynth = m_pLayeredSynth;
 
 	if (pNewSynth == nullptr)
 	{
@@ -1147,7 +1269,7 @@ void CMT32Pi::SwitchSynth(TSynth NewSynth)
 
 	m_pCurrentSynth->AllSoundOff();
 	m_pCurrentSynth = pNewSynth;
-	const char* pMode = NewSynth == TSynth::MT32 ? "MT-32 mode" : "SoundFont mode";
+	const char* pMode = NewSynth == TSynth::MT32 ? "MT-32 mode" : NewSynth == TSynth::SoundFont ? "SoundFont mode" : "Layered mode";
 	LOGNOTE("Switching to %s", pMode);
 	LCDLog(TLCDLogType::Notice, pMode);
 }
@@ -1179,14 +1301,25 @@ void CMT32Pi::SwitchSoundFont(size_t nIndex)
 		return;
 
 	LOGNOTE("Switching to SoundFont %d", nIndex);
-	if (m_pSoundFontSynth->SwitchSoundFont(nIndex))
-	{
-		// Handle any MIDI data that has been queued up while busy
+	m_pSoundFontSynth->SwitchSoundFont(nIndex);
+}
+
+void CMT32Pi::UpdateSoundFontSwitch()
+{
+	const CSoundFontSynth::TSoundFontSwitchResult Result = m_pSoundFontSynth->UpdateSoundFontSwitch();
+
+	if (Result != CSoundFontSynth::TSoundFontSwitchResult::Switched && Result != CSoundFontSynth::TSoundFontSwitchResult::Reloaded)
+		return;
+
+	// The synth was rebuilt on this core; handle any MIDI data that has been queued up while busy
+	if (Result == CSoundFontSynth::TSoundFontSwitchResult::Reloaded)
 		PurgeMIDIBuffers();
 
-		if (m_pCurrentSynth == m_pSoundFontSynth)
-			m_pSoundFontSynth->ReportStatus();
-	}
+	if (m_pCurrentSynth != m_pMT32Synth)
+		m_pCurrentSynth->ReportStatus();
+
+	// Trigger an awaken so we don't immediately go to sleep
+	Awaken();
 }
 
 void CMT32Pi::DeferSwitchSoundFont(size_t nIndex)
@@ -1210,7 +1343,7 @@ void CMT32Pi::SetMasterVolume(s32 nVolume)
 	if (m_pSoundFontSynth)
 		m_pSoundFontSynth->SetMasterVolume(m_nMasterVolume);
 
-	if (m_pCurrentSynth == m_pSoundFontSynth)
+	if (m_pCurrentSynth != m_pMT32Synth)
 		LCDLog(TLCDLogType::Notice, "Volume: %d", m_nMasterVolume);
 }
 
@@ -1243,8 +1376,8 @@ void CMT32Pi::LCDLog(TLCDLogType Type, const char* pFormat...)
 		m_pLCD->Print(Buffer, nOffsetX, 1, true, true);
 	}
 
-	// Let LCD task pick up the message in its next update
-	else
+	// Queue the message for the UI task, which shows it in its next update
+	else if (!CDeferredLog::Get()->WriteLCD(static_cast<int>(Type), Buffer))
 		m_UserInterface.ShowSystemMessage(Buffer, Type == TLCDLogType::Spinner);
 }
 
@@ -1296,7 +1429,7 @@ void CMT32Pi::IRQMIDIReceiveHandler(const u8* pData, size_t nSize)
 {
 	assert(s_pThis != nullptr);
 
-	// Enqueue data into ring buffer
+	// Enqueue data into ring buffer; all MIDI receive IRQs are serviced on core 0, so there is only one producer
 	if (s_pThis->m_MIDIRxBuffer.Enqueue(pData, nSize) != nSize)
 	{
 		static const char* pErrorString = "MIDI overrun error!";
@@ -1305,6 +1438,12 @@ void CMT32Pi::IRQMIDIReceiveHandler(const u8* pData, size_t nSize)
 	}
 }
 
+void CMT32Pi::LCDLogHandler(void* pParam, int nLCDType, const char* pMessage)
+{
+	CMT32Pi* pThis = static_cast<CMT32Pi*>(pParam);
+	pThis->m_UserInterface.ShowSystemMessage(pMessage, static_cast<TLCDLogType>(nLCDType) == TLCDLogType::Spinner);
+}
+
 void CMT32Pi::PanicHandler()
 {
 	if (!s_pThis || !s_pThis->m_pLCD)
@@ -28,8 +28,11 @@
 #include <circle/timer.h>
 #include <circle/util.h>
 
+#include "deferredlog.h"
 #include "net/applemidi.h"
 #include "net/byteorder.h"
+#include "net/rtpmidireceiver.h"
+#include "utility.h"
 
 // #define APPLEMIDI_DEBUG
 
@@ -56,6 +59,9 @@ constexpr unsigned int SyncTimeout = 60 * 10000;
 // Receiver feedback packet frequency (1 second in 100 microsecond units)
 constexpr unsigned int ReceiverFeedbackPeriod = 1 * 10000;
 
+// Longest time to sleep without socket activity before checking the timeouts above (microseconds)
+constexpr unsigned int MaxIdleWait = 100000;
+
 constexpr u16 CommandWord(const char Command[2]) { return Command[0] << 8 | Command[1]; }
 
 enum TAppleMIDICommand : u16
@@ -207,12 +213,12 @@ bool ParseSyncPacket(const u8* pBuffer, size_t nSize, TAppleMIDISync* pOutPacket
 	return true;
 }
 
-u8 ParseMIDIDeltaTime(const u8* pBuffer)
+u8 ParseMIDIDeltaTime(const u8* pBuffer, size_t nSize, u32& nDeltaTime)
 {
 	u8 nLength = 0;
-	u32 nDeltaTime = 0;
+	nDeltaTime = 0;
 
-	while (nLength < 4)
+	while (nLength < 4 && nLength < nSize)
 	{
 		nDeltaTime <<= 7;
 		nDeltaTime |= pBuffer[nLength] & 0x7F;
@@ -225,7 +231,7 @@ u8 ParseMIDIDeltaTime(const u8* pBuffer)
 	return nLength;
 }
 
-size_t ParseSysExCommand(const u8* pBuffer, size_t nSize, CAppleMIDIHandler* pHandler)
+size_t ParseSysExCommand(const u8* pBuffer, size_t nSize, u32 nTimestamp, CRTPMIDIReceiver* pReceiver)
 {
 	size_t nBytesParsed = 1;
 	const u8 nHead = pBuffer[0];
@@ -281,12 +287,12 @@ size_t ParseSysExCommand(const u8* pBuffer, size_t nSize, CAppleMIDIHandler* pHa
 	}
 #endif
 
-	pHandler->OnAppleMIDIDataReceived(pBuffer, nReceiveLength);
+	pReceiver->OnCommand(pBuffer, nReceiveLength, nTimestamp);
 
 	return nBytesParsed;
 }
 
-size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, CAppleMIDIHandler* pHandler)
+size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, u32 nTimestamp, CRTPMIDIReceiver* pReceiver)
 {
 	size_t nBytesParsed = 0;
 	u8 nByte = pBuffer[0];
@@ -297,7 +303,7 @@ size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, CAp
 	{
 		// Ignore undefined System Real-Time
 		if (nByte != 0xF9 && nByte != 0xFD)
-			pHandler->OnAppleMIDIDataReceived(&nByte, 1);
+			pReceiver->OnCommand(&nByte, 1, nTimestamp);
 
 		return 1;
 	}
@@ -327,6 +333,7 @@ size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, CAp
 	if (nByte < 0xF0)
 	{
 		// How many data bytes?
+		size_t nDataBytes = 0;
 		switch (nByte & 0xF0)
 		{
 			case 0x80:				// Note off
@@ -334,17 +341,26 @@ size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, CAp
 			case 0xA0:				// Polyphonic key pressure/aftertouch
 			case 0xB0:				// Control change
 			case 0xE0:				// Pitch bend
-				nBytesParsed += 2;
+				nDataBytes = 2;
 				break;
 
 			case 0xC0:				// Program change
 			case 0xD0:				// Channel pressure/aftertouch
-				nBytesParsed += 1;
+				nDataBytes = 1;
 				break;
 		}
 
+		if (nBytesParsed + nDataBytes > nSize)
+			return 0;
+
+		// Always pass on the status byte; commands may be delayed or interleaved with journal repairs,
+		// so running status wouldn't survive to the MIDI parser
+		u8 Command[3] = { nByte };
+		memcpy(Command + 1, pBuffer + nBytesParsed, nDataBytes);
+		nBytesParsed += nDataBytes;
+
 		// Handle command
-		pHandler->OnAppleMIDIDataReceived(pBuffer, nBytesParsed);
+		pReceiver->OnCommand(Command, nDataBytes + 1, nTimestamp);
 		return nBytesParsed;
 	}
 
@@ -353,7 +369,7 @@ size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, CAp
 	{
 		case 0xF0:					// Start of System Exclusive
 		case 0xF7:					// End of Exclusive
-			return ParseSysExCommand(pBuffer, nSize, pHandler);
+			return ParseSysExCommand(pBuffer, nSize, nTimestamp, pReceiver);
 
 		case 0xF1:					// MIDI Time Code Quarter Frame
 		case 0xF3:					// Song Select
@@ -365,11 +381,14 @@ size_t ParseMIDICommand(const u8* pBuffer, size_t nSize, u8& nRunningStatus, CAp
 			break;
 	}
 
-	pHandler->OnAppleMIDIDataReceived(pBuffer, nBytesParsed);
+	if (nBytesParsed > nSize)
+		return 0;
+
+	pReceiver->OnCommand(pBuffer, nBytesParsed, nTimestamp);
 	return nBytesParsed;
 }
 
-bool ParseMIDICommandSection(const u8* pBuffer, size_t nSize, CAppleMIDIHandler* pHandler)
+bool ParseMIDICommandSection(const u8* pBuffer, size_t nSize, u32 nTimestamp, bool bPacketLost, CRTPMIDIReceiver* pReceiver)
 {
 	// Must have at least a header byte and a single status byte
 	if (nSize < 2)
@@ -400,20 +419,34 @@ bool ParseMIDICommandSection(const u8* pBuffer, size_t nSize, CAppleMIDIHandler*
 		return false;
 	}
 
+	// If J flag is set, the recovery journal follows the command list; it describes the stream state
+	// before this packet, so any repairs must be made before this packet's commands are handled
+	if (bPacketLost && nMIDIHeader & (1 << 6))
+		pReceiver->ApplyJournal(pMIDICommands + nMIDICommandLength, nBytesRemaining - nMIDICommandLength, nTimestamp);
+
 	// Begin decoding the command list
 	while (nMIDICommandLength)
 	{
 		// If Z flag is set, first list entry is a delta time
 		if (nMIDICommandsProcessed || nMIDIHeader & (1 << 5))
 		{
-			const u8 nBytesParsed = ParseMIDIDeltaTime(pMIDICommands);
+			// Delta times are in RTP timestamp units, relative to the previous command
+			u32 nDeltaTime;
+			const u8 nBytesParsed = ParseMIDIDeltaTime(pMIDICommands, nMIDICommandLength, nDeltaTime);
 			nMIDICommandLength -= nBytesParsed;
 			pMIDICommands += nBytesParsed;
+			nTimestamp += nDeltaTime;
 		}
 
 		if (nMIDICommandLength)
 		{
-			const size_t nBytesParsed = ParseMIDICommand(pMIDICommands, nMIDICommandLength, nRunningStatus, pHandler);
+			const size_t nBytesParsed = ParseMIDICommand(pMIDICommands, nMIDICommandLength, nRunningStatus, nTimestamp, pReceiver);
+			if (!nBytesParsed)
+			{
+				LOGERR("Invalid MIDI command");
+				return false;
+			}
+
 			nMIDICommandLength -= nBytesParsed;
 			pMIDICommands += nBytesParsed;
 			++nMIDICommandsProcessed;
@@ -423,9 +456,9 @@ bool ParseMIDICommandSection(const u8* pBuffer, size_t nSize, CAppleMIDIHandler*
 	return true;
 }
 
-bool ParseMIDIPacket(const u8* pBuffer, size_t nSize, TRTPMIDI* pOutPacket, CAppleMIDIHandler* pHandler)
+bool ParseMIDIPacket(const u8* pBuffer, size_t nSize, TRTPMIDI* pOutPacket, u64 nNow, CRTPMIDIReceiver* pReceiver)
 {
-	assert(pHandler != nullptr);
+	assert(pReceiver != nullptr);
 
 	const TRTPMIDI* const pInPacket = reinterpret_cast<const TRTPMIDI*>(pBuffer);
 	const u16 nRTPFlags = ntohs(pInPacket->nFlags);
@@ -451,13 +484,17 @@ bool ParseMIDIPacket(const u8* pBuffer, size_t nSize, TRTPMIDI* pOutPacket, CApp
 	pOutPacket->nTimestamp = ntohl(pInPacket->nTimestamp);
 	pOutPacket->nSSRC = ntohl(pInPacket->nSSRC);
 
+	const CRTPMIDIReceiver::TPacketStatus Status = pReceiver->BeginPacket(pOutPacket->nSequence, nNow);
+	if (Status == CRTPMIDIReceiver::TPacketStatus::Stale)
+		return true;
+
 	// RTP-MIDI variable-length header
 	const u8* const pMIDICommandSection = pBuffer + sizeof(TRTPMIDI);
 	size_t nRemaining = nSize - sizeof(TRTPMIDI);
-	return ParseMIDICommandSection(pMIDICommandSection, nRemaining, pHandler);
+	return ParseMIDICommandSection(pMIDICommandSection, nRemaining, pOutPacket->nTimestamp, Status == CRTPMIDIReceiver::TPacketStatus::Lost, pReceiver);
 }
 
-CAppleMIDIParticipant::CAppleMIDIParticipant(CBcmRandomNumberGenerator* pRandom, CAppleMIDIHandler* pHandler)
+CAppleMIDIParticipant::CAppleMIDIParticipant(CBcmRandomNumberGenerator* pRandom, CAppleMIDIHandler* pHandler, unsigned int nPlayoutLatency)
 	: CTask(TASK_STACK_SIZE, true),
 
 	  m_pRandom(pRandom),
@@ -476,6 +513,7 @@ CAppleMIDIParticipant::CAppleMIDIParticipant(CBcmRandomNumberGenerator* pRandom,
 	  m_nMIDIResult(0),
 
 	  m_pHandler(pHandler),
+	  m_Receiver(pHandler, nPlayoutLatency * 10),
 
 	  m_State(TState::ControlInvitation),
 
@@ -495,11 +533,18 @@ CAppleMIDIParticipant::CAppleMIDIParticipant(CBcmRandomNumberGenerator* pRandom,
 
 CAppleMIDIParticipant::~CAppleMIDIParticipant()
 {
+	// The multiplexer outlives the sockets; it must not touch them after they're deleted
 	if (m_pControlSocket)
+	{
+		m_Multiplexer.Remove(m_pControlSocket);
 		delete m_pControlSocket;
+	}
 
 	if (m_pMIDISocket)
+	{
+		m_Multiplexer.Remove(m_pMIDISocket);
 		delete m_pMIDISocket;
+	}
 }
 
 bool CAppleMIDIParticipant::Initialize()
@@ -527,6 +572,9 @@ bool CAppleMIDIParticipant::Initialize()
 		return false;
 	}
 
+	if (!m_Multiplexer.Add(m_pControlSocket) || !m_Multiplexer.Add(m_pMIDISocket))
+		return false;
+
 	// We started as a suspended task; run now that initialization is successful
 	Start();
 
@@ -560,14 +608,30 @@ void CAppleMIDIParticipant::Run()
 
 		case TState::Connected:
 			ConnectedState();
+			m_Receiver.Update(GetSyncClock());
 			break;
 		}
 
-		// Allow other tasks to run
-		pScheduler->Yield();
+		// Sleep until a packet arrives or something is due; otherwise check for more packets after other tasks have run
+		if (m_nControlResult == 0 && m_nMIDIResult == 0)
+			m_Multiplexer.Wait(GetWaitTimeout());
+		else
+			pScheduler->Yield();
 	}
 }
 
+unsigned int CAppleMIDIParticipant::GetWaitTimeout() const
+{
+	unsigned int nTimeout = MaxIdleWait;
+
+	// Wake up for the next buffered MIDI command (RTP timestamp units are 100 microseconds)
+	unsigned int nPlayoutDelay;
+	if (m_State == TState::Connected && m_Receiver.GetPlayoutDelay(nPlayoutDelay))
+		nTimeout = Utility::Clamp(nPlayoutDelay * 100, 100u, nTimeout);
+
+	return nTimeout;
+}
+
 void CAppleMIDIParticipant::ControlInvitationState()
 {
 	TAppleMIDISession SessionPacket;
@@ -702,8 +766,8 @@ void CAppleMIDIParticipant::ConnectedState()
 	{
 		if (m_ForeignMIDIIPAddress != m_InitiatorIPAddress || m_nForeignMIDIPort != m_nInitiatorMIDIPort)
 			LOGERR("Unexpected packet");
-		else if (ParseMIDIPacket(m_MIDIBuffer, m_nMIDIResult, &MIDIPacket, m_pHandler))
-			m_nSequence = MIDIPacket.nSequence;
+		else if (ParseMIDIPacket(m_MIDIBuffer, m_nMIDIResult, &MIDIPacket, GetSyncClock(), &m_Receiver))
+			m_nSequence = m_Receiver.GetLastSequence();
 		else if (ParseSyncPacket(m_MIDIBuffer, m_nMIDIResult, &SyncPacket))
 		{
 #ifdef APPLEMIDI_DEBUG
@@ -717,6 +781,7 @@ void CAppleMIDIParticipant::ConnectedState()
 				else if (SyncPacket.nCount == 2)
 				{
 					m_nOffsetEstimate = ((SyncPacket.Timestamps[2] + SyncPacket.Timestamps[0]) / 2) - SyncPacket.Timestamps[1];
+					m_Receiver.SetClockOffset(m_nOffsetEstimate);
 #ifdef APPLEMIDI_DEBUG
 					LOGNOTE("Offset estimate: %llu", m_nOffsetEstimate);
 #endif
@@ -753,6 +818,7 @@ void CAppleMIDIParticipant::ConnectedState()
 void CAppleMIDIParticipant::Reset()
 {
 	m_State = TState::ControlInvitation;
+	m_Receiver.Reset();
 
 	m_nInitiatorToken = 0;
 	m_nInitiatorSSRC = 0;
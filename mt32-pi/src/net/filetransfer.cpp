@@ -0,0 +1,318 @@
+//
+// filetransfer.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+
+#include "net/filetransfer.h"
+#include "utility.h"
+
+// Use the owner's name for the log macros
+#define From m_pLogName
+
+CFileTransfer::CFileTransfer(const char* pLogName)
+	: CTask(TASK_STACK_SIZE),
+	  m_pLogName(pLogName),
+	  m_pBuffer(new u8[BlockSize * BlockCount]),
+
+	  m_Mode(TMode::Idle),
+	  m_bQuit(false),
+	  m_bEndOfStream(false),
+	  m_pFile(nullptr),
+	  m_Result(FR_OK),
+
+	  m_nHead(0),
+	  m_nTail(0),
+	  m_BlockSizes{0},
+	  m_nOffset(0),
+
+	  m_nBytes(0),
+	  m_nStartTicks(0),
+	  m_nDiskTicks(0),
+	  m_nStallTicks(0)
+{
+}
+
+CFileTransfer::~CFileTransfer()
+{
+	delete[] m_pBuffer;
+}
+
+void CFileTransfer::BeginWrite(FIL* pFile)
+{
+	assert(m_Mode == TMode::Idle);
+
+	m_pFile = pFile;
+	m_Result = FR_OK;
+	m_bEndOfStream = false;
+	m_nHead = m_nTail = m_nOffset = 0;
+
+	m_nBytes = 0;
+	m_nStartTicks = CTimer::GetClockTicks();
+	m_nDiskTicks = m_nStallTicks = 0;
+
+	m_Mode = TMode::Write;
+	m_DiskEvent.Set();
+}
+
+bool CFileTransfer::Write(const void* pData, size_t nSize)
+{
+	const u8* pBytes = static_cast<const u8*>(pData);
+
+	while (nSize)
+	{
+		// Every block is full; wait for the disk to catch up
+		while (m_nHead - m_nTail == BlockCount)
+			WaitForDisk();
+
+		if (m_Result != FR_OK)
+			return false;
+
+		const size_t nCopy = Utility::Min(nSize, BlockSize - m_nOffset);
+		memcpy(GetBlock(m_nHead) + m_nOffset, pBytes, nCopy);
+		m_nOffset += nCopy;
+		m_nBytes += nCopy;
+		pBytes += nCopy;
+		nSize -= nCopy;
+
+		// Hand the full block over to the disk task
+		if (m_nOffset == BlockSize)
+		{
+			m_BlockSizes[m_nHead % BlockCount] = BlockSize;
+			++m_nHead;
+			m_nOffset = 0;
+			m_DiskEvent.Set();
+		}
+	}
+
+	return m_Result == FR_OK;
+}
+
+void CFileTransfer::BeginRead(FIL* pFile)
+{
+	assert(m_Mode == TMode::Idle);
+
+	m_pFile = pFile;
+	m_Result = FR_OK;
+	m_bEndOfStream = false;
+	m_nHead = m_nTail = m_nOffset = 0;
+
+	m_nBytes = 0;
+	m_nStartTicks = CTimer::GetClockTicks();
+	m_nDiskTicks = m_nStallTicks = 0;
+
+	m_Mode = TMode::Read;
+	m_DiskEvent.Set();
+}
+
+const u8* CFileTransfer::GetReadBuffer(size_t& nAvailable)
+{
+	// Wait for the disk task to fill a block, unless it has finished
+	while (m_nHead == m_nTail && m_Mode != TMode::Idle)
+		WaitForDisk();
+
+	if (m_nHead == m_nTail)
+	{
+		nAvailable = 0;
+		return nullptr;
+	}
+
+	nAvailable = m_BlockSizes[m_nTail % BlockCount] - m_nOffset;
+	return GetBlock(m_nTail) + m_nOffset;
+}
+
+void CFileTransfer::CommitRead(size_t nSize)
+{
+	assert(m_nHead != m_nTail);
+
+	m_nOffset += nSize;
+	m_nBytes += nSize;
+
+	// Give the drained block back to the disk task
+	if (m_nOffset == m_BlockSizes[m_nTail % BlockCount])
+	{
+		++m_nTail;
+		m_nOffset = 0;
+		m_DiskEvent.Set();
+	}
+}
+
+bool CFileTransfer::Finish(bool bAbort)
+{
+	const TMode Mode = m_Mode;
+
+	if (Mode == TMode::Write && !bAbort && m_nOffset)
+	{
+		// Queue the partially-filled last block
+		while (m_nHead - m_nTail == BlockCount)
+			WaitForDisk();
+
+		m_BlockSizes[m_nHead % BlockCount] = m_nOffset;
+		++m_nHead;
+		m_nOffset = 0;
+	}
+
+	// Readers stop at the next block; writers discard whatever is still queued
+	if (bAbort && m_Result == FR_OK)
+		m_Result = FR_INT_ERR;
+
+	m_bEndOfStream = true;
+	m_DiskEvent.Set();
+
+	while (m_Mode != TMode::Idle)
+		WaitForDisk();
+
+	if (m_Result == FR_OK)
+	{
+		const unsigned int nTicks = Utility::Max(CTimer::GetClockTicks() - m_nStartTicks, 1u);
+		const unsigned int nKBPerSecond = static_cast<unsigned int>(m_nBytes * 1000000 / nTicks / 1024);
+
+		LOGNOTE("%s %llu KB in %u ms (%u KB/s); disk busy %u%%, network waited for disk %u%%",
+			Mode == TMode::Write ? "Stored" : "Sent",
+			m_nBytes / 1024,
+			nTicks / 1000,
+			nKBPerSecond,
+			static_cast<unsigned int>(static_cast<u64>(m_nDiskTicks) * 100 / nTicks),
+			static_cast<unsigned int>(static_cast<u64>(m_nStallTicks) * 100 / nTicks));
+	}
+
+	m_pFile = nullptr;
+
+	return m_Result == FR_OK;
+}
+
+void CFileTransfer::Release()
+{
+	assert(m_Mode == TMode::Idle);
+
+	m_bQuit = true;
+	m_DiskEvent.Set();
+}
+
+void CFileTransfer::Run()
+{
+	while (true)
+	{
+		while (m_Mode == TMode::Idle && !m_bQuit)
+		{
+			m_DiskEvent.Clear();
+			m_DiskEvent.Wait();
+		}
+
+		// The scheduler deletes this object once we return
+		if (m_bQuit)
+			return;
+
+		if (m_Mode == TMode::Write)
+			WriteBlocks();
+		else
+			ReadBlocks();
+
+		m_Mode = TMode::Idle;
+		m_WorkerEvent.Set();
+	}
+}
+
+void CFileTransfer::WriteBlocks()
+{
+	while (true)
+	{
+		while (m_nHead == m_nTail && !m_bEndOfStream)
+		{
+			m_DiskEvent.Clear();
+			m_DiskEvent.Wait();
+		}
+
+		if (m_nHead == m_nTail)
+			break;
+
+		// After an error, keep draining so that the network task doesn't block forever
+		if (m_Result == FR_OK)
+		{
+			const size_t nSize = m_BlockSizes[m_nTail % BlockCount];
+			const unsigned int nStartTicks = CTimer::GetClockTicks();
+			UINT nWritten;
+
+			m_Result = f_write(m_pFile, GetBlock(m_nTail), nSize, &nWritten);
+			if (m_Result == FR_OK && nWritten != nSize)
+				m_Result = FR_DENIED;
+
+			if (m_Result != FR_OK)
+				LOGERR("Write failed, return code %d", m_Result);
+
+			m_nDiskTicks += CTimer::GetClockTicks() - nStartTicks;
+		}
+
+		++m_nTail;
+		m_WorkerEvent.Set();
+	}
+}
+
+void CFileTransfer::ReadBlocks()
+{
+	while (m_Result == FR_OK)
+	{
+		// Every block is full; wait for the network task to drain one
+		while (m_nHead - m_nTail == BlockCount && !m_bEndOfStream)
+		{
+			m_DiskEvent.Clear();
+			m_DiskEvent.Wait();
+		}
+
+		if (m_bEndOfStream)
+			break;
+
+		const unsigned int nStartTicks = CTimer::GetClockTicks();
+		UINT nRead;
+
+		m_Result = f_read(m_pFile, GetBlock(m_nHead), BlockSize, &nRead);
+		m_nDiskTicks += CTimer::GetClockTicks() - nStartTicks;
+
+		if (m_Result != FR_OK)
+		{
+			LOGERR("Read failed, return code %d", m_Result);
+			break;
+		}
+
+		if (nRead)
+		{
+			m_BlockSizes[m_nHead % BlockCount] = nRead;
+			++m_nHead;
+			m_WorkerEvent.Set();
+		}
+
+		// End of file
+		if (nRead < BlockSize)
+			break;
+	}
+}
+
+void CFileTransfer::WaitForDisk()
+{
+	const unsigned int nStartTicks = CTimer::GetClockTicks();
+
+	m_WorkerEvent.Clear();
+	m_WorkerEvent.Wait();
+
+	m_nStallTicks += CTimer::GetClockTicks() - nStartTicks;
+}
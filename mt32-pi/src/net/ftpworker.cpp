@@ -25,7 +25,6 @@
 #include <circle/logger.h>
 #include <circle/net/in.h>
 #include <circle/net/netsubsystem.h>
-#include <circle/sched/scheduler.h>
 #include <circle/timer.h>
 #include <fatfs/ff.h>
 
@@ -133,6 +132,8 @@ CFTPWorker::CFTPWorker(CSocket* pControlSocket, const char* pExpectedUser, const
 	  m_pDataSocket(nullptr),
 	  m_nDataSocketPort(0),
 	  m_DataSocketIPAddress(),
+	  m_Multiplexer(),
+	  m_pFileTransfer(nullptr),
 	  m_CommandBuffer{'\0'},
 	  m_DataBuffer{0},
 	  m_User(),
@@ -149,10 +150,19 @@ CFTPWorker::CFTPWorker(CSocket* pControlSocket, const char* pExpectedUser, const
 CFTPWorker::~CFTPWorker()
 {
 	if (m_pControlSocket)
+	{
+		m_Multiplexer.Remove(m_pControlSocket);
 		delete m_pControlSocket;
+	}
 
 	if (m_pDataSocket)
+	{
+		m_Multiplexer.Remove(m_pDataSocket);
 		delete m_pDataSocket;
+	}
+
+	if (m_pFileTransfer)
+		m_pFileTransfer->Release();
 
 	--s_nInstanceCount;
 
@@ -164,7 +174,6 @@ void CFTPWorker::Run()
 	assert(m_pControlSocket != nullptr);
 
 	const size_t nWorkerNumber = s_nInstanceCount;
-	CScheduler* const pScheduler = CScheduler::Get();
 
 	LOGNOTE("Worker task %d spawned", nWorkerNumber);
 
@@ -174,6 +183,8 @@ void CFTPWorker::Run()
 	CTimer* const pTimer = CTimer::Get();
 	unsigned int nTimeout = pTimer->GetTicks();
 
+	m_Multiplexer.Add(m_pControlSocket);
+
 	while (m_pControlSocket)
 	{
 		// Block while waiting to receive
@@ -184,13 +195,12 @@ void CFTPWorker::Run()
 
 		if (nReceiveBytes == 0)
 		{
-			if (pTimer->GetTicks() - nTimeout >= SocketTimeout * HZ)
+			if (!WaitForData(nTimeout))
 			{
 				LOGERR("Socket timed out");
 				break;
 			}
 
-			pScheduler->Yield();
 			continue;
 		}
 
@@ -237,6 +247,13 @@ void CFTPWorker::Run()
 
 	LOGNOTE("Worker task %d shutting down", nWorkerNumber);
 
+	if (m_pFileTransfer)
+	{
+		m_pFileTransfer->Release();
+		m_pFileTransfer = nullptr;
+	}
+
+	m_Multiplexer.Remove(m_pControlSocket);
 	delete m_pControlSocket;
 	m_pControlSocket = nullptr;
 }
@@ -288,6 +305,26 @@ CSocket* CFTPWorker::OpenDataConnection()
 	return pDataSocket;
 }
 
+CFileTransfer* CFTPWorker::GetFileTransfer()
+{
+	// Created on first use so that idle sessions don't hold on to the block buffers
+	if (!m_pFileTransfer)
+		m_pFileTransfer = new CFileTransfer(m_LogName);
+
+	return m_pFileTransfer;
+}
+
+bool CFTPWorker::WaitForData(unsigned int nStartTicks)
+{
+	const unsigned int nElapsed = CTimer::Get()->GetTicks() - nStartTicks;
+	if (nElapsed >= SocketTimeout * HZ)
+		return false;
+
+	// Sleep until a socket has activity or the timeout expires
+	m_Multiplexer.Wait((SocketTimeout * HZ - nElapsed) * (1000000 / HZ));
+	return true;
+}
+
 bool CFTPWorker::SendStatus(TFTPStatus StatusCode, const char* pMessage)
 {
 	assert(m_pControlSocket != nullptr);
@@ -628,30 +665,41 @@ bool CFTPWorker::Retrieve(const char* pArgs)
 	if (pDataSocket == nullptr)
 		return false;
 
-	size_t nSize = f_size(&File);
-	size_t nSent = 0;
+	CFileTransfer* const pTransfer = GetFileTransfer();
+	bool bSuccess = true;
+
+	// The transfer task reads ahead while we send
+	pTransfer->BeginRead(&File);
 
-	while (nSent < nSize)
+	while (true)
 	{
-		UINT nBytesRead;
+		size_t nAvailable;
+		const u8* pData = pTransfer->GetReadBuffer(nAvailable);
+		if (!pData)
+			break;
+
 #ifdef FTPDAEMON_DEBUG
 		LOGDBG("Sending data");
 #endif
-		if (f_read(&File, m_DataBuffer, sizeof(m_DataBuffer), &nBytesRead) != FR_OK || pDataSocket->Send(m_DataBuffer, nBytesRead, 0) < 0)
+		if (pDataSocket->Send(pData, nAvailable, 0) < 0)
 		{
-			delete pDataSocket;
-			f_close(&File);
-			SendStatus(TFTPStatus::ActionAborted, "File action aborted, local error.");
-			return false;
+			bSuccess = false;
+			break;
 		}
 
-		nSent += nBytesRead;
-		assert(nSent <= nSize);
+		pTransfer->CommitRead(nAvailable);
 	}
 
+	if (!pTransfer->Finish(!bSuccess))
+		bSuccess = false;
+
 	delete pDataSocket;
 	f_close(&File);
-	SendStatus(TFTPStatus::TransferComplete, "Transfer complete.");
+
+	if (bSuccess)
+		SendStatus(TFTPStatus::TransferComplete, "Transfer complete.");
+	else
+		SendStatus(TFTPStatus::ActionAborted, "File action aborted, local error.");
 
 	return false;
 }
@@ -679,29 +727,32 @@ bool CFTPWorker::Store(const char* pArgs)
 	if (pDataSocket == nullptr)
 		return false;
 
+	CFileTransfer* const pTransfer = GetFileTransfer();
 	bool bSuccess = true;
 
 	CTimer* const pTimer = CTimer::Get();
 	unsigned int nTimeout = pTimer->GetTicks();
 
+	m_Multiplexer.Add(pDataSocket);
+
+	// The transfer task writes whole blocks to the card while we keep receiving
+	pTransfer->BeginWrite(&File);
+
 	while (true)
 	{
 #ifdef FTPDAEMON_DEBUG
 		LOGDBG("Waiting to receive");
 #endif
 		int nReceiveResult = pDataSocket->Receive(m_DataBuffer, sizeof(m_DataBuffer), MSG_DONTWAIT);
-		FRESULT nWriteResult;
-		UINT nWritten;
 
 		if (nReceiveResult == 0)
 		{
-			if (pTimer->GetTicks() - nTimeout >= SocketTimeout * HZ)
+			if (!WaitForData(nTimeout))
 			{
 				LOGERR("Socket timed out");
 				bSuccess = false;
 				break;
 			}
-			CScheduler::Get()->Yield();
 			continue;
 		}
 
@@ -716,19 +767,18 @@ bool CFTPWorker::Store(const char* pArgs)
 		//LOGDBG("Received %d bytes", nReceiveResult);
 #endif
 
-		if ((nWriteResult = f_write(&File, m_DataBuffer, nReceiveResult, &nWritten)) != FR_OK)
+		if (!pTransfer->Write(m_DataBuffer, nReceiveResult))
 		{
-			LOGERR("Write FAILED, return code %d", nWriteResult);
 			bSuccess = false;
 			break;
 		}
 
-		f_sync(&File);
-		CScheduler::Get()->Yield();
-
 		nTimeout = pTimer->GetTicks();
 	}
 
+	if (!pTransfer->Finish(!bSuccess))
+		bSuccess = false;
+
 	if (bSuccess)
 		SendStatus(TFTPStatus::TransferComplete, "Transfer complete.");
 	else
@@ -737,6 +787,7 @@ bool CFTPWorker::Store(const char* pArgs)
 #ifdef FTPDAEMON_DEBUG
 	LOGDBG("Closing socket/file");
 #endif
+	m_Multiplexer.Remove(pDataSocket);
 	delete pDataSocket;
 	f_close(&File);
 
@@ -0,0 +1,469 @@
+//
+// rtpmidireceiver.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/util.h>
+
+#include "deferredlog.h"
+#include "net/applemidi.h"
+#include "net/rtpmidireceiver.h"
+
+// #define RTPMIDI_DEBUG
+
+LOGMODULE("rtpmidi");
+
+// Channel journal chapter flags (RFC 6295 appendix A.2)
+enum TChapter : u8
+{
+	ChapterP = 1 << 7,		// Program change
+	ChapterC = 1 << 6,		// Control change
+	ChapterM = 1 << 5,		// Parameter system (RPN/NRPN)
+	ChapterW = 1 << 4,		// Pitch wheel
+	ChapterN = 1 << 3,		// Note off/on
+};
+
+CRTPMIDIReceiver::CRTPMIDIReceiver(CAppleMIDIHandler* pHandler, unsigned int nPlayoutLatency)
+	: m_pHandler(pHandler),
+	  m_nPlayoutLatency(nPlayoutLatency),
+
+	  m_bHaveSequence(false),
+	  m_nLastSequence(0),
+
+	  m_bHaveClockOffset(false),
+	  m_nClockOffset(0),
+	  m_nNow(0),
+
+	  m_ChannelState{},
+	  m_CommandBuffer{0}
+{
+	ResetChannelState();
+}
+
+CRTPMIDIReceiver::TPacketStatus CRTPMIDIReceiver::BeginPacket(u16 nSequence, u64 nNow)
+{
+	m_nNow = static_cast<u32>(nNow);
+
+	if (!m_bHaveSequence)
+	{
+		m_bHaveSequence = true;
+		m_nLastSequence = nSequence;
+		return TPacketStatus::InOrder;
+	}
+
+	const s16 nDelta = static_cast<s16>(nSequence - m_nLastSequence);
+
+	// Duplicate or late packet; its contents were already recovered from a later packet's journal
+	if (nDelta <= 0 && nDelta > -MaxReorder)
+		return TPacketStatus::Stale;
+
+	m_nLastSequence = nSequence;
+
+	if (nDelta == 1)
+		return TPacketStatus::InOrder;
+
+#ifdef RTPMIDI_DEBUG
+	LOGNOTE("Lost %d packet(s) before sequence number %u", nDelta - 1, nSequence);
+#endif
+
+	return TPacketStatus::Lost;
+}
+
+void CRTPMIDIReceiver::OnCommand(const u8* pData, size_t nSize, u32 nTimestamp)
+{
+	UpdateChannelState(pData, nSize);
+	Deliver(pData, nSize, nTimestamp);
+}
+
+void CRTPMIDIReceiver::ApplyJournal(const u8* pJournal, size_t nSize, u32 nTimestamp)
+{
+	// Recovery journal header: S Y A H TOTCHAN(4), checkpoint sequence number(16)
+	if (nSize < 3)
+		return;
+
+	const u8 nHeader = pJournal[0];
+	const bool bSystemJournal = nHeader & (1 << 6);
+	const bool bChannelJournals = nHeader & (1 << 5);
+	const size_t nChannels = (nHeader & 0x0F) + 1;
+	size_t nOffset = 3;
+
+	// We don't keep any system state worth repairing; skip over the system journal
+	if (bSystemJournal)
+	{
+		if (nSize < nOffset + 2)
+			return;
+
+		const size_t nLength = (pJournal[nOffset] & 0x03) << 8 | pJournal[nOffset + 1];
+		if (nLength < 2)
+			return;
+
+		nOffset += nLength;
+	}
+
+	if (!bChannelJournals)
+		return;
+
+	for (size_t i = 0; i < nChannels && nOffset + 3 <= nSize; ++i)
+	{
+		// Channel journal header: S CHAN(4) H LENGTH(10), chapter flags(8)
+		const u8* const pChannelJournal = pJournal + nOffset;
+		const u8 nChannel = (pChannelJournal[0] >> 3) & 0x0F;
+		const size_t nLength = (pChannelJournal[0] & 0x03) << 8 | pChannelJournal[1];
+		const u8 nChapters = pChannelJournal[2];
+
+		if (nLength < 3 || nOffset + nLength > nSize)
+		{
+			LOGWARN("Malformed recovery journal");
+			return;
+		}
+
+		ApplyChannelJournal(nChannel, nChapters, pChannelJournal + 3, nLength - 3, nTimestamp);
+		nOffset += nLength;
+	}
+}
+
+void CRTPMIDIReceiver::SetClockOffset(u64 nOffset)
+{
+	// RTP timestamps are the low 32 bits of the same 10kHz clock used by the sync exchange
+	m_nClockOffset = static_cast<u32>(nOffset);
+	m_bHaveClockOffset = true;
+}
+
+void CRTPMIDIReceiver::Update(u64 nNow)
+{
+	m_nNow = static_cast<u32>(nNow);
+
+	TEntry Entry;
+	while (m_Entries.Peek(Entry) && static_cast<int>(Entry.nPlayoutTime - m_nNow) <= 0)
+		PlayNext();
+}
+
+bool CRTPMIDIReceiver::GetPlayoutDelay(unsigned int& nDelay) const
+{
+	TEntry Entry;
+	if (!m_Entries.Peek(Entry))
+		return false;
+
+	const int nRemaining = static_cast<int>(Entry.nPlayoutTime - m_nNow);
+	nDelay = nRemaining > 0 ? nRemaining : 0;
+	return true;
+}
+
+void CRTPMIDIReceiver::Reset()
+{
+	// Play anything still buffered so that note-offs aren't lost
+	Flush();
+
+	m_bHaveSequence = false;
+	m_nLastSequence = 0;
+
+	m_bHaveClockOffset = false;
+	m_nClockOffset = 0;
+
+	ResetChannelState();
+}
+
+void CRTPMIDIReceiver::UpdateChannelState(const u8* pData, size_t nSize)
+{
+	const u8 nStatus = pData[0];
+
+	if (nStatus == 0xFF)
+	{
+		ResetChannelState();
+		return;
+	}
+
+	// Only complete channel messages are tracked
+	if (nStatus < 0x80 || nStatus >= 0xF0 || nSize < 2)
+		return;
+
+	TChannelState& State = m_ChannelState[nStatus & 0x0F];
+	const u8 nData1 = pData[1] & 0x7F;
+	const u8 nData2 = nSize > 2 ? pData[2] & 0x7F : 0;
+
+	switch (nStatus & 0xF0)
+	{
+		case 0x90:
+			if (nData2)
+			{
+				State.ActiveNotes[nData1 >> 5] |= 1u << (nData1 & 31);
+				break;
+			}
+
+			// Note on with zero velocity is a note off
+			// Fall through
+		case 0x80:
+			State.ActiveNotes[nData1 >> 5] &= ~(1u << (nData1 & 31));
+			break;
+
+		case 0xB0:
+			State.Controllers[nData1] = nData2;
+
+			// All Sound Off/All Notes Off
+			if (nData1 == 120 || nData1 == 123)
+				memset(State.ActiveNotes, 0, sizeof(State.ActiveNotes));
+			break;
+
+		case 0xC0:
+			State.nProgram = nData1;
+			break;
+
+		case 0xE0:
+			State.nPitchWheel = nData2 << 7 | nData1;
+			break;
+	}
+}
+
+void CRTPMIDIReceiver::ResetChannelState()
+{
+	for (TChannelState& State : m_ChannelState)
+	{
+		memset(State.ActiveNotes, 0, sizeof(State.ActiveNotes));
+		memset(State.Controllers, UnknownValue, sizeof(State.Controllers));
+		State.nProgram = UnknownValue;
+		State.nPitchWheel = UnknownPitchWheel;
+	}
+}
+
+void CRTPMIDIReceiver::ApplyChannelJournal(u8 nChannel, u8 nChapters, const u8* pChapters, size_t nSize, u32 nTimestamp)
+{
+	// Chapters appear in the order P, C, M, W, N, E, T, A; we stop after N as the rest aren't needed
+	size_t nOffset = 0;
+	size_t nLength;
+
+	if (nChapters & ChapterP)
+	{
+		if (!(nLength = ApplyProgramChapter(nChannel, pChapters + nOffset, nSize - nOffset, nTimestamp)))
+			return;
+		nOffset += nLength;
+	}
+
+	if (nChapters & ChapterC)
+	{
+		if (!(nLength = ApplyControllerChapter(nChannel, pChapters + nOffset, nSize - nOffset, nTimestamp)))
+			return;
+		nOffset += nLength;
+	}
+
+	if (nChapters & ChapterM)
+	{
+		// Header: S P E U W Z LENGTH(10), where the length includes the header
+		if (nSize - nOffset < 2)
+			return;
+
+		nLength = (pChapters[nOffset] & 0x03) << 8 | pChapters[nOffset + 1];
+		if (nLength < 2 || nLength > nSize - nOffset)
+			return;
+		nOffset += nLength;
+	}
+
+	if (nChapters & ChapterW)
+	{
+		if (!(nLength = ApplyPitchWheelChapter(nChannel, pChapters + nOffset, nSize - nOffset, nTimestamp)))
+			return;
+		nOffset += nLength;
+	}
+
+	if (nChapters & ChapterN)
+		ApplyNoteChapter(nChannel, pChapters + nOffset, nSize - nOffset, nTimestamp);
+}
+
+size_t CRTPMIDIReceiver::ApplyProgramChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp)
+{
+	// S PROGRAM(7), B BANK-MSB(7), X BANK-LSB(7)
+	if (nSize < 3)
+		return 0;
+
+	const TChannelState& State = m_ChannelState[nChannel];
+	const u8 nProgram = pChapter[0] & 0x7F;
+	const bool bBank = pChapter[1] & 0x80;
+	const u8 nBankMSB = pChapter[1] & 0x7F;
+	const u8 nBankLSB = pChapter[2] & 0x7F;
+
+	const bool bBankChanged = bBank && (State.Controllers[0] != nBankMSB || State.Controllers[32] != nBankLSB);
+	if (State.nProgram == nProgram && !bBankChanged)
+		return 3;
+
+	if (bBank)
+	{
+		SendCommand(0xB0 | nChannel, 0, nBankMSB, nTimestamp);
+		SendCommand(0xB0 | nChannel, 32, nBankLSB, nTimestamp);
+	}
+
+	SendCommand(0xC0 | nChannel, nProgram, 0, nTimestamp);
+
+	return 3;
+}
+
+size_t CRTPMIDIReceiver::ApplyControllerChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp)
+{
+	// Header: S LEN(7), followed by LEN+1 logs of S NUMBER(7), A VALUE(7)
+	if (nSize < 1)
+		return 0;
+
+	const size_t nLogs = (pChapter[0] & 0x7F) + 1;
+	const size_t nLength = 1 + nLogs * 2;
+	if (nSize < nLength)
+		return 0;
+
+	for (size_t i = 0; i < nLogs; ++i)
+	{
+		const u8* const pLog = pChapter + 1 + i * 2;
+		const u8 nNumber = pLog[0] & 0x7F;
+
+		// Toggle/count tool logs don't carry an absolute value
+		if (pLog[1] & 0x80)
+			continue;
+
+		// Never replay channel mode messages
+		if (nNumber >= 120)
+			continue;
+
+		const u8 nValue = pLog[1] & 0x7F;
+		if (m_ChannelState[nChannel].Controllers[nNumber] != nValue)
+			SendCommand(0xB0 | nChannel, nNumber, nValue, nTimestamp);
+	}
+
+	return nLength;
+}
+
+size_t CRTPMIDIReceiver::ApplyPitchWheelChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp)
+{
+	// S FIRST(7), R SECOND(7)
+	if (nSize < 2)
+		return 0;
+
+	const u8 nFirst = pChapter[0] & 0x7F;
+	const u8 nSecond = pChapter[1] & 0x7F;
+
+	if (m_ChannelState[nChannel].nPitchWheel != (nSecond << 7 | nFirst))
+		SendCommand(0xE0 | nChannel, nFirst, nSecond, nTimestamp);
+
+	return 2;
+}
+
+size_t CRTPMIDIReceiver::ApplyNoteChapter(u8 nChannel, const u8* pChapter, size_t nSize, u32 nTimestamp)
+{
+	// Header: B LEN(7), LOW(4) HIGH(4), followed by LEN note logs and HIGH-LOW+1 bytes of OFFBITS
+	if (nSize < 2)
+		return 0;
+
+	const u8 nLen = pChapter[0] & 0x7F;
+	const u8 nLow = pChapter[1] >> 4;
+	const u8 nHigh = pChapter[1] & 0x0F;
+
+	// LEN=127 with LOW=15 and HIGH=0 is the special encoding of 128 note logs
+	const size_t nLogs = (nLen == 127 && nLow == 15 && nHigh == 0) ? 128 : nLen;
+	const size_t nOffBitsSize = nLow <= nHigh ? nHigh - nLow + 1 : 0;
+	const size_t nLength = 2 + nLogs * 2 + nOffBitsSize;
+	if (nSize < nLength)
+		return 0;
+
+	const u8* const pLogs = pChapter + 2;
+	const u8* const pOffBits = pLogs + nLogs * 2;
+
+	// Each OFFBITS byte covers 8 notes, most significant bit first; a set bit means a note-off was sent
+	auto IsOffBitSet = [&](u8 nNote)
+	{
+		const u8 nByte = nNote >> 3;
+		return nByte >= nLow && nByte <= nHigh && (pOffBits[nByte - nLow] & (0x80 >> (nNote & 7)));
+	};
+
+	// Release notes we're still holding because their note-off was lost
+	for (size_t i = 0; i < nOffBitsSize; ++i)
+	{
+		for (u8 j = 0; j < 8; ++j)
+		{
+			const u8 nNote = (nLow + i) * 8 + j;
+			if (IsOffBitSet(nNote) && IsNoteActive(nChannel, nNote))
+				SendCommand(0x80 | nChannel, nNote, 64, nTimestamp);
+		}
+	}
+
+	// Start lost notes that the sender recommends playing (Y bit)
+	for (size_t i = 0; i < nLogs; ++i)
+	{
+		const u8 nNote = pLogs[i * 2] & 0x7F;
+		const bool bPlay = pLogs[i * 2 + 1] & 0x80;
+		const u8 nVelocity = pLogs[i * 2 + 1] & 0x7F;
+
+		if (bPlay && nVelocity && !IsOffBitSet(nNote) && !IsNoteActive(nChannel, nNote))
+			SendCommand(0x90 | nChannel, nNote, nVelocity, nTimestamp);
+	}
+
+	return nLength;
+}
+
+void CRTPMIDIReceiver::SendCommand(u8 nStatus, u8 nData1, u8 nData2, u32 nTimestamp)
+{
+	const u8 Command[] = { nStatus, nData1, nData2 };
+	const u8 nType = nStatus & 0xF0;
+	const size_t nSize = (nType == 0xC0 || nType == 0xD0) ? 2 : 3;
+
+#ifdef RTPMIDI_DEBUG
+	LOGNOTE("Recovered %02X %02X %02X", nStatus, nData1, nData2);
+#endif
+
+	OnCommand(Command, nSize, nTimestamp);
+}
+
+void CRTPMIDIReceiver::Deliver(const u8* pData, size_t nSize, u32 nTimestamp)
+{
+	if (!m_nPlayoutLatency || !m_bHaveClockOffset || nSize > DataQueueSize)
+	{
+		// Preserve ordering with anything already buffered
+		Flush();
+		m_pHandler->OnAppleMIDIDataReceived(pData, nSize);
+		return;
+	}
+
+	// Map the sender's timestamp onto our clock, then delay it by the fixed latency
+	u32 nPlayoutTime = nTimestamp - m_nClockOffset + m_nPlayoutLatency;
+
+	// The offset estimate is stale or the sender's clock jumped; fall back to arrival time plus latency
+	if (static_cast<int>(nPlayoutTime - m_nNow) > static_cast<int>(m_nPlayoutLatency * 2))
+		nPlayoutTime = m_nNow + m_nPlayoutLatency;
+
+	// Make room by playing the oldest commands early
+	while (m_Entries.GetFreeSpace() < 1 || m_Data.GetFreeSpace() < nSize)
+		PlayNext();
+
+	const TEntry Entry{nPlayoutTime, nSize};
+	m_Data.Enqueue(pData, nSize);
+	m_Entries.Enqueue(Entry);
+}
+
+bool CRTPMIDIReceiver::PlayNext()
+{
+	TEntry Entry;
+	if (!m_Entries.Dequeue(Entry))
+		return false;
+
+	m_Data.Dequeue(m_CommandBuffer, Entry.nSize);
+	m_pHandler->OnAppleMIDIDataReceived(m_CommandBuffer, Entry.nSize);
+	return true;
+}
+
+void CRTPMIDIReceiver::Flush()
+{
+	while (PlayNext())
+		;
+}
@@ -0,0 +1,92 @@
+//
+// socketmultiplexer.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+
+#include "net/socketmultiplexer.h"
+
+LOGMODULE("socketmux");
+
+CSocketMultiplexer::CSocketMultiplexer()
+	: m_Sockets{nullptr}
+{
+}
+
+CSocketMultiplexer::~CSocketMultiplexer()
+{
+	for (CSocket* pSocket : m_Sockets)
+	{
+		if (pSocket)
+			pSocket->SetNotifyEvent(nullptr);
+	}
+}
+
+bool CSocketMultiplexer::Add(CSocket* pSocket)
+{
+	for (CSocket*& pSlot : m_Sockets)
+	{
+		if (pSlot)
+			continue;
+
+		if (pSocket->SetNotifyEvent(&m_Event) != 0)
+			return false;
+
+		pSlot = pSocket;
+
+		// Data may have arrived before we were watching
+		m_Event.Set();
+		return true;
+	}
+
+	LOGERR("Too many sockets");
+	return false;
+}
+
+void CSocketMultiplexer::Remove(CSocket* pSocket)
+{
+	if (!pSocket)
+		return;
+
+	for (CSocket*& pSlot : m_Sockets)
+	{
+		if (pSlot == pSocket)
+		{
+			pSocket->SetNotifyEvent(nullptr);
+			pSlot = nullptr;
+		}
+	}
+}
+
+bool CSocketMultiplexer::Wait(unsigned int nTimeoutMicros)
+{
+	bool bSignalled = true;
+
+	// WaitWithTimeout(0) reports a timeout straight away if the event is already set, so use Wait() for that case;
+	// either call returns immediately if already signalled
+	if (nTimeoutMicros == 0)
+		m_Event.Wait();
+	else
+		bSignalled = !m_Event.WaitWithTimeout(nTimeoutMicros);
+
+	m_Event.Clear();
+	return bSignalled;
+}
@@ -25,6 +25,7 @@
 #include <circle/net/netsubsystem.h>
 #include <circle/sched/scheduler.h>
 
+#include "deferredlog.h"
 #include "net/udpmidi.h"
 
 LOGMODULE("udpmidi");
@@ -26,6 +26,7 @@
 
 #include <cstdio>
 
+#include "deferredlog.h"
 #include "pisound.h"
 
 LOGMODULE("pisound");
@@ -25,6 +25,7 @@
 #include <circle/logger.h>
 #include <circle/timer.h>
 
+#include "deferredlog.h"
 #include "power.h"
 
 LOGMODULE("power");
@@ -0,0 +1,166 @@
+//
+// rendermonitor.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/util.h>
+
+#include "deferredlog.h"
+#include "rendermonitor.h"
+#include "utility.h"
+
+LOGMODULE("rendermonitor");
+
+CRenderMonitor::CRenderMonitor(unsigned int nSampleRate, size_t nMinQueuedFrames, size_t nMaxQueuedFrames, bool bAdaptive)
+	: m_nSampleRate(nSampleRate),
+	  m_nMinQueuedFrames(nMinQueuedFrames),
+	  m_nMaxQueuedFrames(Utility::Max(nMinQueuedFrames, nMaxQueuedFrames)),
+	  m_nTargetQueuedFrames(bAdaptive ? nMinQueuedFrames : m_nMaxQueuedFrames),
+	  m_bAdaptive(bAdaptive),
+	  m_bStarted(false),
+
+	  m_nUnderruns(0),
+	  m_nDropped(0),
+	  m_HeadroomHistogram{0},
+
+	  m_nTotalFrames(0),
+	  m_nTotalRenderTicks(0),
+	  m_nPeakActiveVoices(0),
+
+	  m_nWindowFrames(0),
+	  m_nWindowUnderruns(0),
+	  m_nWindowPeakLoad(0.0f),
+	  m_nCalmWindows(0)
+{
+}
+
+void CRenderMonitor::OnBlockStart(size_t nQueuedFrames)
+{
+	// The queue drained completely before we could refill it
+	if (nQueuedFrames == 0 && m_bStarted)
+	{
+		++m_nUnderruns;
+		++m_nWindowUnderruns;
+	}
+
+	m_bStarted = true;
+}
+
+void CRenderMonitor::OnBlockEnd(size_t nFrames, unsigned int nRenderTicks, size_t nActiveVoices)
+{
+	if (!nFrames)
+		return;
+
+	m_nTotalFrames += nFrames;
+	m_nTotalRenderTicks += nRenderTicks;
+	m_nPeakActiveVoices = Utility::Max(m_nPeakActiveVoices, nActiveVoices);
+
+	// Deadline is the real-time duration of the rendered block
+	const float nDeadlineTicks = static_cast<float>(nFrames) * 1000000.0f / m_nSampleRate;
+	const float nLoad = nRenderTicks / nDeadlineTicks;
+	const float nHeadroom = 1.0f - nLoad;
+
+	size_t nBucket = 0;
+	if (nHeadroom >= 0.0f)
+		nBucket = Utility::Min(static_cast<size_t>(nHeadroom * 10.0f), HeadroomBuckets - 2) + 1;
+	++m_HeadroomHistogram[nBucket];
+
+	m_nWindowPeakLoad = Utility::Max(m_nWindowPeakLoad, nLoad);
+	m_nWindowFrames += nFrames;
+
+	if (m_nWindowFrames >= m_nSampleRate)
+		EndWindow();
+}
+
+void CRenderMonitor::EndWindow()
+{
+	const size_t nPreviousTarget = m_nTargetQueuedFrames;
+
+	if (m_nWindowUnderruns)
+		LOGWARN("%u underrun(s) in the last second (%u total)", m_nWindowUnderruns, m_nUnderruns);
+
+	if (m_bAdaptive)
+	{
+		if (m_nWindowUnderruns || m_nWindowPeakLoad > GrowLoadThreshold)
+		{
+			// Too close to the deadline; buffer more
+			m_nTargetQueuedFrames = Utility::Min(m_nTargetQueuedFrames + StepFrames, m_nMaxQueuedFrames);
+			m_nCalmWindows = 0;
+		}
+		else if (m_nWindowPeakLoad < ShrinkLoadThreshold)
+		{
+			// Plenty of headroom for a while; try a lower latency
+			if (++m_nCalmWindows >= CalmWindowsBeforeShrink)
+			{
+				const size_t nStep = StepFrames;
+				m_nTargetQueuedFrames = m_nTargetQueuedFrames > m_nMinQueuedFrames + nStep ? m_nTargetQueuedFrames - nStep : m_nMinQueuedFrames;
+				m_nCalmWindows = 0;
+			}
+		}
+		else
+			m_nCalmWindows = 0;
+
+		if (m_nTargetQueuedFrames != nPreviousTarget)
+		{
+			LOGNOTE("Audio queue target %s to %u frames (%.2fms)",
+				m_nTargetQueuedFrames > nPreviousTarget ? "raised" : "lowered",
+				static_cast<unsigned int>(m_nTargetQueuedFrames),
+				m_nTargetQueuedFrames * 1000.0f / m_nSampleRate);
+			ReportStatus();
+		}
+	}
+
+	m_nWindowFrames = 0;
+	m_nWindowUnderruns = 0;
+	m_nWindowPeakLoad = 0.0f;
+}
+
+void CRenderMonitor::ReportStatus() const
+{
+	LOGNOTE("Underruns: %u, dropped writes: %u", m_nUnderruns, m_nDropped);
+	LOGNOTE("Headroom histogram (<0%%, 0-10%%, ..., 90-100%%): "
+		"%u %u %u %u %u %u %u %u %u %u %u",
+		m_HeadroomHistogram[0], m_HeadroomHistogram[1], m_HeadroomHistogram[2], m_HeadroomHistogram[3],
+		m_HeadroomHistogram[4], m_HeadroomHistogram[5], m_HeadroomHistogram[6], m_HeadroomHistogram[7],
+		m_HeadroomHistogram[8], m_HeadroomHistogram[9], m_HeadroomHistogram[10]);
+
+	if (!m_nTotalFrames || !m_nTotalRenderTicks)
+		return;
+
+	// Clock ticks are microseconds
+	const float nAudioSeconds = static_cast<float>(m_nTotalFrames) / m_nSampleRate;
+	const float nRenderSeconds = m_nTotalRenderTicks / 1000000.0f;
+	LOGNOTE("Rendered %.1fs of audio in %.1fs: %.2fx realtime, %u ns/frame, peak %u active voices",
+		nAudioSeconds, nRenderSeconds, nAudioSeconds / nRenderSeconds,
+		static_cast<unsigned int>(m_nTotalRenderTicks * 1000 / m_nTotalFrames),
+		static_cast<unsigned int>(m_nPeakActiveVoices));
+}
+
+void CRenderMonitor::ResetStatistics()
+{
+	m_nUnderruns = 0;
+	m_nDropped = 0;
+	memset(m_HeadroomHistogram, 0, sizeof(m_HeadroomHistogram));
+
+	m_nTotalFrames = 0;
+	m_nTotalRenderTicks = 0;
+	m_nPeakActiveVoices = 0;
+}
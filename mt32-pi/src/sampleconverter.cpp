@@ -0,0 +1,164 @@
+//
+// sampleconverter.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/util.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SAMPLE_CONVERTER_NEON
+#include <arm_neon.h>
+#endif
+
+#include "sampleconverter.h"
+#include "utility.h"
+
+constexpr float Sample24BitMax = (1 << 23) - 1;
+
+// Numerical Recipes LCG constants; the top 24 bits are used as a uniform random value
+constexpr u32 LCGMultiplier = 1664525;
+constexpr u32 LCGIncrement  = 1013904223;
+constexpr float LCGScale    = 1.0f / (1 << 24);
+
+CSampleConverter::CSampleConverter(bool bReversedStereo, bool bDither)
+	: m_bReversedStereo(bReversedStereo),
+	  m_bDither(bDither),
+	  m_DitherState{0x12345678, 0x9ABCDEF0, 0x0FEDCBA9, 0x87654321}
+{
+}
+
+float CSampleConverter::NextDitherValue()
+{
+	// Triangular PDF of +/-1 LSB from the difference of two uniform values
+	u32& nState = m_DitherState[0];
+	nState = nState * LCGMultiplier + LCGIncrement;
+	const float nA = static_cast<float>(nState >> 8);
+	nState = nState * LCGMultiplier + LCGIncrement;
+	const float nB = static_cast<float>(nState >> 8);
+	return (nA - nB) * LCGScale;
+}
+
+s32 CSampleConverter::ConvertSample(float nSample)
+{
+	float nScaled = nSample * Sample24BitMax;
+	if (m_bDither)
+		nScaled += NextDitherValue();
+
+	return static_cast<s32>(Utility::Clamp(nScaled, -Sample24BitMax, Sample24BitMax));
+}
+
+#ifdef SAMPLE_CONVERTER_NEON
+// Converts four samples (two frames) at a time
+static inline int32x4_t ConvertSamples(float32x4_t Samples, bool bReversedStereo, bool bDither, uint32x4_t& DitherState)
+{
+	if (bReversedStereo)
+		Samples = vrev64q_f32(Samples);
+
+	float32x4_t Scaled = vmulq_n_f32(Samples, Sample24BitMax);
+
+	if (bDither)
+	{
+		const uint32x4_t Multiplier = vdupq_n_u32(LCGMultiplier);
+		const uint32x4_t Increment = vdupq_n_u32(LCGIncrement);
+
+		DitherState = vmlaq_u32(Increment, DitherState, Multiplier);
+		const float32x4_t A = vcvtq_f32_u32(vshrq_n_u32(DitherState, 8));
+		DitherState = vmlaq_u32(Increment, DitherState, Multiplier);
+		const float32x4_t B = vcvtq_f32_u32(vshrq_n_u32(DitherState, 8));
+
+		Scaled = vmlaq_n_f32(Scaled, vsubq_f32(A, B), LCGScale);
+	}
+
+	// Saturate to full scale so that overshoot doesn't wrap around
+	Scaled = vminq_f32(vmaxq_f32(Scaled, vdupq_n_f32(-Sample24BitMax)), vdupq_n_f32(Sample24BitMax));
+
+	return vcvtq_s32_f32(Scaled);
+}
+#endif
+
+void CSampleConverter::ConvertS24_32(s32* pOutBuffer, const float* pInBuffer, size_t nFrames)
+{
+	const size_t nSamples = nFrames * 2;
+	size_t i = 0;
+
+#ifdef SAMPLE_CONVERTER_NEON
+	uint32_t* const pDitherState = reinterpret_cast<uint32_t*>(m_DitherState);
+	uint32x4_t DitherState = vld1q_u32(pDitherState);
+
+	for (; i + 4 <= nSamples; i += 4)
+		vst1q_s32(reinterpret_cast<int32_t*>(pOutBuffer + i), ConvertSamples(vld1q_f32(pInBuffer + i), m_bReversedStereo, m_bDither, DitherState));
+
+	vst1q_u32(pDitherState, DitherState);
+#endif
+
+	for (; i < nSamples; i += 2)
+	{
+		const size_t nLeft = m_bReversedStereo ? i + 1 : i;
+		const size_t nRight = m_bReversedStereo ? i : i + 1;
+		pOutBuffer[i] = ConvertSample(pInBuffer[nLeft]);
+		pOutBuffer[i + 1] = ConvertSample(pInBuffer[nRight]);
+	}
+}
+
+void CSampleConverter::ConvertS24(u8* pOutBuffer, const float* pInBuffer, size_t nFrames)
+{
+	const size_t nSamples = nFrames * 2;
+	size_t i = 0;
+
+#ifdef SAMPLE_CONVERTER_NEON
+	uint32_t* const pDitherState = reinterpret_cast<uint32_t*>(m_DitherState);
+	uint32x4_t DitherState = vld1q_u32(pDitherState);
+
+	for (; i + 4 <= nSamples; i += 4)
+	{
+		const int32x4_t Converted = ConvertSamples(vld1q_f32(pInBuffer + i), m_bReversedStereo, m_bDither, DitherState);
+		u8* const pOut = pOutBuffer + i * 3;
+
+#ifdef __aarch64__
+		// Gather the low three bytes of each lane into 12 contiguous bytes; the last 4 bytes written are
+		// overwritten by the next iteration (or fall into the caller's slack)
+		static const u8 PackIndices[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0 };
+		vst1q_u8(pOut, vqtbl1q_u8(vreinterpretq_u8_s32(Converted), vld1q_u8(PackIndices)));
+#else
+		// ARMv7 table lookups only produce 8 bytes, so gather the 12 bytes in two halves; the last 4 bytes written
+		// are overwritten by the next iteration (or fall into the caller's slack)
+		static const u8 PackIndicesLow[8] = { 0, 1, 2, 4, 5, 6, 8, 9 };
+		static const u8 PackIndicesHigh[8] = { 10, 12, 13, 14, 0, 0, 0, 0 };
+		const uint8x16_t Bytes = vreinterpretq_u8_s32(Converted);
+		const uint8x8x2_t Table = { { vget_low_u8(Bytes), vget_high_u8(Bytes) } };
+		vst1_u8(pOut, vtbl2_u8(Table, vld1_u8(PackIndicesLow)));
+		vst1_u8(pOut + 8, vtbl2_u8(Table, vld1_u8(PackIndicesHigh)));
+#endif
+	}
+
+	vst1q_u32(pDitherState, DitherState);
+#endif
+
+	// Overlapping 32-bit writes; the top byte of each is overwritten by the next sample (or falls into the slack)
+	for (; i < nSamples; i += 2)
+	{
+		const size_t nLeft = m_bReversedStereo ? i + 1 : i;
+		const size_t nRight = m_bReversedStereo ? i : i + 1;
+		const s32 nLeftSample = ConvertSample(pInBuffer[nLeft]);
+		const s32 nRightSample = ConvertSample(pInBuffer[nRight]);
+		memcpy(pOutBuffer + i * 3, &nLeftSample, sizeof(s32));
+		memcpy(pOutBuffer + (i + 1) * 3, &nRightSample, sizeof(s32));
+	}
+}
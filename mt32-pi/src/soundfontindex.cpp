@@ -0,0 +1,365 @@
+//
+// soundfontindex.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/util.h>
+
+#include "soundfontindex.h"
+#include "utility.h"
+
+LOGMODULE("soundfontindex");
+const char IndexFileName[] = "soundfonts.idx";
+
+constexpr u32 IndexMagic   = 0x58444953; // 'SIDX'
+constexpr u32 IndexVersion = 1;
+
+// Record flags
+constexpr u8 FlagSoundFont = 1 << 0;
+
+// Record size prefix + file name length + file name + key + flags + name length + name + sample data size +
+// preset count + FX profile key + FX profile mask + FX profile values
+constexpr size_t MaxFXProfileSize = 11 * sizeof(float);
+constexpr size_t MaxRecordSize = 2 + 1 + 255 + sizeof(CSoundFontIndex::TFileKey) + 1 + 1 + 255 + 4 + 2 + sizeof(CSoundFontIndex::TFileKey) + 2 + MaxFXProfileSize;
+
+struct TIndexHeader
+{
+	u32 nMagic;
+	u32 nVersion;
+	u32 nEntries;
+	u32 nDataSize;
+}
+PACKED;
+
+template <class T>
+static inline void Put(u8*& pCursor, const T& Value)
+{
+	memcpy(pCursor, &Value, sizeof(T));
+	pCursor += sizeof(T);
+}
+
+template <class T>
+static inline bool Get(const u8*& pCursor, const u8* pEnd, T& Value)
+{
+	if (static_cast<size_t>(pEnd - pCursor) < sizeof(T))
+		return false;
+
+	memcpy(&Value, pCursor, sizeof(T));
+	pCursor += sizeof(T);
+	return true;
+}
+
+static inline void PutString(u8*& pCursor, const char* pString)
+{
+	const u8 nLength = Utility::Min(strlen(pString), static_cast<size_t>(255));
+	Put(pCursor, nLength);
+	memcpy(pCursor, pString, nLength);
+	pCursor += nLength;
+}
+
+// Applies OP to every member of TFXProfile along with its bit in the stored mask
+#define FX_PROFILE_MEMBERS(OP) \
+	OP(0, nGain)           \
+	OP(1, bReverbActive)   \
+	OP(2, nReverbDamping)  \
+	OP(3, nReverbLevel)    \
+	OP(4, nReverbRoomSize) \
+	OP(5, nReverbWidth)    \
+	OP(6, bChorusActive)   \
+	OP(7, nChorusDepth)    \
+	OP(8, nChorusLevel)    \
+	OP(9, nChorusVoices)   \
+	OP(10, nChorusSpeed)
+
+CSoundFontIndex::CSoundFontIndex()
+	: m_pLoadedData(nullptr),
+	  m_nLoadedSize(0),
+	  m_nLoadedEntries(0),
+	  m_nSearchOffset(0),
+
+	  m_pData(nullptr),
+	  m_nSize(0),
+	  m_nCapacity(0),
+	  m_nEntries(0)
+{
+}
+
+CSoundFontIndex::~CSoundFontIndex()
+{
+	Reset();
+}
+
+void CSoundFontIndex::Reset()
+{
+	delete[] m_pLoadedData;
+	m_pLoadedData = nullptr;
+	m_nLoadedSize = 0;
+	m_nLoadedEntries = 0;
+	m_nSearchOffset = 0;
+
+	delete[] m_pData;
+	m_pData = nullptr;
+	m_nSize = 0;
+	m_nCapacity = 0;
+	m_nEntries = 0;
+}
+
+bool CSoundFontIndex::Load(const char* pDirectoryPath)
+{
+	Reset();
+
+	CString IndexPath;
+	IndexPath.Format("%s/%s", pDirectoryPath, IndexFileName);
+
+	FIL File;
+	if (f_open(&File, IndexPath, FA_READ) != FR_OK)
+		return false;
+
+	TIndexHeader Header;
+	UINT nRead;
+	bool bResult = f_read(&File, &Header, sizeof(Header), &nRead) == FR_OK && nRead == sizeof(Header) &&
+		       Header.nMagic == IndexMagic && Header.nVersion == IndexVersion &&
+		       Header.nDataSize <= MaxIndexSize && Header.nDataSize == f_size(&File) - sizeof(Header);
+
+	if (bResult)
+	{
+		m_pLoadedData = new u8[Header.nDataSize];
+		bResult = f_read(&File, m_pLoadedData, Header.nDataSize, &nRead) == FR_OK && nRead == Header.nDataSize;
+	}
+
+	f_close(&File);
+
+	if (!bResult)
+	{
+		LOGWARN("Ignoring invalid index in %s", pDirectoryPath);
+		Reset();
+		return false;
+	}
+
+	m_nLoadedSize = Header.nDataSize;
+	m_nLoadedEntries = Header.nEntries;
+	return true;
+}
+
+bool CSoundFontIndex::Save(const char* pDirectoryPath)
+{
+	// Nothing was added or removed, and no entries were updated
+	if (m_nEntries == m_nLoadedEntries && m_nSize == m_nLoadedSize && (!m_nSize || memcmp(m_pData, m_pLoadedData, m_nSize) == 0))
+		return true;
+
+	CString IndexPath;
+	IndexPath.Format("%s/%s", pDirectoryPath, IndexFileName);
+
+	FIL File;
+	if (f_open(&File, IndexPath, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		LOGWARN("Couldn't create index in %s", pDirectoryPath);
+		return false;
+	}
+
+	const TIndexHeader Header{IndexMagic, IndexVersion, static_cast<u32>(m_nEntries), static_cast<u32>(m_nSize)};
+	UINT nWritten;
+	bool bResult = f_write(&File, &Header, sizeof(Header), &nWritten) == FR_OK && nWritten == sizeof(Header);
+	if (bResult && m_nSize)
+		bResult = f_write(&File, m_pData, m_nSize, &nWritten) == FR_OK && nWritten == m_nSize;
+
+	f_close(&File);
+
+	if (!bResult)
+	{
+		// Don't leave a truncated index behind
+		LOGWARN("Couldn't write index in %s", pDirectoryPath);
+		f_unlink(IndexPath);
+		return false;
+	}
+
+	// Keep it out of the way of scans and file browsers
+	f_chmod(IndexPath, AM_HID, AM_HID);
+
+	LOGNOTE("Updated index in %s (%u entries)", pDirectoryPath, static_cast<unsigned int>(m_nEntries));
+	return true;
+}
+
+bool CSoundFontIndex::Find(const char* pFileName, const TFileKey& FileKey, TEntry& Entry)
+{
+	if (!m_nLoadedSize)
+		return false;
+
+	const size_t nFileNameLength = strlen(pFileName);
+
+	// Directory order rarely changes between scans, so start looking just after the previous match
+	const size_t nStartOffset = m_nSearchOffset;
+	size_t nOffset = nStartOffset;
+	bool bWrapped = false;
+
+	while (!bWrapped || nOffset < nStartOffset)
+	{
+		if (nOffset >= m_nLoadedSize)
+		{
+			nOffset = 0;
+			bWrapped = true;
+			continue;
+		}
+
+		const u8* pRecord = m_pLoadedData + nOffset;
+		u16 nRecordSize = 0;
+		if (nOffset + sizeof(nRecordSize) <= m_nLoadedSize)
+			memcpy(&nRecordSize, pRecord, sizeof(nRecordSize));
+
+		// Corrupt record; give up on the rest of the index
+		if (nRecordSize <= sizeof(nRecordSize) + 1 || nOffset + nRecordSize > m_nLoadedSize)
+			return false;
+
+		const u8 nNameLength = pRecord[sizeof(nRecordSize)];
+		if (sizeof(nRecordSize) + 1 + nNameLength > nRecordSize)
+			return false;
+
+		const char* pName = reinterpret_cast<const char*>(pRecord + sizeof(nRecordSize) + 1);
+		nOffset += nRecordSize;
+
+		if (nNameLength == nFileNameLength && memcmp(pName, pFileName, nNameLength) == 0)
+		{
+			m_nSearchOffset = nOffset;
+			return Decode(pRecord, Entry) && Entry.FileKey == FileKey;
+		}
+	}
+
+	return false;
+}
+
+void CSoundFontIndex::Add(const char* pFileName, const TEntry& Entry)
+{
+	u8 Record[MaxRecordSize];
+	u8* pCursor = Record + sizeof(u16);
+
+	PutString(pCursor, pFileName);
+	Put(pCursor, Entry.FileKey);
+	Put(pCursor, Entry.bSoundFont ? FlagSoundFont : static_cast<u8>(0));
+
+	if (Entry.bSoundFont)
+	{
+		PutString(pCursor, Entry.Name);
+		Put(pCursor, Entry.nSampleDataSize);
+		Put(pCursor, Entry.nPresetCount);
+		Put(pCursor, Entry.FXProfileKey);
+
+		u16 nMask = 0;
+		u8* const pMask = pCursor;
+		pCursor += sizeof(nMask);
+
+		#define PUT_MEMBER(BIT, MEMBER)                          \
+			if (Entry.FXProfile.MEMBER)                      \
+			{                                                \
+				nMask |= 1 << BIT;                       \
+				Put(pCursor, Entry.FXProfile.MEMBER.Value()); \
+			}
+
+		FX_PROFILE_MEMBERS(PUT_MEMBER)
+		#undef PUT_MEMBER
+
+		memcpy(pMask, &nMask, sizeof(nMask));
+	}
+
+	const u16 nRecordSize = pCursor - Record;
+	memcpy(Record, &nRecordSize, sizeof(nRecordSize));
+	Append(Record, nRecordSize);
+	++m_nEntries;
+}
+
+bool CSoundFontIndex::IsIndexFile(const char* pFileName)
+{
+	return strcasecmp(pFileName, IndexFileName) == 0;
+}
+
+bool CSoundFontIndex::Decode(const u8* pRecord, TEntry& Entry)
+{
+	u16 nRecordSize;
+	memcpy(&nRecordSize, pRecord, sizeof(nRecordSize));
+
+	const u8* const pEnd = pRecord + nRecordSize;
+	const u8* pCursor = pRecord + sizeof(nRecordSize);
+
+	// Skip file name
+	u8 nLength;
+	if (!Get(pCursor, pEnd, nLength) || static_cast<size_t>(pEnd - pCursor) < nLength)
+		return false;
+	pCursor += nLength;
+
+	u8 nFlags;
+	if (!Get(pCursor, pEnd, Entry.FileKey) || !Get(pCursor, pEnd, nFlags))
+		return false;
+
+	Entry.bSoundFont = nFlags & FlagSoundFont;
+	Entry.Name[0] = '\0';
+	Entry.nSampleDataSize = 0;
+	Entry.nPresetCount = 0;
+	Entry.FXProfileKey = TFileKey{0, 0, 0};
+	Entry.FXProfile = TFXProfile();
+
+	if (!Entry.bSoundFont)
+		return true;
+
+	if (!Get(pCursor, pEnd, nLength) || static_cast<size_t>(pEnd - pCursor) < nLength)
+		return false;
+	memcpy(Entry.Name, pCursor, nLength);
+	Entry.Name[nLength] = '\0';
+	pCursor += nLength;
+
+	u16 nMask;
+	if (!Get(pCursor, pEnd, Entry.nSampleDataSize) || !Get(pCursor, pEnd, Entry.nPresetCount) ||
+	    !Get(pCursor, pEnd, Entry.FXProfileKey) || !Get(pCursor, pEnd, nMask))
+		return false;
+
+	#define GET_MEMBER(BIT, MEMBER)                                              \
+		if (nMask & (1 << BIT))                                              \
+		{                                                                    \
+			auto Value = decltype(*Entry.FXProfile.MEMBER){};            \
+			if (!Get(pCursor, pEnd, Value))                              \
+				return false;                                        \
+			Entry.FXProfile.MEMBER = Value;                              \
+		}
+
+	FX_PROFILE_MEMBERS(GET_MEMBER)
+	#undef GET_MEMBER
+
+	return true;
+}
+
+void CSoundFontIndex::Append(const u8* pData, size_t nSize)
+{
+	if (m_nSize + nSize > m_nCapacity)
+	{
+		size_t nNewCapacity = m_nCapacity ? m_nCapacity * 2 : InitialCapacity;
+		while (nNewCapacity < m_nSize + nSize)
+			nNewCapacity *= 2;
+
+		u8* const pNewData = new u8[nNewCapacity];
+		if (m_nSize)
+			memcpy(pNewData, m_pData, m_nSize);
+
+		delete[] m_pData;
+		m_pData = pNewData;
+		m_nCapacity = nNewCapacity;
+	}
+
+	memcpy(m_pData + m_nSize, pData, nSize);
+	m_nSize += nSize;
+}
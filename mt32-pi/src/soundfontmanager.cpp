@@ -43,9 +43,15 @@ constexpr u32 FourCC(const char pFourCC[4])
 constexpr u32 FourCCINAM = FourCC("INAM");
 constexpr u32 FourCCINFO = FourCC("INFO");
 constexpr u32 FourCCLIST = FourCC("LIST");
+constexpr u32 FourCCPDTA = FourCC("pdta");
+constexpr u32 FourCCPHDR = FourCC("phdr");
 constexpr u32 FourCCRIFF = FourCC("RIFF");
+constexpr u32 FourCCSDTA = FourCC("sdta");
 constexpr u32 FourCCSFBK = FourCC("sfbk");
 
+// Size of a preset header record in the pdta-list phdr chunk
+constexpr size_t PresetHeaderSize = 38;
+
 struct TSoundFontChunk
 {
 	u32 FourCC;
@@ -66,32 +72,14 @@ bool CSoundFontManager::ScanSoundFonts()
 
 	m_nSoundFonts = 0;
 
-	DIR Dir;
-	FILINFO FileInfo;
-	FRESULT Result;
 	CString DirectoryPath;
+	size_t nParsed = 0;
 
 	// Loop over each disk
 	for (auto pDisk : Disks)
 	{
 		DirectoryPath.Format("%s:%s", pDisk, SoundFontDirectory);
-		Result = f_findfirst(&Dir, &FileInfo, DirectoryPath, "*");
-
-		// Loop over each file in the directory
-		while (Result == FR_OK && *FileInfo.fname && m_nSoundFonts < MaxSoundFonts)
-		{
-			// Ensure not directory, hidden, or system file
-			if (!(FileInfo.fattrib & (AM_DIR | AM_HID | AM_SYS)))
-			{
-				// Assemble path
-				CString SoundFontPath;
-				SoundFontPath.Format("%s/%s", static_cast<const char*>(DirectoryPath), FileInfo.fname);
-
-				CheckSoundFont(SoundFontPath, FileInfo.fname);
-			}
-
-			Result = f_findnext(&Dir, &FileInfo);
-		}
+		ScanDirectory(DirectoryPath, nParsed);
 	}
 
 	if (m_nSoundFonts > 0)
@@ -99,9 +87,9 @@ bool CSoundFontManager::ScanSoundFonts()
 		// Sort into lexicographical order
 		Utility::QSort(m_SoundFontList, SoundFontListComparator, 0, m_nSoundFonts - 1);
 
-		LOGNOTE("%d SoundFonts found:", m_nSoundFonts);
+		LOGNOTE("%u SoundFonts found (%u files parsed):", static_cast<unsigned int>(m_nSoundFonts), static_cast<unsigned int>(nParsed));
 		for (size_t i = 0; i < m_nSoundFonts; ++i)
-			LOGNOTE("%d: %s (%s)", i, static_cast<const char*>(m_SoundFontList[i].Path), static_cast<const char*>(m_SoundFontList[i].Name));
+			LOGNOTE("%u: %s (%s)", static_cast<unsigned int>(i), static_cast<const char*>(m_SoundFontList[i].Path), static_cast<const char*>(m_SoundFontList[i].Name));
 
 		return true;
 	}
@@ -128,131 +116,222 @@ const char* CSoundFontManager::GetSoundFontName(size_t nIndex) const
 	return static_cast<const char*>(m_SoundFontList[nIndex].Name);
 }
 
-TFXProfile CSoundFontManager::GetSoundFontFXProfile(size_t nIndex) const
+TFXProfile CSoundFontManager::GetSoundFontFXProfile(size_t nIndex)
 {
-	TFXProfile FXProfile;
+	if (nIndex >= m_nSoundFonts)
+		return TFXProfile();
 
-	const char* const pSoundFontPath = GetSoundFontPath(nIndex);
-	if (!pSoundFontPath)
-		return FXProfile;
+	// Only re-read the profile if it has been changed since the scan
+	TSoundFontListEntry& Entry = m_SoundFontList[nIndex];
+	UpdateFXProfile(Entry.Path, Entry.FXProfileKey, Entry.FXProfile);
 
-	// +5 bytes in case we need to add an extension (4 chars + null terminator)
-	const size_t nPathLength = strlen(pSoundFontPath) + 5;
-	char PathBuffer[nPathLength];
-	strcpy(PathBuffer, pSoundFontPath);
+	return Entry.FXProfile;
+}
 
-	// Replace file extension if present
-	char* const pExtension = strrchr(PathBuffer, '.');
-	if (pExtension)
-		strcpy(pExtension, ".cfg");
-	else
-		strcat(PathBuffer, ".cfg");
+size_t CSoundFontManager::GetSoundFontSampleDataSize(size_t nIndex) const
+{
+	return nIndex < m_nSoundFonts ? m_SoundFontList[nIndex].nSampleDataSize : 0;
+}
 
-	FIL File;
-	if (f_open(&File, PathBuffer, FA_READ) != FR_OK)
-		return FXProfile;
+size_t CSoundFontManager::GetSoundFontPresetCount(size_t nIndex) const
+{
+	return nIndex < m_nSoundFonts ? m_SoundFontList[nIndex].nPresetCount : 0;
+}
 
-	// +1 byte for null terminator
-	const UINT nSize = f_size(&File);
-	char Buffer[nSize + 1];
-	UINT nRead;
+const char* CSoundFontManager::GetFirstValidSoundFontPath() const
+{
+	return m_nSoundFonts > 0 ? static_cast<const char*>(m_SoundFontList[0].Path) : nullptr;
+}
 
-	if (f_read(&File, Buffer, nSize, &nRead) != FR_OK)
+void CSoundFontManager::ScanDirectory(const char* pDirectoryPath, size_t& nParsed)
+{
+	DIR Dir;
+	FILINFO FileInfo;
+	FRESULT Result = f_findfirst(&Dir, &FileInfo, pDirectoryPath, "*");
+
+	if (Result != FR_OK)
+		return;
+
+	CSoundFontIndex Index;
+	Index.Load(pDirectoryPath);
+
+	// Loop over each file in the directory
+	while (Result == FR_OK && *FileInfo.fname && m_nSoundFonts < MaxSoundFonts)
 	{
-		LOGERR("Error reading effects profile");
-		f_close(&File);
-		return FXProfile;
-	}
+		// Ensure not directory, hidden, or system file
+		if (!(FileInfo.fattrib & (AM_DIR | AM_HID | AM_SYS)) && !CSoundFontIndex::IsIndexFile(FileInfo.fname))
+		{
+			// Assemble path
+			CString SoundFontPath;
+			SoundFontPath.Format("%s/%s", pDirectoryPath, FileInfo.fname);
 
-	// Ensure null-terminated
-	Buffer[nRead] = '\0';
+			// Only open files that are new or have changed since the last scan
+			const CSoundFontIndex::TFileKey FileKey = CSoundFontIndex::GetFileKey(FileInfo);
+			CSoundFontIndex::TEntry IndexEntry;
 
-	const int nResult = ini_parse_string(Buffer, INIHandler, &FXProfile);
-	if (nResult > 0)
-		LOGWARN("Effects profile parse error on line %d", nResult);
+			if (!Index.Find(FileInfo.fname, FileKey, IndexEntry))
+			{
+				IndexEntry = CSoundFontIndex::TEntry();
+				IndexEntry.FileKey = FileKey;
+				IndexEntry.bSoundFont = ParseSoundFont(SoundFontPath, IndexEntry);
+				++nParsed;
+			}
 
-	f_close(&File);
-	return FXProfile;
+			if (IndexEntry.bSoundFont)
+			{
+				UpdateFXProfile(SoundFontPath, IndexEntry.FXProfileKey, IndexEntry.FXProfile);
+				AddSoundFont(SoundFontPath, FileInfo.fname, IndexEntry);
+			}
+
+			Index.Add(FileInfo.fname, IndexEntry);
+		}
+
+		Result = f_findnext(&Dir, &FileInfo);
+	}
+
+	f_closedir(&Dir);
+	Index.Save(pDirectoryPath);
 }
 
-const char* CSoundFontManager::GetFirstValidSoundFontPath() const
+void CSoundFontManager::AddSoundFont(const char* pFullPath, const char* pFileName, const CSoundFontIndex::TEntry& IndexEntry)
 {
-	return m_nSoundFonts > 0 ? static_cast<const char*>(m_SoundFontList[0].Path) : nullptr;
+	TSoundFontListEntry& Entry = m_SoundFontList[m_nSoundFonts++];
+	Entry.Path = pFullPath;
+
+	// If we got a name, use it, otherwise fall back on filename
+	if (IndexEntry.Name[0] != '\0')
+		Entry.Name = IndexEntry.Name;
+	else
+		Entry.Name = pFileName;
+
+	Entry.nSampleDataSize = IndexEntry.nSampleDataSize;
+	Entry.nPresetCount = IndexEntry.nPresetCount;
+	Entry.FXProfileKey = IndexEntry.FXProfileKey;
+	Entry.FXProfile = IndexEntry.FXProfile;
 }
 
-void CSoundFontManager::CheckSoundFont(const char* pFullPath, const char* pFileName)
+bool CSoundFontManager::ParseSoundFont(const char* pFullPath, CSoundFontIndex::TEntry& IndexEntry)
 {
 	FIL File;
 	UINT nBytesRead;
 	TSoundFontChunk Chunk;
 	u32 nFourCC;
-	u32 nInfoListChunkSize;
-	char Name[MaxSoundFontNameLength];
-
-	// Init with null terminator
-	Name[0] = '\0';
+	bool bInfoFound = false;
 
 	// Try to open file
 	if (f_open(&File, pFullPath, FA_READ) != FR_OK)
-		return;
-
-#define CHECK_CHUNK_ID(EXPECTED_CHUNK_ID)                                                                \
-	if (f_read(&File, &Chunk, sizeof(Chunk), &nBytesRead) != FR_OK || Chunk.FourCC != EXPECTED_CHUNK_ID) \
-	{                                                                                                    \
-		f_close(&File);                                                                                  \
-		return;                                                                                          \
-	}
+		return false;
 
-#define CHECK_FORM_ID(EXPECTED_FORM_ID)                                                                \
-	if (f_read(&File, &nFourCC, sizeof(nFourCC), &nBytesRead) != FR_OK || nFourCC != EXPECTED_FORM_ID) \
-	{                                                                                                  \
-		f_close(&File);                                                                                \
-		return;                                                                                        \
+	if (f_read(&File, &Chunk, sizeof(Chunk), &nBytesRead) != FR_OK || Chunk.FourCC != FourCCRIFF ||
+	    f_read(&File, &nFourCC, sizeof(nFourCC), &nBytesRead) != FR_OK || nFourCC != FourCCSFBK)
+	{
+		f_close(&File);
+		return false;
 	}
 
-	CHECK_CHUNK_ID(FourCCRIFF);
-	CHECK_FORM_ID(FourCCSFBK);
-	CHECK_CHUNK_ID(FourCCLIST);
-	CHECK_FORM_ID(FourCCINFO);
-
-	#undef CHECK_CHUNK_ID
-	#undef CHECK_FORM_ID
-
-	// Loop over info list chunks and look for name chunk
-	nInfoListChunkSize = Chunk.Size;
-	size_t nTotalBytesRead = 4;
-
-	while (nTotalBytesRead < nInfoListChunkSize && f_read(&File, &Chunk, sizeof(Chunk), &nBytesRead) == FR_OK)
+	// Loop over the INFO, sdta and pdta lists
+	while (f_read(&File, &Chunk, sizeof(Chunk), &nBytesRead) == FR_OK && nBytesRead == sizeof(Chunk))
 	{
-		nTotalBytesRead += nBytesRead;
+		const FSIZE_t nNextChunkOffset = f_tell(&File) + Chunk.Size;
 
-		// Extract name
-		if (Chunk.FourCC == FourCCINAM)
+		if (Chunk.FourCC == FourCCLIST && f_read(&File, &nFourCC, sizeof(nFourCC), &nBytesRead) == FR_OK && nBytesRead == sizeof(nFourCC))
 		{
-			if (Chunk.Size <= sizeof(Name))
-				f_read(&File, Name, Chunk.Size, &nBytesRead);
+			const u32 nListSize = Chunk.Size - sizeof(nFourCC);
 
-			break;
+			if (nFourCC == FourCCSDTA)
+				IndexEntry.nSampleDataSize = nListSize;
+			else if (nFourCC == FourCCINFO || nFourCC == FourCCPDTA)
+			{
+				bInfoFound |= nFourCC == FourCCINFO;
+
+				// Loop over sub-chunks and look for name or preset headers
+				size_t nTotalBytesRead = 0;
+				while (nTotalBytesRead < nListSize && f_read(&File, &Chunk, sizeof(Chunk), &nBytesRead) == FR_OK && nBytesRead == sizeof(Chunk))
+				{
+					nTotalBytesRead += nBytesRead;
+
+					// Extract name
+					if (Chunk.FourCC == FourCCINAM)
+					{
+						if (Chunk.Size < sizeof(IndexEntry.Name) && f_read(&File, IndexEntry.Name, Chunk.Size, &nBytesRead) == FR_OK)
+							IndexEntry.Name[nBytesRead] = '\0';
+						break;
+					}
+
+					// Last preset header is a terminator
+					if (Chunk.FourCC == FourCCPHDR)
+					{
+						IndexEntry.nPresetCount = Chunk.Size >= PresetHeaderSize ? Chunk.Size / PresetHeaderSize - 1 : 0;
+						break;
+					}
+
+					// Skip to start of next chunk
+					f_lseek(&File, f_tell(&File) + Chunk.Size);
+					nTotalBytesRead += Chunk.Size;
+				}
+			}
 		}
 
-		// Skip to start of next chunk
-		else
-			f_lseek(&File, f_tell(&File) + Chunk.Size);
-
-		nTotalBytesRead += Chunk.Size;
+		f_lseek(&File, nNextChunkOffset);
 	}
 
 	// Clean up
 	f_close(&File);
 
-	TSoundFontListEntry& Entry = m_SoundFontList[m_nSoundFonts++];
-	Entry.Path = pFullPath;
+	return bInfoFound;
+}
 
-	// If we got a name, use it, otherwise fall back on filename
-	if (Name[0] != '\0')
-		Entry.Name = Name;
+bool CSoundFontManager::UpdateFXProfile(const char* pSoundFontPath, CSoundFontIndex::TFileKey& FXProfileKey, TFXProfile& FXProfile)
+{
+	// +5 bytes in case we need to add an extension (4 chars + null terminator)
+	const size_t nPathLength = strlen(pSoundFontPath) + 5;
+	char PathBuffer[nPathLength];
+	strcpy(PathBuffer, pSoundFontPath);
+
+	// Replace file extension if present
+	char* const pExtension = strrchr(PathBuffer, '.');
+	if (pExtension)
+		strcpy(pExtension, ".cfg");
 	else
-		Entry.Name = pFileName;
+		strcat(PathBuffer, ".cfg");
+
+	// A zero key means there's no profile
+	FILINFO FileInfo;
+	CSoundFontIndex::TFileKey Key{0, 0, 0};
+	if (f_stat(PathBuffer, &FileInfo) == FR_OK)
+		Key = CSoundFontIndex::GetFileKey(FileInfo);
+
+	if (Key == FXProfileKey)
+		return false;
+
+	FXProfileKey = Key;
+	FXProfile = TFXProfile();
+
+	FIL File;
+	if (f_open(&File, PathBuffer, FA_READ) != FR_OK)
+		return true;
+
+	// +1 byte for null terminator
+	const UINT nSize = f_size(&File);
+	char Buffer[nSize + 1];
+	UINT nRead;
+
+	if (f_read(&File, Buffer, nSize, &nRead) != FR_OK)
+	{
+		LOGERR("Error reading effects profile");
+		f_close(&File);
+		return true;
+	}
+
+	// Ensure null-terminated
+	Buffer[nRead] = '\0';
+
+	const int nResult = ini_parse_string(Buffer, INIHandler, &FXProfile);
+	if (nResult > 0)
+		LOGWARN("Effects profile parse error on line %d", nResult);
+
+	f_close(&File);
+	return true;
 }
 
 inline bool CSoundFontManager::SoundFontListComparator(const TSoundFontListEntry& EntryA, const TSoundFontListEntry& EntryB)
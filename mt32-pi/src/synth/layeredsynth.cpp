@@ -0,0 +1,265 @@
+//
+// layeredsynth.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/synchronize.h>
+
+#include "config.h"
+#include "deferredlog.h"
+#include "lcd/ui.h"
+#include "synth/layeredsynth.h"
+#include "utility.h"
+
+LOGMODULE("layeredsynth");
+
+CLayeredSynth::CLayeredSynth(CMT32Synth& MT32Synth, CSoundFontSynth& SoundFontSynth, size_t nMaxFrames)
+	: CSynthBase(SoundFontSynth.m_nSampleRate),
+
+	  m_MT32Synth(MT32Synth),
+	  m_SoundFontSynth(SoundFontSynth),
+
+	  m_nMT32ChannelMask(0xFFFF),
+	  m_nSoundFontChannelMask(0xFFFF),
+	  m_nMT32Gain(1.0f),
+	  m_nSoundFontGain(1.0f),
+
+	  m_nMaxFrames(nMaxFrames),
+	  m_pMT32Buffer(nullptr),
+	  m_pMT32IntBuffer(nullptr),
+
+	  m_nWorkerFrames(0),
+	  m_bWorkerFloat(true)
+{
+}
+
+CLayeredSynth::~CLayeredSynth()
+{
+	delete[] m_pMT32Buffer;
+	delete[] m_pMT32IntBuffer;
+}
+
+bool CLayeredSynth::Initialize()
+{
+	m_pMT32Buffer = new float[m_nMaxFrames * 2];
+	m_pMT32IntBuffer = new s16[m_nMaxFrames * 2];
+
+	const CConfig* const pConfig = CConfig::Get();
+	m_bChannelMeters = pConfig->LCDType != CConfig::TLCDType::None && pConfig->LCDMeters == CConfig::TLCDMeters::Audio;
+
+	LOGNOTE("MT-32 channel mask: 0x%04X, SoundFont channel mask: 0x%04X", m_nMT32ChannelMask, m_nSoundFontChannelMask);
+	return true;
+}
+
+void CLayeredSynth::HandleMIDIShortMessage(u32 nMessage)
+{
+	const u8 nStatus = nMessage & 0xFF;
+
+	// System messages go to both engines, like a MIDI thru chain
+	if (nStatus >= 0xF0)
+	{
+		m_MT32Synth.HandleMIDIShortMessage(nMessage);
+		m_SoundFontSynth.HandleMIDIShortMessage(nMessage);
+	}
+	else
+	{
+		const u16 nChannelBit = 1 << (nStatus & 0x0F);
+
+		if (m_nMT32ChannelMask & nChannelBit)
+			m_MT32Synth.HandleMIDIShortMessage(nMessage);
+
+		if (m_nSoundFontChannelMask & nChannelBit)
+			m_SoundFontSynth.HandleMIDIShortMessage(nMessage);
+	}
+
+	// Update MIDI monitor
+	CSynthBase::HandleMIDIShortMessage(nMessage);
+}
+
+void CLayeredSynth::HandleMIDISysExMessage(const u8* pData, size_t nSize)
+{
+	// Each engine ignores SysEx that isn't addressed to it
+	m_MT32Synth.HandleMIDISysExMessage(pData, nSize);
+	m_SoundFontSynth.HandleMIDISysExMessage(pData, nSize);
+}
+
+void CLayeredSynth::AllSoundOff()
+{
+	m_MT32Synth.AllSoundOff();
+	m_SoundFontSynth.AllSoundOff();
+
+	// Reset MIDI monitor
+	CSynthBase::AllSoundOff();
+}
+
+void CLayeredSynth::SetMasterVolume(u8 nVolume)
+{
+	m_MT32Synth.SetMasterVolume(nVolume);
+	m_SoundFontSynth.SetMasterVolume(nVolume);
+}
+
+void CLayeredSynth::StartWorker(size_t nFrames, bool bFloat)
+{
+	m_bWorkerFloat = bFloat;
+
+	// Make the job parameters visible before handing over the job
+	DataMemBarrier();
+	m_nWorkerFrames = nFrames;
+
+	// Wake up the worker core
+	DataSyncBarrier();
+	SendEvent();
+}
+
+void CLayeredSynth::WaitForWorker()
+{
+	while (m_nWorkerFrames)
+		;
+
+	// Ensure the worker's output is read after its completion has been observed
+	DataMemBarrier();
+}
+
+static inline void MixFrames(float* pOutBuffer, const float* pMT32Buffer, size_t nSamples, float nMT32Gain, float nSoundFontGain)
+{
+	for (size_t i = 0; i < nSamples; ++i)
+		pOutBuffer[i] = pOutBuffer[i] * nSoundFontGain + pMT32Buffer[i] * nMT32Gain;
+}
+
+static inline void MixFrames(s16* pOutBuffer, const s16* pMT32Buffer, size_t nSamples, float nMT32Gain, float nSoundFontGain)
+{
+	for (size_t i = 0; i < nSamples; ++i)
+	{
+		const float nSample = pOutBuffer[i] * nSoundFontGain + pMT32Buffer[i] * nMT32Gain;
+		pOutBuffer[i] = static_cast<s16>(Utility::Clamp(nSample, -32768.0f, 32767.0f));
+	}
+}
+
+template <class T>
+size_t CLayeredSynth::RenderLayered(T* pOutBuffer, T* pMT32Buffer, size_t nFrames, bool bFloat)
+{
+	const T* pBlockStart = pOutBuffer;
+	size_t nTotalFrames = 0;
+
+	// Never hand the worker more than its buffer can hold
+	while (nFrames)
+	{
+		const size_t nBlockFrames = Utility::Min(nFrames, m_nMaxFrames);
+
+		StartWorker(nBlockFrames, bFloat);
+		m_SoundFontSynth.Render(pOutBuffer, nBlockFrames);
+		WaitForWorker();
+
+		MixFrames(pOutBuffer, pMT32Buffer, nBlockFrames * 2, m_nMT32Gain, m_nSoundFontGain);
+
+		pOutBuffer += nBlockFrames * 2;
+		nFrames -= nBlockFrames;
+		nTotalFrames += nBlockFrames;
+	}
+
+	// Both engines have published their state by now, as the worker has finished
+	const TState MT32State = m_MT32Synth.GetState();
+	const TState SoundFontState = m_SoundFontSynth.GetState();
+	PublishState(pBlockStart, nTotalFrames, MT32State.bActive || SoundFontState.bActive, MT32State.nActiveVoices + SoundFontState.nActiveVoices);
+
+	return nTotalFrames;
+}
+
+size_t CLayeredSynth::Render(s16* pOutBuffer, size_t nFrames)
+{
+	return RenderLayered(pOutBuffer, m_pMT32IntBuffer, nFrames, false);
+}
+
+size_t CLayeredSynth::Render(float* pOutBuffer, size_t nFrames)
+{
+	return RenderLayered(pOutBuffer, m_pMT32Buffer, nFrames, true);
+}
+
+void CLayeredSynth::RunWorker()
+{
+	const size_t nFrames = m_nWorkerFrames;
+
+	// No MT-32 job; help FluidSynth instead (sleeps until the next event if it has nothing to do either)
+	if (!nFrames)
+	{
+		m_SoundFontSynth.RunMixerWorker();
+		return;
+	}
+
+	DataMemBarrier();
+
+	if (m_bWorkerFloat)
+		m_MT32Synth.Render(m_pMT32Buffer, nFrames);
+	else
+		m_MT32Synth.Render(m_pMT32IntBuffer, nFrames);
+
+	DataMemBarrier();
+	m_nWorkerFrames = 0;
+}
+
+void CLayeredSynth::ReportStatus() const
+{
+	// SoundFont switches are more frequent than ROM set switches, so show the SoundFont
+	m_SoundFontSynth.ReportStatus();
+}
+
+void CLayeredSynth::UpdateLCD(CLCD& LCD, unsigned int nTicks)
+{
+	const u8 nBarHeight = 16;
+	float ChannelLevels[16], PeakLevels[16];
+
+	if (m_bChannelMeters)
+	{
+		// Combine the output levels of each engine on the channels routed to it
+		float MT32Levels[16], MT32Peaks[16];
+		m_SoundFontSynth.m_ChannelMeters.GetLevels(ChannelLevels, PeakLevels, 16);
+		m_MT32Synth.GetChannelOutputLevels(MT32Levels, MT32Peaks);
+
+		for (u8 nChannel = 0; nChannel < 16; ++nChannel)
+		{
+			const u16 nChannelBit = 1 << nChannel;
+
+			if (!(m_nSoundFontChannelMask & nChannelBit))
+				ChannelLevels[nChannel] = PeakLevels[nChannel] = 0.0f;
+
+			if (m_nMT32ChannelMask & nChannelBit)
+			{
+				ChannelLevels[nChannel] = Utility::Max(ChannelLevels[nChannel], MT32Levels[nChannel]);
+				PeakLevels[nChannel] = Utility::Max(PeakLevels[nChannel], MT32Peaks[nChannel]);
+			}
+		}
+	}
+	else
+		m_MIDIMonitor.GetChannelLevels(nTicks, ChannelLevels, PeakLevels, 1 << PercussionChannel);
+	CUserInterface::DrawChannelLevels(LCD, nBarHeight, ChannelLevels, PeakLevels, 16, true);
+}
+
+void CLayeredSynth::SetChannelMasks(u16 nMT32ChannelMask, u16 nSoundFontChannelMask)
+{
+	m_nMT32ChannelMask = nMT32ChannelMask;
+	m_nSoundFontChannelMask = nSoundFontChannelMask;
+}
+
+void CLayeredSynth::SetGains(float nMT32Gain, float nSoundFontGain)
+{
+	m_nMT32Gain = nMT32Gain;
+	m_nSoundFontGain = nSoundFontGain;
+}
@@ -21,9 +21,11 @@
 //
 
 #include <circle/logger.h>
+#include <circle/memory.h>
 #include <circle/timer.h>
 
 #include "config.h"
+#include "deferredlog.h"
 #include "lcd/ui.h"
 #include "synth/mt32synth.h"
 #include "utility.h"
@@ -36,6 +38,10 @@ constexpr size_t ROMOffsetVersionStringNew  = 0x2206;
 constexpr u32 MemoryAddressMIDIChannels     = 0x4000D;
 constexpr u32 MemoryAddressMasterVolume     = 0x40016;
 
+// Frames of the previous instance rendered at a time while crossfading between ROM sets
+constexpr size_t CrossfadeChunkFrames = 64;
+constexpr int MaxCrossfadeMillis = 1000;
+
 // SysEx commands for setting MIDI channel assignment (no SysEx framing, just 3-byte address and 9 channel values)
 const u8 CMT32Synth::StandardMIDIChannelsSysEx[] = { 0x10, 0x00, 0x0D, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09 };
 const u8 CMT32Synth::AlternateMIDIChannelsSysEx[] = { 0x10, 0x00, 0x0D, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x09 };
@@ -55,7 +61,14 @@ CMT32Synth::CMT32Synth(unsigned nSampleRate, float nGain, float nReverbGain, TRe
 	  m_pControlROMImage(nullptr),
 	  m_pPCMROMImage(nullptr),
 
-	  m_LCDTextBuffer{'\0'}
+	  m_bROMSetStandby(false),
+	  m_StandbyInstances{},
+	  m_FadeOutInstance{},
+	  m_FadeOutROMSet(TMT32ROMSet::Any),
+	  m_nCrossfadeFrames(0),
+	  m_nCrossfadeFramesRemaining(0),
+
+	  m_bNarrowDisplayText(false)
 {
 }
 
@@ -66,6 +79,11 @@ CMT32Synth::~CMT32Synth()
 
 	if (m_pSampleRateConverter)
 		delete m_pSampleRateConverter;
+
+	for (TInstance& Instance : m_StandbyInstances)
+		CloseInstance(Instance);
+
+	CloseInstance(m_FadeOutInstance);
 }
 
 bool CMT32Synth::Initialize()
@@ -81,13 +99,69 @@ bool CMT32Synth::Initialize()
 	if (!m_ROMManager.GetROMSet(InitialROMSet, m_CurrentROMSet, m_pControlROMImage, m_pPCMROMImage))
 		return false;
 
-	m_pSynth = new MT32Emu::Synth(this);
+	CMemorySystem* const pMemorySystem = CMemorySystem::Get();
+	size_t nHeapFreeSpace = pMemorySystem->GetHeapFreeSpace(HEAP_ANY);
 
-	if (!m_pSynth->open(*m_pControlROMImage, *m_pPCMROMImage))
+	TInstance Instance = { nullptr, nullptr, m_pControlROMImage, m_pPCMROMImage };
+	if (!OpenInstance(Instance))
 		return false;
 
-	m_pSynth->setOutputGain(m_nGain);
-	m_pSynth->setReverbOutputGain(m_nReverbGain);
+	m_pSynth = Instance.pSynth;
+	m_pSampleRateConverter = Instance.pSampleRateConverter;
+
+	// Parts are always metered (mt32emu measures their output as it renders), so this only selects what's displayed
+	const CConfig* const pConfig = CConfig::Get();
+	m_bChannelMeters = pConfig->LCDType != CConfig::TLCDType::None && pConfig->LCDMeters == CConfig::TLCDMeters::Audio;
+
+	m_bROMSetStandby = pConfig->MT32EmuROMSetStandby;
+	if (!m_bROMSetStandby)
+		return true;
+
+	LOGNOTE("%s: %d KB", m_pControlROMImage->getROMInfo()->shortName, (nHeapFreeSpace - pMemorySystem->GetHeapFreeSpace(HEAP_ANY)) / 1024);
+
+	// Open an instance for every other available ROM set, ready to be switched to
+	for (size_t i = 0; i < ROMSetCount; ++i)
+	{
+		const TMT32ROMSet ROMSet = static_cast<TMT32ROMSet>(i);
+		TMT32ROMSet AvailableROMSet;
+		TInstance& StandbyInstance = m_StandbyInstances[i];
+
+		if (ROMSet == m_CurrentROMSet || !m_ROMManager.HaveROMSet(ROMSet))
+			continue;
+
+		if (!m_ROMManager.GetROMSet(ROMSet, AvailableROMSet, StandbyInstance.pControlROMImage, StandbyInstance.pPCMROMImage))
+			continue;
+
+		nHeapFreeSpace = pMemorySystem->GetHeapFreeSpace(HEAP_ANY);
+
+		if (!OpenInstance(StandbyInstance))
+		{
+			LOGWARN("Couldn't open standby instance for %s", StandbyInstance.pControlROMImage->getROMInfo()->shortName);
+			continue;
+		}
+
+		LOGNOTE("%s (standby): %d KB", StandbyInstance.pControlROMImage->getROMInfo()->shortName, (nHeapFreeSpace - pMemorySystem->GetHeapFreeSpace(HEAP_ANY)) / 1024);
+	}
+
+	m_nCrossfadeFrames = Utility::Clamp(pConfig->MT32EmuROMSetCrossfade, 0, MaxCrossfadeMillis) * m_nSampleRate / 1000;
+
+	return true;
+}
+
+bool CMT32Synth::OpenInstance(TInstance& Instance)
+{
+	Instance.pSynth = new MT32Emu::Synth(this);
+	Instance.pSampleRateConverter = nullptr;
+
+	if (!Instance.pSynth->open(*Instance.pControlROMImage, *Instance.pPCMROMImage))
+	{
+		delete Instance.pSynth;
+		Instance.pSynth = nullptr;
+		return false;
+	}
+
+	Instance.pSynth->setOutputGain(m_nGain);
+	Instance.pSynth->setReverbOutputGain(m_nReverbGain);
 
 	if (m_ResamplerQuality != TResamplerQuality::None)
 	{
@@ -114,15 +188,51 @@ bool CMT32Synth::Initialize()
 				break;
 		}
 
-		m_pSampleRateConverter = new MT32Emu::SampleRateConverter(*m_pSynth, m_nSampleRate, quality);
+		Instance.pSampleRateConverter = new MT32Emu::SampleRateConverter(*Instance.pSynth, m_nSampleRate, quality);
 	}
 
 	return true;
 }
 
+void CMT32Synth::CloseInstance(TInstance& Instance)
+{
+	if (Instance.pSampleRateConverter)
+		delete Instance.pSampleRateConverter;
+
+	if (Instance.pSynth)
+		delete Instance.pSynth;
+
+	Instance.pSampleRateConverter = nullptr;
+	Instance.pSynth = nullptr;
+}
+
+void CMT32Synth::ResetStandbyInstance(TInstance& Instance)
+{
+	MT32Emu::Synth* const pSynth = Instance.pSynth;
+
+	// Anything left over from when it was last in use is played out, then discarded by the reset
+	pSynth->flushMIDIQueue();
+
+	// Reset to power-on state, as if it had just been opened
+	const u8 ResetSysEx[] = { 0x7F, 0x00, 0x00 };
+	pSynth->writeSysex(0x10, ResetSysEx, sizeof(ResetSysEx));
+
+	// Reopening the reverb model clears the old reverb tail from its buffers
+	pSynth->setReverbEnabled(false);
+	pSynth->setReverbEnabled(true);
+
+	// Discard output levels from when it was last in use
+	float PartOutputLevels[MT32ChannelCount];
+	pSynth->getPartOutputLevels(PartOutputLevels);
+
+	pSynth->setReversedStereoEnabled(m_pSynth->isReversedStereoEnabled());
+}
+
 void CMT32Synth::HandleMIDIShortMessage(u32 nMessage)
 {
-	m_pSynth->playMsg(nMessage);
+	// Passed on to mt32emu by the audio task with a timestamp matching its arrival time
+	if (!m_MIDIQueue.EnqueueShortMessage(nMessage))
+		LOGWARN("MIDI queue overflow");
 
 	// Update MIDI monitor
 	CSynthBase::HandleMIDIShortMessage(nMessage);
@@ -130,15 +240,39 @@ void CMT32Synth::HandleMIDIShortMessage(u32 nMessage)
 
 void CMT32Synth::HandleMIDISysExMessage(const u8* pData, size_t nSize)
 {
+	if (m_MIDIQueue.EnqueueSysExMessage(pData, nSize))
+		return;
+
+	// No room, e.g. during a large dump; rather than lose it, play it now after everything queued before it
+	m_Lock.Acquire();
+
+	CTimedMIDIQueue::TMessage Message;
+	while (m_MIDIQueue.DequeueImmediate(Message))
+	{
+		if (Message.pSysExData)
+			m_pSynth->playSysex(Message.pSysExData, Message.nSysExSize);
+		else
+			m_pSynth->playMsg(Message.nShortMessage);
+	}
+
 	m_pSynth->playSysex(pData, nSize);
+
+	m_Lock.Release();
 }
 
 void CMT32Synth::AllSoundOff()
 {
+	m_Lock.Acquire();
+
+	// Discard anything not yet played
+	m_MIDIQueue.Flush();
+
 	// Stop all sound immediately; mt32emu treats CC 0x7C like "All Sound Off", ignoring pedal
 	for (uint8_t i = 0; i < 8; ++i)
 		m_pSynth->playMsgOnPart(i, 0x0B, 0x7C, 0);
 
+	m_Lock.Release();
+
 	// Reset MIDI monitor
 	CSynthBase::AllSoundOff();
 }
@@ -149,13 +283,118 @@ void CMT32Synth::SetMasterVolume(u8 nVolume)
 	m_pSynth->writeSysex(0x10, SetVolumeSysEx, sizeof(SetVolumeSysEx));
 }
 
+void CMT32Synth::PlayQueuedMIDIMessages(size_t nFrames)
+{
+	// mt32emu has its own timestamped event queue; convert each message's frame offset within
+	// this block into a timestamp at the internal sample rate
+	const MT32Emu::Bit32u nBlockTimestamp = m_pSynth->getInternalRenderedSampleCount();
+	CTimedMIDIQueue::TMessage Message;
+
+	m_MIDIQueue.BeginBlock(nFrames);
+	while (m_MIDIQueue.Dequeue(Message))
+	{
+		MT32Emu::Bit32u nTimestamp = nBlockTimestamp;
+		if (m_pSampleRateConverter)
+			nTimestamp += static_cast<MT32Emu::Bit32u>(m_pSampleRateConverter->convertOutputToSynthTimestamp(Message.nOffset));
+		else
+			nTimestamp += Message.nOffset;
+
+		if (Message.pSysExData)
+			m_pSynth->playSysex(Message.pSysExData, Message.nSysExSize, nTimestamp);
+		else
+			m_pSynth->playMsg(Message.nShortMessage, nTimestamp);
+	}
+}
+
+template <class T>
+void CMT32Synth::PublishSynthState(const T* pOutBuffer, size_t nFrames)
+{
+	MT32Emu::PartialState PartialStates[MaxPartials];
+	size_t nActivePartials = 0;
+	float PartOutputLevels[MT32ChannelCount];
+	TMT32State MT32State;
+
+	const size_t nPartials = m_pSynth->getPartialCount();
+	assert(nPartials <= MaxPartials);
+	m_pSynth->getPartialStates(PartialStates);
+
+	// Each partial is one of up to four sound generators making up an MT-32 note
+	for (size_t i = 0; i < nPartials; ++i)
+		if (PartialStates[i] != MT32Emu::PartialState_INACTIVE)
+			++nActivePartials;
+
+	PublishState(pOutBuffer, nFrames, m_pSynth->isActive(), nActivePartials);
+
+	m_pSynth->getPartOutputLevels(PartOutputLevels);
+	for (size_t nPart = 0; nPart < MT32ChannelCount; ++nPart)
+		m_ChannelMeters.MeasurePeak(nPart, PartOutputLevels[nPart], nFrames);
+	m_ChannelMeters.Publish(nFrames, m_nSampleRate);
+
+	// mt32emu's memory and display aren't thread-safe, so read them here rather than from the UI core
+	m_pSynth->readMemory(MemoryAddressMIDIChannels, MT32ChannelCount, MT32State.MIDIChannelPartMap);
+	m_pSynth->readMemory(MemoryAddressMasterVolume, 1, &MT32State.nMasterVolume);
+	m_pSynth->getDisplayState(MT32State.DisplayText, m_bNarrowDisplayText);
+	m_MT32State.Write(MT32State);
+}
+
+template <class T>
+void CMT32Synth::RenderCrossfade(T* pOutBuffer, size_t nFrames)
+{
+	T FadeOutBuffer[CrossfadeChunkFrames * 2];
+	const float nGainStep = 1.0f / m_nCrossfadeFrames;
+
+	while (nFrames && m_nCrossfadeFramesRemaining)
+	{
+		const size_t nChunkFrames = Utility::Min(Utility::Min(nFrames, CrossfadeChunkFrames), m_nCrossfadeFramesRemaining);
+
+		if (m_FadeOutInstance.pSampleRateConverter)
+			m_FadeOutInstance.pSampleRateConverter->getOutputSamples(FadeOutBuffer, nChunkFrames);
+		else
+			m_FadeOutInstance.pSynth->render(FadeOutBuffer, nChunkFrames);
+
+		// Linear crossfade from the previous instance into the current one
+		for (size_t i = 0; i < nChunkFrames * 2; i += 2)
+		{
+			const float nFadeOutGain = m_nCrossfadeFramesRemaining-- * nGainStep;
+			const float nFadeInGain = 1.0f - nFadeOutGain;
+
+			pOutBuffer[i] = static_cast<T>(pOutBuffer[i] * nFadeInGain + FadeOutBuffer[i] * nFadeOutGain);
+			pOutBuffer[i + 1] = static_cast<T>(pOutBuffer[i + 1] * nFadeInGain + FadeOutBuffer[i + 1] * nFadeOutGain);
+		}
+
+		pOutBuffer += nChunkFrames * 2;
+		nFrames -= nChunkFrames;
+	}
+
+	if (!m_nCrossfadeFramesRemaining)
+		FinishCrossfade();
+}
+
+void CMT32Synth::FinishCrossfade()
+{
+	if (!m_FadeOutInstance.pSynth)
+		return;
+
+	// Put the previous instance back on standby
+	m_StandbyInstances[static_cast<size_t>(m_FadeOutROMSet)] = m_FadeOutInstance;
+	m_FadeOutInstance = TInstance{};
+	m_nCrossfadeFramesRemaining = 0;
+}
+
 size_t CMT32Synth::Render(s16* pOutBuffer, size_t nFrames)
 {
+	if (!nFrames)
+		return 0;
+
 	m_Lock.Acquire();
+	PlayQueuedMIDIMessages(nFrames);
 	if (m_pSampleRateConverter)
 		m_pSampleRateConverter->getOutputSamples(pOutBuffer, nFrames);
 	else
 		m_pSynth->render(pOutBuffer, nFrames);
+	if (m_FadeOutInstance.pSynth)
+		RenderCrossfade(pOutBuffer, nFrames);
+	PublishSynthState(pOutBuffer, nFrames);
 	m_Lock.Release();
 
 	return nFrames;
@@ -163,11 +402,18 @@ size_t CMT32Synth::Render(s16* pOutBuffer, size_t nFrames)
 
 size_t CMT32Synth::Render(float* pOutBuffer, size_t nFrames)
 {
+	if (!nFrames)
+		return 0;
+
 	m_Lock.Acquire();
+	PlayQueuedMIDIMessages(nFrames);
 	if (m_pSampleRateConverter)
 		m_pSampleRateConverter->getOutputSamples(pOutBuffer, nFrames);
 	else
 		m_pSynth->render(pOutBuffer, nFrames);
+	if (m_FadeOutInstance.pSynth)
+		RenderCrossfade(pOutBuffer, nFrames);
+	PublishSynthState(pOutBuffer, nFrames);
 	m_Lock.Release();
 
 	return nFrames;
@@ -203,17 +449,24 @@ void CMT32Synth::UpdateLCD(CLCD& LCD, unsigned int nTicks)
 	}
 
 	float PartLevels[9], PartPeaks[9];
-	GetPartLevels(nTicks, PartLevels, PartPeaks);
+	if (m_bChannelMeters)
+		m_ChannelMeters.GetLevels(PartLevels, PartPeaks, MT32ChannelCount);
+	else
+		GetPartLevels(nTicks, PartLevels, PartPeaks);
 	CUserInterface::DrawChannelLevels(LCD, nBarHeight, PartLevels, PartPeaks, 9, false);
 
-	m_pSynth->getDisplayState(m_LCDTextBuffer, bNarrowPartStateText);
+	// Picked up by the rendering core when it next publishes the display text
+	m_bNarrowDisplayText = bNarrowPartStateText;
+
+	TMT32State MT32State;
+	m_MT32State.Read(MT32State);
 
 	// Remap active part indicator character
-	for (size_t i = 0; i < Utility::ArraySize(m_LCDTextBuffer) - 1; ++i)
-		if (m_LCDTextBuffer[i] == 1)
-			m_LCDTextBuffer[i] = '\xFF';
+	for (size_t i = 0; i < Utility::ArraySize(MT32State.DisplayText) - 1; ++i)
+		if (MT32State.DisplayText[i] == 1)
+			MT32State.DisplayText[i] = '\xFF';
 
-	LCD.Print(m_LCDTextBuffer, 0, nStatusRow, true, false);
+	LCD.Print(MT32State.DisplayText, 0, nStatusRow, true, false);
 }
 
 void CMT32Synth::SetMIDIChannels(TMIDIChannels Channels)
@@ -226,6 +479,7 @@ void CMT32Synth::SetMIDIChannels(TMIDIChannels Channels)
 
 bool CMT32Synth::SwitchROMSet(TMT32ROMSet ROMSet)
 {
+	TMT32ROMSet NewROMSet;
 	const MT32Emu::ROMImage* pControlROMImage;
 	const MT32Emu::ROMImage* pPCMROMImage;
 
@@ -238,13 +492,16 @@ bool CMT32Synth::SwitchROMSet(TMT32ROMSet ROMSet)
 	}
 
 	// Get ROM set if available
-	if (!m_ROMManager.GetROMSet(ROMSet, m_CurrentROMSet, pControlROMImage, pPCMROMImage))
+	if (!m_ROMManager.GetROMSet(ROMSet, NewROMSet, pControlROMImage, pPCMROMImage))
 	{
 		if (m_pUI)
 			m_pUI->ShowSystemMessage("ROM set not avail!");
 		return false;
 	}
 
+	if (m_bROMSetStandby && SwitchToStandbyInstance(NewROMSet))
+		return true;
+
 	// Reopen synth with new ROMs
 	m_Lock.Acquire();
 	m_pSynth->close();
@@ -253,12 +510,54 @@ bool CMT32Synth::SwitchROMSet(TMT32ROMSet ROMSet)
 	m_pSynth->setReverbOutputGain(m_nReverbGain);
 	m_Lock.Release();
 
+	m_CurrentROMSet    = NewROMSet;
 	m_pControlROMImage = pControlROMImage;
 	m_pPCMROMImage     = pPCMROMImage;
 
 	return true;
 }
 
+bool CMT32Synth::SwitchToStandbyInstance(TMT32ROMSet ROMSet)
+{
+	TInstance& StandbyInstance = m_StandbyInstances[static_cast<size_t>(ROMSet)];
+
+	// The instance may still be fading out after a previous switch
+	m_Lock.Acquire();
+	FinishCrossfade();
+	m_Lock.Release();
+
+	if (!StandbyInstance.pSynth)
+		return false;
+
+	// Not in use by the rendering core, so this doesn't hold it up
+	ResetStandbyInstance(StandbyInstance);
+
+	// Swap instances at the next block boundary
+	m_Lock.Acquire();
+
+	const TInstance PreviousInstance = { m_pSynth, m_pSampleRateConverter, m_pControlROMImage, m_pPCMROMImage };
+
+	if (m_nCrossfadeFrames)
+	{
+		m_FadeOutInstance = PreviousInstance;
+		m_FadeOutROMSet = m_CurrentROMSet;
+		m_nCrossfadeFramesRemaining = m_nCrossfadeFrames;
+	}
+	else
+		m_StandbyInstances[static_cast<size_t>(m_CurrentROMSet)] = PreviousInstance;
+
+	m_pSynth               = StandbyInstance.pSynth;
+	m_pSampleRateConverter = StandbyInstance.pSampleRateConverter;
+	m_pControlROMImage     = StandbyInstance.pControlROMImage;
+	m_pPCMROMImage         = StandbyInstance.pPCMROMImage;
+	m_CurrentROMSet        = ROMSet;
+	StandbyInstance        = TInstance{};
+
+	m_Lock.Release();
+
+	return true;
+}
+
 TMT32ROMSet CMT32Synth::GetROMSet() const
 {
 	return m_CurrentROMSet;
@@ -304,19 +603,18 @@ const char* CMT32Synth::GetControlROMName() const
 
 u8 CMT32Synth::GetMasterVolume() const
 {
-	u8 nVolume;
-	m_pSynth->readMemory(MemoryAddressMasterVolume, 1, &nVolume);
-	return nVolume;
+	return m_MT32State.Read().nMasterVolume;
 }
 
 void CMT32Synth::GetPartLevels(unsigned int nTicks, float PartLevels[9], float PartPeaks[9])
 {
 	float ChannelLevels[16], ChannelPeaks[16];
-	u8 MIDIChannelPartMap[9];
 	u16 nPercussionMask;
 
 	// Find which MIDI channels each MT-32 part is mapped to and identify percussion channel
-	m_pSynth->readMemory(MemoryAddressMIDIChannels, 9, MIDIChannelPartMap);
+	TMT32State MT32State;
+	m_MT32State.Read(MT32State);
+	const u8* MIDIChannelPartMap = MT32State.MIDIChannelPartMap;
 	nPercussionMask = 1 << MIDIChannelPartMap[8];
 
 	// Map channel levels to part levels
@@ -329,6 +627,32 @@ void CMT32Synth::GetPartLevels(unsigned int nTicks, float PartLevels[9], float P
 	}
 }
 
+void CMT32Synth::GetChannelOutputLevels(float ChannelLevels[16], float ChannelPeaks[16]) const
+{
+	float PartLevels[MT32ChannelCount], PartPeaks[MT32ChannelCount];
+	m_ChannelMeters.GetLevels(PartLevels, PartPeaks, MT32ChannelCount);
+
+	TMT32State MT32State;
+	m_MT32State.Read(MT32State);
+
+	for (u8 nChannel = 0; nChannel < 16; ++nChannel)
+	{
+		ChannelLevels[nChannel] = 0.0f;
+		ChannelPeaks[nChannel] = 0.0f;
+	}
+
+	// Show each part on the MIDI channel it's assigned to (if any)
+	for (u8 nPart = 0; nPart < MT32ChannelCount; ++nPart)
+	{
+		const u8 nChannel = MT32State.MIDIChannelPartMap[nPart];
+		if (nChannel >= 16)
+			continue;
+
+		ChannelLevels[nChannel] = Utility::Max(ChannelLevels[nChannel], PartLevels[nPart]);
+		ChannelPeaks[nChannel] = Utility::Max(ChannelPeaks[nChannel], PartPeaks[nPart]);
+	}
+}
+
 bool CMT32Synth::onMIDIQueueOverflow()
 {
 	LOGERR("MIDI queue overflow");
@@ -0,0 +1,180 @@
+//
+// soundfontfile.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/util.h>
+
+#include "synth/soundfontfile.h"
+#include "utility.h"
+
+LOGMODULE("soundfontfile");
+
+CSoundFontFile::CSoundFontFile()
+	: m_File{},
+	  m_bOpen(false),
+	  m_pLinkMap(nullptr),
+
+	  m_nPosition(0),
+
+	  m_pReadAhead(nullptr),
+	  m_nReadAheadOffset(0),
+	  m_nReadAheadLength(0)
+{
+}
+
+CSoundFontFile::~CSoundFontFile()
+{
+	if (m_bOpen)
+		Close();
+}
+
+bool CSoundFontFile::Open(const char* pPath)
+{
+	assert(!m_bOpen);
+
+	if (f_open(&m_File, pPath, FA_READ) != FR_OK)
+		return false;
+
+	m_bOpen = true;
+	m_nPosition = 0;
+	m_nReadAheadOffset = 0;
+	m_nReadAheadLength = 0;
+
+	// Heap blocks are word-aligned, so the drivers can transfer straight into the buffer
+	m_pReadAhead = new u8[ReadAheadSize];
+
+	// Still usable without the map, just slower
+	if (!CreateLinkMap())
+		LOGWARN("Couldn't create cluster map for '%s'; seeks will follow the FAT", pPath);
+
+	return true;
+}
+
+bool CSoundFontFile::Close()
+{
+	assert(m_bOpen);
+
+	const bool bResult = f_close(&m_File) == FR_OK;
+	m_bOpen = false;
+
+	delete[] m_pLinkMap;
+	m_pLinkMap = nullptr;
+
+	delete[] m_pReadAhead;
+	m_pReadAhead = nullptr;
+
+	return bResult;
+}
+
+bool CSoundFontFile::CreateLinkMap()
+{
+	size_t nMapSize = InitialLinkMapSize;
+
+	// Retry once with the size FatFs asks for if the file is too fragmented for the first guess
+	for (size_t nAttempt = 0; nAttempt < 2; ++nAttempt)
+	{
+		m_pLinkMap = new DWORD[nMapSize];
+		m_pLinkMap[0] = static_cast<DWORD>(nMapSize);
+		m_File.cltbl = m_pLinkMap;
+
+		const FRESULT Result = f_lseek(&m_File, CREATE_LINKMAP);
+		if (Result == FR_OK)
+			return true;
+
+		m_File.cltbl = nullptr;
+		nMapSize = m_pLinkMap[0];
+		delete[] m_pLinkMap;
+		m_pLinkMap = nullptr;
+
+		if (Result != FR_NOT_ENOUGH_CORE)
+			break;
+	}
+
+	return false;
+}
+
+bool CSoundFontFile::FillReadAhead()
+{
+	// Start on a sector boundary so that FatFs reads whole sectors directly into the buffer
+	const u64 nOffset = m_nPosition & ~static_cast<u64>(SectorSize - 1);
+	UINT nRead;
+
+	m_nReadAheadLength = 0;
+	if (f_lseek(&m_File, nOffset) != FR_OK || f_read(&m_File, m_pReadAhead, ReadAheadSize, &nRead) != FR_OK)
+		return false;
+
+	m_nReadAheadOffset = nOffset;
+	m_nReadAheadLength = nRead;
+
+	return m_nPosition < m_nReadAheadOffset + m_nReadAheadLength;
+}
+
+bool CSoundFontFile::Read(void* pBuffer, size_t nSize)
+{
+	assert(m_bOpen);
+
+	u8* pOut = static_cast<u8*>(pBuffer);
+
+	while (nSize)
+	{
+		// Serve as much as possible from the read-ahead buffer
+		if (m_nPosition >= m_nReadAheadOffset && m_nPosition < m_nReadAheadOffset + m_nReadAheadLength)
+		{
+			const size_t nBufferOffset = m_nPosition - m_nReadAheadOffset;
+			const size_t nCopy = Utility::Min(nSize, m_nReadAheadLength - nBufferOffset);
+
+			memcpy(pOut, m_pReadAhead + nBufferOffset, nCopy);
+			m_nPosition += nCopy;
+			pOut += nCopy;
+			nSize -= nCopy;
+			continue;
+		}
+
+		// Large reads (i.e. sample data) go straight to the caller's buffer as multi-block transfers
+		if (nSize >= ReadAheadSize)
+		{
+			UINT nRead;
+			if (f_lseek(&m_File, m_nPosition) != FR_OK || f_read(&m_File, pOut, nSize, &nRead) != FR_OK)
+				return false;
+
+			m_nPosition += nRead;
+			return nRead == nSize;
+		}
+
+		if (!FillReadAhead())
+			return false;
+	}
+
+	return true;
+}
+
+bool CSoundFontFile::Seek(u64 nOffset)
+{
+	assert(m_bOpen);
+
+	if (nOffset > GetSize())
+		return false;
+
+	// Deferred until the next read; the buffer may already cover the new position
+	m_nPosition = nOffset;
+	return true;
+}
@@ -24,12 +24,17 @@
 
 #include <fatfs/ff.h>
 #include <circle/logger.h>
+#include <circle/sched/scheduler.h>
+#include <circle/synchronize.h>
 #include <circle/timer.h>
 
 #include "config.h"
+#include "deferredlog.h"
 #include "lcd/ui.h"
 #include "synth/gmsysex.h"
 #include "synth/rolandsysex.h"
+#include "synth/soundfontfile.h"
+#include "synth/soundfontloadtask.h"
 #include "synth/soundfontsynth.h"
 #include "synth/yamahasysex.h"
 #include "utility.h"
@@ -38,6 +43,15 @@
 LOGMODULE("soundfontsynth");
 const char SoundFontPath[] = "soundfonts";
 
+// Marks a mixer job that the worker core has started on
+static void* const ClaimedMixerJob = reinterpret_cast<void*>(1);
+
+// Frames rendered at a time when rendering each MIDI channel separately for the level meters
+constexpr size_t ChannelBufferFrames = 256;
+
+// Longest read between yields in a load task; about 10ms at 25 MB/s
+constexpr size_t LoadTaskReadChunkSize = 256 * 1024;
+
 extern "C"
 {
 	// Replacements for fluid_sys.c functions
@@ -73,8 +87,8 @@ extern "C"
 	// These were found to be much faster than FluidSynth's default approach of going through libc
 	void* default_fopen(const char* path)
 	{
-		FIL* pFile = new FIL;
-		if (f_open(pFile, path, FA_READ) != FR_OK)
+		CSoundFontFile* pFile = new CSoundFontFile();
+		if (!pFile->Open(path))
 		{
 			delete pFile;
 			pFile = nullptr;
@@ -85,49 +99,62 @@ extern "C"
 
 	int default_fclose(void* handle)
 	{
-		FIL* pFile = static_cast<FIL*>(handle);
-
-		if (f_close(pFile) == FR_OK)
-		{
-			delete pFile;
-			return FLUID_OK;
-		}
+		CSoundFontFile* pFile = static_cast<CSoundFontFile*>(handle);
+		const bool bResult = pFile->Close();
+		delete pFile;
 
-		return FLUID_FAILED;
+		return bResult ? FLUID_OK : FLUID_FAILED;
 	}
 
 	fluid_long_long_t default_ftell(void* handle)
 	{
-		FIL* pFile = static_cast<FIL*>(handle);
-		return f_tell(pFile);
+		CSoundFontFile* pFile = static_cast<CSoundFontFile*>(handle);
+		return pFile->Tell();
 	}
 
 	int safe_fread(void* buf, fluid_long_long_t count, void* fd)
 	{
-		FIL* pFile = static_cast<FIL*>(fd);
-		UINT nRead;
-		return f_read(pFile, buf, count, &nRead) == FR_OK ? FLUID_OK : FLUID_FAILED;
+		CSoundFontFile* pFile = static_cast<CSoundFontFile*>(fd);
+
+		// Split long sample reads, so that MIDI, the network and the controls are serviced in between
+		if (CSoundFontLoadTask::IsCurrentTask())
+		{
+			u8* pBuffer = static_cast<u8*>(buf);
+			while (count > static_cast<fluid_long_long_t>(LoadTaskReadChunkSize))
+			{
+				if (!pFile->Read(pBuffer, LoadTaskReadChunkSize))
+					return FLUID_FAILED;
+
+				pBuffer += LoadTaskReadChunkSize;
+				count -= LoadTaskReadChunkSize;
+				CScheduler::Get()->Yield();
+			}
+
+			buf = pBuffer;
+		}
+
+		return pFile->Read(buf, count) ? FLUID_OK : FLUID_FAILED;
 	}
 
 	int safe_fseek(void* fd, fluid_long_long_t ofs, int whence)
 	{
-		FIL* pFile = static_cast<FIL*>(fd);
+		CSoundFontFile* pFile = static_cast<CSoundFontFile*>(fd);
 
 		switch (whence)
 		{
 		case SEEK_CUR:
-			ofs += f_tell(pFile);
+			ofs += pFile->Tell();
 			break;
 
 		case SEEK_END:
-			ofs += f_size(pFile);
+			ofs += pFile->GetSize();
 			break;
 
 		default:
 			break;
 		}
 
-		return f_lseek(pFile, ofs) == FR_OK ? FLUID_OK : FLUID_FAILED;
+		return ofs >= 0 && pFile->Seek(ofs) ? FLUID_OK : FLUID_FAILED;
 	}
 }
 
@@ -136,22 +163,63 @@ CSoundFontSynth::CSoundFontSynth(unsigned nSampleRate)
 
 	  m_pSettings(nullptr),
 	  m_pSynth(nullptr),
+	  m_pSoundFontLoader(nullptr),
+	  m_nSoundFontID(FLUID_FAILED),
 
 	  m_nVolume(100),
 	  m_nInitialGain(0.2f),
 
 	  m_nPercussionMask(1 << 9),
-	  m_nCurrentSoundFontIndex(0)
+	  m_nCurrentSoundFontIndex(0),
+
+	  m_pChannelBuffers(nullptr),
+	  m_DryBuffers{nullptr},
+	  m_FXBuffers{nullptr},
+
+	  m_SwitchState(TSwitchState::Idle),
+	  m_nSwitchSoundFontIndex(0),
+	  m_pSwitchSoundFont(nullptr),
+
+	  m_bSwitchQueued(false),
+	  m_nQueuedSoundFontIndex(0),
+
+	  m_bUnloadPending(false),
+	  m_nUnloadPollTime(0),
+
+	  m_bDynamicSamples(false),
+	  m_BankSelect{0},
+	  m_nQueuedMessages(0),
+	  m_nPlayedMessages(0),
+	  m_nSelectionSequence(0),
+	  m_nLoadedSequence(0),
+	  m_nPresetHoldHead(0),
+	  m_nPresetHoldRead(0),
+	  m_nPresetHoldTail(0),
+	  m_bSelectedSamplesPending(false),
+	  m_bSampleTaskRunning(false),
+
+	  m_pMixerJob(nullptr),
+
+	  m_pLoadJob(nullptr),
+	  m_bLoadWorkerBusy(false)
 {
 }
 
 CSoundFontSynth::~CSoundFontSynth()
 {
+	WaitForSampleTask();
+
 	if (m_pSynth)
 		delete_fluid_synth(m_pSynth);
 
+	// SoundFonts refer to their loader's file callbacks, so this must outlive the synth
+	if (m_pSoundFontLoader)
+		delete_fluid_sfloader(m_pSoundFontLoader);
+
 	if (m_pSettings)
 		delete_fluid_settings(m_pSettings);
+
+	delete[] m_pChannelBuffers;
 }
 
 void CSoundFontSynth::FluidSynthLogCallback(int nLevel, const char* pMessage, void* pUser)
@@ -159,6 +227,121 @@ void CSoundFontSynth::FluidSynthLogCallback(int nLevel, const char* pMessage, vo
 	CLogger::Get()->Write(From, static_cast<TLogSeverity>(nLevel), pMessage);
 }
 
+void CSoundFontSynth::MixerWorkerKick(void* pUser, void* pJob)
+{
+	CSoundFontSynth* pThis = static_cast<CSoundFontSynth*>(pUser);
+
+	// Make voice state written by this core visible before handing over the job
+	DataMemBarrier();
+	pThis->m_pMixerJob = pJob;
+
+	// Wake up the worker core
+	DataSyncBarrier();
+	SendEvent();
+}
+
+void CSoundFontSynth::MixerWorkerWait(void* pUser, void* pJob)
+{
+	CSoundFontSynth* pThis = static_cast<CSoundFontSynth*>(pUser);
+
+	// The worker hasn't started yet (e.g. it's busy with a sample for a SoundFont load); take the job back.
+	// All voices have been rendered by now, so this only clears the worker's buffers.
+	void* pExpected = pJob;
+	if (__atomic_compare_exchange_n(&pThis->m_pMixerJob, &pExpected, nullptr, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		fluid_synth_mixer_worker_render(pJob);
+		return;
+	}
+
+	while (pThis->m_pMixerJob)
+		;
+
+	// Ensure the worker's buffers are read after its completion has been observed
+	DataMemBarrier();
+}
+
+void CSoundFontSynth::LoadWorkerKick(void* pUser, void* pJob)
+{
+	CSoundFontSynth* pThis = static_cast<CSoundFontSynth*>(pUser);
+
+	DataMemBarrier();
+	pThis->m_pLoadJob = pJob;
+
+	// Wake up the worker core
+	DataSyncBarrier();
+	SendEvent();
+}
+
+void CSoundFontSynth::LoadWorkerWait(void* pUser, void* pJob)
+{
+	CSoundFontSynth* pThis = static_cast<CSoundFontSynth*>(pUser);
+
+	// Withdraw the job, then wait for the worker to finish the sample it may be processing
+	pThis->m_pLoadJob = nullptr;
+	DataMemBarrier();
+
+	// Loads run in tasks on the main core; let the others run meanwhile
+	while (pThis->m_bLoadWorkerBusy)
+		CScheduler::Get()->Yield();
+
+	DataMemBarrier();
+}
+
+void CSoundFontSynth::LoadProgressCallback(void* pUser, int nPercent)
+{
+	CSoundFontSynth* pThis = static_cast<CSoundFontSynth*>(pUser);
+
+	// Picked up by the UI core when it next refreshes the display
+	if (pThis->m_pUI)
+		pThis->m_pUI->SetSpinnerProgress(nPercent);
+
+	// Loads run in tasks on the main core, so MIDI, the network and the controls keep being serviced
+	CScheduler::Get()->Yield();
+}
+
+void CSoundFontSynth::RunMixerWorker()
+{
+	void* pJob = m_pMixerJob;
+
+	if (pJob)
+	{
+		// Claim the job; fails if the audio core has taken it back
+		if (!__atomic_compare_exchange_n(&m_pMixerJob, &pJob, ClaimedMixerJob, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return;
+
+		fluid_synth_mixer_worker_render(pJob);
+		DataMemBarrier();
+
+		m_pMixerJob = nullptr;
+		return;
+	}
+
+	// Help with a SoundFont load between audio blocks
+	if (m_pLoadJob)
+	{
+		RunLoadWorker();
+		return;
+	}
+
+	// Sleep until the audio core (or a SoundFont load) sends an event
+	WaitForEvent();
+}
+
+void CSoundFontSynth::RunLoadWorker()
+{
+	// Announce ourselves before looking at the job again, so that LoadWorkerWait() can't miss us
+	m_bLoadWorkerBusy = true;
+	DataMemBarrier();
+
+	// One sample at a time, so that mixer jobs are picked up promptly
+	void* pJob = m_pLoadJob;
+	if (pJob && !fluid_sfloader_load_worker_process(pJob))
+		m_pLoadJob = nullptr;
+
+	DataMemBarrier();
+	m_bLoadWorkerBusy = false;
+}
+
 bool CSoundFontSynth::Initialize()
 {
 	const CConfig* const pConfig = CConfig::Get();
@@ -202,13 +385,78 @@ bool CSoundFontSynth::Initialize()
 	fluid_settings_setnum(m_pSettings, "synth.sample-rate", static_cast<double>(m_nSampleRate));
 	fluid_settings_setint(m_pSettings, "synth.threadsafe-api", false);
 
-	ReportStatus();
+	// Load samples when presets are selected rather than the whole SoundFont up front
+	if (pConfig->FluidSynthDynamicSamples)
+	{
+		fluid_settings_setint(m_pSettings, "synth.dynamic-sample-loading", true);
+		fluid_settings_setint(m_pSettings, "synth.dynamic-sample-cache-size", pConfig->FluidSynthSampleCacheSize);
+
+		// Samples are read on the main core rather than by the audio task when it plays program changes
+		fluid_settings_setint(m_pSettings, "synth.dynamic-sample-deferred", true);
+		m_bDynamicSamples = true;
+	}
+
+	// Render each MIDI channel to its own output group so that it can be metered
+	m_bChannelMeters = pConfig->LCDType != CConfig::TLCDType::None && pConfig->LCDMeters == CConfig::TLCDMeters::Audio;
+	if (m_bChannelMeters)
+	{
+		fluid_settings_setint(m_pSettings, "synth.audio-groups", MeteredChannelCount);
+		fluid_settings_setint(m_pSettings, "synth.audio-channels", MeteredChannelCount);
+
+		m_pChannelBuffers = new float[(DryBufferCount + FXBufferCount) * ChannelBufferFrames];
+		for (size_t i = 0; i < DryBufferCount; ++i)
+			m_DryBuffers[i] = m_pChannelBuffers + i * ChannelBufferFrames;
+		for (size_t i = 0; i < FXBufferCount; ++i)
+			m_FXBuffers[i] = m_pChannelBuffers + (DryBufferCount + i) * ChannelBufferFrames;
+	}
+
+	// Separate loader for background SoundFont switching; if unavailable, switching falls back to reinitializing the synth
+	m_pSoundFontLoader = new_fluid_defsfloader(m_pSettings);
+	if (m_pSoundFontLoader)
+	{
+		// Samples are processed on the worker core while the rest of the sample data is being read
+		fluid_sfloader_set_load_worker(m_pSoundFontLoader, LoadWorkerKick, LoadWorkerWait, this);
+		fluid_sfloader_set_progress_callback(m_pSoundFontLoader, LoadProgressCallback, this);
+	}
+	else
+		LOGWARN("Failed to create SoundFont loader");
 
+	ReportStatus();
 
 	return Reinitialize(pSoundFontPath, &FXProfile);
 }
 
+// Whether a message may select a different preset on a channel
+static inline bool SelectsPreset(u32 nMessage)
+{
+	const u8 nStatus = nMessage & 0xFF;
+	const u8 nData1  = (nMessage >> 8) & 0xFF;
+
+	return nStatus == 0xFF || (nStatus & 0xF0) == 0xC0 || ((nStatus & 0xF0) == 0xB0 && nData1 == 70);
+}
+
 void CSoundFontSynth::HandleMIDIShortMessage(u32 nMessage)
+{
+	// Read the samples of any preset this selects now, so that the audio task never has to
+	if (m_bDynamicSamples)
+		PrepareMIDIShortMessage(nMessage);
+
+	// Played back by the audio task at the sample offset matching its arrival time
+	if (m_MIDIQueue.EnqueueShortMessage(nMessage))
+	{
+		++m_nQueuedMessages;
+		if (SelectsPreset(nMessage))
+			m_nSelectionSequence = m_nQueuedMessages;
+	}
+	else
+		LOGWARN("MIDI queue overflow");
+
+	// Update MIDI monitor
+	if ((nMessage & 0xFF) != 0xFF)
+		CSynthBase::HandleMIDIShortMessage(nMessage);
+}
+
+void CSoundFontSynth::PlayMIDIShortMessage(u32 nMessage)
 {
 	const u8 nStatus  = nMessage & 0xFF;
 	const u8 nChannel = nMessage & 0x0F;
@@ -218,14 +466,10 @@ void CSoundFontSynth::HandleMIDIShortMessage(u32 nMessage)
 	// Handle system real-time messages
 	if (nStatus == 0xFF)
 	{
-		m_Lock.Acquire();
 		fluid_synth_system_reset(m_pSynth);
-		m_Lock.Release();
 		return;
 	}
 
-	m_Lock.Acquire();
-
 	// Handle channel messages
 	switch (nStatus & 0xF0)
 	{
@@ -267,11 +511,6 @@ void CSoundFontSynth::HandleMIDIShortMessage(u32 nMessage)
 			fluid_synth_pitch_bend(m_pSynth, nChannel, (nData2 << 7) | nData1);
 			break;
 	}
-
-	m_Lock.Release();
-
-	// Update MIDI monitor
-	CSynthBase::HandleMIDIShortMessage(nMessage);
 }
 
 void CSoundFontSynth::HandleMIDISysExMessage(const u8* pData, size_t nSize)
@@ -280,24 +519,214 @@ void CSoundFontSynth::HandleMIDISysExMessage(const u8* pData, size_t nSize)
 	if (!ParseGMSysEx(pData, nSize) && (ParseRolandSysEx(pData, nSize) || ParseYamahaSysEx(pData, nSize)))
 		return;
 
-	// No special handling; forward to FluidSynth SysEx parser, excluding leading 0xF0 and trailing 0xF7
+	// No special handling; forward to FluidSynth SysEx parser via the audio task
+	if (m_MIDIQueue.EnqueueSysExMessage(pData, nSize))
+	{
+		// Resets and drum part assignments select presets too
+		m_nSelectionSequence = ++m_nQueuedMessages;
+		return;
+	}
+
+	// No room, e.g. during a large dump; rather than lose it, play it now after everything queued before it
 	m_Lock.Acquire();
-	fluid_synth_sysex(m_pSynth, reinterpret_cast<const char*>(pData + 1), nSize - 2, nullptr, nullptr, nullptr, false);
+
+	CTimedMIDIQueue::TMessage Message;
+	u32 nPlayed = 0;
+	while (m_MIDIQueue.DequeueImmediate(Message))
+	{
+		++nPlayed;
+
+		if (Message.pSysExData)
+			PlayMIDISysExMessage(Message.pSysExData, Message.nSysExSize);
+		else
+			PlayMIDIShortMessage(Message.nShortMessage);
+	}
+
+	PlayMIDISysExMessage(pData, nSize);
+
+	m_nSelectionSequence = ++m_nQueuedMessages;
+	m_nPlayedMessages += nPlayed + 1;
+
 	m_Lock.Release();
 }
 
-bool CSoundFontSynth::IsActive()
+void CSoundFontSynth::PlayMIDISysExMessage(const u8* pData, size_t nSize)
+{
+	// Exclude leading 0xF0 and trailing 0xF7
+	fluid_synth_sysex(m_pSynth, reinterpret_cast<const char*>(pData + 1), nSize - 2, nullptr, nullptr, nullptr, false);
+}
+
+void CSoundFontSynth::PrepareMIDIShortMessage(u32 nMessage)
+{
+	const u8 nStatus  = nMessage & 0xFF;
+	const u8 nChannel = nMessage & 0x0F;
+	const u8 nData1   = (nMessage >> 8) & 0xFF;
+	const u8 nData2   = (nMessage >> 16) & 0xFF;
+	const bool bDrums = m_nPercussionMask & (1 << nChannel);
+
+	if (nStatus == 0xFF)
+	{
+		memset(m_BankSelect, 0, sizeof(m_BankSelect));
+		HoldResetPresets();
+		return;
+	}
+
+	switch (nStatus & 0xF0)
+	{
+		// Control change
+		case 0xB0:
+			if (nData1 == 0)
+				m_BankSelect[nChannel] = nData2;
+			else if (nData1 == 70)
+				HoldPreset(bDrums, m_BankSelect[nChannel], nData2);
+			break;
+
+		// Program change
+		case 0xC0:
+			HoldPreset(bDrums, m_BankSelect[nChannel], nData1);
+			break;
+	}
+}
+
+void CSoundFontSynth::HoldPreset(bool bDrums, u8 nBank, u8 nProgram)
 {
+	// Out of holds; once the message has been played, UpdateDynamicSamples() has the load task read the
+	// selected preset's samples instead
+	if (m_nPresetHoldHead - m_nPresetHoldTail == MaxPresetHolds)
+		return;
+
+	// The audio task selects presets from the same SoundFonts, and a switch may unload this one
 	m_Lock.Acquire();
-	int nVoices = fluid_synth_get_active_voice_count(m_pSynth);
+
+	fluid_sfont_t* const pSoundFont = fluid_synth_get_sfont_by_id(m_pSynth, m_nSoundFontID);
+	if (!pSoundFont)
+	{
+		m_Lock.Release();
+		return;
+	}
+
+	// Resolve the preset the way fluid_synth_program_change() will, including its fallbacks
+	fluid_preset_t* pPreset;
+	if (bDrums)
+	{
+		pPreset = fluid_sfont_get_preset(pSoundFont, DrumBank, nProgram);
+		if (!pPreset)
+			pPreset = fluid_sfont_get_preset(pSoundFont, DrumBank, 0);
+	}
+	else
+	{
+		pPreset = fluid_sfont_get_preset(pSoundFont, nBank, nProgram);
+		if (!pPreset)
+			pPreset = fluid_sfont_get_preset(pSoundFont, 0, nProgram);
+		if (!pPreset)
+			pPreset = fluid_sfont_get_preset(pSoundFont, 0, 0);
+	}
+
+	if (!pPreset)
+	{
+		m_Lock.Release();
+		return;
+	}
+
+	TPresetHold& Hold = m_PresetHolds[m_nPresetHoldHead % MaxPresetHolds];
+	Hold.nSoundFontID = m_nSoundFontID;
+	Hold.nBank        = fluid_preset_get_banknum(pPreset);
+	Hold.nProgram     = fluid_preset_get_num(pPreset);
+
 	m_Lock.Release();
 
-	return nVoices > 0;
+	// Held until the message about to be queued has been played
+	Hold.nSequence    = m_nQueuedMessages + 1;
+	Hold.bHeld        = false;
+
+	// Reading the samples can take a long time; leave it to the load task so that MIDI parsing carries on
+	++m_nPresetHoldHead;
+	StartSampleTask();
+}
+
+void CSoundFontSynth::HoldResetPresets()
+{
+	if (!m_bDynamicSamples)
+		return;
+
+	// Resets select the first melodic and drum presets
+	HoldPreset(false, 0, 0);
+	HoldPreset(true, 0, 0);
+}
+
+void CSoundFontSynth::ReleasePresetHolds(bool bAll)
+{
+	const u32 nPlayedMessages = m_nPlayedMessages;
+
+	// Holds still waiting for the load task are left to it
+	while (m_nPresetHoldTail != m_nPresetHoldRead)
+	{
+		const TPresetHold& Hold = m_PresetHolds[m_nPresetHoldTail % MaxPresetHolds];
+
+		// Once played, the selection keeps the samples loaded
+		if (!bAll && static_cast<s32>(nPlayedMessages - Hold.nSequence) < 0)
+			break;
+
+		if (Hold.bHeld)
+			fluid_synth_release_preset(m_pSynth, Hold.nSoundFontID, Hold.nBank, Hold.nProgram);
+		++m_nPresetHoldTail;
+	}
+}
+
+void CSoundFontSynth::ReadPendingSamples()
+{
+	while (m_nPresetHoldRead != m_nPresetHoldHead || m_bSelectedSamplesPending)
+	{
+		if (m_nPresetHoldRead != m_nPresetHoldHead)
+		{
+			TPresetHold& Hold = m_PresetHolds[m_nPresetHoldRead % MaxPresetHolds];
+
+			// Don't bother if the message has been played already; the selection has its samples read instead
+			if (static_cast<s32>(m_nPlayedMessages - Hold.nSequence) < 0)
+				Hold.bHeld = fluid_synth_hold_preset(m_pSynth, Hold.nSoundFontID, Hold.nBank, Hold.nProgram) == FLUID_OK;
+
+			++m_nPresetHoldRead;
+		}
+		else
+		{
+			m_bSelectedSamplesPending = false;
+			LoadSelectedSamples();
+		}
+
+		CScheduler::Get()->Yield();
+	}
+
+	m_bSampleTaskRunning = false;
+}
+
+void CSoundFontSynth::StartSampleTask()
+{
+	if (m_bSampleTaskRunning)
+		return;
+
+	// The scheduler deletes the task once it has finished
+	m_bSampleTaskRunning = true;
+	new CSoundFontLoadTask(this, CSoundFontLoadTask::TJob::ReadSamples);
+}
+
+void CSoundFontSynth::WaitForSampleTask()
+{
+	// The task reads from the current SoundFont and takes holds on its presets
+	while (m_bSampleTaskRunning)
+		CScheduler::Get()->Yield();
+}
+
+void CSoundFontSynth::LoadSelectedSamples()
+{
+	if (fluid_synth_load_selected_samples(m_pSynth) == FLUID_FAILED)
+		LOGWARN("Failed to load some samples");
 }
 
 void CSoundFontSynth::AllSoundOff()
 {
 	m_Lock.Acquire();
+	m_MIDIQueue.Flush();
+	m_nPlayedMessages = m_nQueuedMessages;
 	fluid_synth_all_sounds_off(m_pSynth, -1);
 	m_Lock.Release();
 
@@ -313,20 +742,141 @@ void CSoundFontSynth::SetMasterVolume(u8 nVolume)
 	m_Lock.Release();
 }
 
-size_t CSoundFontSynth::Render(float* pOutBuffer, size_t nFrames)
+static inline void WriteFrames(fluid_synth_t* pSynth, float* pOutBuffer, size_t nFrames)
+{
+	assert(fluid_synth_write_float(pSynth, nFrames, pOutBuffer, 0, 2, pOutBuffer, 1, 2) == FLUID_OK);
+}
+
+static inline void WriteFrames(fluid_synth_t* pSynth, s16* pOutBuffer, size_t nFrames)
+{
+	assert(fluid_synth_write_s16(pSynth, nFrames, pOutBuffer, 0, 2, pOutBuffer, 1, 2) == FLUID_OK);
+}
+
+static inline void StoreSample(float* pOut, float nSample)
+{
+	*pOut = nSample;
+}
+
+static inline void StoreSample(s16* pOut, float nSample)
+{
+	*pOut = static_cast<s16>(Utility::Clamp(nSample * 32768.0f, -32768.0f, 32767.0f));
+}
+
+template <class T>
+void CSoundFontSynth::RenderFrames(T* pOutBuffer, size_t nFrames)
+{
+	if (!m_pChannelBuffers)
+	{
+		WriteFrames(m_pSynth, pOutBuffer, nFrames);
+		return;
+	}
+
+	while (nFrames)
+	{
+		const size_t nChunkFrames = Utility::Min(nFrames, ChannelBufferFrames);
+
+		// FluidSynth mixes into the buffers
+		for (float* pBuffer : m_DryBuffers)
+			memset(pBuffer, 0, nChunkFrames * sizeof(float));
+		for (float* pBuffer : m_FXBuffers)
+			memset(pBuffer, 0, nChunkFrames * sizeof(float));
+
+		assert(fluid_synth_process(m_pSynth, nChunkFrames, FXBufferCount, m_FXBuffers, DryBufferCount, m_DryBuffers) == FLUID_OK);
+
+		// Meter each channel, and mix them down onto the reverb output along with the chorus
+		float* const pMixLeft = m_FXBuffers[0];
+		float* const pMixRight = m_FXBuffers[1];
+
+		for (size_t i = 0; i < nChunkFrames; ++i)
+		{
+			pMixLeft[i] += m_FXBuffers[2][i];
+			pMixRight[i] += m_FXBuffers[3][i];
+		}
+
+		for (size_t nChannel = 0; nChannel < MeteredChannelCount; ++nChannel)
+		{
+			const float* const pLeft = m_DryBuffers[nChannel * 2];
+			const float* const pRight = m_DryBuffers[nChannel * 2 + 1];
+
+			m_ChannelMeters.Measure(nChannel, pLeft, pRight, nChunkFrames);
+
+			for (size_t i = 0; i < nChunkFrames; ++i)
+			{
+				pMixLeft[i] += pLeft[i];
+				pMixRight[i] += pRight[i];
+			}
+		}
+
+		for (size_t i = 0; i < nChunkFrames; ++i)
+		{
+			StoreSample(pOutBuffer + i * 2, pMixLeft[i]);
+			StoreSample(pOutBuffer + i * 2 + 1, pMixRight[i]);
+		}
+
+		pOutBuffer += nChunkFrames * 2;
+		nFrames -= nChunkFrames;
+	}
+}
+
+template <class T>
+size_t CSoundFontSynth::RenderQueued(T* pOutBuffer, size_t nFrames)
 {
+	if (!nFrames)
+		return 0;
+
 	m_Lock.Acquire();
-	assert(fluid_synth_write_float(m_pSynth, nFrames, pOutBuffer, 0, 2, pOutBuffer, 1, 2) == FLUID_OK);
+
+	// Split the block at each queued message's offset so that it takes effect at the right sample
+	// (FluidSynth internally quantizes this further to its 64-frame processing period)
+	CTimedMIDIQueue::TMessage Message;
+	size_t nRendered = 0;
+	u32 nPlayed = 0;
+
+	m_MIDIQueue.BeginBlock(nFrames);
+	while (m_MIDIQueue.Dequeue(Message))
+	{
+		++nPlayed;
+
+		if (Message.nOffset > nRendered)
+		{
+			RenderFrames(pOutBuffer + nRendered * 2, Message.nOffset - nRendered);
+			nRendered = Message.nOffset;
+		}
+
+		if (Message.pSysExData)
+			PlayMIDISysExMessage(Message.pSysExData, Message.nSysExSize);
+		else
+			PlayMIDIShortMessage(Message.nShortMessage);
+	}
+
+	// Let the main core know which presets have been selected
+	if (nPlayed)
+	{
+		DataMemBarrier();
+		m_nPlayedMessages += nPlayed;
+	}
+
+	if (nRendered < nFrames)
+		RenderFrames(pOutBuffer + nRendered * 2, nFrames - nRendered);
+
+	const int nVoices = fluid_synth_get_active_voice_count(m_pSynth);
+	PublishState(pOutBuffer, nFrames, nVoices > 0, nVoices);
+
+	if (m_pChannelBuffers)
+		m_ChannelMeters.Publish(nFrames, m_nSampleRate);
+
 	m_Lock.Release();
 	return nFrames;
 }
 
+size_t CSoundFontSynth::Render(float* pOutBuffer, size_t nFrames)
+{
+	return RenderQueued(pOutBuffer, nFrames);
+}
+
 size_t CSoundFontSynth::Render(s16* pOutBuffer, size_t nFrames)
 {
-	m_Lock.Acquire();
-	assert(fluid_synth_write_s16(m_pSynth, nFrames, pOutBuffer, 0, 2, pOutBuffer, 1, 2) == FLUID_OK);
-	m_Lock.Release();
-	return nFrames;
+	return RenderQueued(pOutBuffer, nFrames);
 }
 
 void CSoundFontSynth::ReportStatus() const
@@ -340,12 +890,24 @@ void CSoundFontSynth::UpdateLCD(CLCD& LCD, unsigned int nTicks)
 	//const u8 nBarHeight = LCD.Height();
 	const u8 nBarHeight = 16;
 	float ChannelLevels[CHANNELS], PeakLevels[CHANNELS];
-	m_MIDIMonitor.GetChannelLevels(nTicks, ChannelLevels, PeakLevels, m_nPercussionMask);
+
+	if (m_bChannelMeters)
+		m_ChannelMeters.GetLevels(ChannelLevels, PeakLevels, CHANNELS);
+	else
+		m_MIDIMonitor.GetChannelLevels(nTicks, ChannelLevels, PeakLevels, m_nPercussionMask);
 	CUserInterface::DrawChannelLevels(LCD, nBarHeight, ChannelLevels, PeakLevels, CHANNELS, true);
 }
 
 bool CSoundFontSynth::SwitchSoundFont(size_t nIndex)
 {
+	// A switch is already in progress; switch again once it has completed
+	if (m_SwitchState != TSwitchState::Idle)
+	{
+		m_nQueuedSoundFontIndex = nIndex;
+		m_bSwitchQueued = true;
+		return true;
+	}
+
 	// Is this SoundFont already active?
 	if (m_nCurrentSoundFontIndex == nIndex)
 	{
@@ -366,35 +928,186 @@ bool CSoundFontSynth::SwitchSoundFont(size_t nIndex)
 	if (m_pUI)
 		m_pUI->ShowSystemMessage("Loading SoundFont", true);
 
-	TFXProfile FXProfile = m_SoundFontManager.GetSoundFontFXProfile(nIndex);
+	// Take copies so that a SoundFont rescan can't pull them out from under the loader
+	m_nSwitchSoundFontIndex = nIndex;
+	m_SwitchSoundFontPath = pSoundFontPath;
+	m_SwitchFXProfile = m_SoundFontManager.GetSoundFontFXProfile(nIndex);
+	m_pSwitchSoundFont = nullptr;
+
+	if (!m_pSoundFontLoader)
+	{
+		m_SwitchState = TSwitchState::LoadFailed;
+		return true;
+	}
+
+	// Hand over to the load task; the scheduler deletes it once it has finished
+	m_SwitchState = TSwitchState::LoadRequested;
+	new CSoundFontLoadTask(this, CSoundFontLoadTask::TJob::LoadSoundFont);
+
+	return true;
+}
+
+void CSoundFontSynth::LoadPendingSoundFont()
+{
+	assert(m_SwitchState == TSwitchState::LoadRequested);
+
+	// Only the loader is used here; the synth keeps playing on the other cores
+	const unsigned int nLoadStart = CTimer::GetClockTicks();
+	m_pSwitchSoundFont = fluid_sfloader_load_sfont(m_pSoundFontLoader, m_SwitchSoundFontPath);
+
+	if (m_pSwitchSoundFont)
+	{
+		const float nLoadTime = (CTimer::GetClockTicks() - nLoadStart) / 1000000.0f;
+		LOGNOTE("\"%s\" loaded in %0.2f seconds", static_cast<const char*>(m_SwitchSoundFontPath), nLoadTime);
+	}
+	else
+		LOGWARN("Failed to load \"%s\" in the background", static_cast<const char*>(m_SwitchSoundFontPath));
+
+	// Hand back to the main task
+	m_SwitchState = m_pSwitchSoundFont ? TSwitchState::Loaded : TSwitchState::LoadFailed;
+}
+
+CSoundFontSynth::TSoundFontSwitchResult CSoundFontSynth::UpdateSoundFontSwitch()
+{
+	TSoundFontSwitchResult Result = TSoundFontSwitchResult::None;
+	const TSwitchState State = m_SwitchState;
+
+	if (State == TSwitchState::Loaded || State == TSwitchState::LoadFailed)
+	{
+		DataMemBarrier();
+		Result = State == TSwitchState::Loaded ? SwapSoundFont() : ReloadSoundFont();
+		m_SwitchState = TSwitchState::Idle;
+
+		if (m_bSwitchQueued)
+		{
+			m_bSwitchQueued = false;
+			SwitchSoundFont(m_nQueuedSoundFontIndex);
+		}
+	}
+
+	// Retry freeing replaced SoundFonts; they can't be freed while voices are still playing their samples
+	const unsigned int nTicks = CTimer::GetClockTicks();
+	if (m_bUnloadPending && (nTicks - m_nUnloadPollTime) >= Utility::MillisToTicks(UnloadPollPeriodMillis))
+	{
+		m_Lock.Acquire();
+		m_bUnloadPending = fluid_synth_sfunload_pending(m_pSynth) > 0;
+		m_Lock.Release();
+
+		if (!m_bUnloadPending)
+			LOGNOTE("Replaced SoundFont freed");
+
+		m_nUnloadPollTime = nTicks;
+	}
+
+	return Result;
+}
+
+void CSoundFontSynth::UpdateDynamicSamples()
+{
+	if (!m_bDynamicSamples)
+		return;
+
+	ReleasePresetHolds(false);
+
+	// Read samples that played messages selected without a hold, e.g. via SysEx
+	const u32 nSelectionSequence = m_nSelectionSequence;
+	if (m_nLoadedSequence != nSelectionSequence && static_cast<s32>(m_nPlayedMessages - nSelectionSequence) >= 0)
+	{
+		DataMemBarrier();
+		m_bSelectedSamplesPending = true;
+		m_nLoadedSequence = nSelectionSequence;
+		StartSampleTask();
+	}
+}
+
+CSoundFontSynth::TSoundFontSwitchResult CSoundFontSynth::SwapSoundFont()
+{
+	// Pending program changes will select presets from the new SoundFont
+	WaitForSampleTask();
+	ReleasePresetHolds(true);
+
+	m_Lock.Acquire();
 
-	// We can't use fluid_synth_sfunload() as we don't support the lazy SoundFont unload timer, so trash the entire synth and create a new one
-	if (!Reinitialize(pSoundFontPath, &FXProfile))
+	const int nSoundFontID = fluid_synth_sfload_sfont(m_pSynth, m_pSwitchSoundFont, false);
+	if (nSoundFontID == FLUID_FAILED)
 	{
+		m_Lock.Release();
+		LOGERR("Failed to add SoundFont");
 		if (m_pUI)
 			m_pUI->ShowSystemMessage("SF switch failed!");
+		return TSoundFontSwitchResult::Failed;
+	}
 
-		return false;
+	// Unloading the old SoundFont re-selects every channel's current bank/program from the new one;
+	// notes that are still sounding keep its samples alive until they finish
+	if (m_nSoundFontID != FLUID_FAILED)
+		fluid_synth_sfunload(m_pSynth, m_nSoundFontID, true);
+
+	ApplyFXProfile(&m_SwitchFXProfile);
+	m_bUnloadPending = fluid_synth_sfunload_pending(m_pSynth) > 0;
+
+	// Under the lock, as the MIDI handler looks presets up by this ID
+	m_nSoundFontID = nSoundFontID;
+
+	m_Lock.Release();
+
+	m_pSwitchSoundFont = nullptr;
+
+	if (m_bDynamicSamples)
+	{
+		m_bSelectedSamplesPending = true;
+		StartSampleTask();
+	}
+	m_nUnloadPollTime = CTimer::GetClockTicks();
+	m_nCurrentSoundFontIndex = m_nSwitchSoundFontIndex;
+
+	LOGNOTE("Loaded \"%s\"", m_SoundFontManager.GetSoundFontName(m_nCurrentSoundFontIndex));
+	if (m_pUI)
+		m_pUI->ClearSpinnerMessage();
+
+	return TSoundFontSwitchResult::Switched;
+}
+
+CSoundFontSynth::TSoundFontSwitchResult CSoundFontSynth::ReloadSoundFont()
+{
+	// Most likely there wasn't enough memory for both SoundFonts at once, so trash the entire synth and create a new one
+	LOGNOTE("Reinitializing synth to switch SoundFont");
+
+	if (!Reinitialize(m_SwitchSoundFontPath, &m_SwitchFXProfile))
+	{
+		if (m_pUI)
+			m_pUI->ShowSystemMessage("SF switch failed!");
+
+		return TSoundFontSwitchResult::Failed;
 	}
 
-	m_nCurrentSoundFontIndex = nIndex;
+	m_nCurrentSoundFontIndex = m_nSwitchSoundFontIndex;
 
-	LOGNOTE("Loaded \"%s\"", m_SoundFontManager.GetSoundFontName(nIndex));
+	LOGNOTE("Loaded \"%s\"", m_SoundFontManager.GetSoundFontName(m_nCurrentSoundFontIndex));
 	if (m_pUI)
 		m_pUI->ClearSpinnerMessage();
 
-	return true;
+	return TSoundFontSwitchResult::Reloaded;
 }
 
 bool CSoundFontSynth::Reinitialize(const char* pSoundFontPath, const TFXProfile* pFXProfile)
 {
 	const CConfig* const pConfig = CConfig::Get();
 
+	WaitForSampleTask();
+
 	m_Lock.Acquire();
 
 	if (m_pSynth)
 		delete_fluid_synth(m_pSynth);
 
+	// Deleting the synth also freed any replaced SoundFonts, along with their preset holds
+	m_nSoundFontID = FLUID_FAILED;
+	m_bUnloadPending = false;
+	m_nPresetHoldRead = m_nPresetHoldHead;
+	m_nPresetHoldTail = m_nPresetHoldHead;
+	m_bSelectedSamplesPending = false;
+
 	m_pSynth = new_fluid_synth(m_pSettings);
 
 	if (!m_pSynth)
@@ -406,6 +1119,48 @@ bool CSoundFontSynth::Reinitialize(const char* pSoundFontPath, const TFXProfile*
 
 	fluid_synth_set_polyphony(m_pSynth, pConfig->FluidSynthPolyphony);
 
+	// Share voice rendering with an otherwise idle CPU core
+	if (pConfig->FluidSynthMultiCore && fluid_synth_set_mixer_worker(m_pSynth, MixerWorkerKick, MixerWorkerWait, this) == FLUID_FAILED)
+		LOGERR("Failed to set up multi-core rendering");
+
+	ApplyFXProfile(pFXProfile);
+
+	ResetMIDIMonitor();
+
+	m_Lock.Release();
+
+	const unsigned int nLoadStart = CTimer::GetClockTicks();
+
+	// Our own loader shares the work with the worker core and reports progress
+	if (m_pSoundFontLoader)
+	{
+		fluid_sfont_t* pSoundFont = fluid_sfloader_load_sfont(m_pSoundFontLoader, pSoundFontPath);
+		if (pSoundFont && (m_nSoundFontID = fluid_synth_sfload_sfont(m_pSynth, pSoundFont, true)) == FLUID_FAILED)
+			delete_fluid_sfont(pSoundFont);
+	}
+	else
+		m_nSoundFontID = fluid_synth_sfload(m_pSynth, pSoundFontPath, true);
+
+	if (m_nSoundFontID == FLUID_FAILED)
+	{
+		LOGERR("Failed to load SoundFont");
+		return false;
+	}
+
+	// Loading the SoundFont selected the default presets
+	if (m_bDynamicSamples)
+		LoadSelectedSamples();
+
+	const float nLoadTime = (CTimer::GetClockTicks() - nLoadStart) / 1000000.0f;
+	LOGNOTE("\"%s\" loaded in %0.2f seconds", pSoundFontPath, nLoadTime);
+
+	return true;
+}
+
+void CSoundFontSynth::ApplyFXProfile(const TFXProfile* pFXProfile)
+{
+	const CConfig* const pConfig = CConfig::Get();
+
 	m_nInitialGain = pFXProfile->nGain.ValueOr(pConfig->FluidSynthDefaultGain);
 	fluid_synth_set_gain(m_pSynth, m_nVolume / 100.0f * m_nInitialGain);
 
@@ -425,23 +1180,6 @@ bool CSoundFontSynth::Reinitialize(const char* pSoundFontPath, const TFXProfile*
 #ifndef NDEBUG
 	DumpFXSettings();
 #endif
-
-	ResetMIDIMonitor();
-
-	m_Lock.Release();
-
-	const unsigned int nLoadStart = CTimer::GetClockTicks();
-
-	if (fluid_synth_sfload(m_pSynth, pSoundFontPath, true) == FLUID_FAILED)
-	{
-		LOGERR("Failed to load SoundFont");
-		return false;
-	}
-
-	const float nLoadTime = (CTimer::GetClockTicks() - nLoadStart) / 1000000.0f;
-	LOGNOTE("\"%s\" loaded in %0.2f seconds", pSoundFontPath, nLoadTime);
-
-	return true;
 }
 
 void CSoundFontSynth::ResetMIDIMonitor()
@@ -449,6 +1187,7 @@ void CSoundFontSynth::ResetMIDIMonitor()
 	m_MIDIMonitor.AllNotesOff();
 	m_MIDIMonitor.ResetControllers(false);
 	m_nPercussionMask = 1 << 9;
+	memset(m_BankSelect, 0, sizeof(m_BankSelect));
 }
 
 #ifndef NDEBUG
@@ -503,6 +1242,7 @@ bool CSoundFontSynth::ParseGMSysEx(const u8* pData, size_t nSize)
 		if (Header.SubID2 == TGMSubID::GeneralMIDIOn || Header.SubID2 == TGMSubID::GeneralMIDIOff)
 		{
 			ResetMIDIMonitor();
+			HoldResetPresets();
 			return true;
 		}
 	}
@@ -536,6 +1276,7 @@ bool CSoundFontSynth::ParseRolandSysEx(const u8* pData, size_t nSize)
 		{
 			// Reset MIDI monitor on GS reset
 			ResetMIDIMonitor();
+			HoldResetPresets();
 
 			// Don't consume; forward to FluidSynth
 			return false;
@@ -595,6 +1336,7 @@ bool CSoundFontSynth::ParseYamahaSysEx(const u8* pData, size_t nSize)
 		{
 			// Reset MIDI monitor on XG reset
 			ResetMIDIMonitor();
+			HoldResetPresets();
 
 			// Don't consume; forward to FluidSynth
 			return false;
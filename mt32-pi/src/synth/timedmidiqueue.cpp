@@ -0,0 +1,128 @@
+//
+// timedmidiqueue.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/timer.h>
+
+#include "synth/timedmidiqueue.h"
+
+CTimedMIDIQueue::CTimedMIDIQueue()
+	: m_nBlockStartTicks(0),
+	  m_nBlockEndTicks(0),
+	  m_nBlockFrames(0),
+	  m_SysExBuffer{}
+{
+}
+
+bool CTimedMIDIQueue::EnqueueShortMessage(u32 nMessage)
+{
+	const TEntry Entry{CTimer::GetClockTicks(), nMessage, 0};
+	return m_Entries.Enqueue(Entry);
+}
+
+bool CTimedMIDIQueue::EnqueueSysExMessage(const u8* pData, size_t nSize)
+{
+	// Larger than the consumer's buffer; only possible for messages that didn't come from the MIDI parser
+	if (nSize > MaxSysExSize)
+		return false;
+
+	// Both parts must fit, otherwise the consumer would see a partial message
+	if (m_Entries.GetFreeSpace() < 1 || m_SysExData.GetFreeSpace() < nSize)
+		return false;
+
+	const TEntry Entry{CTimer::GetClockTicks(), 0, nSize};
+	m_SysExData.Enqueue(pData, nSize);
+	m_Entries.Enqueue(Entry);
+
+	return true;
+}
+
+void CTimedMIDIQueue::BeginBlock(size_t nFrames)
+{
+	m_nBlockStartTicks = m_nBlockEndTicks;
+	m_nBlockEndTicks = CTimer::GetClockTicks();
+	m_nBlockFrames = nFrames;
+}
+
+bool CTimedMIDIQueue::Dequeue(TMessage& Message)
+{
+	TEntry Entry;
+	if (!m_Entries.Peek(Entry))
+		return false;
+
+	// Arrived after this block started; leave it for the next block
+	if (static_cast<int>(m_nBlockEndTicks - Entry.nTicks) <= 0)
+		return false;
+
+	m_Entries.Dequeue(Entry);
+
+	// Scale the arrival time within the previous block period to a frame offset within this block
+	const int nSinceStart = static_cast<int>(Entry.nTicks - m_nBlockStartTicks);
+	const unsigned int nPeriod = m_nBlockEndTicks - m_nBlockStartTicks;
+
+	if (nSinceStart <= 0 || nPeriod == 0)
+		Message.nOffset = 0;
+	else
+		Message.nOffset = static_cast<u64>(nSinceStart) * m_nBlockFrames / nPeriod;
+
+	PopEntry(Entry, Message);
+
+	return true;
+}
+
+bool CTimedMIDIQueue::DequeueImmediate(TMessage& Message)
+{
+	TEntry Entry;
+	if (!m_Entries.Dequeue(Entry))
+		return false;
+
+	Message.nOffset = 0;
+	PopEntry(Entry, Message);
+
+	return true;
+}
+
+void CTimedMIDIQueue::Flush()
+{
+	TEntry Entry;
+	while (m_Entries.Dequeue(Entry))
+	{
+		if (Entry.nSysExSize)
+			m_SysExData.Dequeue(m_SysExBuffer, Entry.nSysExSize);
+	}
+}
+
+void CTimedMIDIQueue::PopEntry(const TEntry& Entry, TMessage& Message)
+{
+	Message.nShortMessage = Entry.nShortMessage;
+
+	if (Entry.nSysExSize)
+	{
+		m_SysExData.Dequeue(m_SysExBuffer, Entry.nSysExSize);
+		Message.pSysExData = m_SysExBuffer;
+		Message.nSysExSize = Entry.nSysExSize;
+	}
+	else
+	{
+		Message.pSysExData = nullptr;
+		Message.nSysExSize = 0;
+	}
+}
@@ -34,13 +34,21 @@ LOGMODULE("zoneallocator");
 
 constexpr size_t MallocHeapSize = 32 * MEGABYTE;
 
+static inline size_t FloorLog2(size_t nValue)
+{
+	return sizeof(unsigned long) * 8 - 1 - __builtin_clzl(nValue);
+}
+
 CZoneAllocator* CZoneAllocator::s_pThis = nullptr;
 
 CZoneAllocator::CZoneAllocator()
 	: m_pHeap(nullptr),
 	  m_nHeapSize(0),
-	  m_pCurrentBlock(nullptr),
-	  m_nAllocCount(0)
+	  m_nFirstLevelBitmap(0),
+	  m_SecondLevelBitmaps{0},
+	  m_FreeLists{},
+	  m_nAllocCount(0),
+	  m_Lock(TASK_LEVEL)
 {
 	assert(s_pThis == nullptr);
 	s_pThis = this;
@@ -77,16 +85,16 @@ bool CZoneAllocator::Initialize()
 	if (!m_pHeap)
 	{
 		if (m_nHeapSize >= MEGABYTE)
-			LOGERR("Couldn't allocate a %d megabyte heap", m_nHeapSize / MEGABYTE);
+			LOGERR("Couldn't allocate a %u megabyte heap", static_cast<unsigned int>(m_nHeapSize / MEGABYTE));
 		else
-			LOGERR("Couldn't allocate a %d byte heap", m_nHeapSize);
+			LOGERR("Couldn't allocate a %u byte heap", static_cast<unsigned int>(m_nHeapSize));
 		return false;
 	}
 
 	if (m_nHeapSize >= MEGABYTE)
-		LOGNOTE("Allocated a %d megabyte heap at %p", m_nHeapSize / MEGABYTE, m_pHeap);
+		LOGNOTE("Allocated a %u megabyte heap at %p", static_cast<unsigned int>(m_nHeapSize / MEGABYTE), m_pHeap);
 	else
-		LOGNOTE("Allocated a %d byte heap at %p", m_nHeapSize, m_pHeap);
+		LOGNOTE("Allocated a %u byte heap at %p", static_cast<unsigned int>(m_nHeapSize), m_pHeap);
 
 #ifdef ZONE_ALLOCATOR_DEBUG
 	if ((reinterpret_cast<uintptr>(m_pHeap) & 15) == 0)
@@ -94,7 +102,7 @@ bool CZoneAllocator::Initialize()
 	else
 		LOGDEBUG("Heap is NOT 16-byte aligned");
 
-	LOGDEBUG("Size of block header: %d", sizeof(TBlock));
+	LOGDEBUG("Size of block header: %u", static_cast<unsigned int>(sizeof(TBlock)));
 #endif
 
 	// Initialize the heap with an empty block
@@ -104,6 +112,29 @@ bool CZoneAllocator::Initialize()
 }
 
 void* CZoneAllocator::Alloc(size_t nSize, TZoneTag Tag)
+{
+	m_Lock.Acquire();
+	void* pPtr = AllocBlock(nSize, Tag);
+	m_Lock.Release();
+	return pPtr;
+}
+
+void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
+{
+	m_Lock.Acquire();
+	pPtr = ReallocBlock(pPtr, nSize, Tag);
+	m_Lock.Release();
+	return pPtr;
+}
+
+void CZoneAllocator::Free(void* pPtr)
+{
+	m_Lock.Acquire();
+	FreeBlock(pPtr);
+	m_Lock.Release();
+}
+
+void* CZoneAllocator::AllocBlock(size_t nSize, TZoneTag Tag)
 {
 	if (!nSize)
 		return nullptr;
@@ -117,71 +148,41 @@ void* CZoneAllocator::Alloc(size_t nSize, TZoneTag Tag)
 	// Account for size of block header and magic number at end of zone (for corruption detection), padded to 16 bytes
 	nSize = (nSize + sizeof(TBlock) + sizeof(BlockMagic) + 0xF) & ~0xF;
 
-	TBlock* pNextBlock      = m_pCurrentBlock;
-	TBlock* pCandidateBlock = m_pCurrentBlock;
-	TBlock* pStartBlock     = m_pCurrentBlock->pPrevious;
-
-	do
+	TBlock* pBlock = FindFreeBlock(nSize);
+	if (!pBlock)
 	{
-		// We've been through the whole linked list and couldn't find a free block
-		if (pNextBlock == pStartBlock)
-		{
-			LOGERR("Zone allocation failed: couldn't allocate %d bytes", nSize);
-			return nullptr;
-		}
-
-		// This block is in use; look at the next one
-		if (pNextBlock->Tag != TZoneTag::Free)
-			pCandidateBlock = pNextBlock->pNext;
-
-		pNextBlock = pNextBlock->pNext;
-	} while (pCandidateBlock->Tag || pCandidateBlock->nSize < nSize);
+		LOGERR("Zone allocation failed: couldn't allocate %u bytes", static_cast<unsigned int>(nSize));
+		return nullptr;
+	}
 
-	// Create a new block for any remaining free space
-	const size_t nRemaining = pCandidateBlock->nSize - nSize;
-	if (nRemaining > MinFragmentSize)
-	{
-		TBlock* pNewBlock    = reinterpret_cast<TBlock*>(reinterpret_cast<u8*>(pCandidateBlock) + nSize);
-		pNewBlock->nSize     = nRemaining;
-		pNewBlock->pNext     = pCandidateBlock->pNext;
-		pNewBlock->pPrevious = pCandidateBlock;
-		pNewBlock->Tag       = TZoneTag::Free;
-		pNewBlock->nMagic    = BlockMagic;
-#if AARCH == 32
-		memset(pNewBlock->Padding, 0xEB, Utility::ArraySize(pNewBlock->Padding));
-#endif
-		// Set the next block's previous to look at the new block
-		pNewBlock->pNext->pPrevious = pNewBlock;
+	RemoveFreeBlock(pBlock);
 
-		pCandidateBlock->nSize = nSize;
-		pCandidateBlock->pNext = pNewBlock;
-	}
+	// Return any remaining free space to the free lists
+	if (TBlock* pRemainder = SplitBlock(pBlock, nSize))
+		InsertFreeBlock(pRemainder);
 
 	// Mark block used
-	pCandidateBlock->Tag    = Tag;
-	pCandidateBlock->nMagic = BlockMagic;
+	pBlock->Tag    = Tag;
+	pBlock->nMagic = BlockMagic;
 
 	// Mark end of memory with magic number
-	GetEndMagic(pCandidateBlock) = BlockMagic;
-
-	// Next allocation will start looking at this block
-	m_pCurrentBlock = pCandidateBlock->pNext;
+	GetEndMagic(pBlock) = BlockMagic;
 
 #ifdef ZONE_ALLOCATOR_TRACE
-	LOGDBG("Allocated %d bytes for tag %x", nSize, Tag);
+	LOGDBG("Allocated %u bytes for tag %x", static_cast<unsigned int>(nSize), Tag);
 #endif
 
 	// Increment alloc counter
 	++m_nAllocCount;
 
-	return pCandidateBlock + 1;
+	return pBlock + 1;
 }
 
-void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
+void* CZoneAllocator::ReallocBlock(void* pPtr, size_t nSize, TZoneTag Tag)
 {
 	// If passed a null pointer, perform a new allocation
 	if (!pPtr)
-		return Alloc(nSize, Tag);
+		return AllocBlock(nSize, Tag);
 
 	if (!nSize)
 		return nullptr;
@@ -205,30 +206,16 @@ void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
 	// Expand block
 	if (nNewSize > pBlock->nSize)
 	{
-		const size_t nSizeDiff = nNewSize - pBlock->nSize;
+		TBlock* pNextBlock = pBlock->pNext;
 
 		// Expand in-place if next block is free and large enough
-		if (pBlock->pNext->Tag == TZoneTag::Free && pBlock->pNext->nSize >= nSizeDiff)
+		if (pNextBlock->Tag == TZoneTag::Free && pBlock->nSize + pNextBlock->nSize >= nNewSize)
 		{
-			TBlock* pNewBlock = reinterpret_cast<TBlock*>(reinterpret_cast<u8*>(pBlock) + nNewSize);
-
-			pNewBlock->nSize            = pBlock->pNext->nSize - nSizeDiff;
-			pNewBlock->pNext            = pBlock->pNext->pNext;
-			pNewBlock->pNext->pPrevious = pNewBlock;
-			pNewBlock->pPrevious        = pBlock;
-			pNewBlock->Tag              = TZoneTag::Free;
-			pNewBlock->nMagic           = BlockMagic;
-#if AARCH == 32
-			memset(pNewBlock->Padding, 0xEB, Utility::ArraySize(pNewBlock->Padding));
-#endif
-			GetEndMagic(pNewBlock) = BlockMagic;
+			MergeWithNext(pBlock);
 
-			// Next allocations search from this new merged free block
-			if (pBlock->pNext == m_pCurrentBlock)
-				m_pCurrentBlock = pNewBlock;
+			if (TBlock* pRemainder = SplitBlock(pBlock, nNewSize))
+				InsertFreeBlock(pRemainder);
 
-			pBlock->nSize       = nNewSize;
-			pBlock->pNext       = pNewBlock;
 			pBlock->Tag         = Tag;
 			GetEndMagic(pBlock) = BlockMagic;
 
@@ -243,7 +230,7 @@ void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
 		else
 		{
 			const size_t nSrcSize = pBlock->nSize - sizeof(TBlock) - sizeof(BlockMagic);
-			void* pDest           = Alloc(nSize, Tag);
+			void* pDest           = AllocBlock(nSize, Tag);
 
 			if (!pDest)
 			{
@@ -252,7 +239,7 @@ void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
 			}
 
 			memcpy(pDest, pPtr, nSrcSize);
-			Free(pPtr);
+			FreeBlock(pPtr);
 
 #ifdef ZONE_ALLOCATOR_TRACE
 			LOGDBG("Expanded block at %p by allocating new block", pPtr);
@@ -265,49 +252,18 @@ void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
 	// Shrink in-place
 	if (nNewSize < pBlock->nSize)
 	{
-		const size_t nRemain = pBlock->nSize - nNewSize;
-		if (nRemain > MinFragmentSize)
+		if (TBlock* pRemainder = SplitBlock(pBlock, nNewSize))
 		{
-			TBlock* pNewBlock = reinterpret_cast<TBlock*>(reinterpret_cast<u8*>(pBlock) + nNewSize);
+			// Merge free space with next block if it is also free
+			MergeWithNext(pRemainder);
+			InsertFreeBlock(pRemainder);
 
-			if (pBlock->pNext->Tag == TZoneTag::Free)
-			{
-				// Merge free space with next block if it is also free
-				*pNewBlock = *pBlock->pNext;
-				pNewBlock->nSize += nRemain;
-#ifdef ZONE_ALLOCATOR_TRACE
-				LOGDBG("Shrunk block at %p in-place; adjacent free space expanded", pPtr);
-#endif
-			}
-			else
-			{
-				// Create a new block for any remaining free space
-				pNewBlock->nSize     = nRemain;
-				pNewBlock->pNext     = pBlock->pNext;
-				pNewBlock->pPrevious = pBlock;
-				pNewBlock->Tag       = TZoneTag::Free;
-				pNewBlock->nMagic    = BlockMagic;
-#if AARCH == 32
-				memset(pNewBlock->Padding, 0xEB, Utility::ArraySize(pNewBlock->Padding));
-#endif
-				GetEndMagic(pNewBlock) = BlockMagic;
 #ifdef ZONE_ALLOCATOR_TRACE
-				LOGDBG("Shrunk block at %p in-place; new free block inserted after", pPtr);
+			LOGDBG("Shrunk block at %p in-place", pPtr);
 #endif
-			}
-
-			// Next allocations search from this new merged free block
-			if (pBlock->pNext == m_pCurrentBlock)
-				m_pCurrentBlock = pNewBlock;
-
-			// Set the next block's previous to look at the new block
-			pNewBlock->pNext->pPrevious = pNewBlock;
-
-			pBlock->pNext = pNewBlock;
 		}
 
-		pBlock->nSize = nNewSize;
-		pBlock->Tag   = Tag;
+		pBlock->Tag = Tag;
 
 		// Mark end of memory with magic number
 		GetEndMagic(pBlock) = BlockMagic;
@@ -320,7 +276,7 @@ void* CZoneAllocator::Realloc(void* pPtr, size_t nSize, TZoneTag Tag)
 	return pPtr;
 }
 
-void CZoneAllocator::Free(void* pPtr)
+void CZoneAllocator::FreeBlock(void* pPtr)
 {
 	if (!pPtr)
 		return;
@@ -339,68 +295,183 @@ void CZoneAllocator::Free(void* pPtr)
 		return;
 	}
 
-	// Mark this block as free
-	pBlock->Tag = TZoneTag::Free;
+	// Join with next block if next block is also free
+	MergeWithNext(pBlock);
 
 	// Join with previous block if previous block is also free
-	TBlock* pAdjacentBlock = pBlock->pPrevious;
-	if (pAdjacentBlock->Tag == TZoneTag::Free)
+	TBlock* pPreviousBlock = pBlock->pPrevious;
+	if (pPreviousBlock->Tag == TZoneTag::Free)
 	{
-		pAdjacentBlock->nSize += pBlock->nSize;
-		pAdjacentBlock->pNext            = pBlock->pNext;
-		pAdjacentBlock->pNext->pPrevious = pAdjacentBlock;
-		// Next allocations search from this new merged free block
-		if (pBlock == m_pCurrentBlock)
-			m_pCurrentBlock = pAdjacentBlock;
+		RemoveFreeBlock(pPreviousBlock);
+		pPreviousBlock->nSize += pBlock->nSize;
+		pPreviousBlock->pNext            = pBlock->pNext;
+		pPreviousBlock->pNext->pPrevious = pPreviousBlock;
 #ifdef ZONE_ALLOCATOR_TRACE
-		LOGDBG("Merged freed block at %p with previous block at %p", pPtr, pAdjacentBlock);
+		LOGDBG("Merged freed block at %p with previous block at %p", pPtr, pPreviousBlock);
 #endif
-		pBlock = pAdjacentBlock;
+		pBlock = pPreviousBlock;
 	}
 
-	// Join with next block if next block is also free
-	pAdjacentBlock = pBlock->pNext;
-	if (pAdjacentBlock->Tag == TZoneTag::Free)
-	{
-		pBlock->nSize += pAdjacentBlock->nSize;
-		pBlock->pNext            = pAdjacentBlock->pNext;
-		pBlock->pNext->pPrevious = pBlock;
-		if (pAdjacentBlock == m_pCurrentBlock)
-			m_pCurrentBlock = pBlock;
-#ifdef ZONE_ALLOCATOR_TRACE
-		LOGDBG("Merged freed block at %p with next block at %p", pPtr, pAdjacentBlock);
-#endif
-	}
+	// Mark this block as free
+	InsertFreeBlock(pBlock);
 
 	// Decrement allocation counter
 	--m_nAllocCount;
 }
 
-void CZoneAllocator::Clear()
+void CZoneAllocator::GetSizeClass(size_t nSize, size_t& nFirstLevel, size_t& nSecondLevel)
 {
-	TBlock* pFirstBlock = static_cast<TBlock*>(m_pHeap);
+	if (nSize < SmallBlockSize)
+	{
+		nFirstLevel  = 0;
+		nSecondLevel = nSize >> AlignLog2;
+	}
+	else
+	{
+		const size_t nLog2 = FloorLog2(nSize);
+		nFirstLevel        = nLog2 - FirstLevelShift + 1;
+		nSecondLevel       = (nSize >> (nLog2 - SecondLevelLog2)) ^ SecondLevelCount;
+	}
+}
+
+CZoneAllocator::TBlock* CZoneAllocator::FindFreeBlock(size_t nSize)
+{
+	// Round up to the next size class boundary so that every block in the chosen list is large enough
+	if (nSize >= SmallBlockSize)
+		nSize += (static_cast<size_t>(1) << (FloorLog2(nSize) - SecondLevelLog2)) - 1;
+
+	size_t nFirstLevel, nSecondLevel;
+	GetSizeClass(nSize, nFirstLevel, nSecondLevel);
+
+	if (nFirstLevel >= FirstLevelCount)
+		return nullptr;
+
+	// Look for a non-empty list in the same first level, otherwise take the smallest larger first level
+	u32 nSecondLevelMap = m_SecondLevelBitmaps[nFirstLevel] & (~0u << nSecondLevel);
+	if (!nSecondLevelMap)
+	{
+		const u64 nFirstLevelMap = m_nFirstLevelBitmap & (~0ull << (nFirstLevel + 1));
+		if (!nFirstLevelMap)
+			return nullptr;
+
+		nFirstLevel     = __builtin_ctzll(nFirstLevelMap);
+		nSecondLevelMap = m_SecondLevelBitmaps[nFirstLevel];
+	}
+
+	nSecondLevel = __builtin_ctz(nSecondLevelMap);
+	return m_FreeLists[nFirstLevel][nSecondLevel];
+}
+
+void CZoneAllocator::InsertFreeBlock(TBlock* pBlock)
+{
+	size_t nFirstLevel, nSecondLevel;
+	GetSizeClass(pBlock->nSize, nFirstLevel, nSecondLevel);
+
+	TBlock*& pHead = m_FreeLists[nFirstLevel][nSecondLevel];
+
+	pBlock->Tag           = TZoneTag::Free;
+	pBlock->pPreviousFree = nullptr;
+	pBlock->pNextFree     = pHead;
+
+	if (pHead)
+		pHead->pPreviousFree = pBlock;
+
+	pHead = pBlock;
+
+	m_nFirstLevelBitmap |= 1ull << nFirstLevel;
+	m_SecondLevelBitmaps[nFirstLevel] |= 1u << nSecondLevel;
+}
+
+void CZoneAllocator::RemoveFreeBlock(TBlock* pBlock)
+{
+	size_t nFirstLevel, nSecondLevel;
+	GetSizeClass(pBlock->nSize, nFirstLevel, nSecondLevel);
+
+	if (pBlock->pNextFree)
+		pBlock->pNextFree->pPreviousFree = pBlock->pPreviousFree;
+
+	if (pBlock->pPreviousFree)
+		pBlock->pPreviousFree->pNextFree = pBlock->pNextFree;
+	else
+	{
+		m_FreeLists[nFirstLevel][nSecondLevel] = pBlock->pNextFree;
+
+		// List is now empty
+		if (!pBlock->pNextFree)
+		{
+			m_SecondLevelBitmaps[nFirstLevel] &= ~(1u << nSecondLevel);
+			if (!m_SecondLevelBitmaps[nFirstLevel])
+				m_nFirstLevelBitmap &= ~(1ull << nFirstLevel);
+		}
+	}
+
+	pBlock->pNextFree     = nullptr;
+	pBlock->pPreviousFree = nullptr;
+}
+
+CZoneAllocator::TBlock* CZoneAllocator::SplitBlock(TBlock* pBlock, size_t nSize)
+{
+	// Not enough space left over for another block
+	const size_t nRemaining = pBlock->nSize - nSize;
+	if (nRemaining < MinBlockSize)
+		return nullptr;
+
+	TBlock* pNewBlock = reinterpret_cast<TBlock*>(reinterpret_cast<u8*>(pBlock) + nSize);
+	InitBlock(pNewBlock, nRemaining, pBlock->pNext, pBlock);
+
+	// Set the next block's previous to look at the new block
+	pNewBlock->pNext->pPrevious = pNewBlock;
+
+	pBlock->nSize = nSize;
+	pBlock->pNext = pNewBlock;
+
+	return pNewBlock;
+}
+
+void CZoneAllocator::MergeWithNext(TBlock* pBlock)
+{
+	TBlock* pNextBlock = pBlock->pNext;
+	if (pNextBlock->Tag != TZoneTag::Free)
+		return;
+
+	RemoveFreeBlock(pNextBlock);
+
+	pBlock->nSize += pNextBlock->nSize;
+	pBlock->pNext            = pNextBlock->pNext;
+	pBlock->pNext->pPrevious = pBlock;
+}
 
-	// The main block is a special block which acts as an end marker for the linked list of blocks
-	m_MainBlock.nSize     = 0;
-	m_MainBlock.pNext     = pFirstBlock;
-	m_MainBlock.pPrevious = pFirstBlock;
-	m_MainBlock.Tag       = TZoneTag::Uncategorized;
-	m_MainBlock.nMagic    = 0;
+void CZoneAllocator::InitBlock(TBlock* pBlock, size_t nSize, TBlock* pNext, TBlock* pPrevious)
+{
+	pBlock->nSize         = nSize;
+	pBlock->pNext         = pNext;
+	pBlock->pPrevious     = pPrevious;
+	pBlock->Tag           = TZoneTag::Free;
+	pBlock->nMagic        = BlockMagic;
+	pBlock->pNextFree     = nullptr;
+	pBlock->pPreviousFree = nullptr;
 #if AARCH == 32
 	// 0xEB - "extra byte"; useful for memory view when debugging
-	memset(m_MainBlock.Padding, 0xEB, Utility::ArraySize(m_MainBlock.Padding));
+	memset(pBlock->Padding, 0xEB, Utility::ArraySize(pBlock->Padding));
 #endif
+}
 
-	pFirstBlock->nSize     = m_nHeapSize;
-	pFirstBlock->pNext     = &m_MainBlock;
-	pFirstBlock->pPrevious = &m_MainBlock;
-	pFirstBlock->Tag       = TZoneTag::Free;
-	pFirstBlock->nMagic    = BlockMagic;
-#if AARCH == 32
-	memset(pFirstBlock->Padding, 0xEB, Utility::ArraySize(pFirstBlock->Padding));
-#endif
+void CZoneAllocator::Clear()
+{
+	TBlock* pFirstBlock = static_cast<TBlock*>(m_pHeap);
+
+	// The main block is a special block which acts as an end marker for the linked list of blocks; it is never free
+	InitBlock(&m_MainBlock, 0, pFirstBlock, pFirstBlock);
+	m_MainBlock.Tag    = TZoneTag::Uncategorized;
+	m_MainBlock.nMagic = 0;
+
+	m_nFirstLevelBitmap = 0;
+	m_nAllocCount       = 0;
+	memset(m_SecondLevelBitmaps, 0, sizeof(m_SecondLevelBitmaps));
+	memset(m_FreeLists, 0, sizeof(m_FreeLists));
 
-	m_pCurrentBlock = pFirstBlock;
+	InitBlock(pFirstBlock, m_nHeapSize & ~0xF, &m_MainBlock, &m_MainBlock);
+	InsertFreeBlock(pFirstBlock);
 }
 
 void CZoneAllocator::FreeTag(u32 Tag)
@@ -411,6 +482,8 @@ void CZoneAllocator::FreeTag(u32 Tag)
 		return;
 	}
 
+	m_Lock.Acquire();
+
 	TBlock* pBlock = m_MainBlock.pNext;
 	TBlock* pNextBlock;
 
@@ -419,29 +492,202 @@ void CZoneAllocator::FreeTag(u32 Tag)
 		// Grab the next block before freeing this one
 		pNextBlock = pBlock->pNext;
 		if (pBlock->Tag == Tag)
-			Free(reinterpret_cast<u8*>(pBlock) + sizeof(TBlock));
+			FreeBlock(reinterpret_cast<u8*>(pBlock) + sizeof(TBlock));
 		pBlock = pNextBlock;
 	} while (pBlock != &m_MainBlock);
+
+	m_Lock.Release();
 }
 
-void CZoneAllocator::Dump() const
+void CZoneAllocator::GetStats(TStats& Stats) const
 {
-	LOGNOTE("Allocation diagnostics:");
+	m_Lock.Acquire();
+	GatherStats(Stats);
+	m_Lock.Release();
+}
 
+void CZoneAllocator::GatherStats(TStats& Stats) const
+{
+	Stats = TStats{};
 	TBlock* pBlock = m_MainBlock.pNext;
 
 	do
 	{
-		LOGNOTE("Block address %p (%s):", pBlock, pBlock->Tag ? "IN-USE" : "FREE");
-
 		// If the block is free, it doesn't need a valid tail magic
 		const bool bMagicOK = (pBlock->nMagic == BlockMagic) && (!pBlock->Tag || GetEndMagic(pBlock) == BlockMagic);
+
+#ifdef ZONE_ALLOCATOR_DEBUG
+		LOGNOTE("Block address %p (%s):", pBlock, pBlock->Tag ? "IN-USE" : "FREE");
 		if (!bMagicOK)
 			LOGWARN("WARNING: This memory block is probably corrupt!");
 
-		LOGNOTE("\tSize:  %d bytes", pBlock->nSize);
+		LOGNOTE("\tSize:  %u bytes", static_cast<unsigned int>(pBlock->nSize));
 		LOGNOTE("\tTag:   0x%x", pBlock->Tag);
 		LOGNOTE("\tMagic: %s", bMagicOK ? "OK" : "BAD");
+#endif
+
+		if (!bMagicOK)
+			++Stats.nCorruptBlocks;
+
+		if (pBlock->Tag == TZoneTag::Free)
+		{
+			++Stats.nFreeBlocks;
+			Stats.nFreeBytes += pBlock->nSize;
+			Stats.nLargestFreeBlock = Utility::Max(Stats.nLargestFreeBlock, pBlock->nSize);
+		}
+		else
+		{
+			++Stats.nUsedBlocks;
+			Stats.nUsedBytes += pBlock->nSize;
+		}
+
 		pBlock = pBlock->pNext;
 	} while (pBlock != &m_MainBlock);
 }
+
+void CZoneAllocator::Dump() const
+{
+	LOGNOTE("Allocation diagnostics:");
+
+	TStats Stats;
+	u32 FreeBlocksPerClass[FirstLevelCount][SecondLevelCount];
+
+	// Gather everything first so that other cores aren't held up while logging
+	m_Lock.Acquire();
+
+	GatherStats(Stats);
+
+	for (size_t nFirstLevel = 0; nFirstLevel < FirstLevelCount; ++nFirstLevel)
+	{
+		for (size_t nSecondLevel = 0; nSecondLevel < SecondLevelCount; ++nSecondLevel)
+		{
+			u32 nCount = 0;
+			for (const TBlock* pFreeBlock = m_FreeLists[nFirstLevel][nSecondLevel]; pFreeBlock; pFreeBlock = pFreeBlock->pNextFree)
+				++nCount;
+
+			FreeBlocksPerClass[nFirstLevel][nSecondLevel] = nCount;
+		}
+	}
+
+	m_Lock.Release();
+
+	// Share of free memory that can't be used for one large allocation
+	const unsigned int nFragmentation = Stats.nFreeBytes ? 100 - static_cast<unsigned int>(static_cast<u64>(Stats.nLargestFreeBlock) * 100 / Stats.nFreeBytes) : 0;
+
+	LOGNOTE("In use: %u blocks, %u KB", static_cast<unsigned int>(Stats.nUsedBlocks), static_cast<unsigned int>(Stats.nUsedBytes / 1024));
+	LOGNOTE("Free:   %u blocks, %u KB; largest %u KB", static_cast<unsigned int>(Stats.nFreeBlocks), static_cast<unsigned int>(Stats.nFreeBytes / 1024), static_cast<unsigned int>(Stats.nLargestFreeBlock / 1024));
+	LOGNOTE("Fragmentation: %u%%", nFragmentation);
+
+	if (Stats.nCorruptBlocks)
+		LOGWARN("WARNING: %u memory blocks are probably corrupt!", static_cast<unsigned int>(Stats.nCorruptBlocks));
+
+	// Free blocks per size class
+	for (size_t nFirstLevel = 0; nFirstLevel < FirstLevelCount; ++nFirstLevel)
+	{
+		for (size_t nSecondLevel = 0; nSecondLevel < SecondLevelCount; ++nSecondLevel)
+		{
+			const u32 nCount = FreeBlocksPerClass[nFirstLevel][nSecondLevel];
+			if (!nCount)
+				continue;
+
+			const size_t nClassSize = nFirstLevel ? (static_cast<size_t>(SecondLevelCount + nSecondLevel) << (nFirstLevel + FirstLevelShift - 1 - SecondLevelLog2)) : nSecondLevel << AlignLog2;
+			LOGNOTE("\t>= %u bytes: %u free", static_cast<unsigned int>(nClassSize), static_cast<unsigned int>(nCount));
+		}
+	}
+}
+
+bool CZoneAllocator::CheckHeap() const
+{
+	const char* pError = nullptr;
+	size_t nUsedBlocks = 0, nFreeBlocks = 0, nTotalSize = 0;
+
+	m_Lock.Acquire();
+
+	// Blocks must tile the heap, link to each other in both directions and have been coalesced
+	TBlock* pBlock         = m_MainBlock.pNext;
+	const u8* pExpectedPtr = static_cast<const u8*>(m_pHeap);
+
+	while (pBlock != &m_MainBlock)
+	{
+		if (reinterpret_cast<const u8*>(pBlock) != pExpectedPtr)
+			pError = "block is not contiguous with the previous one";
+		else if (pBlock->pPrevious->pNext != pBlock || pBlock->pNext->pPrevious != pBlock)
+			pError = "block links are inconsistent";
+		else if (pBlock->nMagic != BlockMagic)
+			pError = "block has a bad magic number";
+		else if (pBlock->nSize < MinBlockSize || (pBlock->nSize & 0xF))
+			pError = "block has an invalid size";
+		else if (pBlock->Tag != TZoneTag::Free && GetEndMagic(pBlock) != BlockMagic)
+			pError = "block has a bad end magic number";
+		else if (pBlock->Tag == TZoneTag::Free && pBlock->pNext->Tag == TZoneTag::Free)
+			pError = "adjacent free blocks were not merged";
+
+		if (pError)
+			break;
+
+		if (pBlock->Tag == TZoneTag::Free)
+			++nFreeBlocks;
+		else
+			++nUsedBlocks;
+
+		nTotalSize += pBlock->nSize;
+		pExpectedPtr += pBlock->nSize;
+		pBlock = pBlock->pNext;
+	}
+
+	if (!pError && m_MainBlock.pPrevious->pNext != &m_MainBlock)
+		pError = "last block does not link back to the main block";
+	else if (!pError && nTotalSize != (m_nHeapSize & ~0xF))
+		pError = "block sizes do not add up to the heap size";
+	else if (!pError && nUsedBlocks != m_nAllocCount)
+		pError = "allocation count does not match the used blocks";
+
+	// Every free block must be in the list for its size class, and the bitmaps must mark exactly the non-empty lists
+	size_t nListedBlocks = 0;
+	for (size_t nFirstLevel = 0; nFirstLevel < FirstLevelCount && !pError; ++nFirstLevel)
+	{
+		for (size_t nSecondLevel = 0; nSecondLevel < SecondLevelCount && !pError; ++nSecondLevel)
+		{
+			const TBlock* pHead     = m_FreeLists[nFirstLevel][nSecondLevel];
+			const bool bFirstLevel  = m_nFirstLevelBitmap & (1ull << nFirstLevel);
+			const bool bSecondLevel = m_SecondLevelBitmaps[nFirstLevel] & (1u << nSecondLevel);
+
+			if (bSecondLevel != (pHead != nullptr) || (bSecondLevel && !bFirstLevel))
+				pError = "free list bitmaps are inconsistent";
+
+			const TBlock* pPreviousFree = nullptr;
+			for (const TBlock* pFreeBlock = pHead; pFreeBlock && !pError; pFreeBlock = pFreeBlock->pNextFree)
+			{
+				size_t nBlockFirstLevel, nBlockSecondLevel;
+				GetSizeClass(pFreeBlock->nSize, nBlockFirstLevel, nBlockSecondLevel);
+
+				// Bounding the walk by the number of free blocks also catches cycles
+				if (++nListedBlocks > nFreeBlocks)
+					pError = "free lists hold more blocks than the heap";
+				else if (pFreeBlock->Tag != TZoneTag::Free)
+					pError = "free list holds a block in use";
+				else if (nBlockFirstLevel != nFirstLevel || nBlockSecondLevel != nSecondLevel)
+					pError = "free block is in the wrong size class";
+				else if (pFreeBlock->pPreviousFree != pPreviousFree)
+					pError = "free list links are inconsistent";
+
+				pPreviousFree = pFreeBlock;
+			}
+		}
+	}
+
+	if (!pError && (m_nFirstLevelBitmap >> FirstLevelCount))
+		pError = "free list bitmaps are inconsistent";
+	else if (!pError && nListedBlocks != nFreeBlocks)
+		pError = "free block is missing from the free lists";
+
+	m_Lock.Release();
+
+	if (pError)
+	{
+		LOGERR("Heap check failed: %s", pError);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,183 @@
+//
+// fluidsynthdsp.c
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// FluidSynth's reverb, voice interpolation and voice filter behind the interface in fluidsynthdsp.h. Built as
+// is, this gives the target_ functions; built with FLUIDSYNTHDSP_SCALAR, it gives the scalar_ ones. FluidSynth's
+// own functions are renamed with the same prefix, so that both builds can be linked into one test.
+
+#ifdef FLUIDSYNTHDSP_SCALAR
+#define FDN_NO_NEON
+#define DSP_NO_NEON
+#define IIR_NO_NEON
+#define FLUIDSYNTHDSP(NAME) scalar_##NAME
+#else
+#define FLUIDSYNTHDSP(NAME) target_##NAME
+#endif
+
+#define new_fluid_revmodel			FLUIDSYNTHDSP(new_fluid_revmodel)
+#define delete_fluid_revmodel			FLUIDSYNTHDSP(delete_fluid_revmodel)
+#define fluid_revmodel_processmix		FLUIDSYNTHDSP(fluid_revmodel_processmix)
+#define fluid_revmodel_processreplace		FLUIDSYNTHDSP(fluid_revmodel_processreplace)
+#define fluid_revmodel_reset			FLUIDSYNTHDSP(fluid_revmodel_reset)
+#define fluid_revmodel_set			FLUIDSYNTHDSP(fluid_revmodel_set)
+#define fluid_revmodel_samplerate_change	FLUIDSYNTHDSP(fluid_revmodel_samplerate_change)
+#define fluid_rvoice_dsp_interpolate_none	FLUIDSYNTHDSP(fluid_rvoice_dsp_interpolate_none)
+#define fluid_rvoice_dsp_interpolate_linear	FLUIDSYNTHDSP(fluid_rvoice_dsp_interpolate_linear)
+#define fluid_rvoice_dsp_interpolate_4th_order	FLUIDSYNTHDSP(fluid_rvoice_dsp_interpolate_4th_order)
+#define fluid_rvoice_dsp_interpolate_7th_order	FLUIDSYNTHDSP(fluid_rvoice_dsp_interpolate_7th_order)
+#define fluid_iir_filter_apply			FLUIDSYNTHDSP(fluid_iir_filter_apply)
+#define fluid_iir_filter_init			FLUIDSYNTHDSP(fluid_iir_filter_init)
+#define fluid_iir_filter_reset			FLUIDSYNTHDSP(fluid_iir_filter_reset)
+#define fluid_iir_filter_set_fres		FLUIDSYNTHDSP(fluid_iir_filter_set_fres)
+#define fluid_iir_filter_set_q			FLUIDSYNTHDSP(fluid_iir_filter_set_q)
+#define fluid_iir_filter_calc			FLUIDSYNTHDSP(fluid_iir_filter_calc)
+
+#include "rvoice/fluid_rev.c"
+#include "rvoice/fluid_rvoice_dsp.c"
+#include "rvoice/fluid_iir_filter.c"
+
+#include "fluidsynthdsp.h"
+
+#if defined(FDN_NEON) && defined(DSP_NEON) && defined(IIR_NEON)
+#ifdef NEON_EMULATION
+#define NEON_SUFFIX ", emulated"
+#else
+#define NEON_SUFFIX ""
+#endif
+#ifdef __aarch64__
+const char FLUIDSYNTHDSP(variant)[] = "NEON (AArch64" NEON_SUFFIX ")";
+#else
+const char FLUIDSYNTHDSP(variant)[] = "NEON (ARMv7" NEON_SUFFIX ")";
+#endif
+const int FLUIDSYNTHDSP(vectorised) = 1;
+#else
+const char FLUIDSYNTHDSP(variant)[] = "scalar";
+const int FLUIDSYNTHDSP(vectorised) = 0;
+#endif
+
+_Static_assert(FLUIDSYNTHDSP_BLOCK_SIZE == FLUID_BUFSIZE, "Block size must match FluidSynth's");
+_Static_assert(sizeof(fluid_real_t) == sizeof(float), "FluidSynth must be built with enable-floats");
+
+typedef struct
+{
+	fluid_sample_t sample;
+	fluid_rvoice_dsp_t dsp;
+} voice_t;
+
+void* FLUIDSYNTHDSP(new_reverb)(float sample_rate)
+{
+	fluid_revmodel_t* rev = new_fluid_revmodel(sample_rate, sample_rate);
+
+	if (rev != NULL)
+		fluid_revmodel_set(rev, FLUID_REVMODEL_SET_ALL, 0.8f, 0.3f, 0.9f, 1.0f);
+
+	return rev;
+}
+
+void FLUIDSYNTHDSP(reverb_process)(void* reverb, const float* in, float* left, float* right, int mix)
+{
+	if (mix)
+		fluid_revmodel_processmix(reverb, in, left, right);
+	else
+		fluid_revmodel_processreplace(reverb, in, left, right);
+}
+
+void FLUIDSYNTHDSP(delete_reverb)(void* reverb)
+{
+	delete_fluid_revmodel(reverb);
+}
+
+void* FLUIDSYNTHDSP(new_voice)(const short* data, const char* data24, int length, int loop_start, int loop_end,
+					    float amp, float amp_incr, float phase_incr)
+{
+	voice_t* voice = calloc(1, sizeof(voice_t));
+
+	if (voice == NULL)
+		return NULL;
+
+	voice->sample.data = (short*)data;
+	voice->sample.data24 = (char*)data24;
+
+	voice->dsp.sample = &voice->sample;
+	voice->dsp.start = 0;
+	voice->dsp.end = length - 1;
+	voice->dsp.loopstart = loop_start;
+	voice->dsp.loopend = loop_end;
+	voice->dsp.amp = amp;
+	voice->dsp.amp_incr = amp_incr;
+	voice->dsp.phase_incr = phase_incr;
+	fluid_phase_set_int(voice->dsp.phase, voice->dsp.start);
+
+	return voice;
+}
+
+int FLUIDSYNTHDSP(voice_interpolate)(void* voice, int order, float* buf, int looping)
+{
+	fluid_rvoice_dsp_t* dsp = &((voice_t*)voice)->dsp;
+
+	return order == 7 ? fluid_rvoice_dsp_interpolate_7th_order(dsp, buf, looping)
+	                  : fluid_rvoice_dsp_interpolate_4th_order(dsp, buf, looping);
+}
+
+void FLUIDSYNTHDSP(voice_get_state)(const void* voice, fluidsynthdsp_voice_state_t* state)
+{
+	const fluid_rvoice_dsp_t* dsp = &((const voice_t*)voice)->dsp;
+
+	state->phase = dsp->phase;
+	state->amp = dsp->amp;
+	state->has_looped = dsp->has_looped;
+}
+
+void FLUIDSYNTHDSP(delete_voice)(void* voice)
+{
+	free(voice);
+}
+
+void* FLUIDSYNTHDSP(new_filter)(float fres, float q, float sample_rate)
+{
+	fluid_iir_filter_t* filter = calloc(1, sizeof(fluid_iir_filter_t));
+
+	if (filter == NULL)
+		return NULL;
+
+	filter->type = FLUID_IIR_LOWPASS;
+	fluid_iir_filter_reset(filter);
+	filter->fres = fres;
+	filter->q_lin = q;
+	filter->filter_gain = 1.0f / q;
+
+	// filter_startup sets the coefficients directly, then they are constant
+	filter->filter_startup = 1;
+	fluid_iir_filter_calc(filter, sample_rate, 0.0f);
+
+	return filter;
+}
+
+void FLUIDSYNTHDSP(filter_apply)(void* filter, float* buf, int count)
+{
+	fluid_iir_filter_apply(filter, buf, count);
+}
+
+void FLUIDSYNTHDSP(delete_filter)(void* filter)
+{
+	free(filter);
+}
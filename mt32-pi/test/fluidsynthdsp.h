@@ -0,0 +1,72 @@
+//
+// fluidsynthdsp.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// C interface to FluidSynth's reverb, voice interpolation and voice filter, for fluidsynthdsptest.cpp.
+// fluidsynthdsp.c is built twice into the same test: its target_ functions are FluidSynth as built for the
+// target, which uses NEON where the compiler targets it, and its scalar_ functions always use the scalar code.
+
+#ifndef _fluidsynthdsp_h
+#define _fluidsynthdsp_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// FLUID_BUFSIZE; the interpolation always renders whole blocks
+#define FLUIDSYNTHDSP_BLOCK_SIZE 64
+
+typedef struct
+{
+	unsigned long long phase;
+	float amp;
+	int has_looped;
+} fluidsynthdsp_voice_state_t;
+
+#define FLUIDSYNTHDSP_DECLARE(PREFIX)										\
+	/* How the code was built, and whether all three use their NEON paths */				\
+	extern const char PREFIX##variant[];									\
+	extern const int PREFIX##vectorised;									\
+														\
+	void* PREFIX##new_reverb(float sample_rate);								\
+	void PREFIX##reverb_process(void* reverb, const float* in, float* left, float* right, int mix);		\
+	void PREFIX##delete_reverb(void* reverb);								\
+														\
+	/* The loop end is the first frame after the loop; order is 4 or 7 */					\
+	void* PREFIX##new_voice(const short* data, const char* data24, int length, int loop_start, int loop_end,	\
+				float amp, float amp_incr, float phase_incr);					\
+	int PREFIX##voice_interpolate(void* voice, int order, float* buf, int looping);				\
+	void PREFIX##voice_get_state(const void* voice, fluidsynthdsp_voice_state_t* state);			\
+	void PREFIX##delete_voice(void* voice);									\
+														\
+	/* A constant low-pass filter; fres is in cents */							\
+	void* PREFIX##new_filter(float fres, float q, float sample_rate);					\
+	void PREFIX##filter_apply(void* filter, float* buf, int count);						\
+	void PREFIX##delete_filter(void* filter);
+
+FLUIDSYNTHDSP_DECLARE(target_)
+FLUIDSYNTHDSP_DECLARE(scalar_)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
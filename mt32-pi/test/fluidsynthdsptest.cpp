@@ -0,0 +1,269 @@
+//
+// fluidsynthdsptest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Checks that FluidSynth's NEON reverb, voice interpolation and voice filter give the same output as their
+// scalar code, within the rounding errors of the vector code. When FluidSynth isn't built with NEON for this
+// machine, both would be the same scalar code, so the test is skipped.
+
+#include <initializer_list>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fluidsynthdsp.h"
+#include "hosttest.h"
+
+extern "C"
+{
+	// Replacements for fluid_sys.c functions, as in soundfontsynth.cpp
+	void* fluid_alloc(size_t len) { return malloc(len); }
+	void* fluid_realloc(void* ptr, size_t len) { return realloc(ptr, len); }
+	void fluid_free(void* ptr) { free(ptr); }
+	double fluid_utime() { return 0.0; }
+}
+
+constexpr size_t BlockSize = FLUIDSYNTHDSP_BLOCK_SIZE;
+
+constexpr float ReverbSampleRate = 44100.0f;
+constexpr size_t ReverbBlocks = 10000;
+
+// Largest difference allowed, relative to the peak output (-120 dB); only the order in which the delay lines
+// are summed differs
+constexpr float ReverbTolerance = 1e-6f;
+
+constexpr int SampleLength = 4000;
+constexpr size_t MaxVoiceBlocks = 400;
+
+// As above (-108 dB); the rounding errors of the filter add up over its history
+constexpr float VoiceTolerance = 4e-6f;
+
+// The largest difference from the scalar output, and the scalar output's peak
+struct TDifference
+{
+	float nMax = 0.0f;
+	float nPeak = 0.0f;
+
+	void Add(const float* pOutput, const float* pScalarOutput, size_t nCount)
+	{
+		for (size_t i = 0; i < nCount; ++i)
+		{
+			nPeak = fmaxf(nPeak, fabsf(pScalarOutput[i]));
+			nMax = fmaxf(nMax, fabsf(pOutput[i] - pScalarOutput[i]));
+		}
+	}
+};
+
+static float ReverbInput[ReverbBlocks][BlockSize];
+static float ReverbOutput[2][2][ReverbBlocks][BlockSize];
+
+// Bursts of noise, each followed by silence to let the reverb tail decay
+static void MakeReverbInput()
+{
+	unsigned int nSeed = 1;
+	for (size_t i = 0; i < ReverbBlocks; ++i)
+		for (size_t k = 0; k < BlockSize; ++k)
+		{
+			nSeed = nSeed * 1103515245 + 12345;
+			ReverbInput[i][k] = (i % 400 < 20) ? ((nSeed >> 9) / 8388608.0f - 1.0f) * 0.5f : 0.0f;
+		}
+}
+
+// Runs every block through a reverb, alternating between replacing the output and mixing onto silence
+template <class F>
+static void RunReverb(F Process, void* pReverb, float (*pLeft)[BlockSize], float (*pRight)[BlockSize])
+{
+	for (size_t i = 0; i < ReverbBlocks; ++i)
+	{
+		const bool bMix = i & 1;
+		if (bMix)
+		{
+			memset(pLeft[i], 0, sizeof(pLeft[i]));
+			memset(pRight[i], 0, sizeof(pRight[i]));
+		}
+
+		Process(pReverb, ReverbInput[i], pLeft[i], pRight[i], bMix);
+	}
+}
+
+static void TestReverb()
+{
+	void* pReverb = target_new_reverb(ReverbSampleRate);
+	void* pScalarReverb = scalar_new_reverb(ReverbSampleRate);
+	CHECK(pReverb && pScalarReverb);
+	if (!pReverb || !pScalarReverb)
+		return;
+
+	RunReverb(target_reverb_process, pReverb, ReverbOutput[0][0], ReverbOutput[0][1]);
+	RunReverb(scalar_reverb_process, pScalarReverb, ReverbOutput[1][0], ReverbOutput[1][1]);
+
+	TDifference Difference;
+	Difference.Add(&ReverbOutput[0][0][0][0], &ReverbOutput[1][0][0][0], ReverbBlocks * BlockSize);
+	Difference.Add(&ReverbOutput[0][1][0][0], &ReverbOutput[1][1][0][0], ReverbBlocks * BlockSize);
+
+	CHECK(Difference.nPeak > 0.1f);
+	CHECK(Difference.nMax <= Difference.nPeak * ReverbTolerance);
+
+	target_delete_reverb(pReverb);
+	scalar_delete_reverb(pScalarReverb);
+}
+
+static short SampleData[SampleLength];
+static char SampleData24[SampleLength];
+
+// A decaying sine with noise
+static void MakeSample()
+{
+	unsigned int nSeed = 1;
+	for (int i = 0; i < SampleLength; ++i)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		SampleData[i] = static_cast<short>(20000.0 * sin(i * 0.05) * exp(-i / 2000.0) + static_cast<int>(nSeed >> 20) - 2048);
+		SampleData24[i] = static_cast<char>(nSeed >> 8);
+	}
+}
+
+// Plays the sample with both interpolations, which must go through the same phases and amplitudes, and fill
+// the same number of frames
+static void TestInterpolation(TDifference& Difference, int nOrder, bool b24Bit, bool bLooping, float nPhaseIncrement)
+{
+	const char* pData24 = b24Bit ? SampleData24 : nullptr;
+	const float nAmp = 1.0f / 8388608.0f;
+	void* pVoice = target_new_voice(SampleData, pData24, SampleLength, 1000, 3001, nAmp, nAmp * -1e-4f, nPhaseIncrement);
+	void* pScalarVoice = scalar_new_voice(SampleData, pData24, SampleLength, 1000, 3001, nAmp, nAmp * -1e-4f, nPhaseIncrement);
+	float Output[BlockSize], ScalarOutput[BlockSize];
+	fluidsynthdsp_voice_state_t State, ScalarState;
+	size_t i;
+
+	for (i = 0; i < MaxVoiceBlocks; ++i)
+	{
+		const int nCount = target_voice_interpolate(pVoice, nOrder, Output, bLooping);
+		const int nScalarCount = scalar_voice_interpolate(pScalarVoice, nOrder, ScalarOutput, bLooping);
+		target_voice_get_state(pVoice, &State);
+		scalar_voice_get_state(pScalarVoice, &ScalarState);
+
+		CHECK(nCount == nScalarCount);
+		CHECK(State.phase == ScalarState.phase);
+		CHECK(State.amp == ScalarState.amp);
+		CHECK(State.has_looped == ScalarState.has_looped);
+
+		Difference.Add(Output, ScalarOutput, nScalarCount);
+
+		if (nScalarCount < static_cast<int>(BlockSize))
+			break;
+	}
+
+	// Unlooped samples must have been played to their end, looped ones must have looped
+	CHECK(bLooping ? State.has_looped : i < MaxVoiceBlocks);
+
+	target_delete_voice(pVoice);
+	scalar_delete_voice(pScalarVoice);
+}
+
+// fres is in cents
+static void TestFilter(TDifference& Difference, float nFres, float nQ)
+{
+	void* pFilter = target_new_filter(nFres, nQ, 44100.0f);
+	void* pScalarFilter = scalar_new_filter(nFres, nQ, 44100.0f);
+	float Buffer[BlockSize], ScalarBuffer[BlockSize];
+
+	for (size_t i = 0; i < MaxVoiceBlocks; ++i)
+	{
+		// An odd count on the last block to exercise the scalar remainder
+		const size_t nCount = (i == MaxVoiceBlocks - 1) ? BlockSize - 3 : BlockSize;
+
+		for (size_t k = 0; k < nCount; ++k)
+			Buffer[k] = SampleData[(i * BlockSize + k) % SampleLength] / 32768.0f;
+
+		memcpy(ScalarBuffer, Buffer, sizeof(Buffer));
+		target_filter_apply(pFilter, Buffer, nCount);
+		scalar_filter_apply(pScalarFilter, ScalarBuffer, nCount);
+
+		Difference.Add(Buffer, ScalarBuffer, nCount);
+	}
+
+	target_delete_filter(pFilter);
+	scalar_delete_filter(pScalarFilter);
+}
+
+static void TestVoice()
+{
+	const float PhaseIncrements[] = { 0.37f, 1.0f, 2.91f };
+	TDifference Difference;
+
+	MakeSample();
+
+	for (bool b24Bit : { false, true })
+		for (bool bLooping : { false, true })
+			for (float nPhaseIncrement : PhaseIncrements)
+			{
+				TestInterpolation(Difference, 4, b24Bit, bLooping, nPhaseIncrement);
+				TestInterpolation(Difference, 7, b24Bit, bLooping, nPhaseIncrement);
+			}
+
+	// About 3 kHz, without and with resonance
+	TestFilter(Difference, 10200.0f, 1.0f);
+	TestFilter(Difference, 10200.0f, 10.0f);
+
+	CHECK(Difference.nPeak > 0.1f);
+	CHECK(Difference.nMax <= Difference.nPeak * VoiceTolerance);
+}
+
+static void Benchmark()
+{
+	void* pReverb = target_new_reverb(ReverbSampleRate);
+	void* pScalarReverb = scalar_new_reverb(ReverbSampleRate);
+
+	const double nTime = HostTest::TimePerCall([&] { RunReverb(target_reverb_process, pReverb, ReverbOutput[0][0], ReverbOutput[0][1]); });
+	const double nScalarTime = HostTest::TimePerCall([&] { RunReverb(scalar_reverb_process, pScalarReverb, ReverbOutput[1][0], ReverbOutput[1][1]); });
+
+	printf("fluidsynthdsp [%s]: reverb %.1f ns/frame, scalar reverb %.1f ns/frame\n", target_variant,
+		nTime / (ReverbBlocks * BlockSize), nScalarTime / (ReverbBlocks * BlockSize));
+
+	target_delete_reverb(pReverb);
+	scalar_delete_reverb(pScalarReverb);
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	char Name[64];
+	snprintf(Name, sizeof(Name), "fluidsynthdsp [%s]", target_variant);
+
+	if (!target_vectorised)
+	{
+		printf("%s: skipped, FluidSynth isn't built with NEON for this machine\n", Name);
+		return 0;
+	}
+
+	MakeReverbInput();
+
+	if (HostTest::WantBenchmark(nArgs, pArgs))
+	{
+		Benchmark();
+		return 0;
+	}
+
+	TestReverb();
+	TestVoice();
+
+	return HostTest::Result(Name);
+}
@@ -0,0 +1,99 @@
+//
+// hosttest.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Minimal checking and timing helpers shared by the host tests
+
+#ifndef _hosttest_h
+#define _hosttest_h
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace HostTest
+{
+	inline unsigned int& Failures()
+	{
+		static unsigned int nFailures = 0;
+		return nFailures;
+	}
+
+	inline void Fail(const char* pFile, int nLine, const char* pExpression)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", pFile, nLine, pExpression);
+		++Failures();
+	}
+
+	// Exit status for main(); non-zero if any check failed
+	inline int Result(const char* pName)
+	{
+		if (Failures())
+			fprintf(stderr, "%s: %u check(s) failed\n", pName, Failures());
+		else
+			printf("%s: all checks passed\n", pName);
+
+		return Failures() ? 1 : 0;
+	}
+
+	// Whether the test was asked to run its benchmarks instead of (or as well as) its checks
+	inline bool WantBenchmark(int nArgs, char* pArgs[])
+	{
+		for (int i = 1; i < nArgs; ++i)
+			if (strcmp(pArgs[i], "--bench") == 0)
+				return true;
+
+		return false;
+	}
+
+	inline double NowNanos()
+	{
+		timespec Time;
+		clock_gettime(CLOCK_MONOTONIC, &Time);
+		return Time.tv_sec * 1e9 + Time.tv_nsec;
+	}
+
+	// Runs a function repeatedly for at least nMinNanos and returns the mean time per call in nanoseconds
+	template <class F>
+	double TimePerCall(F Function, double nMinNanos = 2e8)
+	{
+		// Warm up caches and branch predictors
+		Function();
+
+		size_t nCalls = 0;
+		const double nStart = NowNanos();
+		double nElapsed;
+		do
+		{
+			for (size_t i = 0; i < 16; ++i)
+				Function();
+			nCalls += 16;
+			nElapsed = NowNanos() - nStart;
+		} while (nElapsed < nMinNanos);
+
+		return nElapsed / nCalls;
+	}
+}
+
+#define CHECK(EXPRESSION) \
+	do { if (!(EXPRESSION)) HostTest::Fail(__FILE__, __LINE__, #EXPRESSION); } while (0)
+
+#endif
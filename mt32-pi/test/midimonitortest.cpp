@@ -0,0 +1,356 @@
+//
+// midimonitortest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/timer.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "hosttest.h"
+#include "midimonitor.h"
+
+constexpr size_t ChannelCount = 16;
+constexpr size_t NoteCount = 128;
+constexpr u16 PercussionMask = 1 << 9;
+
+// Straightforward model of the meters which scans every note on every channel, as CMIDIMonitor used to
+class CReferenceMonitor
+{
+public:
+	CReferenceMonitor()
+	{
+		for (auto& Channel : m_Channels)
+		{
+			Channel.nVolume = 100;
+			Channel.nExpression = 127;
+			Channel.bDamper = false;
+			for (auto& Note : Channel.Notes)
+				Note = TNote{TPhase::Idle, 0, 0, 0.0f, false};
+		}
+	}
+
+	void NoteOn(size_t nChannel, u8 nNote, u8 nVelocity, unsigned int nTicks)
+	{
+		TNote& Note = m_Channels[nChannel].Notes[nNote];
+		Note = TNote{TPhase::On, nTicks, 0, nVelocity / 127.0f, false};
+	}
+
+	void NoteOff(size_t nChannel, u8 nNote, unsigned int nTicks)
+	{
+		TNote& Note = m_Channels[nChannel].Notes[nNote];
+		if (Note.Phase != TPhase::On)
+			return;
+
+		if (m_Channels[nChannel].bDamper)
+			Note.bHeld = true;
+		else
+		{
+			Note.Phase = TPhase::Off;
+			Note.nOffTime = nTicks;
+		}
+	}
+
+	void Damper(size_t nChannel, bool bDown, unsigned int nTicks)
+	{
+		TChannel& Channel = m_Channels[nChannel];
+		Channel.bDamper = bDown;
+		if (bDown)
+			return;
+
+		for (size_t i = 0; i < NoteCount; ++i)
+		{
+			if (Channel.Notes[i].bHeld)
+			{
+				Channel.Notes[i].bHeld = false;
+				NoteOff(nChannel, i, nTicks);
+			}
+		}
+	}
+
+	void AllNotesOff(unsigned int nTicks)
+	{
+		for (auto& Channel : m_Channels)
+		{
+			for (auto& Note : Channel.Notes)
+			{
+				Note.bHeld = false;
+				if (Note.Phase == TPhase::On)
+				{
+					Note.Phase = TPhase::Off;
+					Note.nOffTime = nTicks;
+				}
+			}
+		}
+	}
+
+	void SetVolume(size_t nChannel, u8 nValue) { m_Channels[nChannel].nVolume = nValue; }
+	void SetExpression(size_t nChannel, u8 nValue) { m_Channels[nChannel].nExpression = nValue; }
+
+	float GetLevel(size_t nChannel, unsigned int nTicks) const
+	{
+		const TChannel& Channel = m_Channels[nChannel];
+		float nLevel = 0.0f;
+
+		for (const TNote& Note : Channel.Notes)
+		{
+			if (Note.Phase == TPhase::Idle)
+				continue;
+
+			float nEnvelope = 0.0f;
+			if (PercussionMask & (1 << nChannel))
+			{
+				const unsigned int nAge = nTicks - Note.nOnTime;
+				if (nAge <= 150000)
+					nEnvelope = 1.0f - nAge * (1.0f / 150000);
+			}
+			else if (Note.Phase == TPhase::On)
+				nEnvelope = Gate(nTicks - Note.nOnTime);
+			else if (nTicks - Note.nOffTime <= 150000)
+				nEnvelope = Gate(Note.nOffTime - Note.nOnTime) - (nTicks - Note.nOffTime) * (1.0f / 150000);
+
+			nLevel = fmaxf(nLevel, nEnvelope * Note.nVelocity);
+		}
+
+		nLevel *= Channel.nVolume * Channel.nExpression * (1.0f / (127.0f * 127.0f));
+		return fminf(fmaxf(nLevel, 0.0f), 1.0f);
+	}
+
+private:
+	enum class TPhase { Idle, On, Off };
+
+	struct TNote
+	{
+		TPhase Phase;
+		unsigned int nOnTime;
+		unsigned int nOffTime;
+		float nVelocity;
+		bool bHeld;
+	};
+
+	struct TChannel
+	{
+		u8 nVolume;
+		u8 nExpression;
+		bool bDamper;
+		TNote Notes[NoteCount];
+	};
+
+	// 20 ms attack, 100 ms decay to 0.8 sustain
+	static float Gate(unsigned int nTicks)
+	{
+		if (nTicks < 20000)
+			return nTicks * (1.0f / 20000);
+		if (nTicks < 120000)
+			return 1.0f - (nTicks - 20000) * ((1.0f - 0.8f) / 100000);
+		return 0.8f;
+	}
+
+	TChannel m_Channels[ChannelCount];
+};
+
+static unsigned int s_nTicks;
+
+static u32 Random()
+{
+	static u32 nState = 0x12345678;
+	nState ^= nState << 13;
+	nState ^= nState >> 17;
+	nState ^= nState << 5;
+	return nState;
+}
+
+static void TestEnvelope()
+{
+	CMIDIMonitor Monitor;
+	float Levels[ChannelCount], Peaks[ChannelCount];
+	const float nGain = 100 * 127 / (127.0f * 127.0f);
+
+	s_nTicks = 1000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	for (size_t i = 0; i < ChannelCount; ++i)
+		CHECK(Levels[i] == 0.0f && Peaks[i] == 0.0f);
+
+	// Full velocity note on the highest note number (last bit of the active note set)
+	Monitor.OnShortMessage(0x90 | 127 << 8 | 127 << 16);
+	s_nTicks += 10000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(fabsf(Levels[0] - 0.5f * nGain) < 1e-4f);
+
+	// Sustain
+	s_nTicks += 490000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(fabsf(Levels[0] - 0.8f * nGain) < 1e-4f);
+	CHECK(fabsf(Peaks[0] - 0.8f * nGain) < 1e-4f);
+
+	// Damper holds the note through a note off
+	Monitor.OnShortMessage(0xB0 | 0x40 << 8 | 127 << 16);
+	Monitor.OnShortMessage(0x80 | 127 << 8);
+	s_nTicks += 300000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(fabsf(Levels[0] - 0.8f * nGain) < 1e-4f);
+
+	// Releasing the pedal starts the release
+	Monitor.OnShortMessage(0xB0 | 0x40 << 8);
+	s_nTicks += 75000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(fabsf(Levels[0] - 0.3f * nGain) < 1e-4f);
+
+	s_nTicks += 100000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(Levels[0] == 0.0f);
+
+	// Percussion decays without a note off
+	Monitor.OnShortMessage(0x99 | 36 << 8 | 127 << 16);
+	s_nTicks += 75000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(fabsf(Levels[9] - 0.5f * nGain) < 1e-4f);
+
+	s_nTicks += 100000;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(Levels[9] == 0.0f);
+
+	// All Notes Off releases everything
+	for (u8 nNote = 0; nNote < NoteCount; ++nNote)
+		Monitor.OnShortMessage(0x93 | nNote << 8 | 100 << 16);
+	s_nTicks += 200000;
+	Monitor.OnShortMessage(0xB3 | 0x7B << 8);
+	s_nTicks += 150001;
+	Monitor.GetChannelLevels(s_nTicks, Levels, Peaks);
+	CHECK(Levels[3] == 0.0f);
+}
+
+// Plays a random stream of MIDI events into both monitors and compares levels at every frame
+static void TestAgainstReference()
+{
+	CMIDIMonitor Monitor;
+	CReferenceMonitor Reference;
+	float Levels[ChannelCount], Peaks[ChannelCount];
+
+	s_nTicks = 5000;
+	for (size_t nFrame = 0; nFrame < 20000; ++nFrame)
+	{
+		const size_t nEvents = Random() % 8;
+		for (size_t i = 0; i < nEvents; ++i)
+		{
+			const u8 nChannel = Random() % ChannelCount;
+			const u8 nNote = Random() % NoteCount;
+			const u32 nType = Random() % 100;
+
+			if (nType < 45)
+			{
+				const u8 nVelocity = 1 + Random() % 127;
+				Monitor.OnShortMessage(0x90 | nChannel | nNote << 8 | nVelocity << 16);
+				Reference.NoteOn(nChannel, nNote, nVelocity, s_nTicks);
+			}
+			else if (nType < 85)
+			{
+				// Note off, sometimes as a zero velocity note on
+				Monitor.OnShortMessage((nType & 1 ? 0x80 : 0x90) | nChannel | nNote << 8);
+				Reference.NoteOff(nChannel, nNote, s_nTicks);
+			}
+			else if (nType < 92)
+			{
+				const bool bDown = Random() % 2;
+				Monitor.OnShortMessage(0xB0 | nChannel | 0x40 << 8 | (bDown ? 127 : 0) << 16);
+				Reference.Damper(nChannel, bDown, s_nTicks);
+			}
+			else if (nType < 96)
+			{
+				const u8 nValue = Random() % 128;
+				Monitor.OnShortMessage(0xB0 | nChannel | 0x07 << 8 | nValue << 16);
+				Reference.SetVolume(nChannel, nValue);
+			}
+			else if (nType < 99)
+			{
+				const u8 nValue = Random() % 128;
+				Monitor.OnShortMessage(0xB0 | nChannel | 0x0B << 8 | nValue << 16);
+				Reference.SetExpression(nChannel, nValue);
+			}
+			else if (Random() % 8 == 0)
+			{
+				Monitor.OnShortMessage(0xB0 | nChannel | 0x7B << 8);
+				Reference.AllNotesOff(s_nTicks);
+			}
+		}
+
+		// Display frames arrive every few milliseconds
+		s_nTicks += 1000 + Random() % 20000;
+		Monitor.GetChannelLevels(s_nTicks, Levels, Peaks, PercussionMask);
+
+		for (size_t nChannel = 0; nChannel < ChannelCount; ++nChannel)
+		{
+			const float nExpected = Reference.GetLevel(nChannel, s_nTicks);
+			if (fabsf(Levels[nChannel] - nExpected) > 1e-5f)
+			{
+				fprintf(stderr, "frame %zu channel %zu: level %f, expected %f\n", nFrame, nChannel, Levels[nChannel], nExpected);
+				CHECK(fabsf(Levels[nChannel] - nExpected) <= 1e-5f);
+				return;
+			}
+		}
+	}
+}
+
+static void Benchmark()
+{
+	const size_t NoteCounts[] = { 0, 32, 256 };
+
+	for (size_t nSounding : NoteCounts)
+	{
+		CMIDIMonitor Monitor;
+		CReferenceMonitor Reference;
+		float Levels[ChannelCount], Peaks[ChannelCount];
+
+		// Spread the notes over the melodic channels; they stay in the sustain phase
+		s_nTicks = 1000;
+		for (size_t i = 0; i < nSounding; ++i)
+		{
+			const u8 nChannel = i % 15 < 9 ? i % 15 : i % 15 + 1;
+			const u8 nNote = 24 + (i / 15) * 5 % 96;
+			Monitor.OnShortMessage(0x90 | nChannel | nNote << 8 | 100 << 16);
+			Reference.NoteOn(nChannel, nNote, 100, s_nTicks);
+		}
+		s_nTicks += 1000000;
+
+		const double nMonitor = HostTest::TimePerCall([&] { Monitor.GetChannelLevels(s_nTicks, Levels, Peaks); });
+		const double nFullScan = HostTest::TimePerCall([&] {
+			for (size_t nChannel = 0; nChannel < ChannelCount; ++nChannel)
+				Levels[nChannel] = Reference.GetLevel(nChannel, s_nTicks);
+		});
+
+		printf("%3zu sounding notes: %8.1f ns/frame (scanning every note: %8.1f ns/frame)\n", nSounding, nMonitor, nFullScan);
+	}
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	CTimer::ClockOverride() = &s_nTicks;
+
+	if (HostTest::WantBenchmark(nArgs, pArgs))
+	{
+		Benchmark();
+		return 0;
+	}
+
+	TestEnvelope();
+	TestAgainstReference();
+
+	return HostTest::Result("midimonitor");
+}
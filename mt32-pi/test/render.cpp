@@ -0,0 +1,550 @@
+//
+// render.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Plays a Standard MIDI File through the synth engines the way the firmware does: the file's messages go
+// through CMIDIParser into HandleMIDIShortMessage()/HandleMIDISysExMessage() as they fall due, and the
+// output is produced block by block by Render(), as the audio task would. Time is simulated, so the output
+// doesn't depend on the speed of the host; only the time spent in Render() is measured.
+//
+//   render [-c <config>] [-b <frames>] [-m <MB>] [-o <output.wav>] <MIDI file> <SoundFont | ROM directory>
+//
+//   -c   mt32-pi.cfg to take the synth and audio settings from; the defaults are used otherwise
+//   -b   frames per block; by default half the configured chunk size, which is what the audio task
+//        renders as each DMA chunk is played
+//   -m   size of the zone allocator's heap in megabytes (default 512)
+//   -o   16-bit WAV file to write the output to
+//
+// The SoundFont or ROMs are made to appear on the SD card, along with the config file and any effects
+// profile next to the SoundFont. Rendering is on one core: the mixer worker is disabled, and load tasks
+// are run to completion before each block, as if the card were infinitely fast.
+
+#include <circle/memory.h>
+#include <circle/sched/scheduler.h>
+#include <circle/timer.h>
+#include <fatfs/ff.h>
+
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "deferredlog.h"
+#include "hosttest.h"
+#include "midiparser.h"
+#include "synth/mt32synth.h"
+#include "synth/soundfontsynth.h"
+#include "zoneallocator.h"
+
+// Circle reserves this much of the heap for malloc() ahead of the zone allocator
+constexpr size_t MallocHeapMegabytes = 32;
+constexpr size_t DefaultZoneHeapMegabytes = 512;
+
+// Rendering carries on after the last message until the synth falls silent, up to this long
+constexpr unsigned int MaxTailSeconds = 10;
+
+// How often the zone allocator's usage is sampled, in seconds of audio
+constexpr unsigned int HeapSamplePeriodSeconds = 1;
+
+struct TMIDIEvent
+{
+	u64 nTick;
+	u64 nMicros;
+	u32 nTempo;
+	std::vector<u8> Data;
+};
+
+class CSynthMIDIParser : public CMIDIParser
+{
+public:
+	CSynthMIDIParser(CSynthBase& Synth) : m_Synth(Synth) {}
+
+protected:
+	virtual void OnShortMessage(u32 nMessage) override { m_Synth.HandleMIDIShortMessage(nMessage); }
+	virtual void OnSysExMessage(const u8* pData, size_t nSize) override { m_Synth.HandleMIDISysExMessage(pData, nSize); }
+
+private:
+	CSynthBase& m_Synth;
+};
+
+static u32 ReadBigEndian(const u8* pData, size_t nSize)
+{
+	u32 nValue = 0;
+	for (size_t i = 0; i < nSize; ++i)
+		nValue = nValue << 8 | pData[i];
+	return nValue;
+}
+
+static bool ReadVariableLength(const u8*& pData, const u8* pEnd, u32& nValue)
+{
+	nValue = 0;
+	for (size_t i = 0; i < 4 && pData < pEnd; ++i)
+	{
+		const u8 nByte = *pData++;
+		nValue = nValue << 7 | (nByte & 0x7F);
+		if (!(nByte & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+static bool ParseTrack(const u8* pData, const u8* pEnd, std::vector<TMIDIEvent>& Events)
+{
+	u64 nTick = 0;
+	u8 nRunningStatus = 0;
+
+	while (pData < pEnd)
+	{
+		u32 nDelta;
+		if (!ReadVariableLength(pData, pEnd, nDelta) || pData >= pEnd)
+			return false;
+
+		nTick += nDelta;
+		TMIDIEvent Event{nTick, 0, 0, {}};
+		const u8 nStatus = *pData;
+
+		// Meta event; only tempo changes matter
+		if (nStatus == 0xFF)
+		{
+			u32 nLength;
+			if (pEnd - pData < 2)
+				return false;
+
+			const u8 nType = pData[1];
+			pData += 2;
+			if (!ReadVariableLength(pData, pEnd, nLength) || static_cast<size_t>(pEnd - pData) < nLength)
+				return false;
+
+			if (nType == 0x2F)
+				return true;
+
+			if (nType == 0x51 && nLength == 3)
+			{
+				Event.nTempo = ReadBigEndian(pData, 3);
+				Events.push_back(Event);
+			}
+
+			pData += nLength;
+			continue;
+		}
+
+		// SysEx, or an escape for arbitrary bytes
+		if (nStatus == 0xF0 || nStatus == 0xF7)
+		{
+			u32 nLength;
+			++pData;
+			if (!ReadVariableLength(pData, pEnd, nLength) || static_cast<size_t>(pEnd - pData) < nLength)
+				return false;
+
+			if (nStatus == 0xF0)
+				Event.Data.push_back(0xF0);
+			Event.Data.insert(Event.Data.end(), pData, pData + nLength);
+			Events.push_back(Event);
+
+			nRunningStatus = 0;
+			pData += nLength;
+			continue;
+		}
+
+		// Channel message, possibly with running status
+		if (nStatus & 0x80)
+		{
+			nRunningStatus = nStatus;
+			++pData;
+		}
+		else if (!nRunningStatus)
+			return false;
+
+		const size_t nDataBytes = (nRunningStatus & 0xE0) == 0xC0 ? 1 : 2;
+		if (static_cast<size_t>(pEnd - pData) < nDataBytes)
+			return false;
+
+		Event.Data.push_back(nRunningStatus);
+		Event.Data.insert(Event.Data.end(), pData, pData + nDataBytes);
+		Events.push_back(Event);
+		pData += nDataBytes;
+	}
+
+	return true;
+}
+
+// Reads all tracks into one list of events in playing order, timed according to the tempo map
+static bool LoadMIDIFile(const char* pPath, std::vector<TMIDIEvent>& Events)
+{
+	FILE* pFile = fopen(pPath, "rb");
+	if (!pFile)
+		return false;
+
+	std::vector<u8> File;
+	u8 Buffer[4096];
+	size_t nRead;
+	while ((nRead = fread(Buffer, 1, sizeof(Buffer), pFile)) > 0)
+		File.insert(File.end(), Buffer, Buffer + nRead);
+	fclose(pFile);
+
+	const u8* pData = File.data();
+	const u8* const pEnd = pData + File.size();
+
+	if (File.size() < 14 || memcmp(pData, "MThd", 4) != 0 || ReadBigEndian(pData + 4, 4) < 6)
+		return false;
+
+	const u16 nDivision = ReadBigEndian(pData + 12, 2);
+	pData += 8 + ReadBigEndian(pData + 4, 4);
+
+	while (pEnd - pData >= 8)
+	{
+		const u32 nChunkSize = ReadBigEndian(pData + 4, 4);
+		if (static_cast<size_t>(pEnd - pData - 8) < nChunkSize)
+			return false;
+
+		if (memcmp(pData, "MTrk", 4) == 0 && !ParseTrack(pData + 8, pData + 8 + nChunkSize, Events))
+			return false;
+
+		pData += 8 + nChunkSize;
+	}
+
+	// Events at the same tick stay in track order
+	std::stable_sort(Events.begin(), Events.end(), [](const TMIDIEvent& A, const TMIDIEvent& B) { return A.nTick < B.nTick; });
+
+	// Microseconds per tick are either fixed (SMPTE timing) or follow the tempo (120 BPM until set)
+	const bool bSMPTE = nDivision & 0x8000;
+	const double nSMPTETickMicros = bSMPTE ? 1e6 / (-static_cast<s8>(nDivision >> 8) * (nDivision & 0xFF)) : 0.0;
+	double nTempoStartMicros = 0.0;
+	u64 nTempoStartTick = 0;
+	u32 nTempo = 500000;
+
+	for (TMIDIEvent& Event : Events)
+	{
+		const u64 nTicks = Event.nTick - nTempoStartTick;
+		const double nMicros = nTempoStartMicros + (bSMPTE ? nTicks * nSMPTETickMicros : static_cast<double>(nTicks) * nTempo / nDivision);
+		Event.nMicros = static_cast<u64>(nMicros);
+
+		if (Event.nTempo)
+		{
+			nTempoStartMicros = nMicros;
+			nTempoStartTick = Event.nTick;
+			nTempo = Event.nTempo;
+		}
+	}
+
+	return true;
+}
+
+// Makes the SoundFont or ROM directory, and the config file, appear on a temporary SD card
+static bool PrepareCard(const char* pCardPath, const char* pSynthPath, const char* pConfigPath, bool& bMT32)
+{
+	char Path[PATH_MAX];
+	std::string CardPath(pCardPath);
+	struct stat Stat;
+
+	if (!realpath(pSynthPath, Path) || stat(Path, &Stat) != 0)
+		return false;
+
+	bMT32 = S_ISDIR(Stat.st_mode);
+	if (bMT32)
+	{
+		if (symlink(Path, (CardPath + "/roms").c_str()) != 0)
+			return false;
+	}
+	else
+	{
+		const std::string SoundFontPath(Path);
+		const std::string DirectoryPath = CardPath + "/soundfonts";
+		const std::string FileName = SoundFontPath.substr(SoundFontPath.rfind('/') + 1);
+
+		if (mkdir(DirectoryPath.c_str(), 0755) != 0 || symlink(Path, (DirectoryPath + "/" + FileName).c_str()) != 0)
+			return false;
+
+		// Effects profile
+		const std::string ProfilePath = SoundFontPath.substr(0, SoundFontPath.rfind('.')) + ".cfg";
+		const std::string ProfileName = ProfilePath.substr(ProfilePath.rfind('/') + 1);
+		if (stat(ProfilePath.c_str(), &Stat) == 0 && symlink(ProfilePath.c_str(), (DirectoryPath + "/" + ProfileName).c_str()) != 0)
+			return false;
+	}
+
+	if (pConfigPath && (!realpath(pConfigPath, Path) || symlink(Path, (CardPath + "/mt32-pi.cfg").c_str()) != 0))
+		return false;
+
+	return true;
+}
+
+static int RemoveFile(const char* pPath, const struct stat* pStat, int nFlag, FTW* pFTW)
+{
+	return remove(pPath);
+}
+
+static void WriteWAVHeader(FILE* pFile, unsigned int nSampleRate, u32 nFrames)
+{
+	const u32 nDataSize = nFrames * 2 * sizeof(s16);
+	const u32 nByteRate = nSampleRate * 2 * sizeof(s16);
+	const u32 Header[] = {
+		0x46464952, 36 + nDataSize,		// "RIFF"
+		0x45564157,				// "WAVE"
+		0x20746D66, 16,				// "fmt "
+		1 | 2 << 16,				// PCM, stereo
+		nSampleRate,
+		nByteRate,
+		2 * sizeof(s16) | 16 << 16,		// Block alignment, bits per sample
+		0x61746164, nDataSize,			// "data"
+	};
+
+	fseek(pFile, 0, SEEK_SET);
+	fwrite(Header, sizeof(Header), 1, pFile);
+}
+
+static int RenderMIDIFile(const char* pMIDIPath, const std::vector<TMIDIEvent>& Events, const char* pSynthPath, bool bMT32, bool bConfig, const char* pOutputPath, size_t nBlockFrames, size_t nHeapMegabytes)
+{
+	CDeferredLog DeferredLog(LogNotice);
+	CConfig Config;
+	if (bConfig && !Config.Initialize("SD:mt32-pi.cfg"))
+		return 1;
+
+	// There's no worker core here; mixer jobs would only be taken back by the rendering core
+	Config.FluidSynthMultiCore = false;
+
+	CMemorySystem::Get()->SetHeapFreeSpace((MallocHeapMegabytes + nHeapMegabytes) * MEGABYTE);
+	CZoneAllocator ZoneAllocator;
+	if (!ZoneAllocator.Initialize())
+		return 1;
+
+	const unsigned int nSampleRate = Config.AudioSampleRate;
+	if (!nBlockFrames)
+		nBlockFrames = Config.AudioChunkSize / 2;
+
+	CSynthBase* pSynth;
+	CSoundFontSynth* pSoundFontSynth = nullptr;
+
+	if (bMT32)
+	{
+		CMT32Synth* const pMT32Synth = new CMT32Synth(nSampleRate, Config.MT32EmuGain, Config.MT32EmuReverbGain, Config.MT32EmuResamplerQuality);
+		pSynth = pMT32Synth;
+		if (!pMT32Synth->Initialize())
+		{
+			fprintf(stderr, "Couldn't open a ROM set from %s\n", pSynthPath);
+			return 1;
+		}
+
+		if (Config.MT32EmuMIDIChannels == CMT32Synth::TMIDIChannels::Alternate)
+			pMT32Synth->SetMIDIChannels(Config.MT32EmuMIDIChannels);
+		pMT32Synth->SetReversedStereo(Config.MT32EmuReversedStereo);
+	}
+	else
+	{
+		pSoundFontSynth = new CSoundFontSynth(nSampleRate);
+		pSynth = pSoundFontSynth;
+		if (!pSoundFontSynth->Initialize())
+		{
+			fprintf(stderr, "Couldn't load %s\n", pSynthPath);
+			return 1;
+		}
+	}
+
+	CZoneAllocator::TStats LoadStats;
+	ZoneAllocator.GetStats(LoadStats);
+
+	FILE* pOutputFile = nullptr;
+	if (pOutputPath)
+	{
+		pOutputFile = fopen(pOutputPath, "wb");
+		if (!pOutputFile)
+		{
+			fprintf(stderr, "Couldn't open %s for writing\n", pOutputPath);
+			return 1;
+		}
+
+		WriteWAVHeader(pOutputFile, nSampleRate, 0);
+	}
+
+	// The synths take message arrival times from the clock
+	unsigned int nClockMicros = 0;
+	CTimer::ClockOverride() = &nClockMicros;
+
+	CSynthMIDIParser Parser(*pSynth);
+	std::vector<float> Buffer(nBlockFrames * 2);
+	std::vector<s16> OutputBuffer(nBlockFrames * 2);
+
+	const u64 nLastEventMicros = Events.empty() ? 0 : Events.back().nMicros;
+	const u64 nHeapSampleFrames = static_cast<u64>(HeapSamplePeriodSeconds) * nSampleRate;
+	size_t nNextEvent = 0;
+	u64 nFrames = 0;
+	u64 nNextHeapSampleFrames = 0;
+	size_t nPeakVoices = 0;
+	size_t nPeakHeapBytes = LoadStats.nUsedBytes;
+	double nRenderNanos = 0.0;
+
+	while (true)
+	{
+		const u64 nBlockEndMicros = (nFrames + nBlockFrames) * 1000000 / nSampleRate;
+
+		// Messages arriving while a block plays are played in the next one
+		while (nNextEvent < Events.size() && Events[nNextEvent].nMicros < nBlockEndMicros)
+		{
+			const TMIDIEvent& Event = Events[nNextEvent++];
+			nClockMicros = static_cast<unsigned int>(Event.nMicros);
+			if (!Event.Data.empty())
+				Parser.ParseMIDIBytes(Event.Data.data(), Event.Data.size());
+		}
+
+		nClockMicros = static_cast<unsigned int>(nBlockEndMicros);
+
+		// What the main loop does in between
+		if (pSoundFontSynth)
+		{
+			pSoundFontSynth->UpdateSoundFontSwitch();
+			pSoundFontSynth->UpdateDynamicSamples();
+		}
+
+		// Until CSoundFontLoadTask has finished reading
+		do
+			CScheduler::Get()->Yield();
+		while (CScheduler::Get()->GetTask("sfload"));
+
+		const double nRenderStart = HostTest::NowNanos();
+		pSynth->Render(Buffer.data(), nBlockFrames);
+		nRenderNanos += HostTest::NowNanos() - nRenderStart;
+
+		nFrames += nBlockFrames;
+		nPeakVoices = Utility::Max(nPeakVoices, pSynth->GetActiveVoiceCount());
+
+		if (nFrames >= nNextHeapSampleFrames)
+		{
+			CZoneAllocator::TStats Stats;
+			ZoneAllocator.GetStats(Stats);
+			nPeakHeapBytes = Utility::Max(nPeakHeapBytes, Stats.nUsedBytes);
+			nNextHeapSampleFrames += nHeapSampleFrames;
+		}
+
+		if (pOutputFile)
+		{
+			for (size_t i = 0; i < nBlockFrames * 2; ++i)
+				OutputBuffer[i] = static_cast<s16>(Utility::Clamp(Buffer[i] * 32768.0f, -32768.0f, 32767.0f));
+			fwrite(OutputBuffer.data(), sizeof(s16), OutputBuffer.size(), pOutputFile);
+		}
+
+		if (nNextEvent == Events.size() && (!pSynth->IsActive() || nBlockEndMicros - nLastEventMicros >= MaxTailSeconds * 1000000ull))
+			break;
+	}
+
+	CTimer::ClockOverride() = nullptr;
+
+	if (pOutputFile)
+	{
+		WriteWAVHeader(pOutputFile, nSampleRate, static_cast<u32>(nFrames));
+		fclose(pOutputFile);
+	}
+
+	CZoneAllocator::TStats EndStats;
+	ZoneAllocator.GetStats(EndStats);
+
+	const double nAudioSeconds = static_cast<double>(nFrames) / nSampleRate;
+	const double nRenderSeconds = nRenderNanos / 1e9;
+
+	printf("%s: %zu events, %u Hz, %zu-frame blocks\n", pMIDIPath, Events.size(), nSampleRate, nBlockFrames);
+	printf("Rendered %.2f s of audio in %.2f s: %.1fx realtime, %.0f ns/frame\n", nAudioSeconds, nRenderSeconds, nAudioSeconds / nRenderSeconds, nRenderNanos / nFrames);
+	printf("Peak active voices: %zu\n", nPeakVoices);
+	printf("Zone allocator: %zu KB in %zu blocks after loading, %zu KB peak; %zu KB in %zu blocks at the end, %zu KB free, largest free block %zu KB\n",
+	       LoadStats.nUsedBytes / 1024, LoadStats.nUsedBlocks, nPeakHeapBytes / 1024, EndStats.nUsedBytes / 1024, EndStats.nUsedBlocks,
+	       EndStats.nFreeBytes / 1024, EndStats.nLargestFreeBlock / 1024);
+
+	if (EndStats.nCorruptBlocks)
+		printf("Zone allocator: %zu corrupt blocks\n", EndStats.nCorruptBlocks);
+
+	delete pSynth;
+
+	return EndStats.nCorruptBlocks ? 1 : 0;
+}
+
+static void PrintUsage(const char* pName)
+{
+	fprintf(stderr, "Usage: %s [-c <config>] [-b <frames>] [-m <MB>] [-o <output.wav>] <MIDI file> <SoundFont | ROM directory>\n", pName);
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	const char* pConfigPath = nullptr;
+	const char* pOutputPath = nullptr;
+	size_t nBlockFrames = 0;
+	size_t nHeapMegabytes = DefaultZoneHeapMegabytes;
+	int nOption;
+
+	while ((nOption = getopt(nArgs, pArgs, "c:b:m:o:")) != -1)
+	{
+		switch (nOption)
+		{
+			case 'c': pConfigPath = optarg; break;
+			case 'b': nBlockFrames = strtoul(optarg, nullptr, 10); break;
+			case 'm': nHeapMegabytes = strtoul(optarg, nullptr, 10); break;
+			case 'o': pOutputPath = optarg; break;
+			default: PrintUsage(pArgs[0]); return 1;
+		}
+	}
+
+	if (nArgs - optind != 2)
+	{
+		PrintUsage(pArgs[0]);
+		return 1;
+	}
+
+	const char* const pMIDIPath = pArgs[optind];
+	const char* const pSynthPath = pArgs[optind + 1];
+
+	std::vector<TMIDIEvent> Events;
+	if (!LoadMIDIFile(pMIDIPath, Events))
+	{
+		fprintf(stderr, "Couldn't read %s as a Standard MIDI File\n", pMIDIPath);
+		return 1;
+	}
+
+	char CardPath[] = "/tmp/mt32-pi-render.XXXXXX";
+	bool bMT32;
+	if (!mkdtemp(CardPath))
+	{
+		fprintf(stderr, "Couldn't create a directory for the SD card\n");
+		return 1;
+	}
+
+	if (!PrepareCard(CardPath, pSynthPath, pConfigPath, bMT32))
+	{
+		fprintf(stderr, "Couldn't put %s on the SD card\n", pSynthPath);
+		nftw(CardPath, RemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+		return 1;
+	}
+
+	FATFS FileSystem{CardPath};
+	f_mount(&FileSystem, "SD:", 1);
+
+	const int nResult = RenderMIDIFile(pMIDIPath, Events, pSynthPath, bMT32, pConfigPath != nullptr, pOutputPath, nBlockFrames, nHeapMegabytes);
+
+	f_mount(nullptr, "SD:", 0);
+	nftw(CardPath, RemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+
+	return nResult;
+}
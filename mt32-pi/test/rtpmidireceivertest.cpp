@@ -0,0 +1,300 @@
+//
+// rtpmidireceivertest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+
+#include <initializer_list>
+#include <vector>
+
+#include "deferredlog.h"
+#include "hosttest.h"
+#include "net/applemidi.h"
+#include "net/rtpmidireceiver.h"
+
+using TBytes = std::vector<u8>;
+
+// Channel journal chapter flags (RFC 6295 appendix A.2)
+constexpr u8 ChapterP = 1 << 7;
+constexpr u8 ChapterC = 1 << 6;
+constexpr u8 ChapterW = 1 << 4;
+constexpr u8 ChapterN = 1 << 3;
+
+// Sender's clock is this far ahead of ours, in RTP timestamp units (100 microseconds)
+constexpr u32 ClockOffset = 123456;
+
+// Records what the receiver hands on, and when
+class CRecordingHandler : public CAppleMIDIHandler
+{
+public:
+	struct TCommand
+	{
+		TBytes Data;
+		u64 nTime;
+	};
+
+	virtual void OnAppleMIDIDataReceived(const u8* pData, size_t nSize) override { m_Commands.push_back({TBytes(pData, pData + nSize), m_nNow}); }
+	virtual void OnAppleMIDIConnect(const CIPAddress* pIPAddress, const char* pName) override {}
+	virtual void OnAppleMIDIDisconnect(const CIPAddress* pIPAddress, const char* pName) override {}
+
+	std::vector<TCommand> m_Commands;
+	u64 m_nNow = 0;
+};
+
+// A command in a packet's MIDI list, with its delta time from the previous one
+struct TTimedCommand
+{
+	u32 nDelta;
+	TBytes Data;
+};
+
+// A channel journal (RFC 6295 appendix A.2); the chapters must be given in P, C, M, W, N order
+static TBytes ChannelJournal(u8 nChannel, u8 nChapters, std::initializer_list<TBytes> Chapters)
+{
+	TBytes Journal = { 0, 0, nChapters };
+	for (const TBytes& Chapter : Chapters)
+		Journal.insert(Journal.end(), Chapter.begin(), Chapter.end());
+
+	// S CHAN(4) H LENGTH(10), where the length includes this header
+	Journal[0] = nChannel << 3 | Journal.size() >> 8;
+	Journal[1] = Journal.size() & 0xFF;
+	return Journal;
+}
+
+// A recovery journal holding only channel journals (RFC 6295 section 5)
+static TBytes RecoveryJournal(u16 nCheckpoint, std::initializer_list<TBytes> ChannelJournals)
+{
+	TBytes Journal = { static_cast<u8>(1 << 5 | (ChannelJournals.size() - 1)), static_cast<u8>(nCheckpoint >> 8), static_cast<u8>(nCheckpoint) };
+	for (const TBytes& ChannelJournal : ChannelJournals)
+		Journal.insert(Journal.end(), ChannelJournal.begin(), ChannelJournal.end());
+
+	return Journal;
+}
+
+// Chapter N: note logs of (note, velocity, Y bit), and the notes whose note-off was sent
+static TBytes NoteChapter(std::initializer_list<std::initializer_list<u8>> Logs, std::initializer_list<u8> OffNotes)
+{
+	u8 nLow = 15, nHigh = 0;
+	for (u8 nNote : OffNotes)
+	{
+		nLow = nNote / 8 < nLow ? nNote / 8 : nLow;
+		nHigh = nNote / 8 > nHigh ? nNote / 8 : nHigh;
+	}
+
+	TBytes Chapter = { static_cast<u8>(Logs.size()), static_cast<u8>(nLow << 4 | nHigh) };
+	for (const auto& Log : Logs)
+	{
+		const u8* pLog = Log.begin();
+		Chapter.push_back(pLog[0]);
+		Chapter.push_back((pLog[2] ? 0x80 : 0) | pLog[1]);
+	}
+
+	const size_t nOffBits = Chapter.size();
+	if (OffNotes.size())
+		Chapter.resize(nOffBits + nHigh - nLow + 1);
+
+	for (u8 nNote : OffNotes)
+		Chapter[nOffBits + nNote / 8 - nLow] |= 0x80 >> (nNote & 7);
+
+	return Chapter;
+}
+
+// Drives the receiver the way ParseMIDIPacket() does: the journal is only applied when packets were
+// lost, and describes the state before this packet, so its repairs come before the packet's commands
+static void ReceivePacket(CRTPMIDIReceiver& Receiver, CRecordingHandler& Handler, u64 nNow, u16 nSequence, u32 nTimestamp, std::initializer_list<TTimedCommand> Commands, const TBytes& Journal = TBytes())
+{
+	Handler.m_nNow = nNow;
+
+	const CRTPMIDIReceiver::TPacketStatus Status = Receiver.BeginPacket(nSequence, nNow);
+	if (Status == CRTPMIDIReceiver::TPacketStatus::Stale)
+		return;
+
+	if (Status == CRTPMIDIReceiver::TPacketStatus::Lost && !Journal.empty())
+		Receiver.ApplyJournal(Journal.data(), Journal.size(), nTimestamp);
+
+	for (const TTimedCommand& Command : Commands)
+	{
+		nTimestamp += Command.nDelta;
+		Receiver.OnCommand(Command.Data.data(), Command.Data.size(), nTimestamp);
+	}
+}
+
+static void AdvanceTo(CRTPMIDIReceiver& Receiver, CRecordingHandler& Handler, u64 nNow)
+{
+	Handler.m_nNow = nNow;
+	Receiver.Update(nNow);
+}
+
+static bool CommandsAre(const CRecordingHandler& Handler, std::initializer_list<TBytes> Expected)
+{
+	if (Handler.m_Commands.size() != Expected.size())
+		return false;
+
+	size_t i = 0;
+	for (const TBytes& Data : Expected)
+		if (Handler.m_Commands[i++].Data != Data)
+			return false;
+
+	return true;
+}
+
+static void TestNoteRecovery()
+{
+	CRecordingHandler Handler;
+	CRTPMIDIReceiver Receiver(&Handler, 0);
+
+	ReceivePacket(Receiver, Handler, 0, 100, 1000, { { 0, { 0x90, 60, 100 } }, { 0, { 0x90, 64, 100 } } });
+
+	// Packet 101 (note-off for 60, note-on for 67) is lost; 102's journal carries both
+	const TBytes Journal = RecoveryJournal(100, { ChannelJournal(0, ChapterN, { NoteChapter({ { 64, 100, 1 }, { 67, 90, 1 } }, { 60 }) }) });
+	ReceivePacket(Receiver, Handler, 20, 102, 1020, { { 0, { 0x90, 72, 80 } } }, Journal);
+
+	// 64 is already sounding, so only the note-off and the missed note-on are repaired
+	CHECK(CommandsAre(Handler, { { 0x90, 60, 100 }, { 0x90, 64, 100 }, { 0x80, 60, 64 }, { 0x90, 67, 90 }, { 0x90, 72, 80 } }));
+
+	// The late arrival of 101 is stale and mustn't replay anything
+	ReceivePacket(Receiver, Handler, 25, 101, 1010, { { 0, { 0x80, 60, 0 } }, { 0, { 0x90, 67, 90 } } });
+	CHECK(Handler.m_Commands.size() == 5);
+	CHECK(Receiver.GetLastSequence() == 102);
+
+	// A journal on an in-order packet is not applied; notes without the Y bit aren't started, and notes
+	// that aren't sounding aren't released
+	const TBytes NoPlay = RecoveryJournal(102, { ChannelJournal(0, ChapterN, { NoteChapter({ { 48, 100, 0 } }, { 64, 65, 90 }) }) });
+	ReceivePacket(Receiver, Handler, 30, 103, 1030, {}, NoPlay);
+	CHECK(Handler.m_Commands.size() == 5);
+
+	ReceivePacket(Receiver, Handler, 40, 105, 1050, {}, NoPlay);
+	CHECK(CommandsAre(Handler, { { 0x90, 60, 100 }, { 0x90, 64, 100 }, { 0x80, 60, 64 }, { 0x90, 67, 90 }, { 0x90, 72, 80 }, { 0x80, 64, 64 } }));
+
+	// A jump back further than any reordering is a sender restart, and sequence numbers wrap
+	ReceivePacket(Receiver, Handler, 50, 0xFFFF, 1060, { { 0, { 0x80, 67, 0 } } });
+	ReceivePacket(Receiver, Handler, 51, 0x0001, 1070, {}, RecoveryJournal(0xFFFF, { ChannelJournal(0, ChapterN, { NoteChapter({}, { 72 }) }) }));
+	CHECK(Handler.m_Commands.size() == 8);
+	CHECK(Handler.m_Commands.back().Data == TBytes({ 0x80, 72, 64 }));
+}
+
+static void TestControllerRecovery()
+{
+	CRecordingHandler Handler;
+	CRTPMIDIReceiver Receiver(&Handler, 0);
+
+	ReceivePacket(Receiver, Handler, 0, 1, 0, { { 0, { 0xB3, 10, 64 } }, { 0, { 0xE3, 0x00, 0x40 } } });
+	Handler.m_Commands.clear();
+
+	// Lost: a bank select and program change; volume, sustain and pan (unchanged) as well as a toggle tool
+	// log and All Notes Off, which mustn't be replayed; and a pitch bend. LEN is the number of logs minus one
+	const TBytes Program     = { 5, 0x80 | 1, 0 };
+	const TBytes Controllers = { 4, 7, 90, 64, 127, 10, 64, 1, 0x80 | 3, 123, 0 };
+	const TBytes PitchWheel  = { 0x7F, 0x50 };
+
+	const TBytes Journal = RecoveryJournal(1, { ChannelJournal(3, ChapterP | ChapterC | ChapterW, { Program, Controllers, PitchWheel }) });
+	ReceivePacket(Receiver, Handler, 10, 3, 100, { { 0, { 0x93, 60, 100 } } }, Journal);
+
+	CHECK(CommandsAre(Handler, {
+		{ 0xB3, 0, 1 },
+		{ 0xB3, 32, 0 },
+		{ 0xC3, 5 },
+		{ 0xB3, 7, 90 },
+		{ 0xB3, 64, 127 },
+		{ 0xE3, 0x7F, 0x50 },
+		{ 0x93, 60, 100 },
+	}));
+
+	// The same journal after another loss finds nothing left to repair
+	Handler.m_Commands.clear();
+	ReceivePacket(Receiver, Handler, 20, 5, 200, {}, Journal);
+	CHECK(Handler.m_Commands.empty());
+
+	// A reset forgets the stream state, so everything is sent again
+	ReceivePacket(Receiver, Handler, 30, 6, 300, { { 0, { 0xFF } } });
+	ReceivePacket(Receiver, Handler, 40, 8, 400, {}, Journal);
+	CHECK(Handler.m_Commands.size() == 8);
+}
+
+static void TestPlayout()
+{
+	// 5ms of playout latency
+	constexpr u32 Latency = 50;
+
+	CRecordingHandler Handler;
+	CRTPMIDIReceiver Receiver(&Handler, Latency);
+
+	// Without a clock offset from the sync exchange, commands are passed straight through
+	ReceivePacket(Receiver, Handler, 1000, 1, ClockOffset + 1000, { { 0, { 0x90, 60, 100 } } });
+	CHECK(Handler.m_Commands.size() == 1);
+	Handler.m_Commands.clear();
+
+	Receiver.SetClockOffset(ClockOffset);
+
+	// A burst of three packets, 2ms apart by the sender's clock, all arriving at once; the last also
+	// carries commands 1ms apart in its own list, and repairs a lost note-off
+	const u64 nArrival = 1010;
+	const u32 nSent    = ClockOffset + 1000;
+	ReceivePacket(Receiver, Handler, nArrival, 2, nSent, { { 0, { 0x90, 62, 100 } } });
+	ReceivePacket(Receiver, Handler, nArrival, 3, nSent + 20, { { 0, { 0x80, 62, 0 } } });
+	ReceivePacket(Receiver, Handler, nArrival, 5, nSent + 40, { { 0, { 0x90, 64, 100 } }, { 10, { 0x90, 67, 100 } } },
+		      RecoveryJournal(3, { ChannelJournal(0, ChapterN, { NoteChapter({}, { 60 }) }) }));
+
+	CHECK(Handler.m_Commands.empty());
+
+	unsigned int nDelay;
+	CHECK(Receiver.GetPlayoutDelay(nDelay) && nDelay == 1000 + Latency - nArrival);
+
+	for (u64 nNow = nArrival; nNow <= 1000 + Latency + 60; ++nNow)
+		AdvanceTo(Receiver, Handler, nNow);
+
+	// Each command plays at its RTP timestamp mapped onto our clock plus the latency, in timestamp order;
+	// the repair plays with the packet that carried it, ahead of that packet's commands
+	CHECK(CommandsAre(Handler, { { 0x90, 62, 100 }, { 0x80, 62, 0 }, { 0x80, 60, 64 }, { 0x90, 64, 100 }, { 0x90, 67, 100 } }));
+	if (Handler.m_Commands.size() == 5)
+	{
+		const u64 ExpectedTimes[] = { 1050, 1070, 1090, 1090, 1100 };
+		for (size_t i = 0; i < 5; ++i)
+			CHECK(Handler.m_Commands[i].nTime == ExpectedTimes[i]);
+	}
+	CHECK(!Receiver.GetPlayoutDelay(nDelay));
+
+	// A timestamp too far ahead means the offset estimate is stale; play at arrival time plus latency
+	Handler.m_Commands.clear();
+	ReceivePacket(Receiver, Handler, 2000, 6, nSent + 100000, { { 0, { 0x90, 69, 100 } } });
+	AdvanceTo(Receiver, Handler, 2000 + Latency - 1);
+	CHECK(Handler.m_Commands.empty());
+	AdvanceTo(Receiver, Handler, 2000 + Latency);
+	CHECK(Handler.m_Commands.size() == 1);
+
+	// Resetting plays anything still buffered, so note-offs aren't lost
+	Handler.m_Commands.clear();
+	ReceivePacket(Receiver, Handler, 3000, 7, ClockOffset + 3000, { { 0, { 0x80, 69, 0 } } });
+	CHECK(Handler.m_Commands.empty());
+	Receiver.Reset();
+	CHECK(CommandsAre(Handler, { { 0x80, 69, 0 } }));
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	CDeferredLog DeferredLog(LogDebug);
+
+	TestNoteRecovery();
+	TestControllerRecovery();
+	TestPlayout();
+
+	return HostTest::Result("rtpmidireceiver");
+}
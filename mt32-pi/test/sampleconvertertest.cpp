@@ -0,0 +1,225 @@
+//
+// sampleconvertertest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "hosttest.h"
+#include "sampleconverter.h"
+#include "utility.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#ifdef NEON_EMULATION
+#define NEON_SUFFIX ", emulated"
+#else
+#define NEON_SUFFIX ""
+#endif
+#ifdef __aarch64__
+static const char Variant[] = "NEON (AArch64" NEON_SUFFIX ")";
+#else
+static const char Variant[] = "NEON (ARMv7" NEON_SUFFIX ")";
+#endif
+#else
+static const char Variant[] = "scalar";
+#endif
+
+constexpr float Sample24BitMax = (1 << 23) - 1;
+constexpr u8 Sentinel = 0xAA;
+
+// What the output stage is specified to produce for one sample without dither
+static s32 Expected(float nSample)
+{
+	float nScaled = nSample * Sample24BitMax;
+	if (nScaled > Sample24BitMax)
+		nScaled = Sample24BitMax;
+	else if (nScaled < -Sample24BitMax)
+		nScaled = -Sample24BitMax;
+
+	return static_cast<s32>(nScaled);
+}
+
+static s32 ReadPacked(const u8* pData)
+{
+	const s32 nValue = pData[0] | pData[1] << 8 | pData[2] << 16;
+	return (nValue ^ 0x800000) - 0x800000;
+}
+
+static std::vector<float> MakeSignal(size_t nFrames, unsigned int nSeed)
+{
+	// Mostly in range, with some overshoot and a few exact full-scale values
+	std::vector<float> Samples(nFrames * 2);
+	srand(nSeed);
+	for (size_t i = 0; i < Samples.size(); ++i)
+	{
+		switch (rand() % 16)
+		{
+			case 0:  Samples[i] = 1.0f; break;
+			case 1:  Samples[i] = -1.0f; break;
+			case 2:  Samples[i] = (rand() % 2 ? 1 : -1) * (1.0f + rand() / static_cast<float>(RAND_MAX)); break;
+			case 3:  Samples[i] = (rand() % 2 ? 1 : -1) * 1e9f; break;
+			case 4:  Samples[i] = (rand() % 2 ? 1 : -1) * INFINITY; break;
+			case 5:  Samples[i] = (rand() % 256 - 128) / Sample24BitMax; break;
+			default: Samples[i] = rand() / static_cast<float>(RAND_MAX) * 2.0f - 1.0f; break;
+		}
+	}
+	return Samples;
+}
+
+static void TestExactConversion()
+{
+	const size_t FrameCounts[] = { 0, 1, 2, 3, 7, 64, 257 };
+
+	for (bool bReversed : { false, true })
+	{
+		for (size_t nFrames : FrameCounts)
+		{
+			const std::vector<float> Input = MakeSignal(nFrames, nFrames + bReversed);
+			CSampleConverter Converter(bReversed, false);
+
+			// I2S: 24-bit samples in 32-bit containers
+			std::vector<s32> I2SOutput(nFrames * 2 + 4, 0x5A5A5A5A);
+			Converter.ConvertS24_32(I2SOutput.data(), Input.data(), nFrames);
+
+			// PWM/HDMI: packed 24-bit samples, plus the documented slack
+			std::vector<u8> PackedOutput(nFrames * 6 + CSampleConverter::PackedOutputSlack + 16, Sentinel);
+			Converter.ConvertS24(PackedOutput.data(), Input.data(), nFrames);
+
+			for (size_t i = 0; i < nFrames * 2; ++i)
+			{
+				const size_t nSource = bReversed ? (i ^ 1) : i;
+				const s32 nExpected = Expected(Input[nSource]);
+				CHECK(I2SOutput[i] == nExpected);
+				CHECK(ReadPacked(&PackedOutput[i * 3]) == nExpected);
+			}
+
+			// Nothing written past the end of the converted data
+			for (size_t i = nFrames * 2; i < I2SOutput.size(); ++i)
+				CHECK(I2SOutput[i] == 0x5A5A5A5A);
+
+			// Nothing written past the slack
+			for (size_t i = nFrames * 6 + CSampleConverter::PackedOutputSlack; i < PackedOutput.size(); ++i)
+				CHECK(PackedOutput[i] == Sentinel);
+		}
+	}
+}
+
+static void TestSaturation()
+{
+	const float Input[] = { 1.0f, -1.0f, 1.0001f, -1.0001f, 2.0f, -2.0f, 1e30f, -1e30f, INFINITY, -INFINITY, 0.0f, -0.0f };
+	const s32 Output[] = { 0x7FFFFF, -0x7FFFFF, 0x7FFFFF, -0x7FFFFF, 0x7FFFFF, -0x7FFFFF, 0x7FFFFF, -0x7FFFFF, 0x7FFFFF, -0x7FFFFF, 0, 0 };
+	constexpr size_t nFrames = Utility::ArraySize(Input) / 2;
+
+	for (bool bDither : { false, true })
+	{
+		CSampleConverter Converter(false, bDither);
+		s32 I2SOutput[nFrames * 2];
+		u8 PackedOutput[nFrames * 6 + CSampleConverter::PackedOutputSlack];
+		Converter.ConvertS24_32(I2SOutput, Input, nFrames);
+		Converter.ConvertS24(PackedOutput, Input, nFrames);
+
+		for (size_t i = 0; i < nFrames * 2; ++i)
+		{
+			// Dither may move a sample by one step, but never past full scale
+			const s32 nTolerance = bDither ? 1 : 0;
+			CHECK(abs(I2SOutput[i] - Output[i]) <= nTolerance);
+			CHECK(abs(ReadPacked(&PackedOutput[i * 3]) - Output[i]) <= nTolerance);
+			CHECK(I2SOutput[i] <= 0x7FFFFF && I2SOutput[i] >= -0x7FFFFF);
+		}
+	}
+}
+
+static void TestDither()
+{
+	constexpr size_t nFrames = 4096;
+	const std::vector<float> Input = MakeSignal(nFrames, 1234);
+
+	CSampleConverter Converter(false, true);
+	std::vector<s32> I2SOutput(nFrames * 2);
+	std::vector<u8> PackedOutput(nFrames * 6 + CSampleConverter::PackedOutputSlack);
+	Converter.ConvertS24_32(I2SOutput.data(), Input.data(), nFrames);
+	Converter.ConvertS24(PackedOutput.data(), Input.data(), nFrames);
+
+	size_t nChangedI2S = 0, nChangedPacked = 0;
+	for (size_t i = 0; i < nFrames * 2; ++i)
+	{
+		// TPDF dither of +/-1 LSB moves a truncated sample by at most one step
+		const s32 nExpected = Expected(Input[i]);
+		const s32 nI2S = I2SOutput[i];
+		const s32 nPacked = ReadPacked(&PackedOutput[i * 3]);
+		CHECK(abs(nI2S - nExpected) <= 1);
+		CHECK(abs(nPacked - nExpected) <= 1);
+		nChangedI2S += nI2S != nExpected;
+		nChangedPacked += nPacked != nExpected;
+	}
+
+	// Roughly half of the samples should land on a different step
+	CHECK(nChangedI2S > nFrames / 4 && nChangedI2S < nFrames * 3 / 2);
+	CHECK(nChangedPacked > nFrames / 4 && nChangedPacked < nFrames * 3 / 2);
+
+	// Silence stays centred on zero
+	const std::vector<float> Silence(nFrames * 2, 0.0f);
+	Converter.ConvertS24_32(I2SOutput.data(), Silence.data(), nFrames);
+	long long nSum = 0;
+	for (s32 nSample : I2SOutput)
+	{
+		CHECK(abs(nSample) <= 1);
+		nSum += nSample;
+	}
+	CHECK(llabs(nSum) < static_cast<long long>(nFrames) / 8);
+}
+
+static void Benchmark()
+{
+	// One audio chunk's worth of frames, as rendered by the audio task
+	constexpr size_t nFrames = 256;
+	const std::vector<float> Input = MakeSignal(nFrames, 42);
+	std::vector<s32> I2SOutput(nFrames * 2);
+	std::vector<u8> PackedOutput(nFrames * 6 + CSampleConverter::PackedOutputSlack);
+
+	for (bool bDither : { false, true })
+	{
+		CSampleConverter Converter(true, bDither);
+		const double nI2S = HostTest::TimePerCall([&] { Converter.ConvertS24_32(I2SOutput.data(), Input.data(), nFrames); });
+		const double nPacked = HostTest::TimePerCall([&] { Converter.ConvertS24(PackedOutput.data(), Input.data(), nFrames); });
+		printf("%-24s dither %-3s  S24_32: %6.2f ns/frame  S24: %6.2f ns/frame\n", Variant, bDither ? "on" : "off", nI2S / nFrames, nPacked / nFrames);
+	}
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	if (HostTest::WantBenchmark(nArgs, pArgs))
+	{
+		Benchmark();
+		return 0;
+	}
+
+	TestExactConversion();
+	TestSaturation();
+	TestDither();
+
+	CString Name;
+	Name.Format("sampleconverter [%s]", Variant);
+	return HostTest::Result(Name);
+}
@@ -0,0 +1,96 @@
+//
+// logger.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's logger; errors and warnings go to stderr, everything else is dropped
+// unless MT32PI_TEST_VERBOSE is set in the environment. Tests that provoke errors on purpose can count
+// them instead of printing them
+
+#ifndef _circle_logger_h
+#define _circle_logger_h
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <circle/sysconfig.h>
+
+enum TLogSeverity
+{
+	LogPanic,
+	LogError,
+	LogWarning,
+	LogNotice,
+	LogDebug,
+};
+
+class CLogger
+{
+public:
+	static CLogger* Get()
+	{
+		static CLogger Logger;
+		return &Logger;
+	}
+
+	void Write(const char* pSource, TLogSeverity Severity, const char* pMessage, ...) __attribute__((format(printf, 4, 5)))
+	{
+		va_list Args;
+		va_start(Args, pMessage);
+		WriteV(pSource, Severity, pMessage, Args);
+		va_end(Args);
+	}
+
+	void WriteV(const char* pSource, TLogSeverity Severity, const char* pMessage, va_list Args)
+	{
+		static const bool bVerbose = getenv("MT32PI_TEST_VERBOSE") != nullptr;
+		if (Severity == LogError)
+			++m_nErrors;
+
+		if ((Severity > LogWarning || (m_bExpectErrors && Severity == LogError)) && !bVerbose)
+			return;
+
+		static const char* const SeverityNames[] = { "PANIC", "ERROR", "WARN", "NOTE", "DEBUG" };
+		fprintf(stderr, "%s: %s: ", pSource, SeverityNames[Severity]);
+		vfprintf(stderr, pMessage, Args);
+		fputc('\n', stderr);
+
+		if (Severity == LogPanic)
+			abort();
+	}
+
+	// Errors logged while expected are counted but not printed
+	void ExpectErrors(bool bExpect) { m_bExpectErrors = bExpect; }
+	unsigned int GetErrorCount() const { return m_nErrors; }
+
+private:
+	bool m_bExpectErrors = false;
+	unsigned int m_nErrors = 0;
+};
+
+#define LOGMODULE(NAME) static const char From[] = NAME
+#define LOGPANIC(...) CLogger::Get()->Write(From, LogPanic, __VA_ARGS__)
+#define LOGERR(...) CLogger::Get()->Write(From, LogError, __VA_ARGS__)
+#define LOGWARN(...) CLogger::Get()->Write(From, LogWarning, __VA_ARGS__)
+#define LOGNOTE(...) CLogger::Get()->Write(From, LogNotice, __VA_ARGS__)
+#define LOGDBG(...) CLogger::Get()->Write(From, LogDebug, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,70 @@
+//
+// memory.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's memory system; heaps come from the C library, and tests choose how much
+// memory is left over for the application
+
+#ifndef _circle_memory_h
+#define _circle_memory_h
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <circle/types.h>
+
+#define MEGABYTE 0x100000
+
+enum THeapType
+{
+	HEAP_LOW,
+	HEAP_HIGH,
+	HEAP_ANY,
+};
+
+struct THeapBlockHeader
+{
+	u32 nMagic;
+	u32 nSize;
+	THeapBlockHeader* pNext;
+	u8 Align[16];
+};
+
+class CMemorySystem
+{
+public:
+	static CMemorySystem* Get()
+	{
+		static CMemorySystem MemorySystem;
+		return &MemorySystem;
+	}
+
+	size_t GetHeapFreeSpace(int nType) const { return nType == HEAP_HIGH ? 0 : m_nHeapFreeSpace; }
+	void SetHeapFreeSpace(size_t nSize) { m_nHeapFreeSpace = nSize; }
+
+	void* HeapAllocate(size_t nSize, int nType) { return aligned_alloc(16, (nSize + 15) & ~static_cast<size_t>(15)); }
+	void HeapFree(void* pBlock) { free(pBlock); }
+
+private:
+	size_t m_nHeapFreeSpace = 128 * MEGABYTE;
+};
+
+#endif
@@ -0,0 +1,36 @@
+//
+// socket.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's socket; only what the network code's headers need to compile
+
+#ifndef _circle_net_socket_h
+#define _circle_net_socket_h
+
+#include <circle/net/ipaddress.h>
+#include <circle/types.h>
+
+// From circle/netdevice.h
+#define FRAME_BUFFER_SIZE 1600
+
+class CSocket;
+
+#endif
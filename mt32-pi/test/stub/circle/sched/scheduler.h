@@ -0,0 +1,137 @@
+//
+// scheduler.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's cooperative scheduler. When the main program yields, each task that is ready
+// runs until it yields in turn or returns; tasks always yield back to the main program rather than to each
+// other. As on Circle, tasks are deleted once they have returned.
+
+#ifndef _circle_sched_scheduler_h
+#define _circle_sched_scheduler_h
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <vector>
+
+#include <circle/sched/task.h>
+
+class CScheduler
+{
+public:
+	static CScheduler* Get()
+	{
+		static CScheduler Scheduler;
+		return &Scheduler;
+	}
+
+	void Yield()
+	{
+		// Back to the main program
+		if (m_pCurrentTask)
+		{
+			swapcontext(&m_pCurrentTask->m_Context, &m_MainContext);
+			return;
+		}
+
+		// Tasks created meanwhile get their first turn on the next yield
+		const size_t nTasks = m_Tasks.size();
+		for (size_t i = 0; i < nTasks; ++i)
+		{
+			CTask* const pTask = m_Tasks[i];
+			if (pTask->m_bSuspended || pTask->m_bTerminated)
+				continue;
+
+			if (!pTask->m_pStack)
+			{
+				pTask->m_pStack = malloc(pTask->m_nStackSize);
+				assert(pTask->m_pStack);
+
+				getcontext(&pTask->m_Context);
+				pTask->m_Context.uc_stack.ss_sp = pTask->m_pStack;
+				pTask->m_Context.uc_stack.ss_size = pTask->m_nStackSize;
+				pTask->m_Context.uc_link = &m_MainContext;
+				makecontext(&pTask->m_Context, TaskEntry, 0);
+			}
+
+			m_pCurrentTask = pTask;
+			swapcontext(&m_MainContext, &pTask->m_Context);
+			m_pCurrentTask = nullptr;
+		}
+
+		for (auto Iterator = m_Tasks.begin(); Iterator != m_Tasks.end();)
+		{
+			if ((*Iterator)->m_bTerminated)
+			{
+				delete *Iterator;
+				Iterator = m_Tasks.erase(Iterator);
+			}
+			else
+				++Iterator;
+		}
+	}
+
+	void MsSleep(unsigned nMilliSeconds) { Yield(); }
+	void usSleep(unsigned nMicroSeconds) { Yield(); }
+
+	// Null while the main program runs
+	CTask* GetCurrentTask() { return m_pCurrentTask; }
+
+	CTask* GetTask(const char* pTaskName)
+	{
+		for (CTask* pTask : m_Tasks)
+			if (!pTask->m_bTerminated && strcmp(pTask->GetName(), pTaskName) == 0)
+				return pTask;
+
+		return nullptr;
+	}
+
+	void AddTask(CTask* pTask) { m_Tasks.push_back(pTask); }
+
+private:
+	static void TaskEntry()
+	{
+		CTask* const pTask = Get()->m_pCurrentTask;
+		pTask->Run();
+
+		// Returns to the main program through uc_link
+		pTask->m_bTerminated = true;
+	}
+
+	std::vector<CTask*> m_Tasks;
+	CTask* m_pCurrentTask = nullptr;
+	ucontext_t m_MainContext;
+};
+
+inline CTask::CTask(unsigned nStackSize, bool bCreateSuspended)
+	: m_nStackSize(nStackSize),
+	  m_pStack(nullptr),
+	  m_Context{},
+	  m_bSuspended(bCreateSuspended),
+	  m_bTerminated(false),
+	  m_pName("")
+{
+	CScheduler::Get()->AddTask(this);
+}
+
+#endif
@@ -0,0 +1,42 @@
+//
+// synchronizationevent.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's synchronization event; there is nothing to wait for on the host
+
+#ifndef _circle_sched_synchronizationevent_h
+#define _circle_sched_synchronizationevent_h
+
+class CSynchronizationEvent
+{
+public:
+	CSynchronizationEvent(bool bState = false) : m_bState(bState) {}
+
+	bool GetState() const { return m_bState; }
+	void Set() { m_bState = true; }
+	void Clear() { m_bState = false; }
+	void Wait() {}
+
+private:
+	bool m_bState;
+};
+
+#endif
@@ -0,0 +1,60 @@
+//
+// task.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's cooperative task; tasks run on their own stacks, switched to by the stand-in
+// scheduler whenever the main program yields
+
+#ifndef _circle_sched_task_h
+#define _circle_sched_task_h
+
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <circle/sysconfig.h>
+
+class CTask
+{
+public:
+	CTask(unsigned nStackSize = TASK_STACK_SIZE, bool bCreateSuspended = false);
+	virtual ~CTask() { free(m_pStack); }
+
+	virtual void Run() {}
+
+	void Start() { m_bSuspended = false; }
+	void SetName(const char* pName) { m_pName = pName; }
+	const char* GetName() const { return m_pName; }
+
+private:
+	friend class CScheduler;
+
+	unsigned m_nStackSize;
+	void* m_pStack;
+	ucontext_t m_Context;
+	bool m_bSuspended;
+	bool m_bTerminated;
+	const char* m_pName;
+};
+
+// Needs CTask to be complete; also defines the constructor, which adds the task to the scheduler
+#include <circle/sched/scheduler.h>
+
+#endif
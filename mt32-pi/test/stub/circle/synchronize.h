@@ -0,0 +1,46 @@
+//
+// synchronize.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's synchronization helpers; everything runs at task level here
+
+#ifndef _circle_synchronize_h
+#define _circle_synchronize_h
+
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#define DATA_CACHE_LINE_LENGTH_MAX	64
+#define CACHE_ALIGN			ALIGN(DATA_CACHE_LINE_LENGTH_MAX)
+
+inline unsigned CurrentExecutionLevel() { return TASK_LEVEL; }
+
+inline void EnterCritical(unsigned nTargetLevel = IRQ_LEVEL) {}
+inline void LeaveCritical() {}
+
+inline void DataMemBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+inline void DataSyncBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+// There are no other cores to wake up or be woken by
+inline void SendEvent() {}
+inline void WaitForEvent() {}
+
+#endif
@@ -0,0 +1,69 @@
+//
+// timer.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for Circle's timer, backed by the monotonic clock; tests can take over the 1 MHz clock to
+// make time-dependent code deterministic
+
+#ifndef _circle_timer_h
+#define _circle_timer_h
+
+#include <time.h>
+
+#define HZ 100
+
+class CTimer
+{
+public:
+	static CTimer* Get()
+	{
+		static CTimer Timer;
+		return &Timer;
+	}
+
+	unsigned int GetTicks() const { return GetClockTicks() / (1000000 / HZ); }
+
+	static unsigned int GetClockTicks()
+	{
+		if (const unsigned int* pTicks = ClockOverride())
+			return *pTicks;
+
+		timespec Time;
+		clock_gettime(CLOCK_MONOTONIC, &Time);
+		return static_cast<unsigned int>(Time.tv_sec * 1000000ull + Time.tv_nsec / 1000);
+	}
+
+	// Points GetClockTicks() at a counter owned by the test, or back at the real clock if null
+	static const unsigned int*& ClockOverride()
+	{
+		static const unsigned int* pTicks = nullptr;
+		return pTicks;
+	}
+
+	static void SimpleMsDelay(unsigned int nMilliSeconds) { SimpleusDelay(nMilliSeconds * 1000); }
+	static void SimpleusDelay(unsigned int nMicroSeconds)
+	{
+		const timespec Delay = { static_cast<time_t>(nMicroSeconds / 1000000), static_cast<long>(nMicroSeconds % 1000000) * 1000 };
+		nanosleep(&Delay, nullptr);
+	}
+};
+
+#endif
@@ -0,0 +1,363 @@
+//
+// ff.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Host stand-in for FatFs, configured like Circle's build of it (volumes "SD" and "USB", no exFAT). Each
+// volume is a directory on the host, named by the FATFS object that is mounted for it. The host has no
+// file attributes, so files whose names start with a dot are reported as hidden and f_chmod() does nothing.
+
+#ifndef _fatfs_ff_h
+#define _fatfs_ff_h
+
+#include <errno.h>
+#include <glob.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+typedef char TCHAR;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int UINT;
+typedef unsigned int DWORD;
+typedef DWORD FSIZE_t;
+
+#define FF_VOLUMES	2
+#define FF_LFN_BUF	255
+
+typedef enum
+{
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_INT_ERR,
+	FR_NOT_READY,
+	FR_NO_FILE,
+	FR_NO_PATH,
+	FR_INVALID_NAME,
+	FR_DENIED,
+	FR_EXIST,
+	FR_INVALID_OBJECT,
+	FR_WRITE_PROTECTED,
+	FR_INVALID_DRIVE,
+	FR_NOT_ENABLED,
+	FR_NO_FILESYSTEM,
+	FR_MKFS_ABORTED,
+	FR_TIMEOUT,
+	FR_LOCKED,
+	FR_NOT_ENOUGH_CORE,
+	FR_TOO_MANY_OPEN_FILES,
+	FR_INVALID_PARAMETER
+} FRESULT;
+
+#define FA_READ			0x01
+#define FA_WRITE		0x02
+#define FA_OPEN_EXISTING	0x00
+#define FA_CREATE_NEW		0x04
+#define FA_CREATE_ALWAYS	0x08
+#define FA_OPEN_ALWAYS		0x10
+#define FA_OPEN_APPEND		0x30
+
+#define AM_RDO	0x01
+#define AM_HID	0x02
+#define AM_SYS	0x04
+#define AM_DIR	0x10
+#define AM_ARC	0x20
+
+#define CREATE_LINKMAP	((FSIZE_t)0 - 1)
+
+typedef struct
+{
+	// Host directory holding the volume's files
+	const char* pHostPath;
+} FATFS;
+
+typedef struct
+{
+	FILE* pFile;
+
+	// Cluster link map; files on the host have no clusters, so it's accepted but never used
+	DWORD* cltbl;
+} FIL;
+
+typedef struct
+{
+	glob_t Entries;
+	size_t nNextEntry;
+} DIR;
+
+typedef struct
+{
+	FSIZE_t fsize;
+	WORD fdate;
+	WORD ftime;
+	BYTE fattrib;
+	TCHAR fname[FF_LFN_BUF + 1];
+} FILINFO;
+
+inline FATFS*& FatFsVolume(size_t nVolume)
+{
+	static FATFS* Volumes[FF_VOLUMES] = { nullptr };
+	return Volumes[nVolume];
+}
+
+// Splits a volume ID off the path; paths without one are on the first volume
+inline bool FatFsGetVolume(const TCHAR*& pPath, size_t& nVolume)
+{
+	static const char* const VolumeStrings[FF_VOLUMES] = { "SD", "USB" };
+
+	const char* pColon = strchr(pPath, ':');
+	if (!pColon)
+	{
+		nVolume = 0;
+		return true;
+	}
+
+	for (nVolume = 0; nVolume < FF_VOLUMES; ++nVolume)
+	{
+		const size_t nLength = strlen(VolumeStrings[nVolume]);
+		if (static_cast<size_t>(pColon - pPath) == nLength && !strncasecmp(pPath, VolumeStrings[nVolume], nLength))
+		{
+			pPath = pColon + 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline FRESULT FatFsGetHostPath(const TCHAR* pPath, std::string& HostPath)
+{
+	size_t nVolume;
+	if (!FatFsGetVolume(pPath, nVolume))
+		return FR_INVALID_DRIVE;
+
+	const FATFS* pFileSystem = FatFsVolume(nVolume);
+	if (!pFileSystem)
+		return FR_NOT_ENABLED;
+
+	while (*pPath == '/')
+		++pPath;
+
+	HostPath = pFileSystem->pHostPath;
+	if (*pPath)
+	{
+		HostPath += '/';
+		HostPath += pPath;
+	}
+
+	return FR_OK;
+}
+
+inline FRESULT FatFsGetResult(int nError)
+{
+	switch (nError)
+	{
+		case ENOENT:
+			return FR_NO_FILE;
+
+		case ENOTDIR:
+			return FR_NO_PATH;
+
+		case EACCES:
+		case EPERM:
+		case EISDIR:
+			return FR_DENIED;
+
+		case EEXIST:
+			return FR_EXIST;
+
+		default:
+			return FR_DISK_ERR;
+	}
+}
+
+inline void FatFsGetFileInfo(const struct stat& Stat, const char* pName, FILINFO* fno)
+{
+	tm Time;
+	localtime_r(&Stat.st_mtime, &Time);
+
+	fno->fsize = static_cast<FSIZE_t>(Stat.st_size);
+	fno->fdate = static_cast<WORD>((Time.tm_year - 80) << 9 | (Time.tm_mon + 1) << 5 | Time.tm_mday);
+	fno->ftime = static_cast<WORD>(Time.tm_hour << 11 | Time.tm_min << 5 | Time.tm_sec / 2);
+	fno->fattrib = (S_ISDIR(Stat.st_mode) ? AM_DIR : AM_ARC) | (pName[0] == '.' ? AM_HID : 0);
+	snprintf(fno->fname, sizeof(fno->fname), "%s", pName);
+}
+
+inline FRESULT f_mount(FATFS* fs, const TCHAR* path, BYTE opt)
+{
+	size_t nVolume;
+	if (!FatFsGetVolume(path, nVolume))
+		return FR_INVALID_DRIVE;
+
+	FatFsVolume(nVolume) = fs;
+	return FR_OK;
+}
+
+inline FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode)
+{
+	std::string HostPath;
+	fp->pFile = nullptr;
+	fp->cltbl = nullptr;
+
+	const FRESULT Result = FatFsGetHostPath(path, HostPath);
+	if (Result != FR_OK)
+		return Result;
+
+	const char* pMode;
+	if (mode & FA_CREATE_ALWAYS)
+		pMode = mode & FA_READ ? "w+b" : "wb";
+	else if (mode & FA_WRITE)
+		pMode = "r+b";
+	else
+		pMode = "rb";
+
+	fp->pFile = fopen(HostPath.c_str(), pMode);
+	return fp->pFile ? FR_OK : FatFsGetResult(errno);
+}
+
+inline FRESULT f_close(FIL* fp)
+{
+	if (!fp->pFile)
+		return FR_INVALID_OBJECT;
+
+	const bool bResult = fclose(fp->pFile) == 0;
+	fp->pFile = nullptr;
+
+	return bResult ? FR_OK : FR_DISK_ERR;
+}
+
+inline FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+	*br = static_cast<UINT>(fread(buff, 1, btr, fp->pFile));
+	return ferror(fp->pFile) ? FR_DISK_ERR : FR_OK;
+}
+
+inline FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+	*bw = static_cast<UINT>(fwrite(buff, 1, btw, fp->pFile));
+	return ferror(fp->pFile) ? FR_DISK_ERR : FR_OK;
+}
+
+inline FRESULT f_lseek(FIL* fp, FSIZE_t ofs)
+{
+	if (ofs == CREATE_LINKMAP)
+		return fp->cltbl ? FR_OK : FR_INVALID_PARAMETER;
+
+	return fseeko(fp->pFile, ofs, SEEK_SET) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+inline FSIZE_t f_tell(const FIL* fp)
+{
+	return static_cast<FSIZE_t>(ftello(fp->pFile));
+}
+
+inline FSIZE_t f_size(const FIL* fp)
+{
+	struct stat Stat;
+	return fstat(fileno(fp->pFile), &Stat) == 0 ? static_cast<FSIZE_t>(Stat.st_size) : 0;
+}
+
+inline FRESULT f_stat(const TCHAR* path, FILINFO* fno)
+{
+	std::string HostPath;
+	const FRESULT Result = FatFsGetHostPath(path, HostPath);
+	if (Result != FR_OK)
+		return Result;
+
+	struct stat Stat;
+	if (stat(HostPath.c_str(), &Stat) != 0)
+		return FatFsGetResult(errno);
+
+	const size_t nSlash = HostPath.rfind('/');
+	FatFsGetFileInfo(Stat, HostPath.c_str() + (nSlash == std::string::npos ? 0 : nSlash + 1), fno);
+	return FR_OK;
+}
+
+inline FRESULT f_findnext(DIR* dp, FILINFO* fno)
+{
+	while (dp->nNextEntry < dp->Entries.gl_pathc)
+	{
+		const char* pPath = dp->Entries.gl_pathv[dp->nNextEntry++];
+		const char* pName = strrchr(pPath, '/') + 1;
+		struct stat Stat;
+
+		if (!strcmp(pName, ".") || !strcmp(pName, "..") || stat(pPath, &Stat) != 0)
+			continue;
+
+		FatFsGetFileInfo(Stat, pName, fno);
+		return FR_OK;
+	}
+
+	// End of the directory
+	fno->fname[0] = '\0';
+	return FR_OK;
+}
+
+inline FRESULT f_findfirst(DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* pattern)
+{
+	std::string HostPath;
+	FRESULT Result = FatFsGetHostPath(path, HostPath);
+	if (Result != FR_OK)
+		return Result;
+
+	struct stat Stat;
+	if (stat(HostPath.c_str(), &Stat) != 0 || !S_ISDIR(Stat.st_mode))
+		return FR_NO_PATH;
+
+	dp->nNextEntry = 0;
+	dp->Entries.gl_pathc = 0;
+	dp->Entries.gl_pathv = nullptr;
+
+	const int nResult = glob((HostPath + '/' + pattern).c_str(), GLOB_PERIOD, nullptr, &dp->Entries);
+	if (nResult != 0 && nResult != GLOB_NOMATCH)
+		return FR_DISK_ERR;
+
+	return f_findnext(dp, fno);
+}
+
+inline FRESULT f_closedir(DIR* dp)
+{
+	globfree(&dp->Entries);
+	return FR_OK;
+}
+
+inline FRESULT f_unlink(const TCHAR* path)
+{
+	std::string HostPath;
+	const FRESULT Result = FatFsGetHostPath(path, HostPath);
+	if (Result != FR_OK)
+		return Result;
+
+	return remove(HostPath.c_str()) == 0 ? FR_OK : FatFsGetResult(errno);
+}
+
+inline FRESULT f_chmod(const TCHAR* path, BYTE attr, BYTE mask)
+{
+	FILINFO FileInfo;
+	return f_stat(path, &FileInfo);
+}
+
+#endif
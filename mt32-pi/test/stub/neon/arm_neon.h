@@ -0,0 +1,144 @@
+//
+// arm_neon.h
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Plain C emulation of the NEON intrinsics used by mt32-pi and its FluidSynth patches, so that the vector paths
+// can be built and checked against the scalar ones on a build machine without NEON. It compiles as C or C++.
+// Lane semantics follow the ARM documentation; only little-endian targets are modelled.
+
+#ifndef _arm_neon_h
+#define _arm_neon_h
+
+#define NEON_EMULATION
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NEON_VECTOR(TYPE, LANES, NAME) typedef struct { TYPE Lanes[LANES]; } NAME
+
+typedef float float32_t;
+
+NEON_VECTOR(float, 2, float32x2_t);
+NEON_VECTOR(float, 4, float32x4_t);
+NEON_VECTOR(int16_t, 4, int16x4_t);
+NEON_VECTOR(int32_t, 4, int32x4_t);
+NEON_VECTOR(uint32_t, 2, uint32x2_t);
+NEON_VECTOR(uint32_t, 4, uint32x4_t);
+NEON_VECTOR(uint16_t, 4, uint16x4_t);
+NEON_VECTOR(uint16_t, 8, uint16x8_t);
+NEON_VECTOR(uint8_t, 8, uint8x8_t);
+NEON_VECTOR(uint8_t, 16, uint8x16_t);
+
+typedef struct
+{
+	uint8x8_t val[2];
+} uint8x8x2_t;
+
+// Returns a vector whose lane i is EXPRESSION, which may use i and the arguments
+#define NEON_MAP(TYPE, LANES, EXPRESSION) \
+	TYPE r; for (size_t i = 0; i < LANES; ++i) r.Lanes[i] = (EXPRESSION); return r
+
+// Loads/stores
+static inline float32x2_t vld1_f32(const float* p) { float32x2_t r; memcpy(r.Lanes, p, sizeof(r)); return r; }
+static inline float32x4_t vld1q_f32(const float* p) { float32x4_t r; memcpy(r.Lanes, p, sizeof(r)); return r; }
+static inline int16x4_t vld1_s16(const int16_t* p) { int16x4_t r; memcpy(r.Lanes, p, sizeof(r)); return r; }
+static inline uint32x4_t vld1q_u32(const uint32_t* p) { uint32x4_t r; memcpy(r.Lanes, p, sizeof(r)); return r; }
+static inline uint8x16_t vld1q_u8(const uint8_t* p) { uint8x16_t r; memcpy(r.Lanes, p, sizeof(r)); return r; }
+static inline uint8x8_t vld1_u8(const uint8_t* p) { uint8x8_t r; memcpy(r.Lanes, p, sizeof(r)); return r; }
+static inline void vst1q_f32(float* p, float32x4_t a) { memcpy(p, a.Lanes, sizeof(a)); }
+static inline void vst1q_s32(int32_t* p, int32x4_t a) { memcpy(p, a.Lanes, sizeof(a)); }
+static inline void vst1q_u32(uint32_t* p, uint32x4_t a) { memcpy(p, a.Lanes, sizeof(a)); }
+static inline void vst1q_u8(uint8_t* p, uint8x16_t a) { memcpy(p, a.Lanes, sizeof(a)); }
+static inline void vst1_u8(uint8_t* p, uint8x8_t a) { memcpy(p, a.Lanes, sizeof(a)); }
+
+// Duplication and lane access
+static inline float32x2_t vdup_n_f32(float v) { NEON_MAP(float32x2_t, 2, v); }
+static inline float32x4_t vdupq_n_f32(float v) { NEON_MAP(float32x4_t, 4, v); }
+static inline uint32x2_t vdup_n_u32(uint32_t v) { NEON_MAP(uint32x2_t, 2, v); }
+static inline uint32x4_t vdupq_n_u32(uint32_t v) { NEON_MAP(uint32x4_t, 4, v); }
+static inline float vget_lane_f32(float32x2_t a, int n) { return a.Lanes[n]; }
+static inline float32x2_t vset_lane_f32(float v, float32x2_t a, int n) { a.Lanes[n] = v; return a; }
+static inline float32x4_t vsetq_lane_f32(float v, float32x4_t a, int n) { a.Lanes[n] = v; return a; }
+
+// Arithmetic; multiply-accumulates round the product before adding it, as NEON's VMLA/VMLS do
+static inline float32x2_t vadd_f32(float32x2_t a, float32x2_t b) { NEON_MAP(float32x2_t, 2, a.Lanes[i] + b.Lanes[i]); }
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b) { NEON_MAP(float32x4_t, 4, a.Lanes[i] + b.Lanes[i]); }
+static inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b) { NEON_MAP(float32x4_t, 4, a.Lanes[i] - b.Lanes[i]); }
+static inline float32x4_t vmulq_f32(float32x4_t a, float32x4_t b) { NEON_MAP(float32x4_t, 4, a.Lanes[i] * b.Lanes[i]); }
+static inline float32x4_t vmulq_n_f32(float32x4_t a, float b) { NEON_MAP(float32x4_t, 4, a.Lanes[i] * b); }
+static inline float32x2_t vmul_lane_f32(float32x2_t a, float32x2_t b, int n) { NEON_MAP(float32x2_t, 2, a.Lanes[i] * b.Lanes[n]); }
+static inline float32x4_t vmulq_lane_f32(float32x4_t a, float32x2_t b, int n) { NEON_MAP(float32x4_t, 4, a.Lanes[i] * b.Lanes[n]); }
+static inline float32x4_t vmlaq_f32(float32x4_t a, float32x4_t b, float32x4_t c) { NEON_MAP(float32x4_t, 4, a.Lanes[i] + (float)(b.Lanes[i] * c.Lanes[i])); }
+static inline float32x4_t vmlaq_n_f32(float32x4_t a, float32x4_t b, float c) { NEON_MAP(float32x4_t, 4, a.Lanes[i] + (float)(b.Lanes[i] * c)); }
+static inline float32x2_t vmla_lane_f32(float32x2_t a, float32x2_t b, float32x2_t c, int n) { NEON_MAP(float32x2_t, 2, a.Lanes[i] + (float)(b.Lanes[i] * c.Lanes[n])); }
+static inline float32x4_t vmlaq_lane_f32(float32x4_t a, float32x4_t b, float32x2_t c, int n) { NEON_MAP(float32x4_t, 4, a.Lanes[i] + (float)(b.Lanes[i] * c.Lanes[n])); }
+static inline float32x4_t vmlsq_f32(float32x4_t a, float32x4_t b, float32x4_t c) { NEON_MAP(float32x4_t, 4, a.Lanes[i] - (float)(b.Lanes[i] * c.Lanes[i])); }
+static inline uint32x4_t vmlaq_u32(uint32x4_t a, uint32x4_t b, uint32x4_t c) { NEON_MAP(uint32x4_t, 4, a.Lanes[i] + b.Lanes[i] * c.Lanes[i]); }
+static inline float32x4_t vminq_f32(float32x4_t a, float32x4_t b) { NEON_MAP(float32x4_t, 4, fminf(a.Lanes[i], b.Lanes[i])); }
+static inline float32x4_t vmaxq_f32(float32x4_t a, float32x4_t b) { NEON_MAP(float32x4_t, 4, fmaxf(a.Lanes[i], b.Lanes[i])); }
+static inline int32x4_t vorrq_s32(int32x4_t a, int32x4_t b) { NEON_MAP(int32x4_t, 4, a.Lanes[i] | b.Lanes[i]); }
+static inline int32x4_t vshlq_n_s32(int32x4_t a, int n) { NEON_MAP(int32x4_t, 4, (int32_t)((uint32_t)a.Lanes[i] << n)); }
+static inline uint32x4_t vshrq_n_u32(uint32x4_t a, int n) { NEON_MAP(uint32x4_t, 4, a.Lanes[i] >> n); }
+
+// Pairwise additions; lane i of the result is the sum of two neighbouring lanes of a, then of b
+static inline float32x2_t vpadd_f32(float32x2_t a, float32x2_t b) { NEON_MAP(float32x2_t, 2, i < 1 ? a.Lanes[0] + a.Lanes[1] : b.Lanes[0] + b.Lanes[1]); }
+static inline float32x4_t vpaddq_f32(float32x4_t a, float32x4_t b) { NEON_MAP(float32x4_t, 4, i < 2 ? a.Lanes[2 * i] + a.Lanes[2 * i + 1] : b.Lanes[2 * i - 4] + b.Lanes[2 * i - 3]); }
+
+// AArch64 only; FADDP adds neighbouring pairs first
+static inline float vaddvq_f32(float32x4_t a) { return (a.Lanes[0] + a.Lanes[1]) + (a.Lanes[2] + a.Lanes[3]); }
+
+// Widening and conversions; float to integer rounds towards zero and saturates
+static inline int32x4_t vmovl_s16(int16x4_t a) { NEON_MAP(int32x4_t, 4, a.Lanes[i]); }
+static inline uint32x4_t vmovl_u16(uint16x4_t a) { NEON_MAP(uint32x4_t, 4, a.Lanes[i]); }
+static inline uint16x8_t vmovl_u8(uint8x8_t a) { NEON_MAP(uint16x8_t, 8, a.Lanes[i]); }
+static inline float32x4_t vcvtq_f32_s32(int32x4_t a) { NEON_MAP(float32x4_t, 4, (float)a.Lanes[i]); }
+static inline float32x4_t vcvtq_f32_u32(uint32x4_t a) { NEON_MAP(float32x4_t, 4, (float)a.Lanes[i]); }
+
+static inline int32x4_t vcvtq_s32_f32(float32x4_t a)
+{
+	NEON_MAP(int32x4_t, 4, isnan(a.Lanes[i]) ? 0 : a.Lanes[i] >= 2147483648.0f ? INT32_MAX : a.Lanes[i] < -2147483648.0f ? INT32_MIN : (int32_t)a.Lanes[i]);
+}
+
+// Reinterpretation
+static inline uint8x16_t vreinterpretq_u8_s32(int32x4_t a) { uint8x16_t r; memcpy(&r, &a, sizeof(r)); return r; }
+static inline int32x4_t vreinterpretq_s32_u32(uint32x4_t a) { int32x4_t r; memcpy(&r, &a, sizeof(r)); return r; }
+static inline uint8x8_t vreinterpret_u8_u32(uint32x2_t a) { uint8x8_t r; memcpy(&r, &a, sizeof(r)); return r; }
+
+// Permutes
+static inline float32x4_t vrev64q_f32(float32x4_t a) { NEON_MAP(float32x4_t, 4, a.Lanes[i ^ 1]); }
+static inline float32x4_t vextq_f32(float32x4_t a, float32x4_t b, int n) { NEON_MAP(float32x4_t, 4, i + n < 4 ? a.Lanes[i + n] : b.Lanes[i + n - 4]); }
+
+static inline float32x2_t vget_low_f32(float32x4_t a) { NEON_MAP(float32x2_t, 2, a.Lanes[i]); }
+static inline float32x2_t vget_high_f32(float32x4_t a) { NEON_MAP(float32x2_t, 2, a.Lanes[i + 2]); }
+static inline uint16x4_t vget_low_u16(uint16x8_t a) { NEON_MAP(uint16x4_t, 4, a.Lanes[i]); }
+static inline uint8x8_t vget_low_u8(uint8x16_t a) { NEON_MAP(uint8x8_t, 8, a.Lanes[i]); }
+static inline uint8x8_t vget_high_u8(uint8x16_t a) { NEON_MAP(uint8x8_t, 8, a.Lanes[i + 8]); }
+static inline float32x4_t vcombine_f32(float32x2_t a, float32x2_t b) { NEON_MAP(float32x4_t, 4, i < 2 ? a.Lanes[i] : b.Lanes[i - 2]); }
+
+// Table lookups; out-of-range indices produce zero
+static inline uint8x8_t vtbl2_u8(uint8x8x2_t a, uint8x8_t b) { NEON_MAP(uint8x8_t, 8, b.Lanes[i] < 16 ? a.val[b.Lanes[i] / 8].Lanes[b.Lanes[i] % 8] : 0); }
+static inline uint8x16_t vqtbl1q_u8(uint8x16_t a, uint8x16_t b) { NEON_MAP(uint8x16_t, 16, b.Lanes[i] < 16 ? a.Lanes[b.Lanes[i]] : 0); }
+
+#undef NEON_MAP
+
+#endif
@@ -0,0 +1,325 @@
+//
+// vorbisdecodertest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Checks FluidSynth's built-in Ogg Vorbis decoder against libvorbis on every sample of an SF3, and measures
+// the largest difference between them. libsndfile is used to drive libvorbis, and its float output is
+// converted to 16 bits the same way as libvorbisfile's ov_read() does.
+
+#include <circle/types.h>
+#include <math.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "hosttest.h"
+
+extern "C"
+{
+#include "sfloader/fluid_vorbis.h"
+
+	// Replacements for fluid_sys.c functions, as in soundfontsynth.cpp
+	void* fluid_alloc(size_t len) { return malloc(len); }
+	void* fluid_realloc(void* ptr, size_t len) { return realloc(ptr, len); }
+	void fluid_free(void* ptr) { free(ptr); }
+	double fluid_utime() { return 0.0; }
+}
+
+// Largest difference allowed from libvorbis, in 16-bit steps. Both follow the specification in single
+// precision, so they may only differ by rounding: against libvorbis 1.3.7, 185 of the 122470 frames of
+// VintageDreamsWaves-v2.sf3 differ, all by 1 step.
+constexpr int Tolerance = 1;
+
+const char DefaultSoundFontPath[] = "../external/fluidsynth/sf2/VintageDreamsWaves-v2.sf3";
+
+struct TSample
+{
+	char Name[21];
+	const u8* pStream;
+	size_t nSize;
+};
+
+static u32 ReadU32(const u8* pData) { return pData[0] | pData[1] << 8 | pData[2] << 16 | static_cast<u32>(pData[3]) << 24; }
+static u16 ReadU16(const u8* pData) { return pData[0] | pData[1] << 8; }
+
+// Finds the compressed samples in an SF3; their start and end points are byte offsets into the smpl chunk
+static std::vector<TSample> FindSamples(const std::vector<u8>& File)
+{
+	std::vector<TSample> Samples;
+	const u8* pSampleData = nullptr;
+	size_t nSampleDataSize = 0;
+	const u8* pHeaders = nullptr;
+	size_t nHeadersSize = 0;
+
+	if (File.size() < 12 || memcmp(File.data(), "RIFF", 4) || memcmp(File.data() + 8, "sfbk", 4))
+		return Samples;
+
+	// Walk the LIST chunks, and the sub-chunks inside those
+	for (size_t nOffset = 12; nOffset + 12 <= File.size();)
+	{
+		const u8* pList = File.data() + nOffset;
+		const size_t nListSize = ReadU32(pList + 4);
+		if (nOffset + 8 + nListSize > File.size())
+			break;
+
+		for (size_t nSubOffset = 12; nSubOffset + 8 <= nListSize + 8;)
+		{
+			const u8* pChunk = pList + nSubOffset;
+			const size_t nChunkSize = ReadU32(pChunk + 4);
+
+			if (!memcmp(pList + 8, "sdta", 4) && !memcmp(pChunk, "smpl", 4))
+			{
+				pSampleData = pChunk + 8;
+				nSampleDataSize = nChunkSize;
+			}
+			else if (!memcmp(pList + 8, "pdta", 4) && !memcmp(pChunk, "shdr", 4))
+			{
+				pHeaders = pChunk + 8;
+				nHeadersSize = nChunkSize;
+			}
+
+			nSubOffset += 8 + nChunkSize + (nChunkSize & 1);
+		}
+
+		nOffset += 8 + nListSize + (nListSize & 1);
+	}
+
+	if (!pSampleData || !pHeaders)
+		return Samples;
+
+	// 46-byte sample headers; the last is a terminator
+	constexpr size_t HeaderSize = 46;
+	constexpr u16 CompressedSample = 0x10;
+	for (size_t i = 0; i + 1 < nHeadersSize / HeaderSize; ++i)
+	{
+		const u8* pHeader = pHeaders + i * HeaderSize;
+		const u32 nStart = ReadU32(pHeader + 20);
+		const u32 nEnd = ReadU32(pHeader + 24);
+
+		if (!(ReadU16(pHeader + 44) & CompressedSample) || nEnd <= nStart || nEnd > nSampleDataSize)
+			continue;
+
+		TSample Sample;
+		memcpy(Sample.Name, pHeader, 20);
+		Sample.Name[20] = '\0';
+		Sample.pStream = pSampleData + nStart;
+		Sample.nSize = nEnd - nStart;
+		Samples.push_back(Sample);
+	}
+
+	return Samples;
+}
+
+// Virtual I/O over a stream held in memory
+struct TMemoryStream
+{
+	const u8* pData;
+	sf_count_t nSize;
+	sf_count_t nPosition;
+};
+
+static sf_count_t StreamGetLength(void* pUser) { return static_cast<TMemoryStream*>(pUser)->nSize; }
+static sf_count_t StreamTell(void* pUser) { return static_cast<TMemoryStream*>(pUser)->nPosition; }
+
+static sf_count_t StreamSeek(sf_count_t nOffset, int nWhence, void* pUser)
+{
+	TMemoryStream* pStream = static_cast<TMemoryStream*>(pUser);
+	const sf_count_t nBase = nWhence == SEEK_CUR ? pStream->nPosition : nWhence == SEEK_END ? pStream->nSize : 0;
+	const sf_count_t nPosition = nBase + nOffset;
+
+	if (nPosition < 0 || nPosition > pStream->nSize)
+		return -1;
+
+	pStream->nPosition = nPosition;
+	return nPosition;
+}
+
+static sf_count_t StreamRead(void* pBuffer, sf_count_t nCount, void* pUser)
+{
+	TMemoryStream* pStream = static_cast<TMemoryStream*>(pUser);
+	if (nCount > pStream->nSize - pStream->nPosition)
+		nCount = pStream->nSize - pStream->nPosition;
+
+	memcpy(pBuffer, pStream->pData + pStream->nPosition, nCount);
+	pStream->nPosition += nCount;
+	return nCount;
+}
+
+static sf_count_t StreamWrite(const void* pBuffer, sf_count_t nCount, void* pUser) { return 0; }
+
+// Decodes with libvorbis; false if the stream isn't a mono Ogg Vorbis stream
+static bool DecodeReference(const TSample& Sample, std::vector<short>& Output)
+{
+	SF_VIRTUAL_IO IO = { StreamGetLength, StreamSeek, StreamRead, StreamWrite, StreamTell };
+	TMemoryStream Stream = { Sample.pStream, static_cast<sf_count_t>(Sample.nSize), 0 };
+	SF_INFO Info{};
+
+	SNDFILE* pFile = sf_open_virtual(&IO, SFM_READ, &Info, &Stream);
+	if (!pFile)
+		return false;
+
+	Output.clear();
+	if (Info.channels == 1)
+	{
+		float Buffer[1024];
+		sf_count_t nFrames;
+		while ((nFrames = sf_readf_float(pFile, Buffer, 1024)) > 0)
+		{
+			// As vorbis_ftoi() in ov_read(): round to nearest, then clip
+			for (sf_count_t i = 0; i < nFrames; ++i)
+			{
+				const long nValue = lrint(Buffer[i] * 32768.0f);
+				Output.push_back(nValue > 32767 ? 32767 : nValue < -32768 ? -32768 : nValue);
+			}
+		}
+	}
+
+	sf_close(pFile);
+	return Info.channels == 1;
+}
+
+static int DecodeBuiltIn(fluid_vorbis_decoder_t* pDecoder, const TSample& Sample, short** ppOutput)
+{
+	return fluid_vorbis_decoder_decode(pDecoder, Sample.pStream, static_cast<unsigned int>(Sample.nSize), ppOutput);
+}
+
+static std::vector<u8> ReadFile(const char* pPath)
+{
+	std::vector<u8> Data;
+	FILE* pFile = fopen(pPath, "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "Couldn't open %s\n", pPath);
+		return Data;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	Data.resize(ftell(pFile));
+	fseek(pFile, 0, SEEK_SET);
+	if (fread(Data.data(), 1, Data.size(), pFile) != Data.size())
+		Data.clear();
+
+	fclose(pFile);
+	return Data;
+}
+
+static void TestAgainstReference(const std::vector<TSample>& Samples, bool bReport)
+{
+	fluid_vorbis_decoder_t* pDecoder = new_fluid_vorbis_decoder();
+	std::vector<short> Reference;
+	int nMaxDifference = 0;
+	size_t nTotalFrames = 0, nDifferentFrames = 0;
+	const char* pWorstSample = "";
+
+	CHECK(!Samples.empty());
+
+	for (const TSample& Sample : Samples)
+	{
+		short* pDecoded = nullptr;
+		const int nFrames = DecodeBuiltIn(pDecoder, Sample, &pDecoded);
+
+		CHECK(DecodeReference(Sample, Reference));
+		CHECK(nFrames >= 0 && static_cast<size_t>(nFrames) == Reference.size());
+
+		if (nFrames > 0 && static_cast<size_t>(nFrames) == Reference.size())
+		{
+			for (int i = 0; i < nFrames; ++i)
+			{
+				const int nDifference = abs(pDecoded[i] - Reference[i]);
+				if (nDifference > nMaxDifference)
+				{
+					nMaxDifference = nDifference;
+					pWorstSample = Sample.Name;
+				}
+
+				nDifferentFrames += nDifference != 0;
+			}
+
+			nTotalFrames += nFrames;
+		}
+
+		fluid_free(pDecoded);
+	}
+
+	CHECK(nMaxDifference <= Tolerance);
+
+	if (bReport)
+		printf("%zu samples, %zu frames: %zu differ from libvorbis, by at most %d (%s)\n", Samples.size(), nTotalFrames, nDifferentFrames, nMaxDifference, pWorstSample);
+
+	delete_fluid_vorbis_decoder(pDecoder);
+}
+
+static void Benchmark(const std::vector<TSample>& Samples)
+{
+	TestAgainstReference(Samples, true);
+
+	fluid_vorbis_decoder_t* pDecoder = new_fluid_vorbis_decoder();
+	std::vector<short> Reference;
+	size_t nTotalFrames = 0;
+
+	for (const TSample& Sample : Samples)
+	{
+		DecodeReference(Sample, Reference);
+		nTotalFrames += Reference.size();
+	}
+
+	const double nBuiltIn = HostTest::TimePerCall([&] {
+		for (const TSample& Sample : Samples)
+		{
+			short* pDecoded = nullptr;
+			DecodeBuiltIn(pDecoder, Sample, &pDecoded);
+			fluid_free(pDecoded);
+		}
+	});
+
+	const double nLibVorbis = HostTest::TimePerCall([&] {
+		for (const TSample& Sample : Samples)
+			DecodeReference(Sample, Reference);
+	});
+
+	printf("vorbis decode: built-in %6.2f ns/frame  libvorbis (via libsndfile) %6.2f ns/frame\n", nBuiltIn / nTotalFrames, nLibVorbis / nTotalFrames);
+
+	delete_fluid_vorbis_decoder(pDecoder);
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	const char* pPath = DefaultSoundFontPath;
+	for (int i = 1; i < nArgs; ++i)
+		if (pArgs[i][0] != '-')
+			pPath = pArgs[i];
+
+	const std::vector<u8> File = ReadFile(pPath);
+	const std::vector<TSample> Samples = FindSamples(File);
+
+	if (HostTest::WantBenchmark(nArgs, pArgs))
+	{
+		Benchmark(Samples);
+		return 0;
+	}
+
+	TestAgainstReference(Samples, false);
+
+	return HostTest::Result("vorbisdecoder");
+}
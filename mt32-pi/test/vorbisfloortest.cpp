@@ -0,0 +1,226 @@
+//
+// vorbisfloortest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Checks that FluidSynth's built-in Ogg Vorbis decoder rejects floors whose X values aren't unique, rather than
+// dividing by zero while drawing the floor curve between two of them. Unlike vorbisdecodertest, this needs no
+// libvorbis: the streams are built here.
+
+#include <circle/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fluidsynth.h>
+#include <vector>
+
+#include "hosttest.h"
+
+extern "C"
+{
+#include "sfloader/fluid_vorbis.h"
+
+	// Replacements for fluid_sys.c functions, as in soundfontsynth.cpp
+	void* fluid_alloc(size_t len) { return malloc(len); }
+	void* fluid_realloc(void* ptr, size_t len) { return realloc(ptr, len); }
+	void fluid_free(void* ptr) { free(ptr); }
+	double fluid_utime() { return 0.0; }
+}
+
+constexpr u8 BlockSizeLog2 = 8;
+constexpr int Frames = (1 << BlockSizeLog2) / 2;
+
+class CBitWriter
+{
+public:
+	// Vorbis packs fields starting from the least significant bit
+	void Write(u32 nValue, size_t nBits)
+	{
+		for (size_t i = 0; i < nBits; ++i, ++m_nBits)
+		{
+			if (m_nBits / 8 == m_Data.size())
+				m_Data.push_back(0);
+
+			if (nValue & (1u << i))
+				m_Data.back() |= 1 << (m_nBits % 8);
+		}
+	}
+
+	void WriteHeaderStart(u8 nType)
+	{
+		Write(nType, 8);
+		for (const char* pSignature = "vorbis"; *pSignature; ++pSignature)
+			Write(*pSignature, 8);
+	}
+
+	const std::vector<u8>& GetData() const { return m_Data; }
+
+private:
+	std::vector<u8> m_Data;
+	size_t m_nBits = 0;
+};
+
+// A mono stream with a single floor of four points, whose inner X values are given, and no residue
+static std::vector<u8> MakeStream(u8 nX2, u8 nX3)
+{
+	CBitWriter Packets[5];
+
+	// Identification header
+	Packets[0].WriteHeaderStart(1);
+	Packets[0].Write(0, 32);
+	Packets[0].Write(1, 8);
+	Packets[0].Write(44100, 32);
+	Packets[0].Write(0, 32);
+	Packets[0].Write(0, 32);
+	Packets[0].Write(0, 32);
+	Packets[0].Write(BlockSizeLog2, 4);
+	Packets[0].Write(BlockSizeLog2, 4);
+	Packets[0].Write(1, 1);
+
+	// Comment header
+	Packets[1].WriteHeaderStart(3);
+	Packets[1].Write(0, 32);
+	Packets[1].Write(0, 32);
+	Packets[1].Write(1, 1);
+
+	// Setup header: one codebook of two 1-bit codewords
+	CBitWriter& Setup = Packets[2];
+	Setup.WriteHeaderStart(5);
+	Setup.Write(0, 8);
+	Setup.Write(0x564342, 24);
+	Setup.Write(1, 16);
+	Setup.Write(2, 24);
+	Setup.Write(0, 1);
+	Setup.Write(0, 1);
+	Setup.Write(0, 5);
+	Setup.Write(0, 5);
+	Setup.Write(0, 4);
+
+	// Time domain transforms
+	Setup.Write(0, 6);
+	Setup.Write(0, 16);
+
+	// Floor type 1: one partition of class 0, with two X values read with the codebook
+	Setup.Write(0, 6);
+	Setup.Write(1, 16);
+	Setup.Write(1, 5);
+	Setup.Write(0, 4);
+	Setup.Write(1, 3);
+	Setup.Write(0, 2);
+	Setup.Write(1, 8);
+	Setup.Write(1, 2);
+	Setup.Write(7, 4);
+	Setup.Write(nX2, 7);
+	Setup.Write(nX3, 7);
+
+	// Residue covering nothing
+	Setup.Write(0, 6);
+	Setup.Write(0, 16);
+	Setup.Write(0, 24);
+	Setup.Write(0, 24);
+	Setup.Write(0, 24);
+	Setup.Write(0, 6);
+	Setup.Write(0, 8);
+	Setup.Write(0, 3);
+	Setup.Write(0, 1);
+
+	// Mapping
+	Setup.Write(0, 6);
+	Setup.Write(0, 16);
+	Setup.Write(0, 1);
+	Setup.Write(0, 1);
+	Setup.Write(0, 2);
+	Setup.Write(0, 8);
+	Setup.Write(0, 8);
+	Setup.Write(0, 8);
+
+	// Mode
+	Setup.Write(0, 6);
+	Setup.Write(0, 1);
+	Setup.Write(0, 16);
+	Setup.Write(0, 16);
+	Setup.Write(0, 8);
+	Setup.Write(1, 1);
+
+	// Two audio packets, each with a floor whose inner points both differ from the predicted curve
+	for (size_t i = 3; i < 5; ++i)
+	{
+		Packets[i].Write(0, 1);
+		Packets[i].Write(1, 1);
+		Packets[i].Write(40, 7);
+		Packets[i].Write(40, 7);
+		Packets[i].Write(1, 1);
+		Packets[i].Write(1, 1);
+
+		// Padding, so that the packet isn't read as cut off
+		Packets[i].Write(0, 16);
+	}
+
+	// A single Ogg page holds every packet; the decoder doesn't check the CRC
+	std::vector<u8> Stream(27, 0);
+	memcpy(Stream.data(), "OggS", 4);
+	Stream[6] = Frames;
+	Stream[26] = 5;
+
+	for (const CBitWriter& Packet : Packets)
+		Stream.push_back(Packet.GetData().size());
+
+	for (const CBitWriter& Packet : Packets)
+		Stream.insert(Stream.end(), Packet.GetData().begin(), Packet.GetData().end());
+
+	return Stream;
+}
+
+static int Decode(fluid_vorbis_decoder_t* pDecoder, const std::vector<u8>& Stream, short** ppOutput)
+{
+	return fluid_vorbis_decoder_decode(pDecoder, Stream.data(), Stream.size(), ppOutput);
+}
+
+int main()
+{
+	// The rejected streams are expected to log errors
+	fluid_set_log_function(FLUID_ERR, nullptr, nullptr);
+
+	fluid_vorbis_decoder_t* pDecoder = new_fluid_vorbis_decoder();
+	CHECK(pDecoder != nullptr);
+	if (!pDecoder)
+		return HostTest::Result("vorbisfloor");
+
+	short* pOutput = nullptr;
+
+	// A well-formed floor, as a control for the stream itself
+	CHECK(Decode(pDecoder, MakeStream(32, 64), &pOutput) == Frames);
+	CHECK(pOutput != nullptr);
+	fluid_free(pOutput);
+
+	// The inner points share an X value
+	pOutput = nullptr;
+	CHECK(Decode(pDecoder, MakeStream(32, 32), &pOutput) == -1);
+	CHECK(pOutput == nullptr);
+
+	// An inner point shares the X value of an end point
+	pOutput = nullptr;
+	CHECK(Decode(pDecoder, MakeStream(0, 64), &pOutput) == -1);
+	CHECK(pOutput == nullptr);
+
+	delete_fluid_vorbis_decoder(pDecoder);
+
+	return HostTest::Result("vorbisfloor");
+}
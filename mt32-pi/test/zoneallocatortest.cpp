@@ -0,0 +1,318 @@
+//
+// zoneallocatortest.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <circle/logger.h>
+#include <circle/memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "hosttest.h"
+#include "zoneallocator.h"
+
+// Heap handed to the zone allocator; Initialize() leaves 32MB of the free space to malloc()
+constexpr size_t HeapSize = 16 * MEGABYTE;
+constexpr size_t MallocHeapSize = 32 * MEGABYTE;
+
+// Room for a block header and end magic on any architecture
+constexpr size_t BlockOverhead = 64;
+
+// How often the heap is checked while replaying the trace
+constexpr size_t CheckInterval = 256;
+
+const char DefaultTracePath[] = "build-host/soundfontswitch.trace";
+
+// One operation from a trace recorded by zonetrace
+struct TTraceOp
+{
+	char Type;
+	size_t nAge;
+	size_t nSize;
+};
+
+static std::vector<TTraceOp> LoadTrace(const char* pPath)
+{
+	std::vector<TTraceOp> Ops;
+	FILE* pFile = fopen(pPath, "r");
+	if (!pFile)
+	{
+		fprintf(stderr, "Couldn't open %s\n", pPath);
+		return Ops;
+	}
+
+	char Line[64];
+	while (fgets(Line, sizeof(Line), pFile))
+	{
+		TTraceOp Op{Line[0], 0, 0};
+		const char* pArgs = Line + 1;
+
+		if ((Op.Type == 'a' && sscanf(pArgs, "%zu", &Op.nSize) == 1) ||
+		    (Op.Type == 'r' && sscanf(pArgs, "%zu %zu", &Op.nAge, &Op.nSize) == 2) ||
+		    (Op.Type == 'f' && sscanf(pArgs, "%zu", &Op.nAge) == 1))
+			Ops.push_back(Op);
+		else
+		{
+			fprintf(stderr, "%s: bad line: %s", pPath, Line);
+			Ops.clear();
+			break;
+		}
+	}
+
+	fclose(pFile);
+	return Ops;
+}
+
+// Replays a trace against a pair of allocation functions; returns the number of allocations that failed
+template <class TAlloc, class TRealloc, class TFree>
+static size_t Replay(const std::vector<TTraceOp>& Ops, TAlloc Alloc, TRealloc Realloc, TFree Free, size_t nCheckInterval = 0)
+{
+	static std::vector<void*> Pointers;
+	Pointers.clear();
+
+	size_t nFailures = 0;
+	for (size_t i = 0; i < Ops.size(); ++i)
+	{
+		const TTraceOp& Op = Ops[i];
+		void** ppPtr       = Op.nAge ? &Pointers[Pointers.size() - Op.nAge] : nullptr;
+
+		if (Op.Type == 'f')
+		{
+			Free(*ppPtr);
+			*ppPtr = nullptr;
+			continue;
+		}
+
+		if (!ppPtr)
+		{
+			Pointers.push_back(nullptr);
+			ppPtr = &Pointers.back();
+		}
+
+		// Zero-sized requests are allowed to return null
+		void* pPtr = Op.Type == 'a' ? Alloc(Op.nSize) : Realloc(*ppPtr, Op.nSize);
+		if (!pPtr && Op.nSize)
+			++nFailures;
+
+		*ppPtr = pPtr;
+
+		// Stamp both ends so that overlapping blocks would be noticed by the heap check's end magic or below
+		if (nCheckInterval && pPtr)
+		{
+			memset(pPtr, 0xA5, Op.nSize < 16 ? Op.nSize : 16);
+			memset(static_cast<u8*>(pPtr) + Op.nSize - (Op.nSize < 16 ? Op.nSize : 16), 0xA5, Op.nSize < 16 ? Op.nSize : 16);
+		}
+
+		if (nCheckInterval && i % nCheckInterval == 0)
+			CHECK(CZoneAllocator::Get()->CheckHeap());
+	}
+
+	return nFailures;
+}
+
+// The whole heap is free and in one block, so one allocation can take all of it
+static bool IsHeapCoalesced(CZoneAllocator& Allocator)
+{
+	void* pPtr = Allocator.Alloc(HeapSize - BlockOverhead, TZoneTag::Uncategorized);
+	if (!pPtr)
+		return false;
+
+	Allocator.Free(pPtr);
+	return true;
+}
+
+static void TestTraceReplay(CZoneAllocator& Allocator, const std::vector<TTraceOp>& Ops)
+{
+	CHECK(!Ops.empty());
+
+	const size_t nFailures = Replay(
+		Ops,
+		[&](size_t nSize) { return Allocator.Alloc(nSize, TZoneTag::FluidSynth); },
+		[&](void* pPtr, size_t nSize) { return Allocator.Realloc(pPtr, nSize, TZoneTag::FluidSynth); },
+		[&](void* pPtr) { Allocator.Free(pPtr); },
+		CheckInterval);
+
+	CHECK(nFailures == 0);
+	CHECK(Allocator.GetAllocCount() == 0);
+	CHECK(Allocator.CheckHeap());
+	CHECK(IsHeapCoalesced(Allocator));
+}
+
+// Every misuse must be refused with an error, without disturbing the rest of the heap
+static void TestCorruptionChecks(CZoneAllocator& Allocator)
+{
+	CLogger* const pLogger = CLogger::Get();
+	auto ExpectError = [pLogger](unsigned int nErrors) { CHECK(pLogger->GetErrorCount() == nErrors); };
+
+	constexpr size_t nSize = 100;
+	u8* pFirst  = static_cast<u8*>(Allocator.Alloc(nSize, TZoneTag::Uncategorized));
+	u8* pSecond = static_cast<u8*>(Allocator.Alloc(nSize, TZoneTag::Uncategorized));
+	u8* pThird  = static_cast<u8*>(Allocator.Alloc(nSize, TZoneTag::Uncategorized));
+	CHECK(pFirst && pSecond && pThird);
+	CHECK(Allocator.GetAllocCount() == 3);
+
+	pLogger->ExpectErrors(true);
+	const unsigned int nErrors = pLogger->GetErrorCount();
+
+	// Tag 0 marks free blocks and can't be allocated with
+	CHECK(Allocator.Alloc(nSize, TZoneTag::Free) == nullptr);
+	ExpectError(nErrors + 1);
+
+	// Double free; the block before is in use, so the freed block keeps its own header
+	Allocator.Free(pSecond);
+	CHECK(Allocator.GetAllocCount() == 2);
+	Allocator.Free(pSecond);
+	CHECK(Allocator.GetAllocCount() == 2);
+	ExpectError(nErrors + 2);
+	CHECK(Allocator.Realloc(pSecond, nSize * 2, TZoneTag::Uncategorized) == nullptr);
+	ExpectError(nErrors + 3);
+	CHECK(Allocator.CheckHeap());
+
+	// Overrun into the end magic, which lies somewhere in the 16 bytes of padding after the data
+	u8 Saved[32];
+	memcpy(Saved, pThird + nSize, 20);
+	memset(pThird + nSize, 0xA5, 20);
+	CHECK(!Allocator.CheckHeap());
+	ExpectError(nErrors + 4);
+	memcpy(pThird + nSize, Saved, 20);
+	CHECK(Allocator.CheckHeap());
+
+	// Underrun into the header; the free is refused rather than trusting the links
+	memcpy(Saved, pThird - sizeof(Saved), sizeof(Saved));
+	memset(pThird - sizeof(Saved), 0xA5, sizeof(Saved));
+	Allocator.Free(pThird);
+	CHECK(Allocator.GetAllocCount() == 2);
+	ExpectError(nErrors + 5);
+	memcpy(pThird - sizeof(Saved), Saved, sizeof(Saved));
+	CHECK(Allocator.CheckHeap());
+
+	pLogger->ExpectErrors(false);
+
+	Allocator.Free(pThird);
+	Allocator.Free(pFirst);
+	CHECK(Allocator.GetAllocCount() == 0);
+	CHECK(Allocator.CheckHeap());
+	CHECK(IsHeapCoalesced(Allocator));
+}
+
+static void TestFreeLists(CZoneAllocator& Allocator)
+{
+	// Each size is more than 4x the last, so the holes left by freeing blocks of twice each size fall
+	// into distinct size classes, and each request must be served from the hole meant for it rather
+	// than from the rest of the heap
+	const size_t Sizes[] = { 32, 200, 1500, 12000, 100000, 1000000 };
+	constexpr size_t nSizes = sizeof(Sizes) / sizeof(*Sizes);
+	void* Holes[nSizes];
+	void* Guards[nSizes];
+
+	for (size_t i = 0; i < nSizes; ++i)
+	{
+		Holes[i]  = Allocator.Alloc(Sizes[i] * 2, TZoneTag::Uncategorized);
+		Guards[i] = Allocator.Alloc(16, TZoneTag::Uncategorized);
+	}
+
+	for (size_t i = 0; i < nSizes; ++i)
+		Allocator.Free(Holes[i]);
+	CHECK(Allocator.CheckHeap());
+
+	// Largest first, so that the larger holes are already taken if a smaller request went astray
+	for (size_t i = nSizes; i-- > 0;)
+	{
+		void* pPtr = Allocator.Alloc(Sizes[i], TZoneTag::Uncategorized);
+		CHECK(pPtr == Holes[i]);
+	}
+	CHECK(Allocator.CheckHeap());
+
+	// Growing into a free neighbour and shrinking both happen in place
+	Allocator.Free(Guards[0]);
+	void* pGrown = Allocator.Realloc(Holes[0], Sizes[0] + 16, TZoneTag::Uncategorized);
+	CHECK(pGrown == Holes[0]);
+	void* pShrunk = Allocator.Realloc(pGrown, 16, TZoneTag::Uncategorized);
+	CHECK(pShrunk == Holes[0]);
+	CHECK(Allocator.CheckHeap());
+
+	Allocator.Free(pShrunk);
+	for (size_t i = 1; i < nSizes; ++i)
+	{
+		Allocator.Free(Holes[i]);
+		Allocator.Free(Guards[i]);
+		CHECK(Allocator.CheckHeap());
+	}
+
+	CHECK(Allocator.GetAllocCount() == 0);
+	CHECK(IsHeapCoalesced(Allocator));
+}
+
+static void Benchmark(CZoneAllocator& Allocator, const std::vector<TTraceOp>& Ops)
+{
+	const double nZone = HostTest::TimePerCall([&] {
+		Replay(
+			Ops,
+			[&](size_t nSize) { return Allocator.Alloc(nSize, TZoneTag::FluidSynth); },
+			[&](void* pPtr, size_t nSize) { return Allocator.Realloc(pPtr, nSize, TZoneTag::FluidSynth); },
+			[&](void* pPtr) { Allocator.Free(pPtr); });
+	});
+
+	const double nMalloc = HostTest::TimePerCall([&] {
+		Replay(
+			Ops,
+			[](size_t nSize) { return malloc(nSize); },
+			[](void* pPtr, size_t nSize) { return realloc(pPtr, nSize); },
+			[](void* pPtr) { free(pPtr); });
+	});
+
+	const double nCheck = HostTest::TimePerCall([&] { Allocator.CheckHeap(); });
+
+	printf("zone allocator trace replay (%zu ops): %6.2f ns/op  malloc: %6.2f ns/op  empty heap check: %.0f ns\n", Ops.size(), nZone / Ops.size(), nMalloc / Ops.size(), nCheck);
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	const char* pTracePath = DefaultTracePath;
+	for (int i = 1; i < nArgs; ++i)
+		if (pArgs[i][0] != '-')
+			pTracePath = pArgs[i];
+
+	CMemorySystem::Get()->SetHeapFreeSpace(MallocHeapSize + HeapSize);
+
+	CZoneAllocator Allocator;
+	if (!Allocator.Initialize())
+	{
+		fprintf(stderr, "Couldn't initialize the zone allocator\n");
+		return 1;
+	}
+
+	const std::vector<TTraceOp> Ops = LoadTrace(pTracePath);
+
+	if (HostTest::WantBenchmark(nArgs, pArgs))
+	{
+		Benchmark(Allocator, Ops);
+		return 0;
+	}
+
+	TestTraceReplay(Allocator, Ops);
+	TestCorruptionChecks(Allocator);
+	TestFreeLists(Allocator);
+
+	return HostTest::Result("zoneallocator");
+}
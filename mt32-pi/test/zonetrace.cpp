@@ -0,0 +1,190 @@
+//
+// zonetrace.cpp
+//
+// mt32-pi - A baremetal MIDI synthesizer for Raspberry Pi
+// Copyright (C) 2020-2023 Dale Whinham <daleyo@gmail.com>
+//
+// This file is part of mt32-pi.
+//
+// mt32-pi is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// mt32-pi is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with
+// mt32-pi. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Records FluidSynth's allocations while it loads and switches between SoundFonts the way CSoundFontSynth
+// does, so that the zone allocator test can replay a real workload without FluidSynth or the files
+//
+//   zonetrace <output> <soundfont>...
+//
+// Allocations are numbered in the order they are made, and referred to later by how many allocations
+// have been made since (their age), which keeps the trace small once compressed. Each line is one of:
+//
+//   a <size>         allocation
+//   r <age> <size>   reallocation, or a new allocation if <age> is 0
+//   f <age>          free
+
+#include <fluidsynth.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unordered_map>
+
+static FILE* TraceFile = nullptr;
+static std::unordered_map<void*, unsigned int> LiveIDs;
+static unsigned int NextID = 0;
+
+extern "C"
+{
+	// Replacements for fluid_sys.c functions, as in soundfontsynth.cpp
+	void* fluid_alloc(size_t len)
+	{
+		void* pPtr = malloc(len);
+		if (pPtr && TraceFile)
+		{
+			LiveIDs[pPtr] = NextID++;
+			fprintf(TraceFile, "a %zu\n", len);
+		}
+
+		return pPtr;
+	}
+
+	void* fluid_realloc(void* ptr, size_t len)
+	{
+		auto Live = LiveIDs.find(ptr);
+		const bool bLive = Live != LiveIDs.end();
+		const unsigned int nAge = bLive ? NextID - Live->second : 0;
+		const unsigned int nID  = bLive ? Live->second : NextID++;
+		if (bLive)
+			LiveIDs.erase(Live);
+
+		void* pPtr = realloc(ptr, len);
+		if (pPtr && TraceFile)
+		{
+			LiveIDs[pPtr] = nID;
+			fprintf(TraceFile, "r %u %zu\n", nAge, len);
+		}
+
+		return pPtr;
+	}
+
+	void fluid_free(void* ptr)
+	{
+		auto Live = LiveIDs.find(ptr);
+		if (Live != LiveIDs.end())
+		{
+			fprintf(TraceFile, "f %u\n", NextID - Live->second);
+			LiveIDs.erase(Live);
+		}
+
+		free(ptr);
+	}
+
+	FILE* fluid_file_open(const char* path, const char** errMsg)
+	{
+		FILE* pFile = fopen(path, "rb");
+
+		if (!pFile && errMsg)
+			*errMsg = "Failed to open file";
+
+		return pFile;
+	}
+
+	void fluid_msleep(unsigned int msecs) {}
+	double fluid_utime() { return 0.0; }
+
+	// Replacements for fluid_sfont.c functions; plain stdio here
+	void* default_fopen(const char* path) { return fopen(path, "rb"); }
+	int default_fclose(void* handle) { return fclose(static_cast<FILE*>(handle)) == 0 ? FLUID_OK : FLUID_FAILED; }
+	fluid_long_long_t default_ftell(void* handle) { return ftell(static_cast<FILE*>(handle)); }
+
+	int safe_fread(void* buf, fluid_long_long_t count, void* fd)
+	{
+		return fread(buf, count, 1, static_cast<FILE*>(fd)) == 1 ? FLUID_OK : FLUID_FAILED;
+	}
+
+	int safe_fseek(void* fd, fluid_long_long_t ofs, int whence)
+	{
+		return fseek(static_cast<FILE*>(fd), ofs, whence) == 0 ? FLUID_OK : FLUID_FAILED;
+	}
+}
+
+// Plays a chord on the first preset for a moment so that voices and the sample cache are exercised
+static void PlayChord(fluid_synth_t* pSynth)
+{
+	float Buffer[2][256];
+	float* pBuffers[] = { Buffer[0], Buffer[1] };
+
+	for (int nNote = 48; nNote <= 60; nNote += 4)
+		fluid_synth_noteon(pSynth, 0, nNote, 100);
+
+	for (int i = 0; i < 64; ++i)
+		fluid_synth_write_float(pSynth, 256, pBuffers[0], 0, 1, pBuffers[1], 0, 1);
+
+	fluid_synth_all_notes_off(pSynth, -1);
+
+	// Let the released voices finish so that the old SoundFont can be unloaded
+	while (fluid_synth_get_active_voice_count(pSynth) || fluid_synth_sfunload_pending(pSynth))
+		fluid_synth_write_float(pSynth, 256, pBuffers[0], 0, 1, pBuffers[1], 0, 1);
+}
+
+int main(int nArgs, char* pArgs[])
+{
+	if (nArgs < 3)
+	{
+		fprintf(stderr, "Usage: %s <output> <soundfont>...\n", pArgs[0]);
+		return 1;
+	}
+
+	TraceFile = fopen(pArgs[1], "w");
+	if (!TraceFile)
+	{
+		fprintf(stderr, "Couldn't open %s\n", pArgs[1]);
+		return 1;
+	}
+
+	fluid_settings_t* pSettings = new_fluid_settings();
+	fluid_settings_setnum(pSettings, "synth.sample-rate", 48000.0);
+	fluid_settings_setint(pSettings, "synth.threadsafe-api", false);
+
+	fluid_sfloader_t* pLoader = new_fluid_defsfloader(pSettings);
+	fluid_synth_t* pSynth     = new_fluid_synth(pSettings);
+	int nSoundFontID          = FLUID_FAILED;
+
+	// Load each SoundFont in turn, switching as SwapSoundFont() does
+	for (int i = 2; i < nArgs; ++i)
+	{
+		const char* pPath         = pArgs[i];
+		fluid_sfont_t* pSoundFont = fluid_sfloader_load_sfont(pLoader, pPath);
+		const int nNewID          = pSoundFont ? fluid_synth_sfload_sfont(pSynth, pSoundFont, nSoundFontID == FLUID_FAILED) : FLUID_FAILED;
+		if (nNewID == FLUID_FAILED)
+		{
+			fprintf(stderr, "Couldn't load %s\n", pPath);
+			return 1;
+		}
+
+		if (nSoundFontID != FLUID_FAILED)
+			fluid_synth_sfunload(pSynth, nSoundFontID, true);
+
+		nSoundFontID = nNewID;
+		fluid_synth_program_select(pSynth, 0, nSoundFontID, 0, 0);
+		PlayChord(pSynth);
+	}
+
+	delete_fluid_synth(pSynth);
+	delete_fluid_sfloader(pLoader);
+	delete_fluid_settings(pSettings);
+
+	fclose(TraceFile);
+	printf("Recorded %u allocations; %zu still live\n", NextID, LiveIDs.size());
+
+	return 0;
+}